@@ -3,6 +3,7 @@
 
 #include "../shader.h"
 #include "../stb_image.h"
+#include "../../common/texture_loader.h"
 
 #include <cmath>
 #include <iostream>
@@ -73,31 +74,11 @@ int main (int argc, char *argv[]) {
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-	// Generate and bind texture
-	unsigned int texture;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	
-	// Set texture wrapping/filtering options
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	
-	// Load and generate the texture
-	int width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char *data = stbi_load("wall.jpg", &width, &height, &nrChannels, 0);
-	if (data) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else {
-		std::cout << "Failed to load texture" << std::endl;
-	}
-
-	// Free up memory from image data now it is bound to the texture
-	stbi_image_free(data);
+	// Decode the texture on a worker thread and upload it over the
+	// next frames; a placeholder is drawn until it is ready
+	texture_loader textures;
+	init_texture_loader(&textures, stb_decode_image);
+	int wall = request_texture(&textures, "wall.jpg");
 
 	// Main render loop
 	while (!glfwWindowShouldClose(window)) {
@@ -110,7 +91,8 @@ int main (int argc, char *argv[]) {
 
 		// Use the created shader program for rendering and draw buffers
 		myShader.use();
-		glBindTexture(GL_TEXTURE_2D, texture);
+		texture_loader_update(&textures);
+		glBindTexture(GL_TEXTURE_2D, texture_loader_texture(&textures, wall));
 		glBindVertexArray(VAO);
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 		glBindVertexArray(0);
@@ -121,6 +103,7 @@ int main (int argc, char *argv[]) {
 	}
 
 	// Clean up and exit after window is closed
+	free_texture_loader(&textures);
 	glfwTerminate();
 	return 0;
 }
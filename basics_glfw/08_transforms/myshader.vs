@@ -5,9 +5,19 @@ layout (location = 1) in vec2 aTexCoord;
 
 out vec2 TexCoord;
 
-uniform mat4 transform;
+// camera, shared by every program and updated once per frame
+layout (std140) uniform Frame {
+	mat4 view;
+	mat4 projection;
+	float time;
+};
+
+// this object's slice of the per-object uniform buffer
+layout (std140) uniform Object {
+	mat4 transform;
+};
 
 void main() {
-	gl_Position = transform * vec4(aPos, 1.0f);
+	gl_Position = projection * view * transform * vec4(aPos, 1.0f);
 	TexCoord = aTexCoord;
 }
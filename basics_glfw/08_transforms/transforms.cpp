@@ -8,14 +8,20 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "../shader.h"
+#include "../../common/gl_state.h"
 #include "../stb_image.h"
+#include "../../common/texture_loader.h"
 
 #include <cmath>
+#include <cstring>
 #include <iostream>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
 
+// Shadow of the bound GL state, to skip redundant calls
+gl_state glState;
+
 // Define vertices, texture coordinates and indices of rendered rectangle
 float vertices[] = {
 	 // coordinates         // texture coordinates
@@ -53,10 +59,25 @@ int main (int argc, char *argv[]) {
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
-	glViewport(0, 0, 800, 600);
+	gl_state_init(&glState);
+	gl_set_viewport(&glState, 0, 0, 800, 600);
 
 	// Generate shader object
 	Shader myShader("./myshader.vs", "./myshader.fs");
+	std::cout << "Built shader in " << myShader.buildMs << " ms "
+		  << (myShader.fromCache ? "from binary cache" : "from source") << std::endl;
+
+	// The blocks the loop writes must have survived linking, and the
+	// Object block must hold the matrix copied into it
+	GLint objectBlockSize = myShader.blockSize(object_block_name);
+	if (myShader.blockIndex(frame_block_name) == GL_INVALID_INDEX
+	    || myShader.blockIndex(object_block_name) == GL_INVALID_INDEX
+	    || objectBlockSize < (GLint) sizeof(glm::mat4)) {
+		std::cout << "Shader has no " << frame_block_name << " block or no " << object_block_name
+			  << " block of at least " << sizeof(glm::mat4) << " bytes" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
 
 	// Generate vertex array object to store triangle data
 	unsigned int VAO;
@@ -79,34 +100,32 @@ int main (int argc, char *argv[]) {
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-	// Generate and bind texture
-	unsigned int texture;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	
-	// Set texture wrapping/filtering options
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	
-	// Load and generate the texture
-	int width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char *data = stbi_load("wall.jpg", &width, &height, &nrChannels, 0);
-	if (data) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else {
-		std::cout << "Failed to load texture" << std::endl;
-	}
-
-	// Free up memory from image data now it is bound to the texture
-	stbi_image_free(data);
+	// Decode the texture on a worker thread and upload it over the
+	// next frames; a placeholder is drawn until it is ready. Its
+	// mipmaps are built on the CPU with a Kaiser filter in linear light
+	// rather than by glGenerateMipmap, compressed to BC1 where the
+	// context has S3TC, and cached in wall.jpg.ktx2
+	texture_loader textures;
+	init_texture_loader(&textures, stb_decode_image);
+	enable_texture_compression(&textures);
+	int wall = request_texture(&textures, "wall.jpg", texture_mipmaps_kaiser);
+
+	// Camera block shared by all programs, and per-object blocks
+	// suballocated from one buffer
+	GLuint frameBuffer = init_frame_block();
+	uniform_buffer objectBlocks;
+	init_uniform_buffer(&objectBlocks, 4096);
 
 	// Main render loop
+	gl_state_counters printedCounters = { 0, 0 };
 	while (!glfwWindowShouldClose(window)) {
+		gl_state_new_frame(&glState);
+		if (glState.last_frame.issued != printedCounters.issued || glState.last_frame.elided != printedCounters.elided) {
+			printedCounters = glState.last_frame;
+			std::cout << "GL state calls per frame: " << printedCounters.issued << " issued, "
+				  << printedCounters.elided << " elided" << std::endl;
+		}
+
 		// Check any inputs
 		processInput(window);
 
@@ -115,21 +134,35 @@ int main (int argc, char *argv[]) {
 		glClear(GL_COLOR_BUFFER_BIT);
 
 		// Use the created shader program for rendering and draw buffers
-		myShader.use();
+		gl_use_program(&glState, myShader.ID);
+
+		// Update the camera once for every program
+		frame_block frame;
+		glm::mat4 identity = glm::mat4(1.0f);
+		memcpy(frame.view, glm::value_ptr(identity), sizeof(frame.view));
+		memcpy(frame.projection, glm::value_ptr(identity), sizeof(frame.projection));
+		frame.time = (float) glfwGetTime();
+		update_frame_block(frameBuffer, frame);
 
 		// Set up constant matrix transform
 		glm::mat4 trans = glm::mat4(1.0f);
 		trans = glm::rotate(trans, (float) glfwGetTime(), glm::vec3(0.0f, 0.0f, 1.0f));
 		trans = glm::scale(trans, glm::vec3(0.5f, 0.5f, 0.5f));
 
-		// Assign transformation matrix as a shader program uniform
-		unsigned int transformLoc = glGetUniformLocation(myShader.ID, "transform");
-		glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(trans));
-
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glBindVertexArray(VAO);
+		// Write the object's block, upload the frame's blocks at once
+		// and point the Object block at this one
+		uniform_buffer_reset(&objectBlocks);
+		size_t objectOffset = 0;
+		void* objectData = uniform_buffer_alloc(&objectBlocks, objectBlockSize, &objectOffset);
+		if (objectData != NULL)
+			memcpy(objectData, glm::value_ptr(trans), sizeof(trans));
+		uniform_buffer_upload(&objectBlocks);
+		uniform_buffer_bind(&objectBlocks, object_block_binding, objectOffset, objectBlockSize);
+
+		texture_loader_update(&textures);
+		gl_bind_texture(&glState, 0, GL_TEXTURE_2D, texture_loader_texture(&textures, wall));
+		gl_bind_vertex_array(&glState, VAO);
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
 
 		// Update screen and check for any key presses
 		glfwSwapBuffers(window);
@@ -137,13 +170,16 @@ int main (int argc, char *argv[]) {
 	}
 
 	// Clean up and exit after window is closed
+	free_texture_loader(&textures);
+	free_uniform_buffer(&objectBlocks);
+	glDeleteBuffers(1, &frameBuffer);
 	glfwTerminate();
 	return 0;
 }
 
 // Communicate any window resizes to OpenGL
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-	glViewport(0, 0, width, height);
+	gl_set_viewport(&glState, 0, 0, width, height);
 }
 
 // Process inputs given to the window
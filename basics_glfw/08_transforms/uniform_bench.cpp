@@ -0,0 +1,216 @@
+// 8 uniforms per object, set through glGetUniformLocation on every
+// call, through the Shader's name table, or through locations looked
+// up once. A second round spreads the objects over programs sharing
+// the camera: locations per program, or the Frame block written once
+// and each Object block bound with glBindBufferRange.
+// uniform_bench [objects], 200000 by default
+#include "../../include/glad/glad.h"
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "../shader.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// programs sharing the camera in the second half
+const int nbPrograms = 8;
+
+// one object's worth of updates, 8 uniforms
+struct ObjectUniforms {
+	glm::mat4 model, view, projection;
+	glm::mat3 normalMatrix;
+	glm::vec3 lightPos;
+	glm::vec4 color;
+	glm::vec2 fade;
+	float time;
+};
+
+void updateByGLLookup(const Shader &shader, const ObjectUniforms &u) {
+	glUniformMatrix4fv(glGetUniformLocation(shader.ID, "model"), 1, GL_FALSE, glm::value_ptr(u.model));
+	glUniformMatrix4fv(glGetUniformLocation(shader.ID, "view"), 1, GL_FALSE, glm::value_ptr(u.view));
+	glUniformMatrix4fv(glGetUniformLocation(shader.ID, "projection"), 1, GL_FALSE, glm::value_ptr(u.projection));
+	glUniformMatrix3fv(glGetUniformLocation(shader.ID, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(u.normalMatrix));
+	glUniform3fv(glGetUniformLocation(shader.ID, "lightPos"), 1, glm::value_ptr(u.lightPos));
+	glUniform4fv(glGetUniformLocation(shader.ID, "color"), 1, glm::value_ptr(u.color));
+	glUniform2fv(glGetUniformLocation(shader.ID, "fade"), 1, glm::value_ptr(u.fade));
+	glUniform1f(glGetUniformLocation(shader.ID, "time"), u.time);
+}
+
+void updateByName(const Shader &shader, const ObjectUniforms &u) {
+	shader.setMat4("model", u.model);
+	shader.setMat4("view", u.view);
+	shader.setMat4("projection", u.projection);
+	shader.setMat3("normalMatrix", u.normalMatrix);
+	shader.setVec3("lightPos", u.lightPos);
+	shader.setVec4("color", u.color);
+	shader.setVec2("fade", u.fade);
+	shader.setFloat("time", u.time);
+}
+
+struct Locations {
+	GLint model, view, projection, normalMatrix, lightPos, color, fade, time;
+};
+
+void updateByLocation(const Shader &shader, const Locations &loc, const ObjectUniforms &u) {
+	shader.setMat4(loc.model, u.model);
+	shader.setMat4(loc.view, u.view);
+	shader.setMat4(loc.projection, u.projection);
+	shader.setMat3(loc.normalMatrix, u.normalMatrix);
+	shader.setVec3(loc.lightPos, u.lightPos);
+	shader.setVec4(loc.color, u.color);
+	shader.setVec2(loc.fade, u.fade);
+	shader.setFloat(loc.time, u.time);
+}
+
+// Object block of uniform_blocks_bench.vs, std140
+struct ObjectBlock {
+	glm::mat4 model;
+	glm::mat4 normalMatrix;
+	glm::vec4 color;
+	glm::vec4 lightPos;
+	glm::vec2 fade;
+	float padding[2];
+};
+
+void report(const char* method, int objects, double seconds) {
+	double updates = objects * 8.0;
+	std::cout << "  " << method << ": " << seconds * 1000.0 << " ms, "
+		  << seconds * 1e9 / updates << " ns/uniform, "
+		  << updates / seconds / 1e6 << " M uniforms/s" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	int objects = argc > 1 ? atoi(argv[1]) : 200000;
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "uniform_bench", NULL, NULL);
+	if (window == NULL) {
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+
+	Shader shader("./uniform_bench.vs", "./uniform_bench.fs");
+	shader.use();
+	Locations loc = {
+		shader.location("model"), shader.location("view"), shader.location("projection"),
+		shader.location("normalMatrix"), shader.location("lightPos"), shader.location("color"),
+		shader.location("fade"), shader.location("time")
+	};
+
+	ObjectUniforms u;
+	u.model = u.view = u.projection = glm::mat4(1.0f);
+	u.normalMatrix = glm::mat3(1.0f);
+	u.lightPos = glm::vec3(1.0f, 2.0f, 3.0f);
+	u.color = glm::vec4(1.0f);
+	u.fade = glm::vec2(0.0f, 1.0f);
+
+	std::cout << objects << " objects, 8 uniforms each" << std::endl;
+	for (int method = 0; method < 3; method++) {
+		glFinish();
+		double start = glfwGetTime();
+		for (int i = 0; i < objects; i++) {
+			u.time = (float) i;
+			if (method == 0)
+				updateByGLLookup(shader, u);
+			else if (method == 1)
+				updateByName(shader, u);
+			else
+				updateByLocation(shader, loc, u);
+		}
+		glFinish();
+		double seconds = glfwGetTime() - start;
+		report(method == 0 ? "glGetUniformLocation" : method == 1 ? "name table" : "locations", objects, seconds);
+	}
+
+	// Objects cycling through programs that share the camera
+	std::vector<Shader*> plain, blocks;
+	std::vector<Locations> plainLoc;
+	for (int p = 0; p < nbPrograms; p++) {
+		plain.push_back(new Shader("./uniform_bench.vs", "./uniform_bench.fs"));
+		blocks.push_back(new Shader("./uniform_blocks_bench.vs", "./uniform_blocks_bench.fs"));
+		Shader &s = *plain.back();
+		Locations l = {
+			s.location("model"), s.location("view"), s.location("projection"),
+			s.location("normalMatrix"), s.location("lightPos"), s.location("color"),
+			s.location("fade"), s.location("time")
+		};
+		plainLoc.push_back(l);
+	}
+	GLuint frameBuffer = init_frame_block();
+	uniform_buffer objectBlocks;
+	init_uniform_buffer(&objectBlocks, 1 << 20);
+	GLint objectBlockSize = blocks[0]->blockSize(object_block_name);
+	std::vector<size_t> offsets;
+
+	std::cout << objects << " objects over " << nbPrograms << " programs" << std::endl;
+	for (int method = 0; method < 2; method++) {
+		glFinish();
+		double start = glfwGetTime();
+		if (method == 0) {
+			for (int i = 0; i < objects; i++) {
+				u.time = (float) i;
+				glUseProgram(plain[i % nbPrograms]->ID);
+				updateByLocation(*plain[i % nbPrograms], plainLoc[i % nbPrograms], u);
+			}
+		} else {
+			// the camera once for all programs
+			frame_block frame;
+			memcpy(frame.view, glm::value_ptr(u.view), sizeof(frame.view));
+			memcpy(frame.projection, glm::value_ptr(u.projection), sizeof(frame.projection));
+			frame.time = 0.0f;
+			update_frame_block(frameBuffer, frame);
+			// object blocks by buffer-full, one upload each
+			for (int first = 0; first < objects; ) {
+				uniform_buffer_reset(&objectBlocks);
+				offsets.clear();
+				int i = first;
+				for (; i < objects; i++) {
+					size_t offset = 0;
+					ObjectBlock* block = (ObjectBlock*) uniform_buffer_alloc(&objectBlocks, sizeof(ObjectBlock), &offset);
+					if (block == NULL)
+						break;  // full, upload this batch
+					block->model = u.model;
+					block->normalMatrix = glm::mat4(u.normalMatrix);
+					block->color = u.color;
+					block->lightPos = glm::vec4(u.lightPos, 1.0f);
+					block->fade = u.fade;
+					offsets.push_back(offset);
+				}
+				uniform_buffer_upload(&objectBlocks);
+				for (int j = first; j < i; j++) {
+					glUseProgram(blocks[j % nbPrograms]->ID);
+					uniform_buffer_bind(&objectBlocks, object_block_binding, offsets[j - first], objectBlockSize);
+				}
+				first = i;
+			}
+		}
+		glFinish();
+		double seconds = glfwGetTime() - start;
+		report(method == 0 ? "locations, per program" : "Frame and Object blocks", objects, seconds);
+	}
+
+	free_uniform_buffer(&objectBlocks);
+	glDeleteBuffers(1, &frameBuffer);
+	for (int p = 0; p < nbPrograms; p++) {
+		glDeleteProgram(plain[p]->ID);
+		glDeleteProgram(blocks[p]->ID);
+		delete plain[p];
+		delete blocks[p];
+	}
+	glfwTerminate();
+	return 0;
+}
@@ -0,0 +1,18 @@
+#version 330 core
+
+in vec3 Normal;
+in vec3 FragPos;
+
+out vec4 FragColor;
+
+uniform vec3 lightPos;
+uniform vec4 color;
+uniform vec2 fade;
+uniform float time;
+uniform int mode;
+
+void main() {
+	float diffuse = max(dot(normalize(Normal), normalize(lightPos - FragPos)), 0.0f);
+	float alpha = mode == 1 ? clamp(fade.x + fade.y * time, 0.0f, 1.0f) : 1.0f;
+	FragColor = vec4(color.rgb * diffuse, color.a * alpha);
+}
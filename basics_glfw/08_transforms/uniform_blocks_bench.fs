@@ -0,0 +1,28 @@
+#version 330 core
+
+in vec3 Normal;
+in vec3 FragPos;
+
+out vec4 FragColor;
+
+layout (std140) uniform Frame {
+	mat4 view;
+	mat4 projection;
+	float time;
+};
+
+layout (std140) uniform Object {
+	mat4 model;
+	mat4 normalMatrix;
+	vec4 color;
+	vec4 lightPos;
+	vec2 fade;
+};
+
+uniform int mode;
+
+void main() {
+	float diffuse = max(dot(normalize(Normal), normalize(lightPos.xyz - FragPos)), 0.0f);
+	float alpha = mode == 1 ? clamp(fade.x + fade.y * time, 0.0f, 1.0f) : 1.0f;
+	FragColor = vec4(color.rgb * diffuse, color.a * alpha);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+out vec3 Normal;
+out vec3 FragPos;
+
+layout (std140) uniform Frame {
+	mat4 view;
+	mat4 projection;
+	float time;
+};
+
+layout (std140) uniform Object {
+	mat4 model;
+	mat4 normalMatrix;  // mat3 in the upper left, std140 pads it anyway
+	vec4 color;
+	vec4 lightPos;
+	vec2 fade;
+};
+
+void main() {
+	FragPos = vec3(model * vec4(aPos, 1.0f));
+	Normal = mat3(normalMatrix) * aNormal;
+	gl_Position = projection * view * vec4(FragPos, 1.0f);
+}
@@ -2,8 +2,18 @@
 #define SHADER_H
 
 #include "../include/glad/glad.h"
+#include <GLFW/glfw3.h>
 
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "../common/program_cache.h"
+#include "../common/uniform_blocks.h"
+
+#include <cstring>
 #include <string>
+#include <utility>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -14,6 +24,9 @@ class Shader {
 public:
 	// shader program ID
 	unsigned int ID;
+	// whether the program came from the binary cache, and build time
+	bool fromCache;
+	double buildMs;
 
 	// constructor for reading glsl files and building shader program
 	Shader(const char* vertexPath, const char* fragmentPath) {
@@ -50,47 +63,32 @@ public:
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
 		}
 		
-		// if reading is successful, attempt to compile and link shader program
+		// if reading is successful, build the shader program, or reload
+		// it from the binary cache when it was built before
 		const char* vShaderCode = vertexCode.c_str();
 		const char* fShaderCode = fragmentCode.c_str();
-		unsigned int vertex, fragment;
-		int success;
-		char infoLog[512];
-
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-		if (!success) {
-			glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-		}
-
-		// fragment shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-		if (!success) {
-			glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-		}
+		program_cache* cache = programCache();
+		ID = program_cache_link(cache, &vShaderCode, 1, &fShaderCode, 1);
+		if (ID == 0)
+			std::cout << "ERROR::SHADER::PROGRAM::BUILD_FAILED" << std::endl;
+		fromCache = cache->last_hit;
+		buildMs = cache->last_ms;
+
+		loadUniforms();
+		// the shared Frame and Object blocks, if the program uses them
+		if (ID != 0)
+			bind_uniform_blocks(ID);
+	}
 
-		// shader program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		glLinkProgram(ID);
-		glGetProgramiv(ID, GL_LINK_STATUS, &success);
-		if (!success) {
-			glGetProgramInfoLog(ID, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+	// program binary cache shared by all shaders, in ./program_cache
+	static program_cache* programCache() {
+		static program_cache cache;
+		static bool initialized = false;
+		if (!initialized) {
+			program_cache_init(&cache, "program_cache", (program_cache_loader) glfwGetProcAddress);
+			initialized = true;
 		}
-
-		// delete uneccessary shaders
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
+		return &cache;
 	}
 
 	// method to set shader as active
@@ -98,15 +96,149 @@ public:
 		glUseProgram(ID);
 	}
 
-	// functions for setting uniform values
+	// location of a uniform, from the table filled at link time; look
+	// it up once and keep it for per-frame updates. -1 if inactive
+	GLint location(const char* name) const {
+		if (uniformTable.empty())
+			return -1;
+		unsigned int hash = hashName(name);
+		size_t mask = uniformTable.size() - 1;
+		for (size_t i = hash & mask; uniformTable[i].location != -1; i = (i + 1) & mask) {
+			if (uniformTable[i].hash == hash && uniformTable[i].name == name)
+				return uniformTable[i].location;
+		}
+		// only the first element of arrays is in the table
+		return strchr(name, '[') != NULL ? glGetUniformLocation(ID, name) : -1;
+	}
+	GLint location(const std::string &name) const {
+		return location(name.c_str());
+	}
+
+	// index of a uniform block, GL_INVALID_INDEX if the program has none
+	// by that name
+	GLuint blockIndex(const char* name) const {
+		return ID != 0 ? glGetUniformBlockIndex(ID, name) : GL_INVALID_INDEX;
+	}
+
+	// bytes the block takes, to size its glBindBufferRange; 0 if absent
+	GLint blockSize(const char* name) const {
+		GLuint index = blockIndex(name);
+		GLint size = 0;
+		if (index != GL_INVALID_INDEX)
+			glGetActiveUniformBlockiv(ID, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+		return size;
+	}
+
+	// read the block from uniform buffer binding point 'binding'; Frame
+	// and Object are already bound to frame_block_binding and
+	// object_block_binding. False if the program has no such block
+	bool bindBlock(const char* name, GLuint binding) const {
+		GLuint index = blockIndex(name);
+		if (index == GL_INVALID_INDEX)
+			return false;
+		glUniformBlockBinding(ID, index, binding);
+		return true;
+	}
+
+	// functions for setting uniform values of the program in use, by
+	// name or by location
 	void setBool(const std::string &name, bool value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int) value);
+		setBool(location(name.c_str()), value);
 	}
 	void setInt(const std::string &name, int value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		setInt(location(name.c_str()), value);
 	}
 	void setFloat(const std::string &name, float value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		setFloat(location(name.c_str()), value);
+	}
+	void setBool(const char* name, bool value) const { setBool(location(name), value); }
+	void setInt(const char* name, int value) const { setInt(location(name), value); }
+	void setFloat(const char* name, float value) const { setFloat(location(name), value); }
+	void setVec2(const char* name, const glm::vec2 &value) const { setVec2(location(name), value); }
+	void setVec3(const char* name, const glm::vec3 &value) const { setVec3(location(name), value); }
+	void setVec4(const char* name, const glm::vec4 &value) const { setVec4(location(name), value); }
+	void setMat3(const char* name, const glm::mat3 &value) const { setMat3(location(name), value); }
+	void setMat4(const char* name, const glm::mat4 &value) const { setMat4(location(name), value); }
+
+	void setBool(GLint location, bool value) const { glUniform1i(location, (int) value); }
+	void setInt(GLint location, int value) const { glUniform1i(location, value); }
+	void setFloat(GLint location, float value) const { glUniform1f(location, value); }
+	void setVec2(GLint location, const glm::vec2 &value) const { glUniform2fv(location, 1, glm::value_ptr(value)); }
+	void setVec3(GLint location, const glm::vec3 &value) const { glUniform3fv(location, 1, glm::value_ptr(value)); }
+	void setVec4(GLint location, const glm::vec4 &value) const { glUniform4fv(location, 1, glm::value_ptr(value)); }
+	void setMat3(GLint location, const glm::mat3 &value) const {
+		glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+	void setMat4(GLint location, const glm::mat4 &value) const {
+		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+
+private:
+	// open addressing table of the active uniforms, arrays under both
+	// "name[0]" and "name", a power of two in size and at most a
+	// quarter full; free slots have location -1
+	struct UniformSlot {
+		unsigned int hash;
+		GLint location;
+		std::string name;
+	};
+	std::vector<UniformSlot> uniformTable;
+
+	// 32-bit FNV-1a
+	static unsigned int hashName(const char* name) {
+		unsigned int hash = 2166136261u;
+		for (; *name != '\0'; name++) {
+			hash ^= (unsigned char) *name;
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	void insertUniform(const std::string &name, GLint location) {
+		unsigned int hash = hashName(name.c_str());
+		size_t mask = uniformTable.size() - 1;
+		size_t i = hash & mask;
+		while (uniformTable[i].location != -1)
+			i = (i + 1) & mask;
+		uniformTable[i].hash = hash;
+		uniformTable[i].location = location;
+		uniformTable[i].name = name;
+	}
+
+	// enumerate the active uniforms once, after linking
+	void loadUniforms() {
+		uniformTable.clear();
+		if (ID == 0)
+			return;
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		// every name goes in, then the table is sized for them
+		std::vector<std::pair<std::string, GLint> > names;
+		std::vector<char> nameBuffer(maxLength + 1);
+		for (GLint i = 0; i < count; i++) {
+			GLsizei length = 0;
+			GLint arraySize = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, i, nameBuffer.size(), &length, &arraySize, &type, nameBuffer.data());
+			std::string name(nameBuffer.data(), length);
+			// members of uniform blocks have no location
+			GLint location = glGetUniformLocation(ID, name.c_str());
+			if (location < 0)
+				continue;
+			names.push_back(std::make_pair(name, location));
+			// arrays are reported as "name[0]", also accept "name"
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+				names.push_back(std::make_pair(name.substr(0, name.size() - 3), location));
+		}
+
+		size_t size = 1;
+		while (size < names.size() * 4)
+			size *= 2;
+		uniformTable.assign(size, UniformSlot { 0, -1, std::string() });
+		for (size_t i = 0; i < names.size(); i++)
+			insertUniform(names[i].first, names[i].second);
 	}
 };
 
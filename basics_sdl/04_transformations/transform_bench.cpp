@@ -0,0 +1,156 @@
+/* Scene graph updates with every node animated, then 1 in 10, then
+ * 1 in 100. logic()'s way rebuilds every model and MVP matrix each
+ * frame with chained glm calls; transform_hierarchy only rebuilds the
+ * subtrees under the nodes that moved, with scalar or SIMD local
+ * matrices, and its matrices must match glm's.
+ * transform_bench [nodes ...] runs 10000 to 1000000 nodes by default. */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../../common/bench.h"
+#include "../../common/transform_hierarchy.h"
+
+/* How each node sits under its parent, and spins */
+struct scene_node {
+	int parent;
+	glm::vec3 translation, axis, scale;
+	float speed;
+};
+
+/* Small trees of 16 nodes, each hung on an earlier node of its tree */
+void build_scene(size_t count, vector<scene_node> &nodes) {
+	srand(1);
+	nodes.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		scene_node &n = nodes[i];
+		n.parent = i % 16 == 0 ? -1 : (int)(i - 1 - rand() % (i % 16));
+		n.translation = glm::vec3(rand() % 100 - 50, rand() % 100 - 50, rand() % 100 - 50) * 0.1f;
+		n.axis = glm::normalize(glm::vec3(rand() % 100 - 50, rand() % 100 - 50, rand() % 100 - 50) + glm::vec3(0.01f));
+		n.scale = glm::vec3(0.75f + (rand() % 50) * 0.01f);
+		n.speed = 0.5f + (rand() % 100) * 0.01f;
+	}
+}
+
+/* Whether node i spins when 1 in 'stride' of them do */
+inline bool animated(size_t i, size_t stride) {
+	return i % stride == 0;
+}
+
+/* Everything, every frame, the ad hoc way */
+void update_naive(const vector<scene_node> &nodes, float t, size_t stride, const glm::mat4 &vp,
+		  vector<glm::mat4> &world, vector<glm::mat4> &mvp) {
+	for (size_t i = 0; i < nodes.size(); i++) {
+		const scene_node &n = nodes[i];
+		float angle = animated(i, stride) ? t * n.speed : 0.0f;
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), n.translation)
+			* glm::rotate(glm::mat4(1.0f), angle, n.axis)
+			* glm::scale(glm::mat4(1.0f), n.scale);
+		world[i] = n.parent >= 0 ? world[n.parent] * model : model;
+		mvp[i] = vp * world[i];
+	}
+}
+
+glm::vec4 spin(const scene_node &n, float angle) {
+	return glm::vec4(n.axis * sinf(angle * 0.5f), cosf(angle * 0.5f));
+}
+
+void animate_hierarchy(transform_hierarchy* h, const vector<scene_node> &nodes, float t, size_t stride) {
+	for (size_t i = 0; i < nodes.size(); i += stride)
+		set_node_rotation(h, i, spin(nodes[i], t * nodes[i].speed));
+}
+
+/* Largest difference between two sets of matrices, relative to the
+ * largest element */
+float max_error(const vector<glm::mat4> &a, const vector<glm::mat4> &b) {
+	float error = 0, largest = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				error = max(error, fabsf(a[i][c][r] - b[i][c][r]));
+				largest = max(largest, fabsf(b[i][c][r]));
+			}
+		}
+	}
+	return largest > 0 ? error / largest : error;
+}
+
+int main(int argc, char* argv[]) {
+	vector<size_t> counts;
+	for (int i = 1; i < argc; i++) {
+		counts.push_back(atol(argv[i]));
+		if (counts.back() == 0) {
+			cerr << "Usage: " << argv[0] << " [nodes ...]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (counts.empty()) {
+		counts.push_back(10000);
+		counts.push_back(100000);
+		counts.push_back(1000000);
+	}
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0, 2.0, 0.0), glm::vec3(0.0, 0.0, -4.0), glm::vec3(0.0, 1.0, 0.0));
+	glm::mat4 vp = projection * view;
+
+#if defined(__AVX2__)
+	cout << "SIMD: AVX2, 8 local matrices at a time" << endl;
+#elif defined(__SSE2__)
+	cout << "SIMD: SSE2, 4 local matrices at a time" << endl;
+#else
+	cout << "SIMD: none, the scalar update twice" << endl;
+#endif
+	for (size_t c = 0; c < counts.size(); c++) {
+		size_t count = counts[c];
+		int nb_frames = max(5, (int)(2000000 / count));
+		vector<scene_node> nodes;
+		build_scene(count, nodes);
+		cout << count << " nodes, " << nb_frames << " frames" << endl;
+
+		size_t strides[] = { 1, 10, 100 };
+		for (int s = 0; s < 3; s++) {
+			size_t stride = strides[s];
+			cout << "  1 node in " << stride << " animated" << endl;
+
+			vector<glm::mat4> world(count), mvp(count);
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			for (int frame = 1; frame <= nb_frames; frame++)
+				update_naive(nodes, frame * 0.01f, stride, vp, world, mvp);
+			cout << "    naive glm: " << ms_since(start) / nb_frames << " ms/frame, "
+			     << count << " world and MVP matrices" << endl;
+
+			for (int simd = 0; simd < 2; simd++) {
+				transform_hierarchy h;
+				init_transform_hierarchy(&h, count);
+				for (size_t i = 0; i < count; i++)
+					add_transform_node(&h, nodes[i].parent, nodes[i].translation,
+							   spin(nodes[i], 0.0f), nodes[i].scale);
+				update_transforms(&h, vp);
+
+				size_t nb_worlds = 0;
+				start = chrono::steady_clock::now();
+				for (int frame = 1; frame <= nb_frames; frame++) {
+					animate_hierarchy(&h, nodes, frame * 0.01f, stride);
+					if (simd)
+						update_transforms(&h, vp);
+					else
+						update_transforms_scalar(&h, vp);
+					nb_worlds += h.nb_worlds;
+				}
+				cout << "    hierarchy, " << (simd ? "SIMD" : "scalar") << ": "
+				     << ms_since(start) / nb_frames << " ms/frame, "
+				     << nb_worlds / nb_frames << " world and MVP matrices, error "
+				     << max_error(h.mvp, mvp) << endl;
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
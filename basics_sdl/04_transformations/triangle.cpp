@@ -14,12 +14,17 @@ using namespace std;
 #include <glm/gtc/type_ptr.hpp>
 
 #include "../../common/shader_utils.h"
+#include "../../common/transform_hierarchy.h"
 
 GLuint program;
 GLuint vbo_triangle;
 GLint attribute_coord3d, attribute_v_color;
 GLint uniform_m_transform;
 
+/* The triangle spins under a node that slides it left and right */
+transform_hierarchy transforms;
+int node_slide, node_spin;
+
 struct attributes {
 	GLfloat coord3d[3];
 	GLfloat v_color[3];
@@ -71,6 +76,10 @@ bool init_resources() {
 		cerr << "Could not bind uniform " << uniform_name << endl;
 		return false;
 	}
+
+	init_transform_hierarchy(&transforms);
+	node_slide = add_transform_node(&transforms, -1, glm::vec3(0.0));
+	node_spin = add_transform_node(&transforms, node_slide, glm::vec3(0.0));
 	return true;
 }
 
@@ -78,11 +87,13 @@ void logic() {
 	float move = sinf(SDL_GetTicks() / 1000.0 * 6.28 / 5);
 	float angle = SDL_GetTicks() / 1000.0 * 45;
 	glm::vec3 axis_z(0, 0, 1);
-	glm::mat4 m_transform = glm::translate(glm::mat4(1.0f), glm::vec3(move, 0.0, 0.0)) 
-		* glm::rotate(glm::mat4(1.0f), glm::radians(angle), axis_z);
+	float half_angle = glm::radians(angle) / 2;
+	set_node_translation(&transforms, node_slide, glm::vec3(move, 0.0, 0.0));
+	set_node_rotation(&transforms, node_spin, glm::vec4(axis_z * sinf(half_angle), cosf(half_angle)));
+	update_transforms(&transforms, glm::mat4(1.0f));
 	glUseProgram(program);
 	glUniformMatrix4fv(uniform_m_transform, 1, GL_FALSE,
-		    glm::value_ptr(m_transform));
+		    glm::value_ptr(transforms.world[node_spin]));
 }
 
 void render(SDL_Window* window) {
@@ -2,6 +2,8 @@
 #include <cstdlib>
 #include <iostream>
 #include <math.h>
+#include <cstring>
+#include <vector>
 using namespace std;
 
 /* Use glew.h instead of gl.h to get all the GL prototypes declared */
@@ -13,7 +15,11 @@ using namespace std;
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "../../common/frustum_cull.h"
+#include "../../common/ring_buffer.h"
 #include "../../common/shader_utils.h"
+#include "../../common/vertex_layout.h"
+#include "cube_instance.h"
 
 int screen_width=800, screen_height=600;
 
@@ -21,12 +27,111 @@ GLuint program;
 GLuint vbo_cube, ibo_cube;
 GLint attribute_coord3d, attribute_v_color;
 GLint uniform_mvp;
+vertex_layout cube_layout;
 
 struct attributes {
 	GLfloat coord3d[3];
 	GLfloat v_color[3];
 };
 
+/* With --instances N, N cubes spinning on their own axis, drawn with
+ * one instanced call, or one call each with --per-draw. --stream
+ * picks how the instances reach the ring buffer. Only the cubes whose
+ * bounding sphere is in the view frustum are animated and drawn. */
+int nb_instances = 0;
+bool per_draw = false;
+ring_buffer_mode stream_mode = ring_persistent;
+
+vector<cube_instance> instances;
+vector<glm::vec4> spins;  // rotation axis, and speed in w
+vector<float> bound_x, bound_y, bound_z, bound_radius;
+vector<unsigned> visible;
+size_t nb_visible = 0;
+double cull_ms = 0;  // last frame's
+glm::mat4 vp;
+GLuint program_instanced;
+GLint attribute_instance_position, attribute_instance_rotation;
+GLint uniform_vp;
+vertex_layout instanced_layout;
+ring_buffer instance_ring;
+
+/* Cubes on a square grid around the single cube's position, wider
+ * than the view so that the ones at the edges get culled */
+void init_instances() {
+	int side = 1;
+	while (side * side < nb_instances)
+		side++;
+	float cell = 12.0f / side;
+	instances.resize(nb_instances);
+	spins.resize(nb_instances);
+	bound_x.resize(nb_instances);
+	bound_y.resize(nb_instances);
+	bound_z.resize(nb_instances);
+	bound_radius.resize(nb_instances);
+	visible.resize(nb_instances);
+	for (int i = 0; i < nb_instances; i++) {
+		float x = ((i % side) + 0.5f) * cell - 6.0f;
+		float y = ((i / side) + 0.5f) * cell - 6.0f;
+		instances[i].position = glm::vec4(x, y, -4.0f, cell * 0.35f);
+		// Scattered axes and speeds, the same on every run
+		glm::vec3 axis(sinf(i * 12.9898f), cosf(i * 78.233f), sinf(i * 37.719f) + 1.5f);
+		spins[i] = glm::vec4(glm::normalize(axis), 1.0f + (i % 7) * 0.3f);
+		// Whatever the rotation, the cube's corners stay within scale * sqrt(3)
+		bound_x[i] = x;
+		bound_y[i] = y;
+		bound_z[i] = -4.0f;
+		bound_radius[i] = instances[i].position.w * sqrtf(3.0f);
+	}
+}
+
+/* The instanced program, and the ring buffer its instances stream
+ * through, next to the cube's vertices */
+bool init_instanced(GLuint vbo_vertices, GLuint ibo_elements) {
+	if (!instancing_available()) {
+		cerr << "Instanced arrays not available, drawing one cube per call" << endl;
+		per_draw = true;
+		return true;
+	}
+	program_instanced = create_program("cube_instanced.v.glsl", "cube.f.glsl");
+	if (program_instanced == 0)
+		return false;
+
+	const char* attribute_names[] = { "coord3d", "v_color", "instance_position", "instance_rotation" };
+	GLint attributes[4];
+	for (int i = 0; i < 4; i++) {
+		attributes[i] = glGetAttribLocation(program_instanced, attribute_names[i]);
+		if (attributes[i] == -1) {
+			cerr << "Could not bind attribute " << attribute_names[i] << endl;
+			return false;
+		}
+	}
+	uniform_vp = glGetUniformLocation(program_instanced, "vp");
+	if (uniform_vp == -1) {
+		cerr << "Could not bind uniform vp" << endl;
+		return false;
+	}
+
+	attribute_instance_position = attributes[2];
+	attribute_instance_rotation = attributes[3];
+
+	if (!init_ring_buffer(&instance_ring, nb_instances * sizeof(cube_instance), stream_mode))
+		return false;
+	cout << "Instances streamed with " << ring_buffer_mode_name(instance_ring.mode) << endl;
+
+	add_vertex_attrib(&instanced_layout, attributes[0], vbo_vertices, 3, GL_FLOAT, GL_FALSE,
+			  sizeof(struct attributes), offsetof(struct attributes, coord3d));
+	add_vertex_attrib(&instanced_layout, attributes[1], vbo_vertices, 3, GL_FLOAT, GL_FALSE,
+			  sizeof(struct attributes), offsetof(struct attributes, v_color));
+	// Offsets relative to the frame's allocation, see render()
+	add_vertex_attrib(&instanced_layout, attributes[2], instance_ring.buffer, 4, GL_FLOAT, GL_FALSE,
+			  sizeof(cube_instance), offsetof(cube_instance, position), 1);
+	add_vertex_attrib(&instanced_layout, attributes[3], instance_ring.buffer, 4, GL_FLOAT, GL_FALSE,
+			  sizeof(cube_instance), offsetof(cube_instance, rotation), 1);
+	instanced_layout.element_buffer = ibo_elements;
+	build_vertex_layout(&instanced_layout);
+	return true;
+}
+
 bool init_resources() {	
 	/* Cube vertices and colors */
 	struct attributes cube_attributes[] = {
@@ -105,6 +210,19 @@ bool init_resources() {
 		cerr << "Could not bind uniform " << uniform_name << endl;
 		return false;
 	}
+
+	/* Describe the vertices once: kept in a vertex array object
+	 * when the context has them, set up again per draw otherwise */
+	add_vertex_attrib(&cube_layout, attribute_coord3d, vbo_cube, 3, GL_FLOAT, GL_FALSE,
+			  sizeof(struct attributes), offsetof(struct attributes, coord3d));
+	add_vertex_attrib(&cube_layout, attribute_v_color, vbo_cube, 3, GL_FLOAT, GL_FALSE,
+			  sizeof(struct attributes), offsetof(struct attributes, v_color));
+	cube_layout.element_buffer = ibo_cube;
+	build_vertex_layout(&cube_layout);
+	cout << "Vertex layout: " << (cube_layout.vao != 0 ? "vertex array object" : "set up per draw") << endl;
+
+	if (nb_instances > 0 && !per_draw)
+		return init_instanced(vbo_cube, ibo_cube);
 	return true;
 }
 
@@ -158,48 +276,114 @@ void logic() {
 
 	glUseProgram(program);
 	glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
+
+	vp = projection * view;
+	if (nb_instances == 0)
+		return;
+	Uint64 start = SDL_GetPerformanceCounter();
+	glm::vec4 planes[6];
+	frustum_planes(vp, planes);
+	nb_visible = cull_spheres(planes, bound_x.data(), bound_y.data(), bound_z.data(), bound_radius.data(),
+				  nb_instances, visible.data());
+	cull_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+
+	float t = SDL_GetTicks() / 1000.0f;
+	for (size_t v = 0; v < nb_visible; v++) {
+		int i = visible[v];
+		float half_angle = t * spins[i].w * 0.5f;
+		instances[i].rotation = glm::vec4(glm::vec3(spins[i]) * sinf(half_angle), cosf(half_angle));
+	}
 }
 
 void render(SDL_Window* window) {
 	glClearColor(1.0, 1.0, 1.0, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-	glUseProgram(program);
+	Uint64 start = SDL_GetPerformanceCounter();
+	if (nb_instances == 0) {
+		glUseProgram(program);
 
-	glEnableVertexAttribArray(attribute_coord3d);
-	glEnableVertexAttribArray(attribute_v_color);
+		bind_vertex_layout(&cube_layout);
+		int size; glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+		glDrawElements(GL_TRIANGLES, size/sizeof(GLushort), GL_UNSIGNED_SHORT, 0);
+		unbind_vertex_layout(&cube_layout);
+	} else if (per_draw) {
+		glUseProgram(program);
 
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_cube);
-	glVertexAttribPointer(
-		attribute_coord3d,         // attribute
-		3,                         // number of elements per vertex, here (x,y)
-		GL_FLOAT,                  // the type of each element
-		GL_FALSE,                  // take our values as-is
-		sizeof(struct attributes), // no extra data between each position
-		0                          // offset of first element
-	);
-	glVertexAttribPointer(
-		attribute_v_color,         
-		3,		           
-		GL_FLOAT,	           
-		GL_FALSE,	           
-		sizeof(struct attributes), 
-		(GLvoid*) offsetof(struct attributes, v_color)
-	);
+		bind_vertex_layout(&cube_layout);
+		int size; glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+		for (size_t v = 0; v < nb_visible; v++) {
+			glm::mat4 mvp = vp * instance_model(instances[visible[v]]);
+			glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
+			glDrawElements(GL_TRIANGLES, size/sizeof(GLushort), GL_UNSIGNED_SHORT, 0);
+		}
+		unbind_vertex_layout(&cube_layout);
+	} else {
+		glUseProgram(program_instanced);
+		glUniformMatrix4fv(uniform_vp, 1, GL_FALSE, glm::value_ptr(vp));
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_cube);
-	int size; glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-	glDrawElements(GL_TRIANGLES, size/sizeof(GLushort), GL_UNSIGNED_SHORT, 0);
-	
-	glDisableVertexAttribArray(attribute_coord3d);
-	glDisableVertexAttribArray(attribute_v_color);
+		/* Write this frame's visible instances into the region the
+		 * GPU is done with, then point the instance attributes at them */
+		ring_buffer_begin_frame(&instance_ring);
+		size_t offset = 0;
+		cube_instance* data = (cube_instance*) ring_buffer_alloc_vertices(&instance_ring, nb_visible,
+										  sizeof(cube_instance), &offset);
+		if (data != NULL) {
+			for (size_t v = 0; v < nb_visible; v++)
+				data[v] = instances[visible[v]];
+		}
+		ring_buffer_end_frame(&instance_ring);
+
+		bind_vertex_layout(&instanced_layout);
+		glBindBuffer(GL_ARRAY_BUFFER, instance_ring.buffer);
+		glVertexAttribPointer(attribute_instance_position, 4, GL_FLOAT, GL_FALSE, sizeof(cube_instance),
+				      (const GLvoid*) (offset + offsetof(cube_instance, position)));
+		glVertexAttribPointer(attribute_instance_rotation, 4, GL_FLOAT, GL_FALSE, sizeof(cube_instance),
+				      (const GLvoid*) (offset + offsetof(cube_instance, rotation)));
+		int size; glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+		if (data != NULL && nb_visible > 0)
+			draw_elements_instanced(GL_TRIANGLES, size/sizeof(GLushort), GL_UNSIGNED_SHORT, 0, nb_visible);
+		unbind_vertex_layout(&instanced_layout);
+	}
+
+	if (nb_instances > 0) {
+		/* Average CPU time to cull and submit a frame, every two seconds */
+		static double submit_ms = 0, total_cull_ms = 0;
+		static int nb_frames = 0;
+		static unsigned last_stalls = 0;
+		static Uint32 last_report = SDL_GetTicks();
+		submit_ms += (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		total_cull_ms += cull_ms;
+		nb_frames++;
+		if (SDL_GetTicks() - last_report >= 2000) {
+			cout << nb_instances << " cubes, " << (per_draw ? "one draw each" : "instanced") << ": "
+			     << nb_visible << " visible, " << nb_instances - nb_visible << " culled in "
+			     << total_cull_ms / nb_frames << " ms, "
+			     << submit_ms / nb_frames << " ms/frame submitting, "
+			     << (SDL_GetTicks() - last_report) / (double)nb_frames << " ms/frame";
+			if (program_instanced != 0)
+				cout << ", " << instance_ring.stalls - last_stalls << " stalls on the ring buffer";
+			cout << endl;
+			last_stalls = instance_ring.stalls;
+			submit_ms = total_cull_ms = 0;
+			nb_frames = 0;
+			last_report = SDL_GetTicks();
+		}
+	}
 
 	SDL_GL_SwapWindow(window);
 }
 
 void free_resources() {
 	glDeleteProgram(program);
+	free_vertex_layout(&cube_layout);
+	if (program_instanced != 0) {
+		glDeleteProgram(program_instanced);
+		free_vertex_layout(&instanced_layout);
+		free_ring_buffer(&instance_ring);
+	}
 	glDeleteBuffers(1, &vbo_cube);
+	glDeleteBuffers(1, &ibo_cube);
 }
 
 void mainLoop(SDL_Window* window) {
@@ -218,6 +402,36 @@ void mainLoop(SDL_Window* window) {
 }
 
 int main(int argc, char* argv[]) {
+	/* cube [--instances N] [--per-draw] [--stream persistent|unsynchronized|orphan] */
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+			nb_instances = atoi(argv[++i]);
+			if (nb_instances <= 0) {
+				cerr << "--instances: expected a positive count" << endl;
+				return EXIT_FAILURE;
+			}
+		} else if (strcmp(argv[i], "--per-draw") == 0) {
+			per_draw = true;
+		} else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+			const char* mode = argv[++i];
+			if (strcmp(mode, "persistent") == 0)
+				stream_mode = ring_persistent;
+			else if (strcmp(mode, "unsynchronized") == 0)
+				stream_mode = ring_unsynchronized;
+			else if (strcmp(mode, "orphan") == 0)
+				stream_mode = ring_orphan;
+			else {
+				cerr << "--stream: expected persistent, unsynchronized or orphan" << endl;
+				return EXIT_FAILURE;
+			}
+		} else {
+			cerr << "Usage: " << argv[0] << " [--instances N] [--per-draw]"
+			     << " [--stream persistent|unsynchronized|orphan]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	init_instances();
+
 	SDL_Init(SDL_INIT_VIDEO);
 	SDL_Window* window = SDL_CreateWindow("My First Cube",
 		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
@@ -0,0 +1,25 @@
+#ifndef _CUBE_INSTANCE_H
+#define _CUBE_INSTANCE_H
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+/* One cube of the instanced draw, as cube_instanced.v.glsl reads it.
+ * Shared by cube and draw_bench so both time the same data. */
+struct cube_instance {
+	glm::vec4 position;  // xyz, and scale in w
+	glm::vec4 rotation;  // unit quaternion
+};
+
+/* What cube_instanced.v.glsl computes from an instance */
+inline glm::mat4 instance_model(const cube_instance &instance) {
+	glm::vec3 q(instance.rotation);
+	float w = instance.rotation.w;
+	glm::mat4 rotation(1.0f);
+	rotation[0] = glm::vec4(1 - 2*(q.y*q.y + q.z*q.z), 2*(q.x*q.y + w*q.z), 2*(q.x*q.z - w*q.y), 0);
+	rotation[1] = glm::vec4(2*(q.x*q.y - w*q.z), 1 - 2*(q.x*q.x + q.z*q.z), 2*(q.y*q.z + w*q.x), 0);
+	rotation[2] = glm::vec4(2*(q.x*q.z + w*q.y), 2*(q.y*q.z - w*q.x), 1 - 2*(q.x*q.x + q.y*q.y), 0);
+	glm::mat4 translation = glm::translate(glm::mat4(1.0f), glm::vec3(instance.position));
+	return glm::scale(translation * rotation, glm::vec3(instance.position.w));
+}
+
+#endif
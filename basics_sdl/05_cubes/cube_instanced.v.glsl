@@ -0,0 +1,14 @@
+attribute vec3 coord3d;
+attribute vec3 v_color;
+attribute vec4 instance_position;  // xyz, and scale in w
+attribute vec4 instance_rotation;  // unit quaternion
+varying vec3 f_color;
+uniform mat4 vp;
+
+void main(void) {
+  vec3 v = coord3d * instance_position.w;
+  vec3 q = instance_rotation.xyz;
+  v += 2.0 * cross(q, cross(q, v) + instance_rotation.w * v);
+  gl_Position = vp * vec4(v + instance_position.xyz, 1.0);
+  f_color = v_color;
+}
@@ -0,0 +1,126 @@
+/* frustum_cull on random spheres and boxes around a camera. The
+ * scalar loops and the SIMD ones (4 lanes with SSE2, 8 with make
+ * SIMD=avx2) must keep the same objects; the time per object shows
+ * what the lanes buy.
+ * cull_bench [objects ...] runs 1000 to 1000000 objects by default. */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../../common/bench.h"
+#include "../../common/frustum_cull.h"
+
+/* Bounds of the scene, one array per component */
+struct scene_bounds {
+	vector<float> x, y, z, radius;
+	vector<float> extent_x, extent_y, extent_z;
+};
+
+void build_scene(size_t count, scene_bounds &s) {
+	srand(1);
+	s.x.resize(count);
+	s.y.resize(count);
+	s.z.resize(count);
+	s.radius.resize(count);
+	s.extent_x.resize(count);
+	s.extent_y.resize(count);
+	s.extent_z.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		s.x[i] = rand() / (float)RAND_MAX * 200.0f - 100.0f;
+		s.y[i] = rand() / (float)RAND_MAX * 200.0f - 100.0f;
+		s.z[i] = rand() / (float)RAND_MAX * 200.0f - 100.0f;
+		s.extent_x[i] = 0.25f + rand() / (float)RAND_MAX;
+		s.extent_y[i] = 0.25f + rand() / (float)RAND_MAX;
+		s.extent_z[i] = 0.25f + rand() / (float)RAND_MAX;
+		s.radius[i] = glm::length(glm::vec3(s.extent_x[i], s.extent_y[i], s.extent_z[i]));
+	}
+}
+
+/* Average time of one culling pass. 'cull' fills its own list and
+ * returns its length, the last pass's goes in 'nb_visible'. */
+template <class Cull>
+double time_cull(int nb_frames, Cull cull, size_t &nb_visible) {
+	nb_visible = cull();  // warm-up
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int frame = 0; frame < nb_frames; frame++)
+		nb_visible = cull();
+	return ms_since(start) / nb_frames;
+}
+
+void report(const char* name, double ms, size_t count, size_t nb_visible, bool same) {
+	cout << "  " << name << ": " << ms << " ms/frame, " << ms * 1e6 / count << " ns/object, "
+	     << nb_visible << " visible, " << count - nb_visible << " culled"
+	     << (same ? "" : ", LISTS DIFFER") << endl;
+}
+
+int main(int argc, char* argv[]) {
+	vector<size_t> counts;
+	for (int i = 1; i < argc; i++) {
+		counts.push_back(atol(argv[i]));
+		if (counts.back() == 0) {
+			cerr << "Usage: " << argv[0] << " [objects ...]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (counts.empty()) {
+		counts.push_back(1000);
+		counts.push_back(10000);
+		counts.push_back(100000);
+		counts.push_back(1000000);
+	}
+
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, 1.0, 0.0));
+	glm::vec4 planes[6];
+	frustum_planes(projection * view, planes);
+
+#if defined(__AVX2__)
+	cout << "SIMD: AVX2, 8 objects per test" << endl;
+#elif defined(__SSE2__)
+	cout << "SIMD: SSE2, 4 objects per test" << endl;
+#else
+	cout << "SIMD: none, the scalar loops twice" << endl;
+#endif
+	for (size_t c = 0; c < counts.size(); c++) {
+		size_t count = counts[c];
+		int nb_frames = max(10, (int)(20000000 / count));
+		scene_bounds s;
+		build_scene(count, s);
+		vector<unsigned> scalar(count), simd(count);
+		size_t nb_scalar = 0, nb_simd = 0;
+		cout << count << " objects, " << nb_frames << " frames" << endl;
+
+		double ms = time_cull(nb_frames, [&]() {
+			return cull_spheres_scalar(planes, s.x.data(), s.y.data(), s.z.data(), s.radius.data(),
+						   count, scalar.data());
+		}, nb_scalar);
+		report("spheres, scalar", ms, count, nb_scalar, true);
+		ms = time_cull(nb_frames, [&]() {
+			return cull_spheres(planes, s.x.data(), s.y.data(), s.z.data(), s.radius.data(),
+					    count, simd.data());
+		}, nb_simd);
+		report("spheres, SIMD", ms, count, nb_simd,
+		       nb_simd == nb_scalar && equal(simd.begin(), simd.begin() + nb_simd, scalar.begin()));
+
+		ms = time_cull(nb_frames, [&]() {
+			return cull_boxes_scalar(planes, s.x.data(), s.y.data(), s.z.data(),
+						 s.extent_x.data(), s.extent_y.data(), s.extent_z.data(),
+						 count, scalar.data());
+		}, nb_scalar);
+		report("boxes, scalar", ms, count, nb_scalar, true);
+		ms = time_cull(nb_frames, [&]() {
+			return cull_boxes(planes, s.x.data(), s.y.data(), s.z.data(),
+					  s.extent_x.data(), s.extent_y.data(), s.extent_z.data(),
+					  count, simd.data());
+		}, nb_simd);
+		report("boxes, SIMD", ms, count, nb_simd,
+		       nb_simd == nb_scalar && equal(simd.begin(), simd.begin() + nb_simd, scalar.begin()));
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,342 @@
+/* Where the time goes when every cube is its own draw call with its
+ * own mvp uniform: attributes set up before each draw, through the
+ * gl_state cache, or from one vertex array object. Then one instanced
+ * draw for all of them, their positions and rotations streamed each
+ * frame by glBufferData or by each ring_buffer mode, once finishing
+ * every frame and once back to back so the ring's fences do the
+ * waiting.
+ * draw_bench [cubes ...], 1000 10000 100000 by default */
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "../../common/ring_buffer.h"
+#include "../../common/shader_utils.h"
+#include "../../common/vertex_layout.h"
+#include "cube_instance.h"
+
+struct attributes {
+	GLfloat coord3d[3];
+	GLfloat v_color[3];
+};
+
+GLuint program, program_instanced;
+GLuint vbo_cube, ibo_cube, vbo_instances;
+GLint attribute_coord3d, attribute_v_color;
+GLint uniform_mvp, uniform_vp;
+GLint attribute_instance_position, attribute_instance_rotation;
+vertex_layout instanced_layout;
+int nb_frames;
+
+bool init_resources() {
+	struct attributes cube_attributes[] = {
+		{{-1.0, -1.0,  1.0}, {1.0, 0.0, 0.0}},
+		{{ 1.0, -1.0,  1.0}, {0.0, 1.0, 0.0}},
+		{{ 1.0,  1.0,  1.0}, {0.0, 0.0, 1.0}},
+		{{-1.0,  1.0,  1.0}, {1.0, 1.0, 1.0}},
+		{{-1.0, -1.0, -1.0}, {1.0, 0.0, 0.0}},
+		{{ 1.0, -1.0, -1.0}, {0.0, 1.0, 0.0}},
+		{{ 1.0,  1.0, -1.0}, {0.0, 0.0, 1.0}},
+		{{-1.0,  1.0, -1.0}, {1.0, 1.0, 1.0}},
+	};
+	glGenBuffers(1, &vbo_cube);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_cube);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(cube_attributes), cube_attributes, GL_STATIC_DRAW);
+	GLushort cube_elements[] = {
+		0, 1, 2,  2, 3, 0,  // front
+		1, 5, 6,  6, 2, 1,  // right
+		7, 6, 5,  5, 4, 7,  // back
+		4, 0, 3,  3, 7, 4,  // left
+		4, 5, 1,  1, 0, 4,  // bottom
+		3, 2, 6,  6, 7, 3,  // top
+	};
+	glGenBuffers(1, &ibo_cube);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_cube);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_elements), cube_elements, GL_STATIC_DRAW);
+
+	program = create_program("cube.v.glsl", "cube.f.glsl");
+	if (program == 0)
+		return false;
+	attribute_coord3d = glGetAttribLocation(program, "coord3d");
+	attribute_v_color = glGetAttribLocation(program, "v_color");
+	uniform_mvp = glGetUniformLocation(program, "mvp");
+	if (attribute_coord3d == -1 || attribute_v_color == -1 || uniform_mvp == -1) {
+		cerr << "Could not bind cube.v.glsl's attributes and uniform" << endl;
+		return false;
+	}
+
+	if (!instancing_available())
+		return true;
+	program_instanced = create_program("cube_instanced.v.glsl", "cube.f.glsl");
+	if (program_instanced == 0)
+		return false;
+	const char* attribute_names[] = { "coord3d", "v_color", "instance_position", "instance_rotation" };
+	GLint attributes[4];
+	for (int i = 0; i < 4; i++)
+		attributes[i] = glGetAttribLocation(program_instanced, attribute_names[i]);
+	uniform_vp = glGetUniformLocation(program_instanced, "vp");
+	if (*min_element(attributes, attributes + 4) == -1 || uniform_vp == -1) {
+		cerr << "Could not bind cube_instanced.v.glsl's attributes and uniform" << endl;
+		return false;
+	}
+	attribute_instance_position = attributes[2];
+	attribute_instance_rotation = attributes[3];
+	glGenBuffers(1, &vbo_instances);
+	add_vertex_attrib(&instanced_layout, attributes[0], vbo_cube, 3, GL_FLOAT, GL_FALSE,
+			  sizeof(struct attributes), offsetof(struct attributes, coord3d));
+	add_vertex_attrib(&instanced_layout, attributes[1], vbo_cube, 3, GL_FLOAT, GL_FALSE,
+			  sizeof(struct attributes), offsetof(struct attributes, v_color));
+	add_vertex_attrib(&instanced_layout, attributes[2], vbo_instances, 4, GL_FLOAT, GL_FALSE,
+			  sizeof(cube_instance), offsetof(cube_instance, position), 1);
+	add_vertex_attrib(&instanced_layout, attributes[3], vbo_instances, 4, GL_FLOAT, GL_FALSE,
+			  sizeof(cube_instance), offsetof(cube_instance, rotation), 1);
+	instanced_layout.element_buffer = ibo_cube;
+	build_vertex_layout(&instanced_layout);
+	return true;
+}
+
+void describe_cube(vertex_layout* layout) {
+	add_vertex_attrib(layout, attribute_coord3d, vbo_cube, 3, GL_FLOAT, GL_FALSE,
+			  sizeof(struct attributes), offsetof(struct attributes, coord3d));
+	add_vertex_attrib(layout, attribute_v_color, vbo_cube, 3, GL_FLOAT, GL_FALSE,
+			  sizeof(struct attributes), offsetof(struct attributes, v_color));
+	layout->element_buffer = ibo_cube;
+}
+
+/* Small tilted cubes on a square grid facing the camera */
+void build_cubes(int nb_cubes, glm::mat4 &vp, vector<cube_instance> &instances, vector<glm::mat4> &mvps) {
+	int side = 1;
+	while (side * side < nb_cubes)
+		side++;
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0, 0.0, 2.5), glm::vec3(0.0), glm::vec3(0.0, 1.0, 0.0));
+	vp = projection * view;
+	float scale = 1.0f / side;
+	instances.resize(nb_cubes);
+	mvps.resize(nb_cubes);
+	for (int i = 0; i < nb_cubes; i++) {
+		glm::vec3 position(((i % side) + 0.5f) * 2.0f * scale - 1.0f, ((i / side) + 0.5f) * 2.0f * scale - 1.0f, 0.0f);
+		float half_angle = i * 0.01f;
+		instances[i].position = glm::vec4(position, scale * 0.4f);
+		instances[i].rotation = glm::vec4(glm::normalize(glm::vec3(1, 1, 0)) * sinf(half_angle), cosf(half_angle));
+		mvps[i] = vp * instance_model(instances[i]);
+	}
+}
+
+void report(const char* name, double submit_ns, double frame_ns, size_t nb_cubes) {
+	double cubes = (double)nb_frames * nb_cubes;
+	cout << "  " << name << ": " << submit_ns / cubes << " ns/cube submitted, "
+	     << frame_ns / cubes << " ns/cube finished, "
+	     << frame_ns / nb_frames / 1e6 << " ms/frame" << endl;
+}
+
+/* Average CPU time to submit one draw, and to finish it */
+void run(const char* name, const vertex_layout* layout, gl_state* state, const vector<glm::mat4> &mvps) {
+	double submit_ns = 0, frame_ns = 0;
+	for (int frame = 0; frame <= nb_frames; frame++) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glFinish();
+		if (state != NULL)
+			gl_state_new_frame(state);
+		Uint64 start = SDL_GetPerformanceCounter();
+		for (size_t i = 0; i < mvps.size(); i++) {
+			bind_vertex_layout(layout, state);
+			glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE, glm::value_ptr(mvps[i]));
+			glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+			unbind_vertex_layout(layout, state);
+		}
+		Uint64 submitted = SDL_GetPerformanceCounter();
+		glFinish();
+		Uint64 finished = SDL_GetPerformanceCounter();
+		if (frame == 0)
+			continue;  // warm-up
+		double ns_per_tick = 1e9 / SDL_GetPerformanceFrequency();
+		submit_ns += (submitted - start) * ns_per_tick;
+		frame_ns += (finished - start) * ns_per_tick;
+	}
+	report(name, submit_ns, frame_ns, mvps.size());
+}
+
+/* Upload this frame's instances with glBufferData, or into 'ring',
+ * and draw them in one instanced call */
+void draw_instanced(const vector<cube_instance> &instances, ring_buffer* ring) {
+	size_t size = instances.size() * sizeof(cube_instance);
+	size_t offset = 0;
+	if (ring == NULL) {
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+		glBufferData(GL_ARRAY_BUFFER, size, instances.data(), GL_STREAM_DRAW);
+	} else {
+		ring_buffer_begin_frame(ring);
+		void* data = ring_buffer_alloc_vertices(ring, instances.size(), sizeof(cube_instance), &offset);
+		if (data != NULL)
+			memcpy(data, instances.data(), size);
+		ring_buffer_end_frame(ring);
+	}
+	bind_vertex_layout(&instanced_layout);
+	glBindBuffer(GL_ARRAY_BUFFER, ring == NULL ? vbo_instances : ring->buffer);
+	glVertexAttribPointer(attribute_instance_position, 4, GL_FLOAT, GL_FALSE, sizeof(cube_instance),
+			      (const GLvoid*) (offset + offsetof(cube_instance, position)));
+	glVertexAttribPointer(attribute_instance_rotation, 4, GL_FLOAT, GL_FALSE, sizeof(cube_instance),
+			      (const GLvoid*) (offset + offsetof(cube_instance, rotation)));
+	draw_elements_instanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, instances.size());
+	unbind_vertex_layout(&instanced_layout);
+}
+
+/* One instanced draw, uploading every instance each frame as if the
+ * cubes moved */
+void run_instanced(const char* name, const glm::mat4 &vp, const vector<cube_instance> &instances,
+		   ring_buffer* ring) {
+	glUseProgram(program_instanced);
+	glUniformMatrix4fv(uniform_vp, 1, GL_FALSE, glm::value_ptr(vp));
+	double submit_ns = 0, frame_ns = 0;
+	for (int frame = 0; frame <= nb_frames; frame++) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glFinish();
+		Uint64 start = SDL_GetPerformanceCounter();
+		draw_instanced(instances, ring);
+		Uint64 submitted = SDL_GetPerformanceCounter();
+		glFinish();
+		Uint64 finished = SDL_GetPerformanceCounter();
+		if (frame == 0)
+			continue;  // warm-up
+		double ns_per_tick = 1e9 / SDL_GetPerformanceFrequency();
+		submit_ns += (submitted - start) * ns_per_tick;
+		frame_ns += (finished - start) * ns_per_tick;
+	}
+	glUseProgram(program);
+	report(name, submit_ns, frame_ns, instances.size());
+}
+
+/* The same frames back to back, finishing only at the end: the GPU
+ * runs behind, and the ring waits when it falls three frames back */
+void run_streaming(const char* name, const glm::mat4 &vp, const vector<cube_instance> &instances,
+		   ring_buffer* ring) {
+	glUseProgram(program_instanced);
+	glUniformMatrix4fv(uniform_vp, 1, GL_FALSE, glm::value_ptr(vp));
+	unsigned stalls = ring != NULL ? ring->stalls : 0;
+	double stall_ms = ring != NULL ? ring->stall_ms : 0;
+	glFinish();
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int frame = 0; frame < nb_frames; frame++) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		draw_instanced(instances, ring);
+	}
+	glFinish();
+	double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+	glUseProgram(program);
+	cout << "  " << name << ", back to back: " << ms / nb_frames << " ms/frame";
+	if (ring != NULL)
+		cout << ", " << ring->stalls - stalls << " stalls, "
+		     << (ring->stall_ms - stall_ms) / nb_frames << " ms/frame waiting";
+	cout << endl;
+}
+
+int main(int argc, char* argv[]) {
+	vector<int> counts;
+	for (int i = 1; i < argc; i++) {
+		counts.push_back(atoi(argv[i]));
+		if (counts.back() <= 0) {
+			cerr << "Usage: " << argv[0] << " [cubes ...]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (counts.empty()) {
+		counts.push_back(1000);
+		counts.push_back(10000);
+		counts.push_back(100000);
+	}
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window* window = SDL_CreateWindow("draw_bench",
+		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600,
+		SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (window == NULL) {
+		cerr << "Error: can't create window: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+	if (SDL_GL_CreateContext(window) == NULL) {
+		cerr << "Error: SDL_GL_CreateContext: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	GLenum glew_status = glewInit();
+	if (glew_status != GLEW_OK) {
+		cerr << "Error: glewInit: " << glewGetErrorString(glew_status) << endl;
+		return EXIT_FAILURE;
+	}
+	if (!init_resources())
+		return EXIT_FAILURE;
+	glEnable(GL_DEPTH_TEST);
+	glUseProgram(program);
+
+	vertex_layout per_draw;
+	describe_cube(&per_draw);
+	build_vertex_layout(&per_draw, false);
+	vertex_layout recorded;
+	describe_cube(&recorded);
+	build_vertex_layout(&recorded, true);
+	gl_state state;
+
+	cout << glGetString(GL_RENDERER) << endl;
+	for (size_t c = 0; c < counts.size(); c++) {
+		// About a million cubes per run, at least 5 frames
+		nb_frames = max(5, min(20, 1000000 / counts[c]));
+		glm::mat4 vp;
+		vector<cube_instance> instances;
+		vector<glm::mat4> mvps;
+		build_cubes(counts[c], vp, instances, mvps);
+		cout << counts[c] << " cubes, " << nb_frames << " frames" << endl;
+
+		run("per-draw attribute setup", &per_draw, NULL, mvps);
+		gl_state_init(&state);
+		run("per-draw setup, state cache", &per_draw, &state, mvps);
+		if (recorded.vao != 0)
+			run("vertex array object", &recorded, NULL, mvps);
+		else
+			cout << "  vertex array objects: not available" << endl;
+		if (program_instanced == 0) {
+			cout << "  instanced arrays: not available" << endl;
+			continue;
+		}
+		run_instanced("instanced, glBufferData", vp, instances, NULL);
+		run_streaming("instanced, glBufferData", vp, instances, NULL);
+		ring_buffer_mode modes[] = { ring_persistent, ring_unsynchronized, ring_orphan };
+		for (int m = 0; m < 3; m++) {
+			if (best_ring_buffer_mode(modes[m]) != modes[m]) {
+				cout << "  " << ring_buffer_mode_name(modes[m]) << ": not available" << endl;
+				continue;
+			}
+			ring_buffer ring;
+			if (!init_ring_buffer(&ring, instances.size() * sizeof(cube_instance), modes[m]))
+				continue;
+			string name = string("instanced, ring with ") + ring_buffer_mode_name(ring.mode);
+			run_instanced(name.c_str(), vp, instances, &ring);
+			run_streaming(name.c_str(), vp, instances, &ring);
+			free_ring_buffer(&ring);
+		}
+	}
+
+	free_vertex_layout(&per_draw);
+	free_vertex_layout(&recorded);
+	glDeleteProgram(program);
+	if (program_instanced != 0) {
+		free_vertex_layout(&instanced_layout);
+		glDeleteProgram(program_instanced);
+		glDeleteBuffers(1, &vbo_instances);
+	}
+	glDeleteBuffers(1, &vbo_cube);
+	glDeleteBuffers(1, &ibo_cube);
+	return EXIT_SUCCESS;
+}
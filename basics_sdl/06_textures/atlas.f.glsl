@@ -0,0 +1,6 @@
+varying vec3 f_texcoord;
+uniform sampler2D mytexture;
+
+void main(void) {
+  gl_FragColor = texture2D(mytexture, f_texcoord.xy);
+}
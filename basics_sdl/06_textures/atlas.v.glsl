@@ -0,0 +1,8 @@
+attribute vec2 coord2d;
+attribute vec3 texcoord;
+varying vec3 f_texcoord;
+
+void main(void) {
+  gl_Position = vec4(coord2d, 0.0, 1.0);
+  f_texcoord = texcoord;
+}
@@ -0,0 +1,7 @@
+#extension GL_EXT_texture_array : enable
+varying vec3 f_texcoord;
+uniform sampler2DArray mytexture;
+
+void main(void) {
+  gl_FragColor = texture2DArray(mytexture, f_texcoord);
+}
@@ -0,0 +1,295 @@
+/* Many small images drawn as quads, each after binding its own
+ * texture, or packed by texture_atlas.h into atlas pages or into
+ * texture arrays by size, so that a page or an array takes one bind
+ * and one draw. Prints how full the pages are, binds and draws per
+ * frame, submit and frame times; all three must draw the same image.
+ * atlas_bench [images ...], 256 1024 4096 by default */
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+
+#include "../../common/bench.h"
+#include "../../common/shader_utils.h"
+#include "../../common/texture_atlas.h"
+
+const int width = 800, height = 600;
+const int max_page_size = 1024, padding = 2;
+
+int nb_frames;
+
+/* Images of a few sizes that fit a grid cell, each with its own color,
+ * a darker border and a diagonal, so that any texel off shows */
+void make_images(int nb_images, int cell, vector<atlas_image> &images, vector<vector<unsigned char> > &pixels) {
+	const int sizes[3] = { max(1, cell / 4), max(1, cell / 2), cell };
+	srand(1);
+	images.resize(nb_images);
+	pixels.resize(nb_images);
+	for (int i = 0; i < nb_images; i++) {
+		atlas_image &image = images[i];
+		image.width = sizes[rand() % 3];
+		image.height = sizes[rand() % 3];
+		unsigned char color[3] = { (unsigned char)(rand() % 256), (unsigned char)(rand() % 256),
+					   (unsigned char)(rand() % 256) };
+		pixels[i].resize((size_t)image.width * image.height * 4);
+		for (int y = 0; y < image.height; y++) {
+			for (int x = 0; x < image.width; x++) {
+				unsigned char* p = &pixels[i][((size_t)y * image.width + x) * 4];
+				bool border = x == 0 || y == 0 || x == image.width - 1 || y == image.height - 1;
+				bool diagonal = x * image.height == y * image.width;
+				for (int c = 0; c < 3; c++)
+					p[c] = border ? color[c] / 2 : diagonal ? 255 - color[c] : color[c];
+				p[3] = 255;
+			}
+		}
+	}
+}
+
+/* The quad of image 'i' in its grid cell at one texel per pixel, as
+ * two triangles of x, y, u, v, layer */
+void add_quad(int i, int side, int cell, const atlas_image &image, float layer, vector<float> &vertices) {
+	float x0 = (i % side) * cell, y0 = (i / side) * cell;
+	float x1 = x0 + image.width, y1 = y0 + image.height;
+	const float corners[6][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 0, 1 }, { 1, 0 }, { 1, 1 } };
+	for (int v = 0; v < 6; v++) {
+		float u = corners[v][0], t = corners[v][1];
+		vertices.push_back((x0 + u * (x1 - x0)) * 2.0f / width - 1.0f);
+		vertices.push_back((y0 + t * (y1 - y0)) * 2.0f / height - 1.0f);
+		vertices.push_back(u);
+		vertices.push_back(t);
+		vertices.push_back(layer);
+	}
+}
+
+GLuint make_texture(GLenum target) {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(target, texture);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return texture;
+}
+
+/* A run of quads drawn with one texture */
+struct draw_batch {
+	GLuint texture;
+	GLint first;     // in vertices
+	GLsizei count;
+};
+
+struct timing {
+	double submit_ms, frame_ms;
+	unsigned draw_calls;
+	unsigned long long checksum;
+};
+
+void report(const char* name, const timing &t, unsigned long long reference) {
+	cout << "  " << name << ": " << t.draw_calls << " binds and draw calls, "
+	     << t.submit_ms << " ms submitting, " << t.frame_ms << " ms/frame"
+	     << (t.checksum == reference ? "" : ", IMAGE DIFFERS") << endl;
+}
+
+/* Every batch of 'vertices', bound to 'target' */
+timing run(GLuint program, const vector<float> &vertices, GLenum target, const vector<draw_batch> &batches) {
+	GLuint vbo;
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glUseProgram(program);
+	GLint attribute_coord2d = glGetAttribLocation(program, "coord2d");
+	GLint attribute_texcoord = glGetAttribLocation(program, "texcoord");
+	glEnableVertexAttribArray(attribute_coord2d);
+	glEnableVertexAttribArray(attribute_texcoord);
+	glVertexAttribPointer(attribute_coord2d, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 0);
+	glVertexAttribPointer(attribute_texcoord, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(2 * sizeof(float)));
+
+	timing t = timing();
+	t.draw_calls = batches.size();
+	for (int frame = 0; frame <= nb_frames; frame++) {
+		glClear(GL_COLOR_BUFFER_BIT);
+		glFinish();
+		Uint64 start = SDL_GetPerformanceCounter();
+		for (size_t i = 0; i < batches.size(); i++) {
+			glBindTexture(target, batches[i].texture);
+			glDrawArrays(GL_TRIANGLES, batches[i].first, batches[i].count);
+		}
+		Uint64 submitted = SDL_GetPerformanceCounter();
+		glFinish();
+		Uint64 finished = SDL_GetPerformanceCounter();
+		if (frame == 0) {
+			t.checksum = frame_checksum(width, height);
+			continue;  // warm-up
+		}
+		double ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+		t.submit_ms += (submitted - start) * ms_per_tick / nb_frames;
+		t.frame_ms += (finished - start) * ms_per_tick / nb_frames;
+	}
+
+	glDisableVertexAttribArray(attribute_coord2d);
+	glDisableVertexAttribArray(attribute_texcoord);
+	glDeleteBuffers(1, &vbo);
+	return t;
+}
+
+void bench_images(int nb_images, GLuint program, GLuint array_program) {
+	int side = 1;
+	while (side * side < nb_images)
+		side++;
+	int cell = max(1, height / side);
+	vector<atlas_image> images;
+	vector<vector<unsigned char> > pixels;
+	make_images(nb_images, cell, images, pixels);
+	nb_frames = max(5, min(20, 20000 / nb_images));
+	size_t texels = 0;
+	for (int i = 0; i < nb_images; i++)
+		texels += (size_t)images[i].width * images[i].height;
+	cout << nb_images << " images of " << max(1, cell / 4) << " to " << cell << " texels a side, "
+	     << (texels * 4 >> 10) << " KB, " << nb_frames << " frames" << endl;
+
+	// A texture per image
+	vector<float> vertices;
+	vector<draw_batch> batches;
+	vector<GLuint> textures(nb_images);
+	for (int i = 0; i < nb_images; i++) {
+		textures[i] = make_texture(GL_TEXTURE_2D);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, images[i].width, images[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+			     pixels[i].data());
+		draw_batch batch = { textures[i], (GLint)vertices.size() / 5, 6 };
+		add_quad(i, side, cell, images[i], 0, vertices);
+		batches.push_back(batch);
+	}
+	timing separate = run(program, vertices, GL_TEXTURE_2D, batches);
+	report("texture per image", separate, separate.checksum);
+	glDeleteTextures(nb_images, textures.data());
+
+	// Atlas pages, the quads sorted by page with their UVs rewritten.
+	// Pages are as small as holds the images on one, up to the largest.
+	texture_atlas atlas;
+	int page_size = 64;
+	while (page_size < max_page_size && page_size < cell + 2 * padding)
+		page_size *= 2;
+	bool packed;
+	while (!(packed = pack_atlas(images, page_size, padding, &atlas)) || atlas.nb_pages > 1) {
+		if (page_size == max_page_size)
+			break;
+		page_size *= 2;
+	}
+	if (packed) {
+		vector<const unsigned char*> sources(nb_images);
+		for (int i = 0; i < nb_images; i++)
+			sources[i] = pixels[i].data();
+		vertices.clear();
+		batches.clear();
+		textures.resize(atlas.nb_pages);
+		for (int page = 0; page < atlas.nb_pages; page++) {
+			vector<unsigned char> page_pixels;
+			atlas_page_pixels(&atlas, page, sources, 4, page_pixels);
+			textures[page] = make_texture(GL_TEXTURE_2D);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, page_size, page_size, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+				     page_pixels.data());
+			draw_batch batch = { textures[page], (GLint)vertices.size() / 5, 0 };
+			for (int i = 0; i < nb_images; i++) {
+				if (atlas.entries[i].page != page)
+					continue;
+				size_t first = vertices.size();
+				add_quad(i, side, cell, images[i], 0, vertices);
+				atlas_remap_uvs(&atlas, i, &vertices[first + 2], 6, 5);
+				batch.count += 6;
+			}
+			batches.push_back(batch);
+		}
+		cout << "  atlas: " << atlas.nb_pages << " pages of " << page_size << ", " << 100 * atlas_efficiency(&atlas)
+		     << "% of their texels hold images, "
+		     << 100 * atlas_efficiency(&atlas) * atlas.padded_texels / atlas.image_texels << "% with padding" << endl;
+		report("atlas", run(program, vertices, GL_TEXTURE_2D, batches), separate.checksum);
+		glDeleteTextures(atlas.nb_pages, textures.data());
+	}
+
+	// Arrays of the images of each size, the layer along with the UVs
+	if (array_program == 0) {
+		cout << "  texture arrays: not available" << endl;
+		return;
+	}
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	texture_array_layout layout;
+	group_texture_arrays(images, max_layers, &layout);
+	vertices.clear();
+	batches.clear();
+	textures.resize(layout.groups.size());
+	for (size_t g = 0; g < layout.groups.size(); g++) {
+		const texture_array_group &group = layout.groups[g];
+		textures[g] = make_texture(GL_TEXTURE_2D_ARRAY);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, group.width, group.height, group.images.size(), 0, GL_RGBA,
+			     GL_UNSIGNED_BYTE, NULL);
+		draw_batch batch = { textures[g], (GLint)vertices.size() / 5, 0 };
+		for (size_t layer = 0; layer < group.images.size(); layer++) {
+			int i = group.images[layer];
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, group.width, group.height, 1, GL_RGBA,
+					GL_UNSIGNED_BYTE, pixels[i].data());
+			add_quad(i, side, cell, images[i], layer, vertices);
+			batch.count += 6;
+		}
+		batches.push_back(batch);
+	}
+	cout << "  texture arrays: " << layout.groups.size() << " arrays of up to " << max_layers << " layers" << endl;
+	report("texture arrays", run(array_program, vertices, GL_TEXTURE_2D_ARRAY, batches), separate.checksum);
+	glDeleteTextures(layout.groups.size(), textures.data());
+}
+
+int main(int argc, char* argv[]) {
+	vector<int> counts;
+	for (int i = 1; i < argc; i++) {
+		counts.push_back(atoi(argv[i]));
+		if (counts.back() <= 0 || counts.back() > height * height) {
+			cerr << "Usage: " << argv[0] << " [images ...]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (counts.empty()) {
+		counts.push_back(256);
+		counts.push_back(1024);
+		counts.push_back(4096);
+	}
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window* window = SDL_CreateWindow("atlas_bench",
+		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height,
+		SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (window == NULL) {
+		cerr << "Error: can't create window: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	if (SDL_GL_CreateContext(window) == NULL) {
+		cerr << "Error: SDL_GL_CreateContext: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	GLenum glew_status = glewInit();
+	if (glew_status != GLEW_OK) {
+		cerr << "Error: glewInit: " << glewGetErrorString(glew_status) << endl;
+		return EXIT_FAILURE;
+	}
+
+	GLuint program = create_program("atlas.v.glsl", "atlas.f.glsl");
+	if (program == 0)
+		return EXIT_FAILURE;
+	GLuint array_program = 0;
+	if (GLEW_VERSION_3_0 || GLEW_EXT_texture_array)
+		array_program = create_program("atlas.v.glsl", "atlas_array.f.glsl");
+	glClearColor(0.0, 0.0, 0.0, 1.0);
+
+	cout << glGetString(GL_RENDERER) << endl;
+	for (size_t c = 0; c < counts.size(); c++)
+		bench_images(counts[c], program, array_program);
+
+	glDeleteProgram(program);
+	if (array_program != 0)
+		glDeleteProgram(array_program);
+	return EXIT_SUCCESS;
+}
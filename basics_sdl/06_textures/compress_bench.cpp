@@ -0,0 +1,171 @@
+/* compress_image's BC1, BC3 and BC7 encoders on a photo-like image:
+ * megapixels per second on the scalar, SIMD and threaded paths, the
+ * PSNR once the driver decodes the blocks (where it has S3TC and
+ * BPTC), and the GPU bytes of a full mipmap chain next to RGBA8.
+ * compress_bench [size ...], 1024 2048 by default */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "../../common/bench.h"
+#include "../../common/block_compress.h"
+#include "../../common/ktx2.h"
+#include "../../common/mipmaps.h"
+#include "../../common/texture_loader.h"
+
+/* Smooth gradients and soft rings with some grain, closer to a photo
+ * than mip_bench's checkerboard: what block compression is made for */
+void make_image(int size, vector<unsigned char> &pixels) {
+	srand(1);
+	pixels.resize((size_t)size * size * 4);
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			unsigned char* p = &pixels[((size_t)y * size + x) * 4];
+			float u = (float)x / size, v = (float)y / size;
+			float ring = 0.5f + 0.5f * sinf(40.0f * sqrtf((u - 0.5f) * (u - 0.5f) + (v - 0.5f) * (v - 0.5f)));
+			p[0] = (unsigned char)min(255.0f, 200.0f * u + 40.0f * ring + rand() % 8);
+			p[1] = (unsigned char)min(255.0f, 180.0f * v + 60.0f * ring + rand() % 8);
+			p[2] = (unsigned char)min(255.0f, 120.0f * (1 - u) + 120.0f * ring + rand() % 8);
+			p[3] = (unsigned char)(255.0f * (0.25f + 0.75f * ring));
+		}
+	}
+}
+
+/* The PSNR in dB of 'decoded' RGBA pixels against 'pixels', over the
+ * first 'channels' channels */
+double psnr(const vector<unsigned char> &pixels, const vector<unsigned char> &decoded, int channels) {
+	double error = 0;
+	size_t count = 0;
+	for (size_t i = 0; i < pixels.size(); i += 4) {
+		for (int c = 0; c < channels; c++) {
+			double d = (double)pixels[i + c] - decoded[i + c];
+			error += d * d;
+			count++;
+		}
+	}
+	return error == 0 ? 99.0 : 10 * log10(255.0 * 255.0 * count / error);
+}
+
+/* The driver's decoding of 'blocks' to RGBA, false where it has no
+ * such format */
+bool gl_decode(ktx2_format format, int size, const vector<unsigned char> &blocks, vector<unsigned char> &decoded) {
+	GLenum pixel_format;
+	GLenum internal_format = texture_gl_format(format, &pixel_format);
+	if (internal_format == GL_COMPRESSED_RGBA_BPTC_UNORM
+	    ? !texture_loader_has_extension("GL_ARB_texture_compression_bptc")
+	    : !texture_loader_has_extension("GL_EXT_texture_compression_s3tc"))
+		return false;
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glCompressedTexImage2D(GL_TEXTURE_2D, 0, internal_format, size, size, 0, blocks.size(), blocks.data());
+	decoded.resize((size_t)size * size * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, decoded.data());
+	glDeleteTextures(1, &texture);
+	return glGetError() == GL_NO_ERROR;
+}
+
+void bench_size(int size) {
+	vector<unsigned char> rgba, rgb;
+	make_image(size, rgba);
+	rgb.resize((size_t)size * size * 3);
+	for (size_t i = 0; i < (size_t)size * size; i++)
+		copy(&rgba[i * 4], &rgba[i * 4 + 3], &rgb[i * 3]);
+	int nb_runs = max(1, 2048 / size);
+	double mpix = (double)size * size / 1e6;
+	cout << size << " x " << size << ", best of " << nb_runs << endl;
+
+	const block_format formats[] = { block_bc1, block_bc3, block_bc7 };
+	const ktx2_format gl_formats[] = { ktx2_bc1_rgb_unorm, ktx2_bc3_unorm, ktx2_bc7_unorm };
+	for (int f = 0; f < 3; f++) {
+		block_format format = formats[f];
+		int channels = format == block_bc1 ? 3 : 4;
+		const unsigned char* pixels = channels == 3 ? rgb.data() : rgba.data();
+		vector<unsigned char> reference(compressed_size(format, size, size)), blocks(reference.size());
+		double scalar_ms = best_of(nb_runs, [&] {
+			compress_image_scalar(pixels, size, size, channels, format, reference.data());
+		});
+		double simd_ms = best_of(nb_runs, [&] {
+			compress_image(pixels, size, size, channels, format, blocks.data(), 1);
+		});
+		size_t simd_differences = 0;
+		for (size_t i = 0; i < blocks.size(); i += block_bytes(format))
+			simd_differences += !equal(&blocks[i], &blocks[i] + block_bytes(format), &reference[i]);
+		double threaded_ms = best_of(nb_runs, [&] {
+			compress_image(pixels, size, size, channels, format, blocks.data());
+		});
+		cout << "  " << block_format_name(format) << ": scalar " << mpix * 1000 / scalar_ms << " MPix/s, SIMD "
+		     << mpix * 1000 / simd_ms << " MPix/s (" << simd_differences << " blocks differ), SIMD and "
+		     << thread::hardware_concurrency() << " cores " << mpix * 1000 / threaded_ms << " MPix/s";
+		vector<unsigned char> decoded;
+		if (gl_decode(gl_formats[f], size, blocks, decoded))
+			cout << ", PSNR " << psnr(rgba, decoded, channels) << " dB";
+		else
+			cout << ", not decoded by this driver";
+		cout << endl;
+	}
+
+	mip_chain chain;
+	build_mip_chain(rgba.data(), size, size, 4, false, mip_box, &chain);
+	size_t rgba_bytes = chain.pixels.size();
+	ktx2_texture bc1, bc7;
+	compress_mip_chain(&chain, block_bc1, &bc1);
+	compress_mip_chain(&chain, block_bc7, &bc7);
+	cout << "  Mipmap chain on the GPU: RGBA8 " << (rgba_bytes >> 10) << " KB, BC1 " << (bc1.data.size() >> 10)
+	     << " KB, BC3 and BC7 " << (bc7.data.size() >> 10) << " KB" << endl;
+}
+
+int main(int argc, char* argv[]) {
+	vector<int> sizes;
+	for (int i = 1; i < argc; i++) {
+		sizes.push_back(atoi(argv[i]));
+		if (sizes.back() < 4) {
+			cerr << "Usage: " << argv[0] << " [size ...]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (sizes.empty()) {
+		sizes.push_back(1024);
+		sizes.push_back(2048);
+	}
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window* window = SDL_CreateWindow("compress_bench",
+		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 640, 480,
+		SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (window == NULL) {
+		cerr << "Error: can't create window: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	if (SDL_GL_CreateContext(window) == NULL) {
+		cerr << "Error: SDL_GL_CreateContext: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	GLenum glew_status = glewInit();
+	if (glew_status != GLEW_OK) {
+		cerr << "Error: glewInit: " << glewGetErrorString(glew_status) << endl;
+		return EXIT_FAILURE;
+	}
+
+#if defined(__AVX2__)
+	cout << "SIMD: AVX2, 8 floats at a time" << endl;
+#elif defined(__SSE2__)
+	cout << "SIMD: SSE2, 4 floats at a time" << endl;
+#else
+	cout << "SIMD: none, the scalar encoder twice" << endl;
+#endif
+	cout << glGetString(GL_RENDERER) << endl;
+	for (size_t i = 0; i < sizes.size(); i++)
+		bench_size(sizes[i]);
+	return EXIT_SUCCESS;
+}
@@ -15,6 +15,8 @@ using namespace std;
 #include <SDL2/SDL_image.h>
 
 #include "../../common/shader_utils.h"
+#include "../../common/texture_loader.h"
+#include "../../common/vertex_layout.h"
 
 /* GLM */
 // #define GLM_MESSAGES
@@ -26,9 +28,12 @@ int screen_width=800, screen_height=600;
 GLuint vbo_cube_vertices, vbo_cube_texcoords;
 GLuint ibo_cube_elements;
 GLuint program;
-GLuint texture_id;
+texture_loader textures;
+int texture_handle;
 GLint attribute_coord3d, attribute_texcoord;
 GLint uniform_mvp, uniform_mytexture;
+vertex_layout cube_layout;
+gl_state state;
 
 bool init_resources() {
 	GLfloat cube_vertices[] = {
@@ -104,24 +109,15 @@ bool init_resources() {
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_cube_elements);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_elements), cube_elements, GL_STATIC_DRAW);
 
-	SDL_Surface* res_texture = IMG_Load("res_texture.png");
-	if (res_texture == NULL) {
-		cerr << "IMG_Load: " << SDL_GetError() << endl;
+	/* Decoded on a worker thread and uploaded by render(), the
+	 * placeholder drawn meanwhile. OpenGL 2.0 has no glGenerateMipmap:
+	 * the worker builds the mipmaps, averaging in linear light, and
+	 * compresses them (BC7, or BC3 without BPTC, this image has alpha)
+	 * where the context has S3TC. */
+	if (!init_texture_loader(&textures, sdl_decode_image))
 		return false;
-	}
-	glGenTextures(1, &texture_id);
-	glBindTexture(GL_TEXTURE_2D, texture_id);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D,	// target
-		0,			// level, 0 = base, no minimap,
-		GL_RGBA,		// internalformat
-		res_texture->w,		// width
-		res_texture->h,		// height
-		0,			// border, always 0 in OpenGL ES
-		GL_RGBA,		// format
-		GL_UNSIGNED_BYTE,	// type
-		res_texture->pixels);
-	SDL_FreeSurface(res_texture);
+	enable_texture_compression(&textures);
+	texture_handle = request_texture(&textures, "res_texture.png", texture_mipmaps_box);
 
 	GLint link_ok = GL_FALSE;
 	
@@ -166,6 +162,12 @@ bool init_resources() {
 		cerr << "Could not bind uniform " << uniform_name << endl;
 		return false;
 	}
+
+	/* Recorded in a vertex array object when the context has them */
+	add_vertex_attrib(&cube_layout, attribute_coord3d, vbo_cube_vertices, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	add_vertex_attrib(&cube_layout, attribute_texcoord, vbo_cube_texcoords, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	cube_layout.element_buffer = ibo_cube_elements;
+	build_vertex_layout(&cube_layout);
 	
 	return true;
 }
@@ -182,65 +184,59 @@ void logic() {
 	glm::mat4 projection = glm::perspective(45.0f, 1.0f*screen_width/screen_height, 0.1f, 10.0f);
 	
 	glm::mat4 mvp = projection * view * model * anim;
-	glUseProgram(program);
+	gl_use_program(&state, program);
 	glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
 }
 
 void render(SDL_Window* window) {
+	gl_state_new_frame(&state);
+	static gl_state_counters printed = { 0, 0 };
+	if (state.last_frame.issued != printed.issued || state.last_frame.elided != printed.elided) {
+		printed = state.last_frame;
+		cout << "GL state calls per frame: " << printed.issued << " issued, "
+		     << printed.elided << " elided" << endl;
+	}
+
 	glClearColor(1.0, 1.0, 1.0, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 	
-	glUseProgram(program);
+	/* Pixels decoded since the last frame, up to the budget */
+	if (texture_loader_update(&textures) > 0 && texture_loader_queue_depth(&textures) == 0)
+		cout << "Textures ready: " << textures.ready << " loaded, " << textures.failed << " failed, "
+		     << texture_loader_upload_rate(&textures) << " MB/s uploading with "
+		     << texture_upload_path_name(textures.path) << ", " << (textures.resident.bytes >> 10) << " KB on the GPU ("
+		     << 100 * textures.resident.bytes / max<size_t>(textures.resident.uncompressed, 1) << "% of uncompressed)"
+		     << endl;
+
+	/* Everything below is the same from frame to frame: the state
+	 * cache only lets the changes through */
+	gl_use_program(&state, program);
 	
-	glActiveTexture(GL_TEXTURE0);
 	glUniform1i(uniform_mytexture, /*GL_TEXTURE*/0);
-	glBindTexture(GL_TEXTURE_2D, texture_id);
-	
-	glEnableVertexAttribArray(attribute_coord3d);
-	// Describe our vertices array to OpenGL (it can't guess its format automatically)
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_cube_vertices);
-	glVertexAttribPointer(
-		  attribute_coord3d, // attribute
-		  3,                 // number of elements per vertex, here (x,y,z)
-		  GL_FLOAT,          // the type of each element
-		  GL_FALSE,          // take our values as-is
-		  0,                 // no extra data between each position
-		  0                  // offset of first element
-	);
-	
-	glEnableVertexAttribArray(attribute_texcoord);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_cube_texcoords);
-	glVertexAttribPointer(
-		attribute_texcoord, // attribute
-		2,                  // number of elements per vertex, here (x,y)
-		GL_FLOAT,           // the type of each element
-		GL_FALSE,           // take our values as-is
-		0,                  // no extra data between each position
-		0                   // offset of first element
-	);
+	gl_bind_texture(&state, 0, GL_TEXTURE_2D, texture_loader_texture(&textures, texture_handle));
 	
 	/* Push each element in buffer_vertices to the vertex shader */
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_cube_elements);
+	bind_vertex_layout(&cube_layout, &state);
 	int size;  glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
 	glDrawElements(GL_TRIANGLES, size/sizeof(GLushort), GL_UNSIGNED_SHORT, 0);
 	
-	glDisableVertexAttribArray(attribute_coord3d);
-	glDisableVertexAttribArray(attribute_texcoord);
+	// The layout stays bound: this program is the only one drawing
 	SDL_GL_SwapWindow(window);
 }
 
 void onResize(int width, int height) {
 	screen_width = width;
 	screen_height = height;
-	glViewport(0, 0, screen_width, screen_height);
+	gl_set_viewport(&state, 0, 0, screen_width, screen_height);
 }
 
 void free_resources() {
 	glDeleteProgram(program);
+	free_vertex_layout(&cube_layout);
 	glDeleteBuffers(1, &vbo_cube_vertices);
 	glDeleteBuffers(1, &vbo_cube_texcoords);
 	glDeleteBuffers(1, &ibo_cube_elements);
-	glDeleteTextures(1, &texture_id);
+	free_texture_loader(&textures);
 }
 
 void mainLoop(SDL_Window* window) {
@@ -288,10 +284,10 @@ int main(int argc, char* argv[]) {
 
 	if (!init_resources())
 		return EXIT_FAILURE;
+	gl_state_init(&state);
 	
-    glEnable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_set_blend(&state, true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_set_depth(&state, true);
 
     mainLoop(window);
 
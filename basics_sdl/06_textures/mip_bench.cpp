@@ -0,0 +1,168 @@
+/* build_mip_chain, box and Kaiser, on the scalar, SIMD and threaded
+ * paths, next to glGenerateMipmap, with how far each strays from the
+ * scalar chain in 8-bit codes and how far the driver's level 1 is
+ * from the box filter done in linear light. Last, reading
+ * res_texture.png.ktx2 back is timed against decoding and building
+ * the chain again.
+ * mip_bench [size ...], 1024 2048 4096 by default */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "../../common/bench.h"
+#include "../../common/ktx2.h"
+#include "../../common/mipmaps.h"
+#include "../../common/texture_loader.h"
+
+/* A fine checkerboard in red, a ramp in green, noise in blue and
+ * alpha fading down: detail that filters differently in each space */
+void make_image(int size, vector<unsigned char> &pixels) {
+	srand(1);
+	pixels.resize((size_t)size * size * 4);
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			unsigned char* p = &pixels[((size_t)y * size + x) * 4];
+			p[0] = ((x ^ y) & 1) * 255;
+			p[1] = x * 255 / (size - 1);
+			p[2] = rand() % 256;
+			p[3] = 255 - y * 255 / (size - 1);
+		}
+	}
+}
+
+int max_difference(const unsigned char* a, const unsigned char* b, size_t size) {
+	int difference = 0;
+	for (size_t i = 0; i < size; i++)
+		difference = max(difference, abs(a[i] - b[i]));
+	return difference;
+}
+
+void bench_size(int size) {
+	vector<unsigned char> pixels;
+	make_image(size, pixels);
+	int nb_runs = max(1, 4096 / size);
+	cout << size << " x " << size << " RGBA, best of " << nb_runs << endl;
+
+	mip_chain box_srgb;
+	for (int f = 0; f < 2; f++) {
+		mip_filter filter = f == 0 ? mip_box : mip_kaiser;
+		mip_chain reference, chain;
+		double scalar_ms = best_of(nb_runs, [&] {
+			build_mip_chain_scalar(pixels.data(), size, size, 4, true, filter, &reference);
+		});
+		double simd_ms = best_of(nb_runs, [&] {
+			build_mip_chain(pixels.data(), size, size, 4, true, filter, &chain, 1);
+		});
+		int simd_difference = max_difference(chain.pixels.data(), reference.pixels.data(), chain.pixels.size());
+		double threaded_ms = best_of(nb_runs, [&] {
+			build_mip_chain(pixels.data(), size, size, 4, true, filter, &chain);
+		});
+		int threaded_difference = max_difference(chain.pixels.data(), reference.pixels.data(), chain.pixels.size());
+		cout << "  " << mip_filter_name(filter) << ", sRGB: scalar " << scalar_ms << " ms, SIMD "
+		     << simd_ms << " ms (difference " << simd_difference << "), SIMD and "
+		     << thread::hardware_concurrency() << " cores " << threaded_ms << " ms (difference " << threaded_difference
+		     << "), " << chain.levels.size() << " levels" << endl;
+		if (filter == mip_box)
+			box_srgb = chain;
+	}
+
+	if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object) {
+		cout << "  glGenerateMipmap: not available" << endl;
+		return;
+	}
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	glFinish();
+	double gpu_ms = best_of(nb_runs, [&] {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glFinish();
+	});
+	const mip_level &level = box_srgb.levels[1];
+	vector<unsigned char> level1((size_t)level.width * level.height * 4);
+	glGetTexImage(GL_TEXTURE_2D, 1, GL_RGBA, GL_UNSIGNED_BYTE, level1.data());
+	cout << "  glGenerateMipmap: " << gpu_ms << " ms, level 1 off the linear-light box by up to "
+	     << max_difference(level1.data(), &box_srgb.pixels[level.offset], level1.size()) << endl;
+	glDeleteTextures(1, &texture);
+}
+
+/* Reading the .ktx2 file back against decoding and building again */
+void bench_cache() {
+	const char* image_file = "res_texture.png";
+	string cache_file = string(image_file) + ".ktx2";
+	decoded_image image;
+	mip_chain built;
+	double build_ms = best_of(5, [&] {
+		sdl_decode_image(image_file, &image);
+		build_mip_chain(image.pixels.data(), image.width, image.height, image.channels, true, mip_box, &built);
+	});
+	vector<unsigned char> pixels = built.pixels;
+	ktx2_texture written, loaded;
+	ktx2_from_mip_chain(&built, &written);
+	if (!ktx2_set_source(&written, image_file) || !write_ktx2(cache_file.c_str(), &written)) {
+		cerr << "Could not write " << cache_file << endl;
+		return;
+	}
+	bool valid = true;
+	double load_ms = best_of(5, [&] {
+		valid = read_ktx2(cache_file.c_str(), &loaded) && ktx2_matches_source(&loaded, image_file) && valid;
+	});
+	cout << image_file << ": decoded and built in " << build_ms << " ms, read from " << cache_file << " in "
+	     << load_ms << " ms" << (valid && loaded.data == pixels ? "" : ", CACHE DIFFERS") << endl;
+}
+
+int main(int argc, char* argv[]) {
+	vector<int> sizes;
+	for (int i = 1; i < argc; i++) {
+		sizes.push_back(atoi(argv[i]));
+		if (sizes.back() < 2) {
+			cerr << "Usage: " << argv[0] << " [size ...]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (sizes.empty()) {
+		sizes.push_back(1024);
+		sizes.push_back(2048);
+		sizes.push_back(4096);
+	}
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window* window = SDL_CreateWindow("mip_bench",
+		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 640, 480,
+		SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (window == NULL) {
+		cerr << "Error: can't create window: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	if (SDL_GL_CreateContext(window) == NULL) {
+		cerr << "Error: SDL_GL_CreateContext: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	GLenum glew_status = glewInit();
+	if (glew_status != GLEW_OK) {
+		cerr << "Error: glewInit: " << glewGetErrorString(glew_status) << endl;
+		return EXIT_FAILURE;
+	}
+
+#if defined(__AVX2__)
+	cout << "SIMD: AVX2, 8 floats at a time" << endl;
+#elif defined(__SSE2__)
+	cout << "SIMD: SSE2, 4 floats at a time" << endl;
+#else
+	cout << "SIMD: none, the scalar build twice" << endl;
+#endif
+	cout << glGetString(GL_RENDERER) << endl;
+	for (size_t i = 0; i < sizes.size(); i++)
+		bench_size(sizes[i]);
+	bench_cache();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+/* The texture loader's GPU memory budget at work: copies of
+ * res_texture.png with CPU mipmaps, a window of them drawn each frame
+ * as it slides to the last one and back, the budget a share of what
+ * they all take. Each walk prints hits, misses, levels dropped,
+ * textures evicted, peak resident bytes and the longest
+ * texture_loader_update. The first texture must hold the levels it
+ * kept while reduced, and all of them once drawn again.
+ * residency_bench [textures [budget_percent [evict_after]]], 64 25 30 by default */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "../../common/bench.h"
+#include "../../common/texture_loader.h"
+
+const char* image_file = "res_texture.png";
+const int window_size = 8;      // textures drawn each frame
+const int frames_per_step = 10; // before the window moves by one
+
+/* Whether 'texture' starts at level 'level' and holds that level of
+ * 'chain' there */
+bool holds_level(GLuint texture, const mip_chain &chain, int level) {
+	const mip_level &expected = chain.levels[level];
+	GLint base_level = 0, width = 0, height = 0;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &base_level);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+	if (base_level != level || width != expected.width || height != expected.height)
+		return false;
+	vector<unsigned char> pixels((size_t)width * height * chain.channels);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, level, chain.channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return equal(pixels.begin(), pixels.end(), chain.pixels.begin() + expected.offset);
+}
+
+struct walk_totals {
+	unsigned long long hits, misses, dropped, evicted;
+	size_t peak_bytes;
+	int frames_over_budget;
+	double longest_update_ms;
+};
+
+/* The window from texture 'from' to 'to', one step every
+ * frames_per_step frames, then until every texture in it is whole */
+walk_totals walk(texture_loader* loader, const vector<int> &handles, int from, int to) {
+	walk_totals totals = walk_totals();
+	int step = to >= from ? 1 : -1;
+	for (int first = from, frame = 0; ; frame++) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		texture_loader_update(loader);
+		totals.longest_update_ms = max(totals.longest_update_ms, ms_since(start));
+		totals.hits += loader->last_frame.hits;
+		totals.misses += loader->last_frame.misses;
+		totals.dropped += loader->last_frame.dropped;
+		totals.evicted += loader->last_frame.evicted;
+		totals.peak_bytes = max(totals.peak_bytes, loader->resident.bytes);
+		totals.frames_over_budget += loader->resident.bytes > loader->vram_budget;
+
+		bool whole = true;
+		for (int i = first; i < first + window_size; i++) {
+			glBindTexture(GL_TEXTURE_2D, texture_loader_texture(loader, handles[i]));
+			const texture_request &r = loader->requests[handles[i]];
+			whole = whole && r.status == texture_ready && r.dropped_levels == 0;
+		}
+		if (first == to && whole)
+			break;
+		if (first != to && frame % frames_per_step == frames_per_step - 1)
+			first += step;
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	return totals;
+}
+
+void report(const char* name, const walk_totals &t, const texture_loader* loader) {
+	cout << "  " << name << ": " << t.hits << " hits, " << t.misses << " misses, " << t.dropped
+	     << " levels dropped, " << t.evicted << " textures evicted; peak " << (t.peak_bytes >> 10) << " KB, "
+	     << t.frames_over_budget << " frames over the budget, longest update " << t.longest_update_ms << " ms, "
+	     << (loader->resident.bytes >> 10) << " KB at the end" << endl;
+}
+
+int main(int argc, char* argv[]) {
+	int nb_textures = argc > 1 ? atoi(argv[1]) : 64;
+	int budget_percent = argc > 2 ? atoi(argv[2]) : 25;
+	int evict_after = argc > 3 ? atoi(argv[3]) : 30;
+	if (nb_textures < window_size || budget_percent <= 0 || evict_after < 0) {
+		cerr << "Usage: " << argv[0] << " [textures [budget_percent [evict_after]]]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window* window = SDL_CreateWindow("residency_bench",
+		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 640, 480,
+		SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (window == NULL) {
+		cerr << "Error: can't create window: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	if (SDL_GL_CreateContext(window) == NULL) {
+		cerr << "Error: SDL_GL_CreateContext: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	GLenum glew_status = glewInit();
+	if (glew_status != GLEW_OK) {
+		cerr << "Error: glewInit: " << glewGetErrorString(glew_status) << endl;
+		return EXIT_FAILURE;
+	}
+	cout << glGetString(GL_RENDERER) << endl;
+
+	// The chain every copy should hold, and its .ktx2 file written
+	// once before the workers all read it
+	decoded_image image;
+	if (!sdl_decode_image(image_file, &image)) {
+		cerr << "IMG_Load: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	mip_chain chain;
+	build_mip_chain(image.pixels.data(), image.width, image.height, image.channels, true, mip_box, &chain);
+	texture_loader loader;
+	init_texture_loader(&loader, sdl_decode_image);
+	vector<int> handles(1, request_texture(&loader, image_file, texture_mipmaps_box));
+	while (loader.ready + loader.failed == 0) {
+		texture_loader_update(&loader);
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	for (int i = 1; i < nb_textures; i++)
+		handles.push_back(request_texture(&loader, image_file, texture_mipmaps_box));
+	size_t texture_bytes = loader.resident.bytes;
+	loader.vram_budget = texture_bytes * nb_textures * budget_percent / 100;
+	loader.evict_after = evict_after;
+	cout << nb_textures << " textures of " << (texture_bytes >> 10) << " KB, " << window_size
+	     << " drawn each frame, budget " << (loader.vram_budget >> 10) << " KB, evicted after " << evict_after
+	     << " frames unused" << endl;
+
+	report("walk out", walk(&loader, handles, 0, nb_textures - window_size), &loader);
+	const texture_request &first = loader.requests[handles[0]];
+	bool reduced_ok = first.status == texture_evicted
+		|| holds_level(first.texture, chain, first.dropped_levels);
+	cout << "  first texture: " << (first.status == texture_evicted ? "evicted" : "resident") << ", "
+	     << first.dropped_levels << " levels dropped" << (reduced_ok ? "" : ", LEVELS DIFFER") << endl;
+
+	report("walk back", walk(&loader, handles, nb_textures - window_size, 0), &loader);
+	bool reloaded_ok = first.status == texture_ready && first.dropped_levels == 0
+		&& holds_level(first.texture, chain, 0);
+	cout << "  first texture: " << (reloaded_ok ? "whole again" : "NOT RESTORED") << endl;
+
+	free_texture_loader(&loader);
+	return reduced_ok && reloaded_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,139 @@
+/* Time to the first frame with many textures to load. cube decodes
+ * and uploads each with IMG_Load and glTexImage2D before drawing;
+ * the texture loader decodes them on workers and uploads under a
+ * byte budget per frame, on each of its upload paths, while frames go
+ * on. Also prints the longest frame, the time until all are ready
+ * and the upload rate, and compares the pixels. The last runs build
+ * mipmaps on the workers, then read them from res_texture.png.ktx2.
+ * texture_bench [textures [workers [budget_kb]]], 200 0 4096 by default */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "../../common/bench.h"
+#include "../../common/texture_loader.h"
+
+const char* image_file = "res_texture.png";
+
+/* Sum of a texture's pixels, to compare the ways of loading it */
+unsigned long long texture_checksum(GLuint texture) {
+	GLint width = 0, height = 0;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	vector<unsigned char> pixels(width * height * 4);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	unsigned long long sum = 0;
+	for (size_t i = 0; i < pixels.size(); i++)
+		sum += pixels[i] * (i % 251 + 1);
+	return sum;
+}
+
+/* Everything before the first frame */
+double load_synchronously(int nb_textures, vector<GLuint> &textures) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	textures.resize(nb_textures);
+	glGenTextures(nb_textures, textures.data());
+	for (int i = 0; i < nb_textures; i++) {
+		decoded_image image;
+		if (!sdl_decode_image(image_file, &image)) {
+			cerr << "IMG_Load: " << SDL_GetError() << endl;
+			continue;
+		}
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+			     image.pixels.data());
+	}
+	glFinish();
+	return ms_since(start);
+}
+
+/* Requests, then 60 Hz frames until every texture is ready */
+void load_in_background(int nb_textures, int nb_workers, size_t budget, texture_upload_path path,
+			texture_mipmaps mipmaps, unsigned long long reference) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	texture_loader loader;
+	init_texture_loader(&loader, sdl_decode_image, nb_workers, budget, path);
+	vector<int> handles(nb_textures);
+	for (int i = 0; i < nb_textures; i++)
+		handles[i] = request_texture(&loader, image_file, mipmaps);
+	double first_frame_ms = ms_since(start);
+	size_t peak_depth = texture_loader_queue_depth(&loader);
+
+	double longest_frame_ms = 0;
+	int nb_frames = 0;
+	while (loader.ready + loader.failed < (unsigned)nb_textures) {
+		chrono::steady_clock::time_point frame_start = chrono::steady_clock::now();
+		texture_loader_update(&loader);
+		glFinish();  // the frame's uploads done, as a swap would wait for them
+		longest_frame_ms = max(longest_frame_ms, ms_since(frame_start));
+		nb_frames++;
+		this_thread::sleep_until(frame_start + chrono::microseconds(16667));
+	}
+	double total_ms = ms_since(start);
+
+	bool same = true;
+	for (int i = 0; i < nb_textures; i++)
+		same = same && texture_checksum(texture_loader_texture(&loader, handles[i])) == reference;
+	cout << "  loader, " << texture_upload_path_name(loader.path) << ", " << loader.workers.size() << " workers"
+	     << (mipmaps == texture_mipmaps_box ? ", box mipmaps" : "") << ": "
+	     << first_frame_ms << " ms to the first frame, " << longest_frame_ms << " ms longest frame, "
+	     << total_ms << " ms until all ready over " << nb_frames << " frames, queue depth " << peak_depth
+	     << ", " << texture_loader_upload_rate(&loader) << " MB/s uploading"
+	     << (same ? "" : ", TEXTURES DIFFER") << endl;
+	free_texture_loader(&loader);
+}
+
+int main(int argc, char* argv[]) {
+	int nb_textures = argc > 1 ? atoi(argv[1]) : 200;
+	int nb_workers = argc > 2 ? atoi(argv[2]) : 0;
+	int budget_kb = argc > 3 ? atoi(argv[3]) : 4096;
+	if (nb_textures <= 0 || nb_workers < 0 || budget_kb <= 0) {
+		cerr << "Usage: " << argv[0] << " [textures [workers [budget_kb]]]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window* window = SDL_CreateWindow("texture_bench",
+		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 640, 480,
+		SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (window == NULL) {
+		cerr << "Error: can't create window: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+	if (SDL_GL_CreateContext(window) == NULL) {
+		cerr << "Error: SDL_GL_CreateContext: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	GLenum glew_status = glewInit();
+	if (glew_status != GLEW_OK) {
+		cerr << "Error: glewInit: " << glewGetErrorString(glew_status) << endl;
+		return EXIT_FAILURE;
+	}
+
+	cout << glGetString(GL_RENDERER) << ", " << nb_textures << " x " << image_file << ", "
+	     << budget_kb << " KB per frame" << endl;
+	vector<GLuint> textures;
+	double sync_ms = load_synchronously(nb_textures, textures);
+	unsigned long long reference = texture_checksum(textures[0]);
+	cout << "  synchronous: " << sync_ms << " ms to the first frame" << endl;
+	glDeleteTextures(textures.size(), textures.data());
+
+	load_in_background(nb_textures, nb_workers, budget_kb << 10, texture_upload_pbo, texture_mipmaps_none, reference);
+	load_in_background(nb_textures, nb_workers, budget_kb << 10, texture_upload_direct, texture_mipmaps_none, reference);
+	remove("res_texture.png.ktx2");
+	load_in_background(nb_textures, nb_workers, budget_kb << 10, texture_upload_pbo, texture_mipmaps_box, reference);
+	load_in_background(nb_textures, nb_workers, budget_kb << 10, texture_upload_pbo, texture_mipmaps_box, reference);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+/* smooth_normals on wavy grids of 1 million triangles up to
+ * max_million_faces (8), area and angle weighted, scalar against
+ * SIMD, next to the faceted loop load_obj used to run. Then
+ * split_creases: a cube's corners split into one vertex per face at
+ * 30 degrees and stay whole at 180, and the largest grid, smooth
+ * everywhere, splits nowhere.
+ * normals_bench [max_million_faces] */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+
+#include "../../common/bench.h"
+#include "../../common/mesh_normals.h"
+
+struct soa_mesh {
+	vector<float> x, y, z;
+	vector<unsigned> elements;
+};
+
+/* 'side' x 'side' vertices, two triangles per grid cell */
+void build_grid(size_t side, soa_mesh &mesh) {
+	mesh.x.resize(side * side);
+	mesh.y.resize(side * side);
+	mesh.z.resize(side * side);
+	for (size_t row = 0; row < side; row++) {
+		for (size_t col = 0; col < side; col++) {
+			size_t v = row * side + col;
+			mesh.x[v] = col * 0.01f;
+			mesh.z[v] = row * 0.01f;
+			mesh.y[v] = 0.1f * sinf(mesh.x[v] * 7.0f + mesh.z[v] * 3.0f);
+		}
+	}
+	mesh.elements.clear();
+	mesh.elements.reserve((side - 1) * (side - 1) * 6);
+	for (size_t row = 0; row + 1 < side; row++) {
+		for (size_t col = 0; col + 1 < side; col++) {
+			unsigned a = row * side + col, b = a + 1, c = a + side, d = c + 1;
+			unsigned quad[6] = { a, c, b, b, c, d };
+			mesh.elements.insert(mesh.elements.end(), quad, quad + 6);
+		}
+	}
+}
+
+/* The grid as an obj_mesh, for split_creases */
+void grid_mesh(const soa_mesh &grid, obj_mesh &mesh) {
+	mesh.vertices.resize(grid.x.size());
+	for (size_t v = 0; v < mesh.vertices.size(); v++) {
+		mesh.vertices[v].position = glm::vec3(grid.x[v], grid.y[v], grid.z[v]);
+		mesh.vertices[v].texcoord = glm::vec2(0.0, 0.0);
+		mesh.vertices[v].normal = glm::vec3(0.0, 0.0, 0.0);
+	}
+	mesh.elements = grid.elements;
+	mesh.has_texcoords = mesh.has_normals = false;
+}
+
+/* A cube of 12 triangles over its 8 corners */
+void build_cube(soa_mesh &mesh) {
+	mesh.x.clear();
+	mesh.y.clear();
+	mesh.z.clear();
+	for (int v = 0; v < 8; v++) {
+		mesh.x.push_back(v & 1 ? 1.0f : -1.0f);
+		mesh.y.push_back(v & 2 ? 1.0f : -1.0f);
+		mesh.z.push_back(v & 4 ? 1.0f : -1.0f);
+	}
+	const unsigned faces[6][4] = {
+		{ 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 },
+		{ 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 },
+	};
+	mesh.elements.clear();
+	for (int f = 0; f < 6; f++) {
+		unsigned quad[6] = { faces[f][0], faces[f][1], faces[f][2], faces[f][0], faces[f][2], faces[f][3] };
+		mesh.elements.insert(mesh.elements.end(), quad, quad + 6);
+	}
+}
+
+/* The normal pass load_obj used to run */
+void faceted_normals(const soa_mesh &mesh, vector<glm::vec3> &normals) {
+	normals.assign(mesh.x.size(), glm::vec3(0.0, 0.0, 0.0));
+	for (size_t i = 0; i + 2 < mesh.elements.size(); i+=3) {
+		unsigned ia = mesh.elements[i];
+		unsigned ib = mesh.elements[i+1];
+		unsigned ic = mesh.elements[i+2];
+		glm::vec3 a(mesh.x[ia], mesh.y[ia], mesh.z[ia]);
+		glm::vec3 b(mesh.x[ib], mesh.y[ib], mesh.z[ib]);
+		glm::vec3 c(mesh.x[ic], mesh.y[ic], mesh.z[ic]);
+		glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+		normals[ia] = normals[ib] = normals[ic] = normal;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	size_t max_mfaces = argc > 1 ? strtoul(argv[1], NULL, 10) : 8;
+
+	printf("%8s %12s %12s %12s %12s %12s %9s\n", "Mfaces", "faceted", "area scalar",
+	       "area SIMD", "angle scalar", "angle SIMD", "max diff");
+	soa_mesh largest;
+	for (size_t mfaces = 1; mfaces <= max_mfaces; mfaces *= 2) {
+		size_t side = (size_t)sqrt(mfaces * 1e6 / 2.0) + 1;
+		soa_mesh mesh;
+		build_grid(side, mesh);
+		size_t nb_vertices = mesh.x.size(), nb_faces = mesh.elements.size() / 3;
+
+		vector<glm::vec3> faceted;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		faceted_normals(mesh, faceted);
+		double t_faceted = seconds_since(start);
+
+		vector<float> sx(nb_vertices), sy(nb_vertices), sz(nb_vertices);
+		vector<float> vx(nb_vertices), vy(nb_vertices), vz(nb_vertices);
+		double times[4];
+		float max_diff = 0.0f;
+		for (int angle = 0; angle < 2; angle++) {
+			start = chrono::steady_clock::now();
+			smooth_normals_scalar(mesh.x.data(), mesh.y.data(), mesh.z.data(), nb_vertices,
+					      mesh.elements.data(), mesh.elements.size(), angle,
+					      sx.data(), sy.data(), sz.data());
+			times[angle * 2] = seconds_since(start);
+
+			start = chrono::steady_clock::now();
+			smooth_normals(mesh.x.data(), mesh.y.data(), mesh.z.data(), nb_vertices,
+				       mesh.elements.data(), mesh.elements.size(), angle,
+				       vx.data(), vy.data(), vz.data());
+			times[angle * 2 + 1] = seconds_since(start);
+
+			for (size_t v = 0; v < nb_vertices; v++)
+				max_diff = max(max_diff, fabsf(sx[v] - vx[v]) + fabsf(sy[v] - vy[v]) + fabsf(sz[v] - vz[v]));
+		}
+
+		double mfaces_done = nb_faces / 1e6;
+		printf("%8.2f %7.1f ms   %7.1f ms   %7.1f ms   %7.1f ms   %7.1f ms %9.2g\n", mfaces_done,
+		       t_faceted * 1e3, times[0] * 1e3, times[1] * 1e3, times[2] * 1e3, times[3] * 1e3, max_diff);
+		if (mfaces * 2 > max_mfaces)
+			largest = mesh;
+	}
+
+	bool ok = true;
+	soa_mesh cube;
+	build_cube(cube);
+	const float angles[2] = { 30, 180 };
+	const size_t expected[2] = { 24, 8 };
+	for (int i = 0; i < 2; i++) {
+		obj_mesh mesh;
+		grid_mesh(cube, mesh);
+		split_creases(mesh, angles[i] * M_PI / 180, true);
+		bool axis_aligned = true;
+		for (size_t v = 0; v < mesh.vertices.size(); v++) {
+			const glm::vec3 &n = mesh.vertices[v].normal;
+			axis_aligned = axis_aligned && fabsf(fabsf(n.x) + fabsf(n.y) + fabsf(n.z) - 1.0f) < 1e-5f;
+		}
+		bool good = mesh.vertices.size() == expected[i] && (i == 1 || axis_aligned);
+		printf("Cube creased at %3.0f degrees: %2zu vertices, %zu expected%s\n", angles[i],
+		       mesh.vertices.size(), expected[i], good ? "" : ", WRONG");
+		ok = ok && good;
+	}
+
+	// Smooth everywhere, so at 30 degrees no vertex splits and the
+	// normals are the angle-weighted smooth ones
+	obj_mesh mesh;
+	grid_mesh(largest, mesh);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	split_creases(mesh, 30 * M_PI / 180, true);
+	double t_split = seconds_since(start);
+	size_t nb_vertices = largest.x.size();
+	vector<float> sx(nb_vertices), sy(nb_vertices), sz(nb_vertices);
+	smooth_normals_scalar(largest.x.data(), largest.y.data(), largest.z.data(), nb_vertices,
+			      largest.elements.data(), largest.elements.size(), true, sx.data(), sy.data(), sz.data());
+	float max_diff = 0.0f;
+	for (size_t i = 0; i < largest.elements.size(); i++) {
+		const glm::vec3 &n = mesh.vertices[mesh.elements[i]].normal;
+		unsigned v = largest.elements[i];
+		max_diff = max(max_diff, fabsf(n.x - sx[v]) + fabsf(n.y - sy[v]) + fabsf(n.z - sz[v]));
+	}
+	bool good = mesh.vertices.size() == nb_vertices && max_diff < 1e-4f;
+	printf("Grid of %.2f Mfaces creased at 30 degrees: %.1f ms, %zu vertices for %zu, max diff %.2g%s\n",
+	       largest.elements.size() / 3e6, t_split * 1e3, mesh.vertices.size(), nb_vertices, max_diff,
+	       good ? "" : ", WRONG");
+	ok = ok && good;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,227 @@
+/* load_obj on synthetic .obj grids of growing size, up to max_size_mb
+ * (256) written to tmp_dir (/tmp): MB/s on 1 to max_threads threads,
+ * and the old getline/istringstream loader on the smaller files.
+ * Then load_obj_mesh with the size of its deduplication table, and a
+ * cold start, file dropped from the page cache, of the text path
+ * against the binary mesh cache.
+ * obj_bench [max_size_mb] [max_threads] [tmp_dir] */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glm/glm.hpp>
+
+#include "../../common/bench.h"
+#include "../../common/obj_loader.h"
+#include "../../common/mesh_cache.h"
+
+/* The streams-based loader is far too slow for the big files */
+const size_t legacy_max_mb = 64;
+
+/* Previous load_obj, kept as the baseline */
+void load_obj_legacy(const char* filename, vector<glm::vec4> &vertices,
+		     vector<glm::vec3> &normals, vector<unsigned short> &elements) {
+	ifstream in(filename, ios::in);
+	string line;
+	while (getline(in, line)) {
+		if (line.substr(0,2) == "v ") {
+			istringstream s(line.substr(2));
+			glm::vec4 v; s >> v.x; s >> v.y, s >> v.z; v.w = 1.0f;
+			vertices.push_back(v);
+		}
+		else if (line.substr(0,2) == "f ") {
+			istringstream s(line.substr(2));
+			unsigned short a,b,c;
+			s >> a; s >> b; s >> c;
+			a--; b--; c--;
+			elements.push_back(a); elements.push_back(b); elements.push_back(c);
+		}
+	}
+	normals.resize(vertices.size(), glm::vec3(0.0, 0.0, 0.0));
+	for (size_t i = 0; i < elements.size(); i+=3) {
+		unsigned short ia = elements[i];
+		unsigned short ib = elements[i+1];
+		unsigned short ic = elements[i+2];
+		glm::vec3 normal = glm::normalize(glm::cross(
+				glm::vec3(vertices[ib]) - glm::vec3(vertices[ia]),
+				glm::vec3(vertices[ic]) - glm::vec3(vertices[ia])));
+		normals[ia] = normals[ib] = normals[ic] = normal;
+	}
+}
+
+/* Write a wavy height field, row by row, until the file reaches
+ * 'target' bytes. Face indices are kept below 65536 so both
+ * loaders see the same 16-bit elements. Returns the file size. */
+size_t write_grid(const char* filename, size_t target) {
+	FILE* f = fopen(filename, "wb");
+	if (f == NULL) {
+		cerr << "Cannot create " << filename << endl;
+		exit(EXIT_FAILURE);
+	}
+	const int width = 256;
+	size_t written = 0;
+	for (int row = 0; written < target; row++) {
+		for (int col = 0; col < width; col++) {
+			float x = col * 0.01f, z = row * 0.01f;
+			written += fprintf(f, "v %f %f %f\n", x, 0.1f * (float)sin(x * 7.0f + z * 3.0f), z);
+		}
+		if (row == 0) continue;
+		int base = ((row - 1) * width) % (65536 - 2 * width) + 1;
+		for (int col = 0; col + 1 < width; col++) {
+			int a = base + col, b = a + 1, c = a + width, d = c + 1;
+			written += fprintf(f, "f %d %d %d\n", a, c, b);
+			written += fprintf(f, "f %d %d %d\n", b, c, d);
+		}
+	}
+	fclose(f);
+	return written;
+}
+
+struct obj_data {
+	vector<glm::vec4> vertices;
+	vector<glm::vec3> normals;
+	vector<unsigned> elements;  // the legacy loader's 16-bit ones widened
+};
+
+/* The legacy loader computes faceted normals, so only compare
+ * normals between runs of the current one */
+bool identical(const obj_data &a, const obj_data &b, bool compare_normals = true) {
+	return a.elements == b.elements
+		&& a.vertices.size() == b.vertices.size()
+		&& memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(a.vertices[0])) == 0
+		&& (!compare_normals
+		    || memcmp(a.normals.data(), b.normals.data(), a.normals.size() * sizeof(a.normals[0])) == 0);
+}
+
+/* Drop a file from the page cache so the next read hits the disk */
+void evict(const string &filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+/* Time getting a GPU-ready mesh from a cold .obj, and from a cold
+ * binary cache (touching every page, as glBufferData would) */
+bool cold_start(const string &filename, double &text_ms, double &cache_ms) {
+	string cache_filename = filename + ".meshcache";
+	remove(cache_filename.c_str());
+	cached_mesh cached;
+	if (!load_mesh_cached(filename.c_str(), 0, &cached))
+		return false;
+	free_cached_mesh(&cached);
+
+	evict(filename);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	obj_mesh mesh;
+	mesh_data data;
+	if (!load_obj_mesh(filename.c_str(), mesh))
+		return false;
+	build_mesh_data(mesh, false, vertex_float, data);
+	text_ms = seconds_since(start) * 1000.0;
+
+	evict(cache_filename);
+	start = chrono::steady_clock::now();
+	if (!load_mesh_cached(filename.c_str(), 0, &cached))
+		return false;
+	volatile unsigned char sum = 0;
+	for (size_t i = 0; i < cached.nb_vertices * sizeof(obj_vertex); i += 4096)
+		sum += cached.vertices[i];
+	for (size_t i = 0; i < cached.index_bytes; i += 4096)
+		sum += cached.indices[i];
+	cache_ms = seconds_since(start) * 1000.0;
+	bool same = cached.from_cache && cached.nb_vertices == data.nb_vertices
+		&& memcmp(cached.vertices, data.vertices.data(), data.vertices.size()) == 0;
+	free_cached_mesh(&cached);
+	remove(cache_filename.c_str());
+	if (!same)
+		cerr << "Binary cache differs from the parsed mesh" << endl;
+	return same;
+}
+
+int main(int argc, char* argv[]) {
+	size_t max_mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+	unsigned max_threads = argc > 2 ? strtoul(argv[2], NULL, 10) : thread::hardware_concurrency();
+	string dir = argc > 3 ? argv[3] : "/tmp";
+	string filename = dir + "/obj_bench.obj";
+	max_threads = max(max_threads, 1u);
+
+	vector<unsigned> thread_counts;
+	for (unsigned n = 1; n < max_threads; n *= 2)
+		thread_counts.push_back(n);
+	thread_counts.push_back(max_threads);
+
+	printf("%10s %12s", "size (MB)", "vertices");
+	for (size_t i = 0; i < thread_counts.size(); i++) {
+		char header[32];
+		snprintf(header, sizeof(header), "%u thread%s", thread_counts[i], thread_counts[i] > 1 ? "s" : "");
+		printf(" %13s", header);
+	}
+	printf(" %13s %6s %13s %10s %11s %11s\n", "legacy", "same", "load_obj_mesh", "dedup", "cold text", "cold cache");
+
+	for (size_t mb = 1; mb <= max_mb; mb = (mb == 1024 ? 2048 : mb * 4)) {
+		size_t bytes = write_grid(filename.c_str(), mb << 20);
+		double size_mb = bytes / (1024.0 * 1024.0);
+
+		obj_data serial;
+		bool same = true;
+		for (size_t i = 0; i < thread_counts.size(); i++) {
+			obj_data data;
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			if (!load_obj(filename.c_str(), data.vertices, data.normals, data.elements, thread_counts[i]))
+				return EXIT_FAILURE;
+			double t = seconds_since(start);
+			if (i == 0) {
+				printf("%10.1f %12zu", size_mb, data.vertices.size());
+				serial = data;
+			} else {
+				same = same && identical(serial, data);
+			}
+			printf(" %8.1f MB/s", size_mb / t);
+			fflush(stdout);
+		}
+
+		if (mb <= legacy_max_mb) {
+			obj_data legacy;
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			vector<unsigned short> elements;
+			load_obj_legacy(filename.c_str(), legacy.vertices, legacy.normals, elements);
+			legacy.elements.assign(elements.begin(), elements.end());
+			printf(" %8.1f MB/s", size_mb / seconds_since(start));
+			same = same && identical(serial, legacy, false);
+		} else {
+			printf(" %13s", "-");
+		}
+		printf(" %6s", same ? "yes" : "NO");
+
+		obj_mesh mesh;
+		obj_stats stats;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (!load_obj_mesh(filename.c_str(), mesh, 256 << 20, 0, &stats))
+			return EXIT_FAILURE;
+		double t = seconds_since(start);
+		printf(" %8.1f MB/s %7.1f MB%s", size_mb / t, stats.dedup_bytes / (1024.0 * 1024.0),
+		       stats.dedup_saturated ? " (full)" : "");
+
+		double text_ms, cache_ms;
+		if (!cold_start(filename, text_ms, cache_ms))
+			return EXIT_FAILURE;
+		printf(" %8.1f ms %8.1f ms\n", text_ms, cache_ms);
+	}
+	remove(filename.c_str());
+	return EXIT_SUCCESS;
+}
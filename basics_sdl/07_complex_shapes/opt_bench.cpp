@@ -0,0 +1,103 @@
+/* What the mesh optimizer does to ACMR, ATVR and vertex overfetch,
+ * pass by pass, and how long each pass takes. Without files, runs on
+ * a 1M triangle grid in scan order, then shuffled as some exporters
+ * leave it.
+ * opt_bench [file.obj ...] */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+
+#include "../../common/bench.h"
+#include "../../common/obj_loader.h"
+#include "../../common/mesh_optimize.h"
+
+/* 'side' x 'side' vertices, two triangles per cell, row by row */
+void build_grid(size_t side, obj_mesh &mesh) {
+	mesh.vertices.resize(side * side);
+	for (size_t row = 0; row < side; row++) {
+		for (size_t col = 0; col < side; col++) {
+			obj_vertex &v = mesh.vertices[row * side + col];
+			v.position = glm::vec3(col * 0.01f, 0.1f * sinf(col * 0.07f + row * 0.03f), row * 0.01f);
+			v.texcoord = glm::vec2(0);
+			v.normal = glm::vec3(0, 1, 0);
+		}
+	}
+	mesh.elements.clear();
+	for (size_t row = 0; row + 1 < side; row++) {
+		for (size_t col = 0; col + 1 < side; col++) {
+			unsigned a = row * side + col, b = a + 1, c = a + side, d = c + 1;
+			unsigned quad[6] = { a, c, b, b, c, d };
+			mesh.elements.insert(mesh.elements.end(), quad, quad + 6);
+		}
+	}
+	mesh.has_texcoords = false;
+	mesh.has_normals = true;
+}
+
+void shuffle_triangles(obj_mesh &mesh) {
+	size_t nb_faces = mesh.elements.size() / 3;
+	vector<unsigned> order(nb_faces);
+	for (size_t t = 0; t < nb_faces; t++)
+		order[t] = t;
+	shuffle(order.begin(), order.end(), mt19937(42));
+	vector<unsigned> elements(mesh.elements.size());
+	for (size_t t = 0; t < nb_faces; t++)
+		for (int c = 0; c < 3; c++)
+			elements[t * 3 + c] = mesh.elements[order[t] * 3 + c];
+	mesh.elements.swap(elements);
+}
+
+void print_stats(const char* pass, const obj_mesh &mesh, double ms) {
+	vertex_cache_stats stats = analyze_vertex_cache(mesh.elements.data(), mesh.elements.size(),
+							mesh.vertices.size(), sizeof(obj_vertex));
+	printf("  %-10s %8.3f %8.3f %10.3f", pass, stats.acmr, stats.atvr, stats.overfetch);
+	if (ms >= 0)
+		printf(" %10.1f ms", ms);
+	printf("\n");
+}
+
+void report(const string &name, obj_mesh &mesh) {
+	printf("%s: %zu vertices, %zu triangles\n", name.c_str(), mesh.vertices.size(), mesh.elements.size() / 3);
+	printf("  %-10s %8s %8s %10s %13s\n", "pass", "ACMR", "ATVR", "overfetch", "time");
+	print_stats("loaded", mesh, -1);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	optimize_vertex_cache(mesh.elements.data(), mesh.elements.size(), mesh.vertices.size());
+	print_stats("cache", mesh, ms_since(start));
+
+	start = chrono::steady_clock::now();
+	optimize_overdraw(mesh.elements.data(), mesh.elements.size(), mesh.vertices.data(), mesh.vertices.size());
+	print_stats("overdraw", mesh, ms_since(start));
+
+	start = chrono::steady_clock::now();
+	optimize_vertex_fetch(mesh);
+	print_stats("fetch", mesh, ms_since(start));
+}
+
+int main(int argc, char* argv[]) {
+	vector<string> filenames(argv + 1, argv + argc);
+	for (size_t i = 0; i < filenames.size(); i++) {
+		obj_mesh mesh;
+		if (!load_obj_mesh(filenames[i].c_str(), mesh))
+			return EXIT_FAILURE;
+		report(filenames[i], mesh);
+	}
+
+	if (argc < 2) {
+		obj_mesh grid;
+		build_grid(708, grid);
+		report("grid", grid);
+		build_grid(708, grid);
+		shuffle_triangles(grid);
+		report("shuffled grid", grid);
+	}
+	return EXIT_SUCCESS;
+}
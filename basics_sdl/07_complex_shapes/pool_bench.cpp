@@ -0,0 +1,219 @@
+/* Many distinct static meshes, each in its own buffers and drawn one
+ * by one as suzanne does, or all in a mesh pool drawn from one list of
+ * indirect commands on every submission path the context has. Prints
+ * draw calls, submit and frame times, and compares the frames.
+ * pool_bench [meshes ...], 100 1000 10000 by default */
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "../../common/bench.h"
+#include "../../common/shader_utils.h"
+#include "../../common/mesh_buffers.h"
+#include "../../common/mesh_pool.h"
+
+const int width = 800, height = 600;
+
+GLuint program;
+GLint attribute_v_coord, attribute_v_normal;
+int nb_frames;
+
+/* A UV sphere of 'rings' x 'segments' quads, centered on 'center' */
+void make_sphere(const glm::vec3 &center, float radius, int rings, int segments, obj_mesh &mesh) {
+	mesh.vertices.clear();
+	mesh.elements.clear();
+	for (int r = 0; r <= rings; r++) {
+		float theta = (float)M_PI * r / rings;
+		for (int s = 0; s <= segments; s++) {
+			float phi = 2.0f * (float)M_PI * s / segments;
+			obj_vertex v;
+			v.normal = glm::vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+			v.position = center + v.normal * radius;
+			v.texcoord = glm::vec2((float)s / segments, (float)r / rings);
+			mesh.vertices.push_back(v);
+		}
+	}
+	for (int r = 0; r < rings; r++) {
+		for (int s = 0; s < segments; s++) {
+			unsigned a = r * (segments + 1) + s, b = a + 1, c = a + segments + 1, d = c + 1;
+			unsigned quad[6] = { a, c, b, b, c, d };
+			mesh.elements.insert(mesh.elements.end(), quad, quad + 6);
+		}
+	}
+	mesh.has_texcoords = mesh.has_normals = true;
+}
+
+/* Spheres of varying detail on a square grid facing the camera */
+void build_scene(int nb_meshes, vector<mesh_data> &meshes) {
+	int side = 1;
+	while (side * side < nb_meshes)
+		side++;
+	float cell = 2.0f / side;
+	meshes.resize(nb_meshes);
+	for (int i = 0; i < nb_meshes; i++) {
+		glm::vec3 center(((i % side) + 0.5f) * cell - 1.0f, ((i / side) + 0.5f) * cell - 1.0f, 0.0f);
+		obj_mesh mesh;
+		make_sphere(center, cell * 0.4f, 6 + i % 7, 8 + i % 9, mesh);
+		build_mesh_data(mesh, false, vertex_float, meshes[i]);
+	}
+}
+
+struct timing {
+	double submit_ms, frame_ms;
+	unsigned draw_calls;
+	unsigned long long checksum;
+};
+
+void report(const char* name, const timing &t, unsigned long long reference) {
+	cout << "  " << name << ": " << t.draw_calls << " draw calls, "
+	     << t.submit_ms << " ms submitting, " << t.frame_ms << " ms/frame"
+	     << (t.checksum == reference ? "" : ", IMAGE DIFFERS") << endl;
+}
+
+/* One layout and one glDrawElements per mesh, or the pool when
+ * 'pool' is given */
+timing run(const vector<mesh_buffers> &buffers, const vector<vertex_layout> &layouts, mesh_pool* pool) {
+	timing t = timing();
+	for (int frame = 0; frame <= nb_frames; frame++) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glFinish();
+		Uint64 start = SDL_GetPerformanceCounter();
+		if (pool == NULL) {
+			for (size_t i = 0; i < buffers.size(); i++) {
+				bind_vertex_layout(&layouts[i]);
+				draw_submesh(buffers[i].parts[0]);
+			}
+			unbind_vertex_layout(&layouts.back());
+			t.draw_calls = buffers.size();
+		} else {
+			// Every mesh visible: the commands are rebuilt each frame all the same
+			mesh_pool_clear_draws(pool);
+			for (size_t i = 0; i < pool->meshes.size(); i++)
+				mesh_pool_add_draw(pool, i);
+			draw_mesh_pool(pool);
+			unbind_vertex_layout(&pool->layout);
+			t.draw_calls = pool->draw_calls;
+		}
+		Uint64 submitted = SDL_GetPerformanceCounter();
+		glFinish();
+		Uint64 finished = SDL_GetPerformanceCounter();
+		if (frame == 0) {
+			t.checksum = frame_checksum(width, height);
+			continue;  // warm-up
+		}
+		double ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+		t.submit_ms += (submitted - start) * ms_per_tick / nb_frames;
+		t.frame_ms += (finished - start) * ms_per_tick / nb_frames;
+	}
+	return t;
+}
+
+int main(int argc, char* argv[]) {
+	vector<int> counts;
+	for (int i = 1; i < argc; i++) {
+		counts.push_back(atoi(argv[i]));
+		if (counts.back() <= 0) {
+			cerr << "Usage: " << argv[0] << " [meshes ...]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (counts.empty()) {
+		counts.push_back(100);
+		counts.push_back(1000);
+		counts.push_back(10000);
+	}
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window* window = SDL_CreateWindow("pool_bench",
+		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height,
+		SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (window == NULL) {
+		cerr << "Error: can't create window: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+	if (SDL_GL_CreateContext(window) == NULL) {
+		cerr << "Error: SDL_GL_CreateContext: " << SDL_GetError() << endl;
+		return EXIT_FAILURE;
+	}
+	GLenum glew_status = glewInit();
+	if (glew_status != GLEW_OK) {
+		cerr << "Error: glewInit: " << glewGetErrorString(glew_status) << endl;
+		return EXIT_FAILURE;
+	}
+
+	program = create_program("suzanne.v.glsl", "suzanne.f.glsl");
+	if (program == 0)
+		return EXIT_FAILURE;
+	attribute_v_coord = glGetAttribLocation(program, "v_coord");
+	attribute_v_normal = glGetAttribLocation(program, "v_normal");
+	if (attribute_v_coord == -1 || attribute_v_normal == -1) {
+		cerr << "Could not bind suzanne.v.glsl's attributes" << endl;
+		return EXIT_FAILURE;
+	}
+	glUseProgram(program);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f * width / height, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0, 0.0, 2.5), glm::vec3(0.0), glm::vec3(0.0, 1.0, 0.0));
+	glm::mat4 mvp = projection * view;
+	glUniformMatrix4fv(glGetUniformLocation(program, "mvp"), 1, GL_FALSE, glm::value_ptr(mvp));
+	glUniform3f(glGetUniformLocation(program, "decode_scale"), 1.0f, 1.0f, 1.0f);
+	glUniform3f(glGetUniformLocation(program, "decode_offset"), 0.0f, 0.0f, 0.0f);
+	glUniform1i(glGetUniformLocation(program, "octahedral_normals"), 0);
+	glEnable(GL_DEPTH_TEST);
+
+	cout << glGetString(GL_RENDERER) << endl;
+	for (size_t c = 0; c < counts.size(); c++) {
+		nb_frames = max(5, min(20, 20000 / counts[c]));
+		vector<mesh_data> meshes;
+		build_scene(counts[c], meshes);
+		size_t nb_vertices = 0, nb_indices = 0;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			nb_vertices += meshes[i].nb_vertices;
+			nb_indices += meshes[i].parts[0].nb_indices;
+		}
+		cout << counts[c] << " meshes, " << nb_indices / 3 << " triangles, " << nb_frames << " frames" << endl;
+
+		vector<mesh_buffers> buffers(meshes.size());
+		vector<vertex_layout> layouts(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			upload_mesh(meshes[i], &buffers[i]);
+			build_mesh_layout(buffers[i], buffers[i].parts[0], attribute_v_coord, attribute_v_normal, -1, &layouts[i]);
+		}
+		timing per_mesh = run(buffers, layouts, NULL);
+		report("per-mesh buffers", per_mesh, per_mesh.checksum);
+		for (size_t i = 0; i < meshes.size(); i++) {
+			free_vertex_layout(&layouts[i]);
+			free_mesh(&buffers[i]);
+		}
+
+		mesh_pool_path paths[] = { pool_multi_draw_indirect, pool_base_vertex, pool_rebase_attributes };
+		for (int p = 0; p < 3; p++) {
+			if (best_mesh_pool_path(paths[p]) != paths[p]) {
+				cout << "  pool, " << mesh_pool_path_name(paths[p]) << ": not available" << endl;
+				continue;
+			}
+			// Indices count from each mesh's base vertex: 16 bits are enough
+			mesh_pool pool;
+			init_mesh_pool(&pool, vertex_float, GL_UNSIGNED_SHORT, nb_vertices, nb_indices, paths[p]);
+			for (size_t i = 0; i < meshes.size(); i++)
+				add_pool_mesh(&pool, meshes[i]);
+			build_pool_layout(&pool, attribute_v_coord, attribute_v_normal, -1);
+			string name = string("pool, ") + mesh_pool_path_name(pool.path);
+			report(name.c_str(), run(buffers, layouts, &pool), per_mesh.checksum);
+			free_mesh_pool(&pool);
+		}
+	}
+
+	glDeleteProgram(program);
+	return EXIT_SUCCESS;
+}
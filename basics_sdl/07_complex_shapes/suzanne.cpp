@@ -1,8 +1,8 @@
+#include <cmath>
+#include <cstddef>
 #include <cstdlib>
-#include <fstream>
+#include <cstring>
 #include <iostream>
-#include <sstream>
-#include <string>
 #include <vector>
 using namespace std;
 
@@ -14,6 +14,10 @@ using namespace std;
 #include <SDL2/SDL_image.h>
 
 #include "../../common/shader_utils.h"
+#include "../../common/obj_loader.h"
+#include "../../common/mesh_buffers.h"
+#include "../../common/mesh_cache.h"
+#include "../../common/mesh_simplify.h"
 
 /* GLM */
 // #define GLM_MESSAGES
@@ -23,82 +27,46 @@ using namespace std;
 
 int screen_width=800, screen_height=600;
 
-vector<glm::vec4> suzanne_vertices;
-vector<glm::vec3> suzanne_normals;
-vector<GLushort> suzanne_elements;
+const char* obj_filename = "suzanne.obj";
+unsigned mesh_options = 0;  // mesh_cache_* flags
+float crease_angle = 0;     // radians, 0 for the file's normals
 
-GLuint vbo_mesh_vertices, vbo_mesh_normals;
-GLuint ibo_mesh_elements;
+mesh_buffers suzanne;
+vector<vertex_layout> part_layouts, lod_layouts;  // one per drawn submesh
+size_t current_lod = 0;
+meshlet_draw visible_meshlets;
+size_t visible_triangles = 0;
 GLuint program;
 GLint attribute_v_coord, attribute_v_normal;
-GLint uniform_mvp;
-
-void load_obj(const char* filename, vector<glm::vec4> &vertices, 
-	      vector<glm::vec3> &normals, vector<GLushort> &elements) {
-	ifstream in(filename, ios::in);
-	if (!in) {
-		cerr << "Cannot open " << filename << endl; exit(1);
-	}
-	
-	string line;
-	while (getline(in, line)) {
-		if (line.substr(0,2) == "v ") {
-			istringstream s(line.substr(2));
-			glm::vec4 v; s >> v.x; s >> v.y, s >> v.z; v.w = 1.0f;
-			vertices.push_back(v);
-		}
-		else if (line.substr(0,2) == "f ") {
-			istringstream s(line.substr(2));
-			GLushort a,b,c;
-			s >> a; s >> b; s >> c;
-			a--; b--; c--;
-			elements.push_back(a); elements.push_back(b); elements.push_back(c);
-		}
-	}
-	
-	normals.resize(vertices.size(), glm::vec3(0.0, 0.0, 0.0));
-	for (int i = 0;i < elements.size(); i+=3) {
-		GLushort ia = elements[i];
-		GLushort ib = elements[i+1];
-		GLushort ic = elements[i+2];
-		glm::vec3 normal = glm::normalize(glm::cross(
-				glm::vec3(vertices[ib]) - glm::vec3(vertices[ia]),
-				glm::vec3(vertices[ic]) - glm::vec3(vertices[ia])));
-		normals[ia] = normals[ib] = normals[ic] = normal;
-	}
-}
+GLint uniform_mvp, uniform_decode_scale, uniform_decode_offset, uniform_octahedral_normals;
 
 bool init_resources() {
-	load_obj("suzanne.obj", suzanne_vertices, suzanne_normals, suzanne_elements);
-	
-	glGenBuffers(1, &vbo_mesh_vertices);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_vertices);
-	glBufferData(GL_ARRAY_BUFFER, suzanne_vertices.size() * sizeof(suzanne_vertices[0]), suzanne_vertices.data(), GL_STATIC_DRAW);
-	
-	glGenBuffers(1, &vbo_mesh_normals);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_normals);
-	glBufferData(GL_ARRAY_BUFFER, suzanne_elements.size() * sizeof(suzanne_normals[0]), suzanne_normals.data(), GL_STATIC_DRAW);
-
-	glGenBuffers(1, &ibo_mesh_elements);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_mesh_elements);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, suzanne_elements.size() * sizeof(suzanne_elements[0]), suzanne_elements.data(), GL_STATIC_DRAW);
+	/* Positions, texcoords and normals interleaved in one buffer,
+	 * as floats or quantized with --packed, indices 16 or 32-bit
+	 * depending on the vertex count. With --crease the normals are
+	 * recomputed, split along edges sharper than that. After the
+	 * first run both come mapped from the binary cache. */
+	Uint64 start = SDL_GetPerformanceCounter();
+	cached_mesh mesh;
+	if (!load_mesh_cached(obj_filename, mesh_options, &mesh, crease_angle))
+		return false;
+	upload_cached_mesh(&mesh, &suzanne);
+	size_t vertex_bytes = mesh.nb_vertices * vertex_size(mesh.format);
+	free_cached_mesh(&mesh);
+	double load_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+	cout << "Loaded " << obj_filename << " in " << load_ms << " ms from "
+	     << (mesh.from_cache ? "binary cache" : "text") << ", "
+	     << vertex_bytes / 1024 << " KB of vertices" << endl;
 
-	GLint link_ok = GL_FALSE;
-	
-	GLuint vs, fs;
-	if ((vs = create_shader("suzanne.v.glsl", GL_VERTEX_SHADER))   == 0) return false;
-	if ((fs = create_shader("suzanne.f.glsl", GL_FRAGMENT_SHADER)) == 0) return false;
-	
-	program = glCreateProgram();
-	glAttachShader(program, vs);
-	glAttachShader(program, fs);
-	glLinkProgram(program);
-	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
-	if (!link_ok) {
-		cerr << "glLinkProgram:";
-		print_log(program);
+	/* Linked once, then reloaded as a driver binary: run twice to
+	 * compare cold and warm startup */
+	program = create_program("suzanne.v.glsl", "suzanne.f.glsl");
+	if (program == 0)
 		return false;
-	}
+	const program_cache* cache = get_program_cache();
+	cout << "Built program in " << cache->last_ms << " ms "
+	     << (cache->last_hit ? "from binary cache" : cache->dir.empty() ? "from source (no binary cache)" : "from source")
+	     << endl;
 	
 	const char* attribute_name;
 	attribute_name = "v_coord";
@@ -120,6 +88,33 @@ bool init_resources() {
 		cerr << "Could not bind uniform " << uniform_name << endl;
 		return false;
 	}
+	uniform_name = "decode_scale";
+	uniform_decode_scale = glGetUniformLocation(program, uniform_name);
+	if (uniform_decode_scale == -1) {
+		cerr << "Could not bind uniform " << uniform_name << endl;
+		return false;
+	}
+	uniform_name = "decode_offset";
+	uniform_decode_offset = glGetUniformLocation(program, uniform_name);
+	if (uniform_decode_offset == -1) {
+		cerr << "Could not bind uniform " << uniform_name << endl;
+		return false;
+	}
+	uniform_name = "octahedral_normals";
+	uniform_octahedral_normals = glGetUniformLocation(program, uniform_name);
+	if (uniform_octahedral_normals == -1) {
+		cerr << "Could not bind uniform " << uniform_name << endl;
+		return false;
+	}
+
+	/* Each part and LOD points the attributes at its own first
+	 * vertex: one vertex array object each */
+	part_layouts.resize(suzanne.parts.size());
+	for (size_t i = 0; i < suzanne.parts.size(); i++)
+		build_mesh_layout(suzanne, suzanne.parts[i], attribute_v_coord, attribute_v_normal, -1, &part_layouts[i]);
+	lod_layouts.resize(suzanne.lods.size());
+	for (size_t i = 0; i < suzanne.lods.size(); i++)
+		build_mesh_layout(suzanne, suzanne.lods[i], attribute_v_coord, attribute_v_normal, -1, &lod_layouts[i]);
 
 	return true;
 }
@@ -134,12 +129,44 @@ void logic() {
 	*/
 
 	glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.0, 0.0));
-	glm::mat4 view = glm::lookAt(glm::vec3(2.0, 2.0, 4.0), glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0));
+	glm::vec3 eye(2.0, 2.0, 4.0);
+	if (!suzanne.lods.empty()) {
+		// Fly away and back to go through the LODs
+		float t = SDL_GetTicks() / 1000.0;
+		eye *= 1.0f + 20.0f * (0.5f - 0.5f * cosf(t * 0.5f));
+	}
+	glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0));
 	glm::mat4 projection = glm::perspective(45.0f, 1.0f*screen_width/screen_height, 0.1f, 100.0f);
 	
 	glm::mat4 mvp = projection * view * model; //* anim;
+
+	if (!suzanne.lods.empty()) {
+		glm::vec3 center = (suzanne.bounds_min + suzanne.bounds_max) * 0.5f;
+		float radius = glm::length(suzanne.bounds_max - suzanne.bounds_min) * 0.5f;
+		size_t lod = select_lod(suzanne.lod_errors.data(), suzanne.lods.size(),
+					projection, view * model, center, radius, screen_height);
+		if (lod != current_lod)
+			cout << "LOD " << lod << ": " << suzanne.lods[lod].nb_indices / 3 << " triangles" << endl;
+		current_lod = lod;
+	}
+
+	if (!suzanne.meshlets.empty() && current_lod == 0) {
+		glm::vec3 camera = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0, 0.0, 0.0, 1.0));
+		meshlet_cull_stats stats;
+		cull_meshlets(suzanne.meshlets, suzanne.parts[0], mvp, camera, visible_meshlets, &stats);
+		size_t visible = stats.triangles - stats.frustum_culled - stats.backface_culled;
+		if (visible != visible_triangles)
+			cout << stats.visible_meshlets << "/" << stats.meshlets << " meshlets in "
+			     << stats.draw_ranges << " ranges, culled " << stats.frustum_culled
+			     << " + " << stats.backface_culled << " of " << stats.triangles
+			     << " triangles (frustum + back-facing)" << endl;
+		visible_triangles = visible;
+	}
 	glUseProgram(program);
 	glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
+	glUniform3fv(uniform_decode_scale, 1, glm::value_ptr(suzanne.decode_scale));
+	glUniform3fv(uniform_decode_offset, 1, glm::value_ptr(suzanne.decode_offset));
+	glUniform1i(uniform_octahedral_normals, suzanne.format == vertex_packed);
 }
 
 void render(SDL_Window* window) {
@@ -148,35 +175,26 @@ void render(SDL_Window* window) {
 	
 	glUseProgram(program);
 	
-	glEnableVertexAttribArray(attribute_v_coord);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_vertices);
-	glVertexAttribPointer(
-		  attribute_v_coord, // attribute
-		  4,                 // number of elements per vertex, here (x,y,z,w)
-		  GL_FLOAT,          // the type of each element
-		  GL_FALSE,          // take our values as-is
-		  0,                 // no extra data between each position
-		  0                  // offset of first element
-	);
-	
-	glEnableVertexAttribArray(attribute_v_normal);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_normals);
-	glVertexAttribPointer(
-		attribute_v_normal, // attribute
-		3,                  // number of elements per vertex, here (x,y,z)
-		GL_FLOAT,           // the type of each element
-		GL_FALSE,           // take our values as-is
-		0,                  // no extra data between each position
-		0                   // offset of first element
-	);
-	
-	/* Push each element in buffer_vertices to the vertex shader */
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_mesh_elements);
-	int size;  glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-	glDrawElements(GL_TRIANGLES, size/sizeof(GLushort), GL_UNSIGNED_SHORT, 0);
-	
-	glDisableVertexAttribArray(attribute_v_coord);
-	glDisableVertexAttribArray(attribute_v_normal);
+	const vertex_layout* layout;
+	if (!suzanne.meshlets.empty() && current_lod == 0) {
+		layout = &part_layouts[0];
+		bind_vertex_layout(layout);
+		draw_meshlets(suzanne.parts[0], visible_meshlets);
+	} else if (!suzanne.lods.empty()) {
+		layout = &lod_layouts[current_lod];
+		bind_vertex_layout(layout);
+		draw_submesh(suzanne.lods[current_lod]);
+	} else {
+		/* Each part indexes from its own first vertex */
+		layout = NULL;
+		for (size_t i = 0; i < suzanne.parts.size(); i++) {
+			layout = &part_layouts[i];
+			bind_vertex_layout(layout);
+			draw_submesh(suzanne.parts[i]);
+		}
+	}
+	if (layout != NULL)
+		unbind_vertex_layout(layout);
 	SDL_GL_SwapWindow(window);
 }
 
@@ -188,9 +206,11 @@ void onResize(int width, int height) {
 
 void free_resources() {
 	glDeleteProgram(program);
-	glDeleteBuffers(1, &vbo_mesh_vertices);
-	glDeleteBuffers(1, &vbo_mesh_normals);
-	glDeleteBuffers(1, &ibo_mesh_elements);
+	for (size_t i = 0; i < part_layouts.size(); i++)
+		free_vertex_layout(&part_layouts[i]);
+	for (size_t i = 0; i < lod_layouts.size(); i++)
+		free_vertex_layout(&lod_layouts[i]);
+	free_mesh(&suzanne);
 }
 
 void mainLoop(SDL_Window* window) {
@@ -208,6 +228,24 @@ void mainLoop(SDL_Window* window) {
 }
 
 int main(int argc, char* argv[]) {
+	/* suzanne [--split] [--optimize] [--packed] [--lod] [--meshlets] [--crease degrees] [file.obj] */
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--split") == 0)
+			mesh_options |= mesh_cache_split_16bit;
+		else if (strcmp(argv[i], "--optimize") == 0)
+			mesh_options |= mesh_cache_optimize;
+		else if (strcmp(argv[i], "--packed") == 0)
+			mesh_options |= mesh_cache_packed;
+		else if (strcmp(argv[i], "--lod") == 0)
+			mesh_options |= mesh_cache_lods;
+		else if (strcmp(argv[i], "--meshlets") == 0)
+			mesh_options |= mesh_cache_meshlets;
+		else if (strcmp(argv[i], "--crease") == 0 && i + 1 < argc)
+			crease_angle = atof(argv[++i]) * M_PI / 180;
+		else
+			obj_filename = argv[i];
+	}
+
 	SDL_Init(SDL_INIT_VIDEO);
 	SDL_Window* window = SDL_CreateWindow("My .obj Render",
 		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
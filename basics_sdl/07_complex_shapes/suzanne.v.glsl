@@ -1,9 +1,25 @@
 attribute vec4 v_coord;
 attribute vec3 v_normal;
 uniform mat4 mvp;
+/* Packed vertices store positions scaled to [-1, 1] over the mesh
+   bounds and octahedral normals in v_normal.xy */
+uniform vec3 decode_scale;
+uniform vec3 decode_offset;
+uniform bool octahedral_normals;
 
-void main(void) {
-  gl_Position = mvp * vec4(v_coord) + 0.00000000000000001 * v_normal.x;
+vec3 decode_normal(vec3 n) {
+  if (!octahedral_normals)
+    return n;
+  vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+  if (v.z < 0.0) {
+    vec2 s = vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    v.xy = (1.0 - abs(v.yx)) * s;
+  }
+  return normalize(v);
 }
 
-
+void main(void) {
+  vec3 position = v_coord.xyz * decode_scale + decode_offset;
+  vec3 normal = decode_normal(v_normal);
+  gl_Position = mvp * vec4(position, 1.0) + 0.00000000000000001 * normal.x;
+}
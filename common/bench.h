@@ -0,0 +1,41 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+/* Timing for the samples' *_bench programs, and with a GL loader
+ * included before, a checksum of the frame to compare draw paths */
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+inline double seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline double ms_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* 'run' a few times, the best time in ms */
+template<class F> double best_of(int nb_runs, F run) {
+	double best = 1e30;
+	for (int i = 0; i < nb_runs; i++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		run();
+		best = std::min(best, ms_since(start));
+	}
+	return best;
+}
+
+#ifdef GL_RGBA
+/* Sum of the pixels of the 'width' x 'height' frame, each weighted
+ * by its place so that moved pixels change it too */
+inline unsigned long long frame_checksum(int width, int height) {
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	unsigned long long sum = 0;
+	for (size_t i = 0; i < pixels.size(); i++)
+		sum += pixels[i] * (i % 251 + 1);
+	return sum;
+}
+#endif
+
+#endif
@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "block_compress.h"
+#include "simd.h"
+
+/* Each block's 16 pixels are spread into one float array per channel;
+ * its bounds, the covariance of its channels and the step each pixel
+ * takes along the line are worked out 8 (AVX2) or 4 (SSE2) pixels at
+ * a time. Rows of blocks are split between threads on large images. */
+
+/* A block's pixels, one array per channel */
+struct block_pixels {
+	float c[4][16];
+};
+
+/* Per-block arithmetic, in a SIMD and a scalar flavour */
+struct block_kernels {
+	/* Lowest and highest value of each channel */
+	void (*bounds)(const block_pixels &p, float* lo, float* hi);
+	/* For channels [first, first + n): sum over the pixels of
+	 * (c - centre[c]) * (ref - centre[ref]) */
+	void (*covariance)(const block_pixels &p, int first, int n, const float* centre, int ref, float* cov);
+	/* For channels [first, first + n): each pixel's nearest of the
+	 * nb_steps + 1 points from 'origin' to origin + 'axis' */
+	void (*steps)(const block_pixels &p, int first, int n, const float* origin, const float* axis, int nb_steps,
+		      int32_t* out);
+};
+
+static void bounds_scalar(const block_pixels &p, float* lo, float* hi) {
+	for (int c = 0; c < 4; c++) {
+		lo[c] = hi[c] = p.c[c][0];
+		for (int i = 1; i < 16; i++) {
+			lo[c] = min(lo[c], p.c[c][i]);
+			hi[c] = max(hi[c], p.c[c][i]);
+		}
+	}
+}
+
+static void covariance_scalar(const block_pixels &p, int first, int n, const float* centre, int ref, float* cov) {
+	for (int c = first; c < first + n; c++) {
+		float sum = 0;
+		for (int i = 0; i < 16; i++)
+			sum += (p.c[c][i] - centre[c]) * (p.c[ref][i] - centre[ref]);
+		cov[c] = sum;
+	}
+}
+
+static float squared_length(const float* axis, int n) {
+	float length = 0;
+	for (int c = 0; c < n; c++)
+		length += axis[c] * axis[c];
+	return length;
+}
+
+static void steps_scalar(const block_pixels &p, int first, int n, const float* origin, const float* axis,
+			 int nb_steps, int32_t* out) {
+	float scale = nb_steps / squared_length(axis, n);
+	for (int i = 0; i < 16; i++) {
+		float t = 0;
+		for (int c = 0; c < n; c++)
+			t += (p.c[first + c][i] - origin[c]) * axis[c];
+		out[i] = (int32_t)(min(max(t * scale, 0.0f), (float)nb_steps) + 0.5f);
+	}
+}
+
+#ifdef VFLOAT_SIMD
+static void bounds_simd(const block_pixels &p, float* lo, float* hi) {
+	for (int c = 0; c < 4; c++) {
+		vfloat vlo = v_load(p.c[c]), vhi = vlo;
+		for (int i = lanes; i < 16; i += lanes) {
+			vfloat v = v_load(p.c[c] + i);
+			vlo = v_min(vlo, v);
+			vhi = v_max(vhi, v);
+		}
+		lo[c] = v_reduce(vlo, min4);
+		hi[c] = v_reduce(vhi, max4);
+	}
+}
+
+static void covariance_simd(const block_pixels &p, int first, int n, const float* centre, int ref, float* cov) {
+	vfloat r[16 / lanes];
+	for (int i = 0; i < 16; i += lanes)
+		r[i / lanes] = v_sub(v_load(p.c[ref] + i), v_set1(centre[ref]));
+	for (int c = first; c < first + n; c++) {
+		vfloat sum = v_set1(0.0f);
+		for (int i = 0; i < 16; i += lanes)
+			sum = v_add(sum, v_mul(v_sub(v_load(p.c[c] + i), v_set1(centre[c])), r[i / lanes]));
+		cov[c] = v_reduce(sum, add4);
+	}
+}
+
+static void steps_simd(const block_pixels &p, int first, int n, const float* origin, const float* axis,
+		       int nb_steps, int32_t* out) {
+	vfloat scale = v_set1(nb_steps / squared_length(axis, n));
+	vfloat zero = v_set1(0.0f), top = v_set1(nb_steps), half = v_set1(0.5f);
+	for (int i = 0; i < 16; i += lanes) {
+		vfloat t = v_set1(0.0f);
+		for (int c = 0; c < n; c++)
+			t = v_add(t, v_mul(v_sub(v_load(p.c[first + c] + i), v_set1(origin[c])), v_set1(axis[c])));
+		v_store_int(out + i, v_add(v_min(v_max(v_mul(t, scale), zero), top), half));
+	}
+}
+
+static const block_kernels simd_kernels = { bounds_simd, covariance_simd, steps_simd };
+#else
+static const block_kernels simd_kernels = { bounds_scalar, covariance_scalar, steps_scalar };
+#endif
+
+static const block_kernels scalar_kernels = { bounds_scalar, covariance_scalar, steps_scalar };
+
+/* The ends of the line the block's colors are spread along, in
+ * channels [first, first + n): the corners of the bounding box on the
+ * diagonal that follows the covariance with the widest channel,
+ * moved in by 'inset' of the range */
+static void block_line(const block_pixels &p, const float* lo, const float* hi, int first, int n, float inset,
+		       const block_kernels &k, float* end0, float* end1) {
+	float centre[4], cov[4];
+	int ref = first;
+	for (int c = first; c < first + n; c++) {
+		centre[c] = (lo[c] + hi[c]) * 0.5f;
+		if (hi[c] - lo[c] > hi[ref] - lo[ref])
+			ref = c;
+	}
+	k.covariance(p, first, n, centre, ref, cov);
+	for (int c = first; c < first + n; c++) {
+		float d = (hi[c] - lo[c]) * inset;
+		end0[c - first] = hi[c] - d;
+		end1[c - first] = lo[c] + d;
+		if (cov[c] < 0)
+			swap(end0[c - first], end1[c - first]);
+	}
+}
+
+static inline void put_le(unsigned char* out, uint64_t value, int bytes) {
+	for (int i = 0; i < bytes; i++)
+		out[i] = value >> (8 * i);
+}
+
+static uint16_t pack565(const float* color) {
+	int r = (int)(min(max(color[0], 0.0f), 255.0f) * (31 / 255.0f) + 0.5f);
+	int g = (int)(min(max(color[1], 0.0f), 255.0f) * (63 / 255.0f) + 0.5f);
+	int b = (int)(min(max(color[2], 0.0f), 255.0f) * (31 / 255.0f) + 0.5f);
+	return r << 11 | g << 5 | b;
+}
+
+static void unpack565(uint16_t c, float* color) {
+	int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+	color[0] = r << 3 | r >> 2;
+	color[1] = g << 2 | g >> 4;
+	color[2] = b << 3 | b >> 2;
+}
+
+/* 4-color BC1 block: endpoints, then 2 bits per pixel */
+static void encode_bc1(const block_pixels &p, const float* lo, const float* hi, const block_kernels &k,
+		       unsigned char* out) {
+	float end0[3], end1[3];
+	block_line(p, lo, hi, 0, 3, 1 / 16.0f, k, end0, end1);
+	uint16_t c0 = pack565(end0), c1 = pack565(end1);
+	if (c0 < c1)
+		swap(c0, c1);  // c0 > c1 selects 4 colors
+	uint32_t indices = 0;
+	if (c0 != c1) {
+		float e0[3], e1[3], axis[3];
+		unpack565(c0, e0);
+		unpack565(c1, e1);
+		for (int c = 0; c < 3; c++)
+			axis[c] = e0[c] - e1[c];
+		int32_t steps[16];
+		k.steps(p, 0, 3, e1, axis, 3, steps);
+		static const uint32_t index_of_step[4] = { 1, 3, 2, 0 };
+		for (int i = 0; i < 16; i++)
+			indices |= index_of_step[steps[i]] << (2 * i);
+	}
+	put_le(out, c0, 2);
+	put_le(out + 2, c1, 2);
+	put_le(out + 4, indices, 4);
+}
+
+/* BC3 alpha block: the highest and lowest alpha, then 3 bits per
+ * pixel among 8 values between them */
+static void encode_bc3_alpha(const block_pixels &p, const float* lo, const float* hi, const block_kernels &k,
+			     unsigned char* out) {
+	int a0 = (int)(hi[3] + 0.5f), a1 = (int)(lo[3] + 0.5f);
+	uint64_t indices = 0;
+	if (a0 > a1) {
+		float origin = a1, axis = a0 - a1;
+		int32_t steps[16];
+		k.steps(p, 3, 1, &origin, &axis, 7, steps);
+		for (int i = 0; i < 16; i++) {
+			int s = steps[i];
+			uint64_t index = s == 7 ? 0 : s == 0 ? 1 : 8 - s;
+			indices |= index << (3 * i);
+		}
+	}
+	out[0] = a0;
+	out[1] = a1;
+	put_le(out + 2, indices, 6);
+}
+
+/* Bits of a BC7 block, least significant first */
+struct bit_writer {
+	unsigned char* out;
+	int bit;
+};
+
+static void put_bits(bit_writer &w, uint32_t value, int count) {
+	for (int i = 0; i < count; i++, w.bit++)
+		if ((value >> i) & 1)
+			w.out[w.bit >> 3] |= 1 << (w.bit & 7);
+}
+
+/* Closest 7-bit value and shared low bit to an RGBA endpoint */
+static void quantize_bc7_endpoint(const float* end, int* q, int* pbit) {
+	float best = 1e30f;
+	for (int p = 0; p < 2; p++) {
+		int candidate[4];
+		float error = 0;
+		for (int c = 0; c < 4; c++) {
+			candidate[c] = min(max((int)((end[c] - p) * 0.5f + 0.5f), 0), 127);
+			float d = (candidate[c] << 1 | p) - end[c];
+			error += d * d;
+		}
+		if (error < best) {
+			best = error;
+			memcpy(q, candidate, sizeof(candidate));
+			*pbit = p;
+		}
+	}
+}
+
+/* BC7 mode 6: RGBA endpoints of 7 bits and a shared low bit each,
+ * then 4 bits per pixel, the first pixel's top bit implied 0 */
+static void encode_bc7(const block_pixels &p, const float* lo, const float* hi, const block_kernels &k,
+		       unsigned char* out) {
+	float end[2][4];
+	block_line(p, lo, hi, 0, 4, 1 / 32.0f, k, end[0], end[1]);
+	int q[2][4], pbit[2];
+	float e[2][4], axis[4];
+	bool flat = true;
+	for (int j = 0; j < 2; j++) {
+		quantize_bc7_endpoint(end[j], q[j], &pbit[j]);
+		for (int c = 0; c < 4; c++)
+			e[j][c] = q[j][c] << 1 | pbit[j];
+	}
+	for (int c = 0; c < 4; c++) {
+		axis[c] = e[1][c] - e[0][c];
+		flat = flat && axis[c] == 0;
+	}
+	int32_t steps[16] = { 0 };
+	if (!flat)
+		k.steps(p, 0, 4, e[0], axis, 15, steps);
+	if (steps[0] >= 8) {
+		for (int c = 0; c < 4; c++)
+			swap(q[0][c], q[1][c]);
+		swap(pbit[0], pbit[1]);
+		for (int i = 0; i < 16; i++)
+			steps[i] = 15 - steps[i];
+	}
+
+	memset(out, 0, 16);
+	bit_writer w = { out, 0 };
+	put_bits(w, 1 << 6, 7);  // mode 6
+	for (int c = 0; c < 4; c++) {
+		put_bits(w, q[0][c], 7);
+		put_bits(w, q[1][c], 7);
+	}
+	put_bits(w, pbit[0], 1);
+	put_bits(w, pbit[1], 1);
+	put_bits(w, steps[0], 3);
+	for (int i = 1; i < 16; i++)
+		put_bits(w, steps[i], 4);
+}
+
+/* The block at (bx, by), clamped to the image */
+static void load_block(const unsigned char* pixels, int width, int height, int channels, int bx, int by,
+		       block_pixels &p) {
+	for (int y = 0; y < 4; y++) {
+		const unsigned char* row = pixels + (size_t)min(by * 4 + y, height - 1) * width * channels;
+		for (int x = 0; x < 4; x++) {
+			const unsigned char* pixel = row + min(bx * 4 + x, width - 1) * channels;
+			for (int c = 0; c < 4; c++)
+				p.c[c][y * 4 + x] = c < channels ? pixel[c] : 255.0f;
+		}
+	}
+}
+
+static void encode_block(const block_pixels &p, block_format format, const block_kernels &k, unsigned char* out) {
+	float lo[4], hi[4];
+	k.bounds(p, lo, hi);
+	if (format == block_bc1) {
+		encode_bc1(p, lo, hi, k, out);
+	} else if (format == block_bc3) {
+		encode_bc3_alpha(p, lo, hi, k, out);
+		encode_bc1(p, lo, hi, k, out + 8);
+	} else {
+		encode_bc7(p, lo, hi, k, out);
+	}
+}
+
+/* Below this many blocks per thread, starting threads costs more
+ * than it saves */
+static const size_t min_thread_blocks = 4096;
+
+/* job(first, end) over 'nb_rows' rows of 'width' blocks, cut in
+ * slices for up to 'nb_threads' threads, this one included */
+template<class F> static void for_block_rows(int nb_rows, int width, int nb_threads, F job) {
+	int n = min((size_t)nb_threads, (size_t)nb_rows * width / min_thread_blocks);
+	if (n <= 1) {
+		job(0, nb_rows);
+		return;
+	}
+	vector<thread> threads;
+	for (int i = 0; i < n - 1; i++)
+		threads.push_back(thread(job, nb_rows * i / n, nb_rows * (i + 1) / n));
+	job(nb_rows * (n - 1) / n, nb_rows);
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+static void compress(const unsigned char* pixels, int width, int height, int channels, block_format format,
+		     unsigned char* out, int nb_threads, const block_kernels &k) {
+	int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+	size_t size = block_bytes(format);
+	for_block_rows(blocks_y, blocks_x, nb_threads, [&](int first, int end) {
+		block_pixels p;
+		for (int by = first; by < end; by++) {
+			for (int bx = 0; bx < blocks_x; bx++) {
+				load_block(pixels, width, height, channels, bx, by, p);
+				encode_block(p, format, k, out + ((size_t)by * blocks_x + bx) * size);
+			}
+		}
+	});
+}
+
+const char* block_format_name(block_format format) {
+	return format == block_bc1 ? "BC1" : format == block_bc3 ? "BC3" : "BC7";
+}
+
+size_t block_bytes(block_format format) {
+	return format == block_bc1 ? 8 : 16;
+}
+
+size_t compressed_size(block_format format, int width, int height) {
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * block_bytes(format);
+}
+
+/* 'width' x 'height' pixels of 3 or 4 channels into compressed_size
+ * bytes at 'out', on up to 'nb_threads' threads, one per core when 0.
+ * BC1 ignores alpha. */
+void compress_image(const unsigned char* pixels, int width, int height, int channels, block_format format,
+		    unsigned char* out, int nb_threads) {
+	if (nb_threads <= 0)
+		nb_threads = max(1, (int)thread::hardware_concurrency());
+	compress(pixels, width, height, channels, format, out, nb_threads, simd_kernels);
+}
+
+/* The same without SIMD or threads, for reference */
+void compress_image_scalar(const unsigned char* pixels, int width, int height, int channels, block_format format,
+			   unsigned char* out) {
+	compress(pixels, width, height, channels, format, out, 1, scalar_kernels);
+}
+
+/* Every level of 'chain' */
+void compress_mip_chain(const mip_chain* chain, block_format format, ktx2_texture* texture, int nb_threads) {
+	static const ktx2_format formats[3][2] = { { ktx2_bc1_rgb_unorm, ktx2_bc1_rgb_srgb },
+						   { ktx2_bc3_unorm, ktx2_bc3_srgb },
+						   { ktx2_bc7_unorm, ktx2_bc7_srgb } };
+	texture->format = formats[format][chain->srgb];
+	texture->levels = chain->levels;
+	size_t size = 0;
+	for (size_t i = 0; i < texture->levels.size(); i++) {
+		mip_level &level = texture->levels[i];
+		level.offset = size;
+		size += compressed_size(format, level.width, level.height);
+	}
+	texture->data.resize(size);
+	for (size_t i = 0; i < texture->levels.size(); i++) {
+		const mip_level &level = texture->levels[i];
+		compress_image(&chain->pixels[chain->levels[i].offset], level.width, level.height, chain->channels,
+			       format, &texture->data[level.offset], nb_threads);
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef _BLOCK_COMPRESS_H
+#define _BLOCK_COMPRESS_H
+#include <cstddef>
+
+#include "ktx2.h"
+#include "mipmaps.h"
+
+/* Block compression of 8-bit pixels into 4x4 blocks the GPU samples
+ * directly: BC1 (8 bytes, RGB), BC3 (16 bytes, BC1 color and an
+ * interpolated alpha) and BC7 (16 bytes, RGBA). Endpoints come from
+ * the block's bounding box, turned to the diagonal that follows the
+ * colors and moved in a little; each pixel takes the nearest step
+ * along it. BC7 blocks all use mode 6, one RGBA line with 16 steps.
+ * Blocks over the edge of an image repeat its last row and column. */
+enum block_format {
+	block_bc1,
+	block_bc3,
+	block_bc7
+};
+
+extern const char* block_format_name(block_format format);
+extern size_t block_bytes(block_format format);
+extern size_t compressed_size(block_format format, int width, int height);
+extern void compress_image(const unsigned char* pixels, int width, int height, int channels, block_format format,
+			   unsigned char* out, int nb_threads = 0);
+extern void compress_image_scalar(const unsigned char* pixels, int width, int height, int channels,
+				  block_format format, unsigned char* out);
+extern void compress_mip_chain(const mip_chain* chain, block_format format, ktx2_texture* texture,
+			       int nb_threads = 0);
+
+#endif
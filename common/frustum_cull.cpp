@@ -0,0 +1,152 @@
+#include <cmath>
+#include <cstddef>
+using namespace std;
+
+#include <glm/glm.hpp>
+
+#include "frustum_cull.h"
+#include "simd.h"
+
+/* Objects are tested 8 (AVX2) or 4 (SSE2) at a time against each
+ * plane, their "outside" masks or-ed together; the visible ones are
+ * then appended to the list from the mask's bits. */
+
+/* The six planes of the frustum of 'mvp' in the space it transforms
+ * from (Gribb and Hartmann), normals facing in and normalized, so
+ * that dot(plane.xyz, p) + plane.w is the signed distance of p */
+void frustum_planes(const glm::mat4 &mvp, glm::vec4 planes[6]) {
+	glm::vec4 w(mvp[0][3], mvp[1][3], mvp[2][3], mvp[3][3]);
+	for (int i = 0; i < 3; i++) {
+		glm::vec4 row(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+		planes[i * 2] = w + row;
+		planes[i * 2 + 1] = w - row;
+	}
+	for (int i = 0; i < 6; i++)
+		planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+}
+
+static inline float plane_distance(const glm::vec4 &plane, float x, float y, float z) {
+	return plane.x * x + plane.y * y + plane.z * z + plane.w;
+}
+
+static size_t spheres_scalar(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+			     const float* radius, size_t first, size_t count, unsigned* visible, size_t nb_visible) {
+	for (size_t i = first; i < count; i++) {
+		bool outside = false;
+		for (int p = 0; p < 6; p++)
+			outside |= plane_distance(planes[p], x[i], y[i], z[i]) < -radius[i];
+		visible[nb_visible] = i;
+		nb_visible += !outside;
+	}
+	return nb_visible;
+}
+
+/* The box's reach towards a plane: its extents projected on the normal */
+static size_t boxes_scalar(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+			   const float* ex, const float* ey, const float* ez,
+			   size_t first, size_t count, unsigned* visible, size_t nb_visible) {
+	for (size_t i = first; i < count; i++) {
+		bool outside = false;
+		for (int p = 0; p < 6; p++) {
+			float reach = fabsf(planes[p].x) * ex[i] + fabsf(planes[p].y) * ey[i] + fabsf(planes[p].z) * ez[i];
+			outside |= plane_distance(planes[p], x[i], y[i], z[i]) < -reach;
+		}
+		visible[nb_visible] = i;
+		nb_visible += !outside;
+	}
+	return nb_visible;
+}
+
+size_t cull_spheres_scalar(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+			   const float* radius, size_t count, unsigned* visible) {
+	return spheres_scalar(planes, x, y, z, radius, 0, count, visible, 0);
+}
+
+size_t cull_boxes_scalar(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+			 const float* extent_x, const float* extent_y, const float* extent_z,
+			 size_t count, unsigned* visible) {
+	return boxes_scalar(planes, x, y, z, extent_x, extent_y, extent_z, 0, count, visible, 0);
+}
+
+#ifdef VFLOAT_SIMD
+/* Append the objects of 'first' ... 'first + lanes' whose bit in
+ * 'outside' is clear */
+static inline size_t append_visible(int outside, size_t first, unsigned* visible, size_t nb_visible) {
+	unsigned inside = ~outside & ((1u << lanes) - 1);
+	while (inside != 0) {
+		visible[nb_visible++] = first + __builtin_ctz(inside);
+		inside &= inside - 1;
+	}
+	return nb_visible;
+}
+
+struct simd_planes {
+	vfloat x[6], y[6], z[6], w[6];
+	vfloat abs_x[6], abs_y[6], abs_z[6];
+};
+
+static void splat_planes(const glm::vec4 planes[6], simd_planes &out) {
+	for (int p = 0; p < 6; p++) {
+		out.x[p] = v_set1(planes[p].x);
+		out.y[p] = v_set1(planes[p].y);
+		out.z[p] = v_set1(planes[p].z);
+		out.w[p] = v_set1(planes[p].w);
+		out.abs_x[p] = v_set1(fabsf(planes[p].x));
+		out.abs_y[p] = v_set1(fabsf(planes[p].y));
+		out.abs_z[p] = v_set1(fabsf(planes[p].z));
+	}
+}
+
+static inline vfloat v_distance(const simd_planes &planes, int p, vfloat x, vfloat y, vfloat z) {
+	// Same order of operations as plane_distance
+	return v_add(v_add(v_add(v_mul(planes.x[p], x), v_mul(planes.y[p], y)), v_mul(planes.z[p], z)), planes.w[p]);
+}
+
+size_t cull_spheres(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+		    const float* radius, size_t count, unsigned* visible) {
+	simd_planes sp;
+	splat_planes(planes, sp);
+	vfloat minus_one = v_set1(-1.0f);
+	size_t nb_visible = 0, i = 0;
+	for (; i + lanes <= count; i += lanes) {
+		vfloat vx = v_load(x + i), vy = v_load(y + i), vz = v_load(z + i);
+		vfloat neg_radius = v_mul(v_load(radius + i), minus_one);
+		vfloat outside = v_zero();
+		for (int p = 0; p < 6; p++)
+			outside = v_or(outside, v_less(v_distance(sp, p, vx, vy, vz), neg_radius));
+		nb_visible = append_visible(v_mask(outside), i, visible, nb_visible);
+	}
+	return spheres_scalar(planes, x, y, z, radius, i, count, visible, nb_visible);
+}
+
+size_t cull_boxes(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+		  const float* extent_x, const float* extent_y, const float* extent_z,
+		  size_t count, unsigned* visible) {
+	simd_planes sp;
+	splat_planes(planes, sp);
+	vfloat minus_one = v_set1(-1.0f);
+	size_t nb_visible = 0, i = 0;
+	for (; i + lanes <= count; i += lanes) {
+		vfloat vx = v_load(x + i), vy = v_load(y + i), vz = v_load(z + i);
+		vfloat ex = v_load(extent_x + i), ey = v_load(extent_y + i), ez = v_load(extent_z + i);
+		vfloat outside = v_zero();
+		for (int p = 0; p < 6; p++) {
+			vfloat reach = v_add(v_add(v_mul(sp.abs_x[p], ex), v_mul(sp.abs_y[p], ey)), v_mul(sp.abs_z[p], ez));
+			outside = v_or(outside, v_less(v_distance(sp, p, vx, vy, vz), v_mul(reach, minus_one)));
+		}
+		nb_visible = append_visible(v_mask(outside), i, visible, nb_visible);
+	}
+	return boxes_scalar(planes, x, y, z, extent_x, extent_y, extent_z, i, count, visible, nb_visible);
+}
+#else
+size_t cull_spheres(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+		    const float* radius, size_t count, unsigned* visible) {
+	return cull_spheres_scalar(planes, x, y, z, radius, count, visible);
+}
+
+size_t cull_boxes(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+		  const float* extent_x, const float* extent_y, const float* extent_z,
+		  size_t count, unsigned* visible) {
+	return cull_boxes_scalar(planes, x, y, z, extent_x, extent_y, extent_z, count, visible);
+}
+#endif
@@ -0,0 +1,23 @@
+#ifndef _FRUSTUM_CULL_H
+#define _FRUSTUM_CULL_H
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/* Frustum culling of many objects, their bounds stored as one array
+ * per component. The culled functions write the indices of the
+ * objects that may be visible, in order, to 'visible' (room for
+ * 'count') and return how many there are. */
+
+extern void frustum_planes(const glm::mat4 &mvp, glm::vec4 planes[6]);
+extern size_t cull_spheres(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+			   const float* radius, size_t count, unsigned* visible);
+extern size_t cull_spheres_scalar(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+				  const float* radius, size_t count, unsigned* visible);
+extern size_t cull_boxes(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+			 const float* extent_x, const float* extent_y, const float* extent_z,
+			 size_t count, unsigned* visible);
+extern size_t cull_boxes_scalar(const glm::vec4 planes[6], const float* x, const float* y, const float* z,
+				const float* extent_x, const float* extent_y, const float* extent_z,
+				size_t count, unsigned* visible);
+
+#endif
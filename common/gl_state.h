@@ -0,0 +1,236 @@
+#ifndef _GL_STATE_H
+#define _GL_STATE_H
+/* Shadow copy of the GL state the samples set every frame (program,
+ * buffers, vertex array and attributes, textures per unit, blending,
+ * depth and viewport), to drop the calls that would not change
+ * anything.
+ * Every change to the tracked state must go through it; call
+ * gl_state_invalidate after code that bypasses it, and after
+ * deleting a bound object. */
+
+const GLuint gl_state_unknown = ~0u;
+const int gl_state_max_texture_units = 16;
+const int gl_state_max_attribs = 16;
+const int gl_state_texture_targets = 4;  // 2D, cube map, 3D, 2D array
+
+/* GL calls made, and skipped as redundant */
+struct gl_state_counters {
+	unsigned issued;
+	unsigned elided;
+};
+
+/* glVertexAttribPointer arguments, plus the buffer it captured */
+struct gl_state_attrib {
+	GLuint enabled;  // GL_TRUE, GL_FALSE or gl_state_unknown
+	GLuint buffer;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
+	const void* pointer;
+};
+
+struct gl_state {
+	GLuint program;
+	GLuint vertex_array;
+	GLuint array_buffer;
+	GLuint element_array_buffer;  // part of the vertex array's state
+	gl_state_attrib attribs[gl_state_max_attribs];  // likewise
+	GLuint active_texture;  // unit index
+	GLuint textures[gl_state_max_texture_units][gl_state_texture_targets];
+	GLuint blend;
+	GLenum blend_src, blend_dst;
+	GLuint depth_test;
+	GLenum depth_func;
+	GLuint depth_mask;
+	GLint viewport[4];
+	gl_state_counters frame;       // since gl_state_new_frame
+	gl_state_counters last_frame;  // the whole previous frame
+};
+
+/* Forget what the vertex array holds */
+inline void gl_state_invalidate_attribs(gl_state* state) {
+	state->element_array_buffer = gl_state_unknown;
+	for (int i = 0; i < gl_state_max_attribs; i++) {
+		state->attribs[i] = gl_state_attrib();
+		state->attribs[i].enabled = gl_state_unknown;
+	}
+}
+
+/* Forget everything: the next call of each kind reaches GL */
+inline void gl_state_invalidate(gl_state* state) {
+	state->program = gl_state_unknown;
+	state->vertex_array = gl_state_unknown;
+	state->array_buffer = gl_state_unknown;
+	gl_state_invalidate_attribs(state);
+	state->active_texture = gl_state_unknown;
+	for (int unit = 0; unit < gl_state_max_texture_units; unit++)
+		for (int target = 0; target < gl_state_texture_targets; target++)
+			state->textures[unit][target] = gl_state_unknown;
+	state->blend = gl_state_unknown;
+	state->blend_src = state->blend_dst = gl_state_unknown;
+	state->depth_test = gl_state_unknown;
+	state->depth_func = gl_state_unknown;
+	state->depth_mask = gl_state_unknown;
+	state->viewport[0] = state->viewport[1] = -1;
+	state->viewport[2] = state->viewport[3] = -1;
+}
+
+inline void gl_state_init(gl_state* state) {
+	gl_state_invalidate(state);
+	state->frame = gl_state_counters();
+	state->last_frame = gl_state_counters();
+}
+
+/* Call once per frame, before drawing: moves the counters to last_frame */
+inline void gl_state_new_frame(gl_state* state) {
+	state->last_frame = state->frame;
+	state->frame = gl_state_counters();
+}
+
+/* Count the call, and tell whether to make it */
+inline bool gl_state_changed(gl_state* state, bool changed) {
+	if (changed)
+		state->frame.issued++;
+	else
+		state->frame.elided++;
+	return changed;
+}
+
+inline void gl_use_program(gl_state* state, GLuint program) {
+	if (gl_state_changed(state, state->program != program)) {
+		glUseProgram(program);
+		state->program = program;
+	}
+}
+
+inline void gl_bind_vertex_array(gl_state* state, GLuint vertex_array) {
+	if (gl_state_changed(state, state->vertex_array != vertex_array)) {
+		glBindVertexArray(vertex_array);
+		state->vertex_array = vertex_array;
+		gl_state_invalidate_attribs(state);
+	}
+}
+
+/* Tracks GL_ARRAY_BUFFER and GL_ELEMENT_ARRAY_BUFFER, passes others */
+inline void gl_bind_buffer(gl_state* state, GLenum target, GLuint buffer) {
+	GLuint* current = NULL;
+	if (target == GL_ARRAY_BUFFER)
+		current = &state->array_buffer;
+	else if (target == GL_ELEMENT_ARRAY_BUFFER)
+		current = &state->element_array_buffer;
+	if (gl_state_changed(state, current == NULL || *current != buffer)) {
+		glBindBuffer(target, buffer);
+		if (current != NULL)
+			*current = buffer;
+	}
+}
+
+inline void gl_enable_vertex_attrib_array(gl_state* state, GLuint index, bool enabled) {
+	GLuint* current = index < (GLuint)gl_state_max_attribs ? &state->attribs[index].enabled : NULL;
+	GLuint value = enabled ? GL_TRUE : GL_FALSE;
+	if (gl_state_changed(state, current == NULL || *current != value)) {
+		if (enabled)
+			glEnableVertexAttribArray(index);
+		else
+			glDisableVertexAttribArray(index);
+		if (current != NULL)
+			*current = value;
+	}
+}
+
+/* Sources the attribute from the bound GL_ARRAY_BUFFER, like GL */
+inline void gl_vertex_attrib_pointer(gl_state* state, GLuint index, GLint size, GLenum type,
+				     GLboolean normalized, GLsizei stride, const void* pointer) {
+	gl_state_attrib* current = index < (GLuint)gl_state_max_attribs ? &state->attribs[index] : NULL;
+	bool same = current != NULL && state->array_buffer != gl_state_unknown
+		&& current->buffer == state->array_buffer && current->size == size
+		&& current->type == type && current->normalized == normalized
+		&& current->stride == stride && current->pointer == pointer;
+	if (gl_state_changed(state, !same)) {
+		glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+		if (current != NULL) {
+			current->buffer = state->array_buffer;
+			current->size = size;
+			current->type = type;
+			current->normalized = normalized;
+			current->stride = stride;
+			current->pointer = pointer;
+		}
+	}
+}
+
+inline int gl_state_texture_target(GLenum target) {
+	switch (target) {
+	case GL_TEXTURE_2D:       return 0;
+	case GL_TEXTURE_CUBE_MAP: return 1;
+	case GL_TEXTURE_3D:       return 2;
+	case GL_TEXTURE_2D_ARRAY: return 3;
+	default:                  return -1;
+	}
+}
+
+/* Bind 'texture' on texture unit 'unit', switching the active unit
+ * only when the binding changes */
+inline void gl_bind_texture(gl_state* state, GLuint unit, GLenum target, GLuint texture) {
+	int index = gl_state_texture_target(target);
+	GLuint* current = (unit < (GLuint)gl_state_max_texture_units && index >= 0)
+		? &state->textures[unit][index] : NULL;
+	if (!gl_state_changed(state, current == NULL || *current != texture))
+		return;
+	if (gl_state_changed(state, state->active_texture != unit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		state->active_texture = unit;
+	}
+	glBindTexture(target, texture);
+	if (current != NULL)
+		*current = texture;
+}
+
+/* Toggle a capability tracked in 'current' */
+inline void gl_state_enable(gl_state* state, GLuint* current, GLenum cap, bool enabled) {
+	GLuint value = enabled ? GL_TRUE : GL_FALSE;
+	if (gl_state_changed(state, *current != value)) {
+		if (enabled)
+			glEnable(cap);
+		else
+			glDisable(cap);
+		*current = value;
+	}
+}
+
+/* The blend function is only set when blending is on */
+inline void gl_set_blend(gl_state* state, bool enabled, GLenum src = GL_ONE, GLenum dst = GL_ZERO) {
+	gl_state_enable(state, &state->blend, GL_BLEND, enabled);
+	if (enabled && gl_state_changed(state, state->blend_src != src || state->blend_dst != dst)) {
+		glBlendFunc(src, dst);
+		state->blend_src = src;
+		state->blend_dst = dst;
+	}
+}
+
+inline void gl_set_depth(gl_state* state, bool test, GLenum func = GL_LESS, bool write = true) {
+	gl_state_enable(state, &state->depth_test, GL_DEPTH_TEST, test);
+	if (test && gl_state_changed(state, state->depth_func != func)) {
+		glDepthFunc(func);
+		state->depth_func = func;
+	}
+	GLuint mask = write ? GL_TRUE : GL_FALSE;
+	if (gl_state_changed(state, state->depth_mask != mask)) {
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+		state->depth_mask = mask;
+	}
+}
+
+inline void gl_set_viewport(gl_state* state, GLint x, GLint y, GLsizei width, GLsizei height) {
+	GLint* v = state->viewport;
+	if (gl_state_changed(state, v[0] != x || v[1] != y || v[2] != width || v[3] != height)) {
+		glViewport(x, y, width, height);
+		v[0] = x;
+		v[1] = y;
+		v[2] = width;
+		v[3] = height;
+	}
+}
+
+#endif
@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <sys/stat.h>
+
+#include "ktx2.h"
+#include "mapped_file.h"
+
+/* Layout of a KTX2 file: this header, the level index, the data
+ * format descriptor (DFD), the key/value data, then the levels,
+ * smallest first. Everything is little-endian, which is native byte
+ * order on every platform the samples run on. */
+static const unsigned char ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct ktx2_header {
+	unsigned char identifier[12];
+	uint32_t vk_format;
+	uint32_t type_size;
+	uint32_t pixel_width, pixel_height, pixel_depth;
+	uint32_t layer_count, face_count, level_count;
+	uint32_t supercompression_scheme;
+	uint32_t dfd_byte_offset, dfd_byte_length;
+	uint32_t kvd_byte_offset, kvd_byte_length;
+	uint64_t sgd_byte_offset, sgd_byte_length;
+};
+
+struct ktx2_level_index {
+	uint64_t byte_offset;
+	uint64_t byte_length;
+	uint64_t uncompressed_byte_length;
+};
+
+bool ktx2_format_compressed(ktx2_format format) {
+	return format >= ktx2_bc1_rgb_unorm;
+}
+
+bool ktx2_format_srgb(ktx2_format format) {
+	return format == ktx2_r8g8b8_srgb || format == ktx2_r8g8b8a8_srgb || format == ktx2_bc1_rgb_srgb
+		|| format == ktx2_bc3_srgb || format == ktx2_bc7_srgb;
+}
+
+/* Channels of the pixels the format holds, or decodes to */
+int ktx2_format_channels(ktx2_format format) {
+	return format == ktx2_r8g8b8_unorm || format == ktx2_r8g8b8_srgb || format == ktx2_bc1_rgb_unorm
+		|| format == ktx2_bc1_rgb_srgb ? 3 : 4;
+}
+
+static bool known_format(uint32_t format) {
+	static const uint32_t formats[] = { ktx2_r8g8b8_unorm, ktx2_r8g8b8_srgb, ktx2_r8g8b8a8_unorm,
+		ktx2_r8g8b8a8_srgb, ktx2_bc1_rgb_unorm, ktx2_bc1_rgb_srgb, ktx2_bc3_unorm, ktx2_bc3_srgb,
+		ktx2_bc7_unorm, ktx2_bc7_srgb };
+	return find(formats, formats + sizeof(formats) / sizeof(formats[0]), format) != formats + sizeof(formats) / sizeof(formats[0]);
+}
+
+/* Bytes per texel, or per 4x4 block */
+static size_t element_size(ktx2_format format) {
+	if (!ktx2_format_compressed(format))
+		return ktx2_format_channels(format);
+	return format == ktx2_bc1_rgb_unorm || format == ktx2_bc1_rgb_srgb ? 8 : 16;
+}
+
+size_t ktx2_level_size(ktx2_format format, int width, int height) {
+	if (ktx2_format_compressed(format))
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * element_size(format);
+	return (size_t)width * height * element_size(format);
+}
+
+/* Levels start on a multiple of both the element size and 4 */
+static uint64_t align_level(uint64_t offset, ktx2_format format) {
+	uint64_t alignment = element_size(format) == 3 ? 12 : max((size_t)4, element_size(format));
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+/* Takes the chain's pixels */
+void ktx2_from_mip_chain(mip_chain* chain, ktx2_texture* texture) {
+	if (chain->channels == 3)
+		texture->format = chain->srgb ? ktx2_r8g8b8_srgb : ktx2_r8g8b8_unorm;
+	else
+		texture->format = chain->srgb ? ktx2_r8g8b8a8_srgb : ktx2_r8g8b8a8_unorm;
+	texture->levels = chain->levels;
+	texture->data.swap(chain->pixels);
+	chain->pixels.clear();
+}
+
+/* The value of 'key', or NULL */
+const char* ktx2_metadata(const ktx2_texture* texture, const char* key) {
+	for (size_t i = 0; i < texture->metadata.size(); i++)
+		if (texture->metadata[i].first == key)
+			return texture->metadata[i].second.c_str();
+	return NULL;
+}
+
+void ktx2_set_metadata(ktx2_texture* texture, const char* key, const string &value) {
+	for (size_t i = 0; i < texture->metadata.size(); i++) {
+		if (texture->metadata[i].first == key) {
+			texture->metadata[i].second = value;
+			return;
+		}
+	}
+	texture->metadata.push_back(make_pair(string(key), value));
+}
+
+/* Size, mtime and content hash of a source file, as text */
+static bool source_stamp(const char* filename, bool with_hash, string* stamp) {
+	struct stat st;
+	if (stat(filename, &st) < 0)
+		return false;
+	unsigned long long hash = 0;
+	if (with_hash) {
+		mapped_file file;
+		if (!map_file(filename, &file))
+			return false;
+		hash = hash_bytes(file.data, file.size);
+		unmap_file(&file);
+	}
+	char text[64];
+	snprintf(text, sizeof(text), "%llu %lld %016llx", (unsigned long long)st.st_size, (long long)st.st_mtime, hash);
+	*stamp = text;
+	return true;
+}
+
+/* Record what the texture was built from, for ktx2_matches_source */
+bool ktx2_set_source(ktx2_texture* texture, const char* source_filename) {
+	string stamp;
+	if (!source_stamp(source_filename, true, &stamp))
+		return false;
+	ktx2_set_metadata(texture, "source", stamp);
+	return true;
+}
+
+/* Whether the texture was built from 'source_filename' as it is now.
+ * As in the mesh cache, a changed mtime only counts if the content
+ * changed too. */
+bool ktx2_matches_source(const ktx2_texture* texture, const char* source_filename) {
+	const char* recorded = ktx2_metadata(texture, "source");
+	unsigned long long size, hash;
+	long long mtime;
+	string stamp;
+	if (recorded == NULL || sscanf(recorded, "%llu %lld %llx", &size, &mtime, &hash) != 3
+	    || !source_stamp(source_filename, false, &stamp))
+		return false;
+	unsigned long long now_size, now_hash;
+	long long now_mtime;
+	sscanf(stamp.c_str(), "%llu %lld %llx", &now_size, &now_mtime, &now_hash);
+	if (size != now_size)
+		return false;
+	if (mtime == now_mtime)
+		return true;
+	return source_stamp(source_filename, true, &stamp)
+		&& sscanf(stamp.c_str(), "%llu %lld %llx", &now_size, &now_mtime, &now_hash) == 3 && hash == now_hash;
+}
+
+/* The basic data format descriptor of 'format': its color model and
+ * where each channel, or each part of a block, sits */
+static vector<uint32_t> make_dfd(ktx2_format format) {
+	enum { model_rgbsda = 1, model_bc1a = 128, model_bc3 = 130, model_bc7 = 134 };
+	struct sample { uint32_t bit_offset, bit_length, channel, lower, upper; };
+	vector<sample> samples;
+	uint32_t model;
+	bool srgb = ktx2_format_srgb(format);
+	if (!ktx2_format_compressed(format)) {
+		model = model_rgbsda;
+		for (int c = 0; c < ktx2_format_channels(format); c++) {
+			// Channel ids 0, 1, 2 and 15 for alpha, which stays linear
+			sample s = { (uint32_t)c * 8, 8, c == 3 ? 15u : (uint32_t)c, 0, 255 };
+			if (c == 3 && srgb)
+				s.channel |= 0x10;
+			samples.push_back(s);
+		}
+	} else if (format == ktx2_bc1_rgb_unorm || format == ktx2_bc1_rgb_srgb) {
+		model = model_bc1a;
+		sample color = { 0, 64, 0, 0, 0xFFFFFFFF };
+		samples.push_back(color);
+	} else if (format == ktx2_bc3_unorm || format == ktx2_bc3_srgb) {
+		model = model_bc3;
+		sample alpha = { 0, 64, 15 | (srgb ? 0x10u : 0), 0, 0xFFFFFFFF };
+		sample color = { 64, 64, 0, 0, 0xFFFFFFFF };
+		samples.push_back(alpha);
+		samples.push_back(color);
+	} else {
+		model = model_bc7;
+		sample color = { 0, 128, 0, 0, 0xFFFFFFFF };
+		samples.push_back(color);
+	}
+
+	uint32_t block_size = 24 + 16 * samples.size();
+	vector<uint32_t> dfd;
+	dfd.push_back(4 + block_size);                  // total size
+	dfd.push_back(0);                               // Khronos vendor, basic descriptor type
+	dfd.push_back(2 | block_size << 16);            // version 2
+	dfd.push_back(model | 1 << 8 | (srgb ? 2 : 1) << 16);  // BT.709 primaries, sRGB or linear transfer
+	dfd.push_back(ktx2_format_compressed(format) ? 3 | 3 << 8 : 0);  // block size minus 1
+	dfd.push_back(element_size(format));            // bytes per plane
+	dfd.push_back(0);
+	for (size_t i = 0; i < samples.size(); i++) {
+		const sample &s = samples[i];
+		dfd.push_back(s.bit_offset | (s.bit_length - 1) << 16 | s.channel << 24);
+		dfd.push_back(0);                       // sample position
+		dfd.push_back(s.lower);
+		dfd.push_back(s.upper);
+	}
+	return dfd;
+}
+
+/* Key/value data: each entry's length, then key and value each
+ * NUL-terminated, padded to 4 bytes; sorted by key */
+static vector<unsigned char> make_kvd(const ktx2_texture* texture) {
+	vector<pair<string, string> > entries = texture->metadata;
+	entries.push_back(make_pair(string("KTXwriter"), string("graphics common/ktx2")));
+	sort(entries.begin(), entries.end());
+	vector<unsigned char> kvd;
+	for (size_t i = 0; i < entries.size(); i++) {
+		uint32_t length = entries[i].first.size() + 1 + entries[i].second.size() + 1;
+		kvd.insert(kvd.end(), (unsigned char*)&length, (unsigned char*)&length + 4);
+		kvd.insert(kvd.end(), entries[i].first.c_str(), entries[i].first.c_str() + entries[i].first.size() + 1);
+		kvd.insert(kvd.end(), entries[i].second.c_str(), entries[i].second.c_str() + entries[i].second.size() + 1);
+		kvd.resize((kvd.size() + 3) & ~(size_t)3);
+	}
+	return kvd;
+}
+
+static bool write_at(FILE* f, uint64_t offset, const void* data, size_t size) {
+	return fseek(f, offset, SEEK_SET) == 0 && fwrite(data, 1, size, f) == size;
+}
+
+/* Written to a temporary file, then renamed into place */
+bool write_ktx2(const char* filename, const ktx2_texture* texture) {
+	if (texture->levels.empty())
+		return false;
+	vector<uint32_t> dfd = make_dfd(texture->format);
+	vector<unsigned char> kvd = make_kvd(texture);
+	uint32_t nb_levels = texture->levels.size();
+
+	ktx2_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.identifier, ktx2_identifier, sizeof(ktx2_identifier));
+	header.vk_format = texture->format;
+	header.type_size = 1;
+	header.pixel_width = texture->levels[0].width;
+	header.pixel_height = texture->levels[0].height;
+	header.face_count = 1;
+	header.level_count = nb_levels;
+	header.dfd_byte_offset = sizeof(header) + nb_levels * sizeof(ktx2_level_index);
+	header.dfd_byte_length = dfd.size() * 4;
+	header.kvd_byte_offset = header.dfd_byte_offset + header.dfd_byte_length;
+	header.kvd_byte_length = kvd.size();
+
+	vector<ktx2_level_index> index(nb_levels);
+	uint64_t offset = header.kvd_byte_offset + header.kvd_byte_length;
+	for (int i = nb_levels - 1; i >= 0; i--) {
+		const mip_level &level = texture->levels[i];
+		offset = align_level(offset, texture->format);
+		index[i].byte_offset = offset;
+		index[i].byte_length = index[i].uncompressed_byte_length
+			= ktx2_level_size(texture->format, level.width, level.height);
+		if (level.offset + index[i].byte_length > texture->data.size())
+			return false;
+		offset += index[i].byte_length;
+	}
+
+	string tmp_filename = string(filename) + ".tmp";
+	FILE* f = fopen(tmp_filename.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	bool ok = write_at(f, 0, &header, sizeof(header))
+		&& write_at(f, sizeof(header), index.data(), index.size() * sizeof(ktx2_level_index))
+		&& write_at(f, header.dfd_byte_offset, dfd.data(), header.dfd_byte_length)
+		&& write_at(f, header.kvd_byte_offset, kvd.data(), kvd.size());
+	for (uint32_t i = 0; ok && i < nb_levels; i++)
+		ok = write_at(f, index[i].byte_offset, &texture->data[texture->levels[i].offset], index[i].byte_length);
+	ok = (fclose(f) == 0) && ok;
+	if (!ok || rename(tmp_filename.c_str(), filename) != 0) {
+		remove(tmp_filename.c_str());
+		return false;
+	}
+	return true;
+}
+
+/* A 2D texture in one of the formats above, without
+ * supercompression; false, quietly, when the file is missing */
+bool read_ktx2(const char* filename, ktx2_texture* texture) {
+	struct stat st;
+	if (stat(filename, &st) < 0)
+		return false;
+	mapped_file file;
+	if (!map_file(filename, &file))
+		return false;
+
+	const ktx2_header* header = (const ktx2_header*)file.data;
+	const ktx2_level_index* index = (const ktx2_level_index*)(file.data + sizeof(ktx2_header));
+	bool valid = file.size >= sizeof(ktx2_header)
+		&& memcmp(header->identifier, ktx2_identifier, sizeof(ktx2_identifier)) == 0
+		&& known_format(header->vk_format)
+		&& header->pixel_width > 0 && header->pixel_height > 0 && header->pixel_depth == 0
+		&& header->layer_count == 0 && header->face_count == 1
+		&& header->level_count > 0 && header->level_count <= 32
+		&& header->supercompression_scheme == 0
+		&& sizeof(ktx2_header) + header->level_count * sizeof(ktx2_level_index) <= file.size
+		&& (uint64_t)header->kvd_byte_offset + header->kvd_byte_length <= file.size;
+	ktx2_format format = (ktx2_format)(valid ? header->vk_format : 0);
+	size_t size = 0;
+	for (uint32_t i = 0; valid && i < header->level_count; i++) {
+		size_t expected = ktx2_level_size(format, max(1u, header->pixel_width >> i), max(1u, header->pixel_height >> i));
+		valid = index[i].byte_length == expected && index[i].byte_offset <= file.size
+			&& expected <= file.size - index[i].byte_offset;
+		size += expected;
+	}
+	if (!valid) {
+		unmap_file(&file);
+		return false;
+	}
+
+	texture->format = format;
+	texture->levels.resize(header->level_count);
+	texture->data.resize(size);
+	size_t offset = 0;
+	for (uint32_t i = 0; i < header->level_count; i++) {
+		mip_level &level = texture->levels[i];
+		level.width = max(1u, header->pixel_width >> i);
+		level.height = max(1u, header->pixel_height >> i);
+		level.offset = offset;
+		memcpy(&texture->data[offset], file.data + index[i].byte_offset, index[i].byte_length);
+		offset += index[i].byte_length;
+	}
+	texture->metadata.clear();
+	const char* kvd = file.data + header->kvd_byte_offset;
+	const char* end = kvd + header->kvd_byte_length;
+	while (kvd + 4 <= end) {
+		uint32_t length;
+		memcpy(&length, kvd, 4);
+		const char* entry = kvd + 4;
+		if (length > (size_t)(end - entry))
+			break;
+		const char* key_end = (const char*)memchr(entry, '\0', length);
+		if (key_end != NULL) {
+			const char* value = key_end + 1;
+			size_t value_length = entry + length - value;
+			if (value_length > 0 && value[value_length - 1] == '\0')
+				value_length--;
+			texture->metadata.push_back(make_pair(string(entry, key_end), string(value, value_length)));
+		}
+		kvd = entry + ((length + 3) & ~(uint32_t)3);
+	}
+	unmap_file(&file);
+	return true;
+}
@@ -0,0 +1,46 @@
+#ifndef _KTX2_H
+#define _KTX2_H
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mipmaps.h"
+
+/* Vulkan numbers of the formats written here, as KTX2 names them */
+enum ktx2_format {
+	ktx2_r8g8b8_unorm = 23,
+	ktx2_r8g8b8_srgb = 29,
+	ktx2_r8g8b8a8_unorm = 37,
+	ktx2_r8g8b8a8_srgb = 43,
+	ktx2_bc1_rgb_unorm = 131,
+	ktx2_bc1_rgb_srgb = 132,
+	ktx2_bc3_unorm = 137,
+	ktx2_bc3_srgb = 138,
+	ktx2_bc7_unorm = 145,
+	ktx2_bc7_srgb = 146
+};
+
+/* A 2D texture and its levels, level 0 first in 'data' (the file has
+ * them smallest first), with its key/value metadata. Block formats
+ * store 4x4 blocks, the levels' width and height stay in pixels. */
+struct ktx2_texture {
+	ktx2_format format;
+	std::vector<mip_level> levels;
+	std::vector<unsigned char> data;
+	std::vector<std::pair<std::string, std::string> > metadata;
+};
+
+extern bool ktx2_format_compressed(ktx2_format format);
+extern bool ktx2_format_srgb(ktx2_format format);
+extern int ktx2_format_channels(ktx2_format format);
+extern size_t ktx2_level_size(ktx2_format format, int width, int height);
+extern void ktx2_from_mip_chain(mip_chain* chain, ktx2_texture* texture);
+extern const char* ktx2_metadata(const ktx2_texture* texture, const char* key);
+extern void ktx2_set_metadata(ktx2_texture* texture, const char* key, const std::string &value);
+extern bool ktx2_set_source(ktx2_texture* texture, const char* source_filename);
+extern bool ktx2_matches_source(const ktx2_texture* texture, const char* source_filename);
+extern bool write_ktx2(const char* filename, const ktx2_texture* texture);
+extern bool read_ktx2(const char* filename, ktx2_texture* texture);
+
+#endif
@@ -0,0 +1,122 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+/* Fallback for platforms (or files) that can't be mmap'd: read
+ * the whole file into a heap buffer. */
+static bool read_file(const char* filename, mapped_file* file) {
+	FILE* f = fopen(filename, "rb");
+	if (f == NULL) return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (size < 0) {
+		fclose(f);
+		return false;
+	}
+
+	char* buf = (char*)malloc(size + 1);
+	size_t nb_read = fread(buf, 1, size, f);
+	fclose(f);
+	if (nb_read != (size_t)size) {
+		free(buf);
+		return false;
+	}
+	buf[size] = '\0';
+
+	file->data = buf;
+	file->size = size;
+	file->mapped = false;
+	return true;
+}
+
+/* Map 'filename' read-only into memory. The view is not
+ * NUL-terminated, parsers must stop at data + size. */
+bool map_file(const char* filename, mapped_file* file) {
+	file->data = NULL;
+	file->size = 0;
+	file->mapped = false;
+
+#ifndef _WIN32
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		cerr << "Cannot open " << filename << endl;
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return false;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return true;
+	}
+
+	void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr != MAP_FAILED) {
+		// We only ever walk the file front to back
+		madvise(addr, st.st_size, MADV_SEQUENTIAL);
+		file->data = (const char*)addr;
+		file->size = st.st_size;
+		file->mapped = true;
+		return true;
+	}
+#endif
+
+	if (!read_file(filename, file)) {
+		cerr << "Cannot read " << filename << endl;
+		return false;
+	}
+	return true;
+}
+
+void unmap_file(mapped_file* file) {
+	if (file->data == NULL) return;
+#ifndef _WIN32
+	if (file->mapped)
+		munmap((void*)file->data, file->size);
+	else
+#endif
+		free((void*)file->data);
+	file->data = NULL;
+	file->size = 0;
+	file->mapped = false;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+/* 64-bit content hash, one multiply-rotate round per 8 bytes so it
+ * runs close to memory speed on big sources */
+uint64_t hash_bytes(const char* data, size_t size) {
+	const uint64_t k1 = 0x9E3779B185EBCA87ull, k2 = 0xC2B2AE3D27D4EB4Full;
+	uint64_t h = 0x27D4EB2F165667C5ull ^ (size * k1);
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t w;
+		memcpy(&w, data + i, 8);
+		h = rotl64(h ^ (w * k2), 31) * k1;
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, data + i, size - i);
+	h = rotl64(h ^ (tail * k2), 31) * k1;
+	h ^= h >> 33;
+	h *= k2;
+	h ^= h >> 29;
+	return h;
+}
@@ -0,0 +1,18 @@
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+#include <cstddef>
+#include <cstdint>
+
+/* Read-only view of a whole file. 'mapped' is false when the
+ * contents had to be copied to the heap instead of mmap'd. */
+struct mapped_file {
+	const char* data;
+	size_t size;
+	bool mapped;
+};
+
+extern bool map_file(const char* filename, mapped_file* file);
+extern void unmap_file(mapped_file* file);
+extern uint64_t hash_bytes(const char* data, size_t size);
+
+#endif
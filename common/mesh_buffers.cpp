@@ -0,0 +1,313 @@
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh_buffers.h"
+
+GLsizei index_size(GLenum index_type) {
+	return index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+/* Append a part's indices to the blob in the narrowest type that
+ * can address its vertices */
+static void pack_part(const unsigned* elements, submesh &part, vector<unsigned char> &indices) {
+	part.index_type = part.nb_vertices <= max_vertices_16bit ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	size_t size = index_size(part.index_type);
+	// 32-bit indices must start on a 4-byte boundary
+	indices.resize((indices.size() + size - 1) / size * size);
+	part.index_offset = indices.size();
+	indices.resize(part.index_offset + part.nb_indices * size);
+
+	unsigned char* out = &indices[part.index_offset];
+	if (part.index_type == GL_UNSIGNED_SHORT) {
+		for (size_t i = 0; i < part.nb_indices; i++)
+			((GLushort*)out)[i] = elements[i];
+	} else {
+		memcpy(out, elements, part.nb_indices * sizeof(GLuint));
+	}
+}
+
+/* Cut the mesh into runs of triangles that each use at most
+ * max_vertices_16bit vertices, duplicating the vertices shared
+ * across a cut. Triangle order is preserved. */
+static void split_mesh(const obj_mesh &mesh, mesh_data &data, vector<obj_vertex> &vertices,
+		       vector<unsigned> &elements) {
+	vector<unsigned> local(mesh.vertices.size(), ~0u);
+	vector<unsigned> used;  // vertices of the current part, to reset 'local'
+	submesh part = submesh();
+
+	elements.resize(mesh.elements.size());
+	for (size_t t = 0; t + 2 < mesh.elements.size(); t += 3) {
+		size_t nb_new = 0;
+		for (int i = 0; i < 3; i++)
+			nb_new += local[mesh.elements[t + i]] == ~0u;
+		if (used.size() + nb_new > max_vertices_16bit) {
+			data.parts.push_back(part);
+			for (size_t i = 0; i < used.size(); i++)
+				local[used[i]] = ~0u;
+			used.clear();
+			part.first_vertex = vertices.size();
+			part.nb_indices = 0;
+		}
+		for (int i = 0; i < 3; i++) {
+			unsigned v = mesh.elements[t + i];
+			if (local[v] == ~0u) {
+				local[v] = used.size();
+				used.push_back(v);
+				vertices.push_back(mesh.vertices[v]);
+			}
+			elements[t + i] = local[v];
+		}
+		part.nb_vertices = used.size();
+		part.nb_indices += 3;
+	}
+	if (part.nb_indices > 0)
+		data.parts.push_back(part);
+}
+
+GLsizei vertex_size(vertex_format format) {
+	return format == vertex_packed ? sizeof(packed_vertex) : sizeof(obj_vertex);
+}
+
+/* Scale and offset that turn the position attribute back into
+ * model coordinates: packed positions map the bounds to [-1, 1] */
+void position_decode(vertex_format format, const glm::vec3 &bounds_min, const glm::vec3 &bounds_max,
+		     glm::vec3* scale, glm::vec3* offset) {
+	if (format != vertex_packed) {
+		*scale = glm::vec3(1.0, 1.0, 1.0);
+		*offset = glm::vec3(0.0, 0.0, 0.0);
+		return;
+	}
+	*offset = (bounds_min + bounds_max) * 0.5f;
+	*scale = (bounds_max - bounds_min) * 0.5f;
+	// A flat mesh still needs a usable scale on its flat axis
+	for (int i = 0; i < 3; i++)
+		if (!((*scale)[i] > 0.0f))
+			(*scale)[i] = 1.0f;
+}
+
+static inline GLshort to_snorm16(float v) {
+	return (GLshort)lroundf(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+/* Round to the nearest half float; out of range values become
+ * infinities and tiny ones denormals or zero */
+static GLushort to_half(float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t abs_bits = bits & 0x7fffffff;
+	if (abs_bits >= 0x7f800000)  // inf or NaN
+		return sign | 0x7c00 | (abs_bits > 0x7f800000 ? 0x200 : 0);
+	if (abs_bits >= 0x477ff000)  // rounds past the largest half
+		return sign | 0x7c00;
+	if (abs_bits < 0x38800000) {  // denormal half
+		float denormal;
+		memcpy(&denormal, &abs_bits, sizeof(denormal));
+		return sign | (uint32_t)lrintf(denormal * 16777216.0f);  // in units of 2^-24
+	}
+	uint32_t rounded = abs_bits + 0xfff + ((abs_bits >> 13) & 1);
+	return sign | ((rounded - 0x38000000) >> 13);
+}
+
+/* Octahedral encoding: project the unit normal on the octahedron
+ * |x| + |y| + |z| = 1 and fold the lower half over the upper one */
+static void encode_octahedral(const glm::vec3 &n, GLshort out[2]) {
+	float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (!(sum > 0.0f)) {
+		out[0] = out[1] = 0;
+		return;
+	}
+	float x = n.x / sum, y = n.y / sum;
+	if (n.z < 0.0f) {
+		float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = fx;
+		y = fy;
+	}
+	out[0] = to_snorm16(x);
+	out[1] = to_snorm16(y);
+}
+
+static void encode_vertices(const vector<obj_vertex> &vertices, mesh_data &data) {
+	data.nb_vertices = vertices.size();
+	if (data.format != vertex_packed) {
+		data.vertices.resize(vertices.size() * sizeof(obj_vertex));
+		memcpy(data.vertices.data(), vertices.data(), data.vertices.size());
+		return;
+	}
+
+	glm::vec3 scale, offset;
+	position_decode(vertex_packed, data.bounds_min, data.bounds_max, &scale, &offset);
+	data.vertices.resize(vertices.size() * sizeof(packed_vertex));
+	packed_vertex* out = (packed_vertex*)data.vertices.data();
+	for (size_t i = 0; i < vertices.size(); i++) {
+		glm::vec3 p = (vertices[i].position - offset) / scale;
+		for (int c = 0; c < 3; c++)
+			out[i].position[c] = to_snorm16(p[c]);
+		out[i].position[3] = 32767;
+		encode_octahedral(vertices[i].normal, out[i].normal);
+		out[i].texcoord[0] = to_half(vertices[i].texcoord.x);
+		out[i].texcoord[1] = to_half(vertices[i].texcoord.y);
+	}
+}
+
+/* Lay out a loaded mesh for upload. Without 'split_16bit' the mesh
+ * is a single part, drawn with 16-bit indices when it has few
+ * enough vertices and 32-bit ones otherwise. With it, large meshes
+ * are split into 16-bit addressable parts instead, trading a few
+ * duplicated vertices for half the index bandwidth. Vertices are
+ * stored in 'format'. */
+void build_mesh_data(const obj_mesh &mesh, bool split_16bit, vertex_format format, mesh_data &data) {
+	data.format = format;
+	data.vertices.clear();
+	data.indices.clear();
+	data.parts.clear();
+	data.lods.clear();
+	data.lod_errors.clear();
+	data.meshlets.clear();
+
+	vector<obj_vertex> split_vertices;
+	vector<unsigned> split_elements;
+	const vector<obj_vertex>* vertices = &mesh.vertices;
+	const unsigned* elements = mesh.elements.data();
+	if (split_16bit && mesh.vertices.size() > max_vertices_16bit) {
+		split_mesh(mesh, data, split_vertices, split_elements);
+		vertices = &split_vertices;
+		elements = split_elements.data();
+	} else {
+		submesh part = submesh();
+		part.nb_vertices = mesh.vertices.size();
+		part.nb_indices = mesh.elements.size();
+		data.parts.push_back(part);
+	}
+
+	size_t first_element = 0;
+	for (size_t i = 0; i < data.parts.size(); i++) {
+		pack_part(elements + first_element, data.parts[i], data.indices);
+		first_element += data.parts[i].nb_indices;
+	}
+
+	data.bounds_min = data.bounds_max = glm::vec3(0.0, 0.0, 0.0);
+	if (!vertices->empty())
+		data.bounds_min = data.bounds_max = (*vertices)[0].position;
+	for (size_t i = 1; i < vertices->size(); i++) {
+		data.bounds_min = glm::min(data.bounds_min, (*vertices)[i].position);
+		data.bounds_max = glm::max(data.bounds_max, (*vertices)[i].position);
+	}
+	encode_vertices(*vertices, data);
+}
+
+/* Append a level of detail of an unsplit mesh, as triangles over
+ * its vertices (see build_lod_chain). The first call also makes the
+ * full mesh LOD 0. */
+bool add_mesh_lod(mesh_data &data, const vector<unsigned> &elements, float error) {
+	if (data.parts.size() != 1)
+		return false;
+	if (data.lods.empty()) {
+		data.lods.push_back(data.parts[0]);
+		data.lod_errors.push_back(0.0f);
+	}
+	submesh lod = submesh();
+	lod.nb_vertices = data.nb_vertices;
+	lod.nb_indices = elements.size();
+	pack_part(elements.data(), lod, data.indices);
+	data.lods.push_back(lod);
+	data.lod_errors.push_back(error);
+	return true;
+}
+
+void upload_mesh(const mesh_data &data, mesh_buffers* buffers) {
+	glGenBuffers(1, &buffers->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers->vbo);
+	glBufferData(GL_ARRAY_BUFFER, data.vertices.size(), data.vertices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &buffers->ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size(), data.indices.data(), GL_STATIC_DRAW);
+
+	buffers->format = data.format;
+	buffers->parts = data.parts;
+	buffers->lods = data.lods;
+	buffers->lod_errors = data.lod_errors;
+	buffers->meshlets = data.meshlets;
+	buffers->bounds_min = data.bounds_min;
+	buffers->bounds_max = data.bounds_max;
+	position_decode(data.format, data.bounds_min, data.bounds_max, &buffers->decode_scale, &buffers->decode_offset);
+}
+
+/* The attributes of a part, pointing at its first vertex in the
+ * buffer's format; attributes passed as -1 are skipped */
+static void describe_attributes(const mesh_buffers &buffers, const submesh &part,
+				GLint attribute_coord, GLint attribute_normal, GLint attribute_texcoord,
+				vertex_layout* layout) {
+	GLsizei stride = vertex_size(buffers.format);
+	size_t base = part.first_vertex * stride;
+	if (buffers.format == vertex_packed) {
+		if (attribute_coord != -1)
+			add_vertex_attrib(layout, attribute_coord, buffers.vbo, 4, GL_SHORT, GL_TRUE, stride,
+					  base + offsetof(packed_vertex, position));
+		if (attribute_normal != -1)
+			add_vertex_attrib(layout, attribute_normal, buffers.vbo, 2, GL_SHORT, GL_TRUE, stride,
+					  base + offsetof(packed_vertex, normal));
+		if (attribute_texcoord != -1)
+			add_vertex_attrib(layout, attribute_texcoord, buffers.vbo, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+					  base + offsetof(packed_vertex, texcoord));
+	} else {
+		if (attribute_coord != -1)
+			add_vertex_attrib(layout, attribute_coord, buffers.vbo, 3, GL_FLOAT, GL_FALSE, stride,
+					  base + offsetof(obj_vertex, position));
+		if (attribute_normal != -1)
+			add_vertex_attrib(layout, attribute_normal, buffers.vbo, 3, GL_FLOAT, GL_FALSE, stride,
+					  base + offsetof(obj_vertex, normal));
+		if (attribute_texcoord != -1)
+			add_vertex_attrib(layout, attribute_texcoord, buffers.vbo, 2, GL_FLOAT, GL_FALSE, stride,
+					  base + offsetof(obj_vertex, texcoord));
+	}
+	layout->element_buffer = buffers.ibo;
+}
+
+/* Point the vertex attributes at a part's first vertex, in the
+ * buffer's format. The vertex buffer must be bound; attributes
+ * passed as -1 are skipped. */
+void point_attributes(const mesh_buffers &buffers, const submesh &part,
+		      GLint attribute_coord, GLint attribute_normal, GLint attribute_texcoord) {
+	vertex_layout layout;
+	describe_attributes(buffers, part, attribute_coord, attribute_normal, attribute_texcoord, &layout);
+	for (size_t i = 0; i < layout.attribs.size(); i++) {
+		const vertex_attrib &a = layout.attribs[i];
+		glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride, (GLvoid*) a.offset);
+	}
+}
+
+/* The same as a vertex layout, with the index buffer, recorded in a
+ * vertex array object when available. Free it with
+ * free_vertex_layout. */
+void build_mesh_layout(const mesh_buffers &buffers, const submesh &part,
+		       GLint attribute_coord, GLint attribute_normal, GLint attribute_texcoord,
+		       vertex_layout* layout, bool use_vao) {
+	layout->attribs.clear();
+	describe_attributes(buffers, part, attribute_coord, attribute_normal, attribute_texcoord, layout);
+	build_vertex_layout(layout, use_vao);
+}
+
+/* Draw one part from the bound index buffer, with the index type
+ * it was packed with */
+void draw_submesh(const submesh &part) {
+	glDrawElements(GL_TRIANGLES, part.nb_indices, part.index_type, (GLvoid*) part.index_offset);
+}
+
+void free_mesh(mesh_buffers* buffers) {
+	glDeleteBuffers(1, &buffers->vbo);
+	glDeleteBuffers(1, &buffers->ibo);
+	buffers->parts.clear();
+	buffers->lods.clear();
+	buffers->lod_errors.clear();
+	buffers->meshlets.clear();
+}
@@ -0,0 +1,86 @@
+#ifndef _MESH_BUFFERS_H
+#define _MESH_BUFFERS_H
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+
+#include "obj_loader.h"
+#include "mesh_meshlets.h"
+#include "vertex_layout.h"
+
+/* A range of a mesh drawn with a single glDrawElements. Indices are
+ * relative to 'first_vertex', so the vertex attributes must point
+ * at that vertex before drawing. */
+struct submesh {
+	size_t first_vertex;
+	size_t nb_vertices;
+	size_t index_offset;  // in bytes, into the index buffer
+	size_t nb_indices;
+	GLenum index_type;    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+};
+
+/* How vertices are stored in the vertex buffer */
+enum vertex_format {
+	vertex_float,   // obj_vertex as is, 32 bytes
+	vertex_packed,  // packed_vertex, 16 bytes
+};
+
+/* Quantized vertex. Positions are signed normalized shorts spanning
+ * the mesh bounds, w always 1; normals are octahedral-encoded in two
+ * signed normalized shorts; texcoords are half floats (drawing with
+ * them needs GL 3.0 or ARB_half_float_vertex). The vertex shader
+ * undoes the position scaling and the normal encoding. */
+struct packed_vertex {
+	GLshort position[4];
+	GLshort normal[2];
+	GLushort texcoord[2];
+};
+
+/* Vertex and index data laid out exactly as it goes to the GPU */
+struct mesh_data {
+	vertex_format format;
+	std::vector<unsigned char> vertices;
+	size_t nb_vertices;
+	std::vector<unsigned char> indices;
+	std::vector<submesh> parts;
+	/* Optional levels of detail, each a whole-mesh part. lods[0]
+	 * is the full mesh, with error 0. */
+	std::vector<submesh> lods;
+	std::vector<float> lod_errors;
+	/* Optional meshlets of an unsplit mesh's only part */
+	std::vector<meshlet> meshlets;
+	glm::vec3 bounds_min, bounds_max;
+};
+
+struct mesh_buffers {
+	GLuint vbo;
+	GLuint ibo;
+	vertex_format format;
+	std::vector<submesh> parts;
+	std::vector<submesh> lods;
+	std::vector<float> lod_errors;
+	std::vector<meshlet> meshlets;
+	glm::vec3 bounds_min, bounds_max;
+	/* position = attribute * decode_scale + decode_offset */
+	glm::vec3 decode_scale, decode_offset;
+};
+
+/* Largest vertex count addressable with 16-bit indices */
+const size_t max_vertices_16bit = 65536;
+
+extern GLsizei index_size(GLenum index_type);
+extern GLsizei vertex_size(vertex_format format);
+extern void position_decode(vertex_format format, const glm::vec3 &bounds_min, const glm::vec3 &bounds_max,
+			    glm::vec3* scale, glm::vec3* offset);
+extern void build_mesh_data(const obj_mesh &mesh, bool split_16bit, vertex_format format, mesh_data &data);
+extern bool add_mesh_lod(mesh_data &data, const std::vector<unsigned> &elements, float error);
+extern void upload_mesh(const mesh_data &data, mesh_buffers* buffers);
+extern void point_attributes(const mesh_buffers &buffers, const submesh &part,
+			     GLint attribute_coord, GLint attribute_normal, GLint attribute_texcoord);
+extern void build_mesh_layout(const mesh_buffers &buffers, const submesh &part,
+			      GLint attribute_coord, GLint attribute_normal, GLint attribute_texcoord,
+			      vertex_layout* layout, bool use_vao = true);
+extern void draw_submesh(const submesh &part);
+extern void free_mesh(mesh_buffers* buffers);
+
+#endif
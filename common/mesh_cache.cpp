@@ -0,0 +1,363 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <sys/stat.h>
+
+#include <GL/glew.h>
+
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "mesh_optimize.h"
+#include "mesh_simplify.h"
+
+/* Layout of a .meshcache file: this header, then the parts table
+ * (parts, then LODs), the vertex blob, the index blob and the
+ * meshlets, each starting on a 16-byte boundary. Everything is in
+ * native byte order; the cache is meant for the machine that wrote
+ * it. */
+static const char cache_magic[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+static const uint32_t cache_version = 4;
+
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;         // load_mesh_cached options the data was built with
+	uint64_t source_size;
+	int64_t source_mtime;
+	uint64_t source_hash;
+	uint32_t vertex_size;   // of the vertex format when written
+	uint32_t nb_parts;
+	uint32_t nb_lods;
+	uint32_t nb_meshlets;
+	uint64_t nb_vertices;
+	uint64_t index_bytes;
+	uint64_t parts_offset;
+	uint64_t vertices_offset;
+	uint64_t indices_offset;
+	uint64_t meshlets_offset;
+	float bounds_min[3];
+	float bounds_max[3];
+	float crease_angle;     // load_mesh_cached's, 0 for the file's normals
+};
+
+struct cache_part {
+	uint64_t first_vertex;
+	uint64_t nb_vertices;
+	uint64_t index_offset;
+	uint64_t nb_indices;
+	uint32_t index_type;
+	float error;            // of a LOD, 0 for parts
+};
+
+static submesh from_cache_part(const cache_part &in) {
+	submesh out;
+	out.first_vertex = in.first_vertex;
+	out.nb_vertices = in.nb_vertices;
+	out.index_offset = in.index_offset;
+	out.nb_indices = in.nb_indices;
+	out.index_type = in.index_type;
+	return out;
+}
+
+static cache_part to_cache_part(const submesh &in, float error) {
+	cache_part out;
+	out.first_vertex = in.first_vertex;
+	out.nb_vertices = in.nb_vertices;
+	out.index_offset = in.index_offset;
+	out.nb_indices = in.nb_indices;
+	out.index_type = in.index_type;
+	out.error = error;
+	return out;
+}
+
+static inline uint64_t align16(uint64_t offset) {
+	return (offset + 15) & ~(uint64_t)15;
+}
+
+struct source_info {
+	uint64_t size;
+	int64_t mtime;
+};
+
+static bool stat_source(const char* filename, source_info* info) {
+	struct stat st;
+	if (stat(filename, &st) < 0)
+		return false;
+	info->size = st.st_size;
+	info->mtime = st.st_mtime;
+	return true;
+}
+
+static bool hash_source(const char* filename, uint64_t* hash) {
+	mapped_file file;
+	if (!map_file(filename, &file))
+		return false;
+	*hash = hash_bytes(file.data, file.size);
+	unmap_file(&file);
+	return true;
+}
+
+static bool write_at(FILE* f, uint64_t offset, const void* data, size_t size) {
+	return fseek(f, offset, SEEK_SET) == 0 && fwrite(data, 1, size, f) == size;
+}
+
+/* Record a new source mtime in a cache found to still match its
+ * source, so the next open skips the hash. Best effort: a cache we
+ * can't write to only costs the hash again. */
+static void update_source_mtime(const char* cache_filename, int64_t mtime) {
+	FILE* f = fopen(cache_filename, "r+b");
+	if (f == NULL)
+		return;
+	write_at(f, offsetof(cache_header, source_mtime), &mtime, sizeof(mtime));
+	fclose(f);
+}
+
+/* Whether 'count' elements of 'element_size' bytes from 'offset' lie
+ * within a file of 'size' bytes. Divides rather than multiplies, so
+ * a corrupt count can't wrap around to a small size. An empty blob,
+ * such as the meshlets of a mesh without any, may start past the
+ * end: nothing is written after the last one. */
+static bool blob_fits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t size) {
+	return count == 0 || (offset <= size && count <= (size - offset) / element_size);
+}
+
+/* Whether a part or LOD only uses vertices and indices of the blobs */
+static bool part_fits(const cache_part &part, uint64_t nb_vertices, uint64_t index_bytes) {
+	uint64_t index_size;
+	if (part.index_type == GL_UNSIGNED_SHORT)
+		index_size = sizeof(GLushort);
+	else if (part.index_type == GL_UNSIGNED_INT)
+		index_size = sizeof(GLuint);
+	else
+		return false;
+	return part.first_vertex <= nb_vertices && part.nb_vertices <= nb_vertices - part.first_vertex
+		&& blob_fits(part.index_offset, part.nb_indices, index_size, index_bytes);
+}
+
+/* Whether the parts table, and the meshlets of the first part, stay
+ * within the blobs; the header's blobs are known to fit the file */
+static bool parts_fit(const char* base, const cache_header* header) {
+	const cache_part* parts = (const cache_part*)(base + header->parts_offset);
+	for (uint64_t i = 0; i < (uint64_t)header->nb_parts + header->nb_lods; i++)
+		if (!part_fits(parts[i], header->nb_vertices, header->index_bytes))
+			return false;
+	if (header->nb_meshlets > 0 && header->nb_parts == 0)
+		return false;
+	const meshlet* meshlets = (const meshlet*)(base + header->meshlets_offset);
+	for (uint32_t i = 0; i < header->nb_meshlets; i++) {
+		uint64_t nb_triangles = parts[0].nb_indices / 3;
+		if (meshlets[i].first_triangle > nb_triangles
+		    || meshlets[i].nb_triangles > nb_triangles - meshlets[i].first_triangle)
+			return false;
+	}
+	return true;
+}
+
+/* Map a cache file and check it still matches its source. Size
+ * must match; if the mtime differs as well (a fresh checkout, a
+ * touch) the source is hashed and the cache kept when the content
+ * is unchanged, with the new mtime written back into its header. */
+static bool open_cache(const char* cache_filename, const char* source_filename,
+		       uint32_t flags, float crease_angle, vertex_format format, cached_mesh* mesh) {
+	source_info source;
+	if (!stat_source(source_filename, &source))
+		return false;
+	struct stat st;
+	if (stat(cache_filename, &st) < 0)
+		return false;
+	if (!map_file(cache_filename, &mesh->file))
+		return false;
+
+	const char* base = mesh->file.data;
+	const cache_header* header = (const cache_header*)base;
+	bool valid = mesh->file.size >= sizeof(cache_header)
+		&& memcmp(header->magic, cache_magic, sizeof(cache_magic)) == 0
+		&& header->version == cache_version
+		&& header->flags == flags
+		&& header->crease_angle == crease_angle
+		&& header->vertex_size == (uint32_t)vertex_size(format)
+		&& header->source_size == source.size
+		&& blob_fits(header->parts_offset, (uint64_t)header->nb_parts + header->nb_lods, sizeof(cache_part), mesh->file.size)
+		&& blob_fits(header->vertices_offset, header->nb_vertices, header->vertex_size, mesh->file.size)
+		&& blob_fits(header->indices_offset, header->index_bytes, 1, mesh->file.size)
+		&& blob_fits(header->meshlets_offset, header->nb_meshlets, sizeof(meshlet), mesh->file.size)
+		&& parts_fit(base, header);
+	if (valid && header->source_mtime != source.mtime) {
+		uint64_t hash;
+		valid = hash_source(source_filename, &hash) && hash == header->source_hash;
+		if (valid)
+			update_source_mtime(cache_filename, source.mtime);
+	}
+	if (!valid) {
+		unmap_file(&mesh->file);
+		return false;
+	}
+
+	const cache_part* parts = (const cache_part*)(base + header->parts_offset);
+	mesh->parts.resize(header->nb_parts);
+	for (size_t i = 0; i < mesh->parts.size(); i++)
+		mesh->parts[i] = from_cache_part(parts[i]);
+	const cache_part* lods = parts + header->nb_parts;
+	mesh->lods.resize(header->nb_lods);
+	mesh->lod_errors.resize(header->nb_lods);
+	for (size_t i = 0; i < mesh->lods.size(); i++) {
+		mesh->lods[i] = from_cache_part(lods[i]);
+		mesh->lod_errors[i] = lods[i].error;
+	}
+	const meshlet* meshlets = (const meshlet*)(base + header->meshlets_offset);
+	mesh->meshlets.assign(meshlets, meshlets + header->nb_meshlets);
+	mesh->format = format;
+	mesh->vertices = (const unsigned char*)(base + header->vertices_offset);
+	mesh->nb_vertices = header->nb_vertices;
+	mesh->indices = (const unsigned char*)(base + header->indices_offset);
+	mesh->index_bytes = header->index_bytes;
+	mesh->bounds_min = glm::vec3(header->bounds_min[0], header->bounds_min[1], header->bounds_min[2]);
+	mesh->bounds_max = glm::vec3(header->bounds_max[0], header->bounds_max[1], header->bounds_max[2]);
+	mesh->from_cache = true;
+	return true;
+}
+
+/* Write the cache to a temporary file and rename it into place, so
+ * a crash never leaves a truncated cache behind */
+static bool write_cache(const char* cache_filename, const char* source_filename,
+			uint32_t flags, float crease_angle, const mesh_data &data) {
+	cache_header header;
+	memset(&header, 0, sizeof(header));
+	source_info source;
+	if (!stat_source(source_filename, &source) || !hash_source(source_filename, &header.source_hash))
+		return false;
+
+	memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = cache_version;
+	header.flags = flags;
+	header.crease_angle = crease_angle;
+	header.source_size = source.size;
+	header.source_mtime = source.mtime;
+	header.vertex_size = vertex_size(data.format);
+	header.nb_parts = data.parts.size();
+	header.nb_lods = data.lods.size();
+	header.nb_meshlets = data.meshlets.size();
+	header.nb_vertices = data.nb_vertices;
+	header.index_bytes = data.indices.size();
+
+	vector<cache_part> parts;
+	for (size_t i = 0; i < data.parts.size(); i++)
+		parts.push_back(to_cache_part(data.parts[i], 0.0f));
+	for (size_t i = 0; i < data.lods.size(); i++)
+		parts.push_back(to_cache_part(data.lods[i], data.lod_errors[i]));
+	header.parts_offset = align16(sizeof(header));
+	header.vertices_offset = align16(header.parts_offset + parts.size() * sizeof(cache_part));
+	header.indices_offset = align16(header.vertices_offset + data.vertices.size());
+	header.meshlets_offset = align16(header.indices_offset + data.indices.size());
+	for (int i = 0; i < 3; i++) {
+		header.bounds_min[i] = data.bounds_min[i];
+		header.bounds_max[i] = data.bounds_max[i];
+	}
+
+	string tmp_filename = string(cache_filename) + ".tmp";
+	FILE* f = fopen(tmp_filename.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	bool ok = write_at(f, 0, &header, sizeof(header))
+		&& write_at(f, header.parts_offset, parts.data(), parts.size() * sizeof(cache_part))
+		&& write_at(f, header.vertices_offset, data.vertices.data(), data.vertices.size())
+		&& write_at(f, header.indices_offset, data.indices.data(), data.indices.size())
+		&& write_at(f, header.meshlets_offset, data.meshlets.data(), data.meshlets.size() * sizeof(meshlet));
+	ok = (fclose(f) == 0) && ok;
+	if (!ok || rename(tmp_filename.c_str(), cache_filename) != 0) {
+		remove(tmp_filename.c_str());
+		return false;
+	}
+	return true;
+}
+
+/* Load 'obj_filename' through its binary cache, 'obj_filename'.meshcache.
+ * A valid cache is only mapped, never parsed. Otherwise the .obj
+ * is parsed, the cache written, and the fresh cache mapped.
+ * 'crease_angle' goes to load_obj_mesh. */
+bool load_mesh_cached(const char* obj_filename, unsigned options, cached_mesh* mesh, float crease_angle) {
+	string cache_filename = string(obj_filename) + ".meshcache";
+	mesh->file.data = NULL;
+	mesh->file.size = 0;
+	mesh->file.mapped = false;
+	vertex_format format = (options & mesh_cache_packed) ? vertex_packed : vertex_float;
+	if (open_cache(cache_filename.c_str(), obj_filename, options, crease_angle, format, mesh))
+		return true;
+
+	obj_mesh obj;
+	if (!load_obj_mesh(obj_filename, obj, 256 << 20, 0, NULL, crease_angle))
+		return false;
+	if (options & mesh_cache_optimize)
+		optimize_mesh(obj);
+	build_mesh_data(obj, options & mesh_cache_split_16bit, format, mesh->fallback);
+	if ((options & mesh_cache_lods) && mesh->fallback.parts.size() == 1) {
+		vector<mesh_lod> lods;
+		build_lod_chain(obj, default_lod_ratios, sizeof(default_lod_ratios) / sizeof(default_lod_ratios[0]), lods);
+		for (size_t i = 1; i < lods.size(); i++) {
+			if (options & mesh_cache_optimize)
+				optimize_vertex_cache(lods[i].elements.data(), lods[i].elements.size(), obj.vertices.size());
+			add_mesh_lod(mesh->fallback, lods[i].elements, lods[i].error);
+		}
+	}
+	if ((options & mesh_cache_meshlets) && mesh->fallback.parts.size() == 1)
+		build_meshlets(obj, mesh->fallback.meshlets);
+	if (write_cache(cache_filename.c_str(), obj_filename, options, crease_angle, mesh->fallback)
+	    && open_cache(cache_filename.c_str(), obj_filename, options, crease_angle, format, mesh)) {
+		mesh->from_cache = false;
+		mesh->fallback = mesh_data();
+		return true;
+	}
+
+	cerr << "Could not write " << cache_filename << ", using the parsed mesh" << endl;
+	mesh->format = format;
+	mesh->vertices = mesh->fallback.vertices.data();
+	mesh->nb_vertices = mesh->fallback.nb_vertices;
+	mesh->indices = mesh->fallback.indices.data();
+	mesh->index_bytes = mesh->fallback.indices.size();
+	mesh->parts = mesh->fallback.parts;
+	mesh->lods = mesh->fallback.lods;
+	mesh->lod_errors = mesh->fallback.lod_errors;
+	mesh->meshlets = mesh->fallback.meshlets;
+	mesh->bounds_min = mesh->fallback.bounds_min;
+	mesh->bounds_max = mesh->fallback.bounds_max;
+	mesh->from_cache = false;
+	return true;
+}
+
+/* Hand the mapped blobs to GL as they are */
+void upload_cached_mesh(const cached_mesh* mesh, mesh_buffers* buffers) {
+	glGenBuffers(1, &buffers->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers->vbo);
+	glBufferData(GL_ARRAY_BUFFER, mesh->nb_vertices * vertex_size(mesh->format), mesh->vertices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &buffers->ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->index_bytes, mesh->indices, GL_STATIC_DRAW);
+
+	buffers->format = mesh->format;
+	buffers->parts = mesh->parts;
+	buffers->lods = mesh->lods;
+	buffers->lod_errors = mesh->lod_errors;
+	buffers->meshlets = mesh->meshlets;
+	buffers->bounds_min = mesh->bounds_min;
+	buffers->bounds_max = mesh->bounds_max;
+	position_decode(mesh->format, mesh->bounds_min, mesh->bounds_max, &buffers->decode_scale, &buffers->decode_offset);
+}
+
+void free_cached_mesh(cached_mesh* mesh) {
+	unmap_file(&mesh->file);
+	mesh->fallback = mesh_data();
+	mesh->parts.clear();
+	mesh->lods.clear();
+	mesh->lod_errors.clear();
+	mesh->meshlets.clear();
+	mesh->vertices = NULL;
+	mesh->indices = NULL;
+	mesh->nb_vertices = mesh->index_bytes = 0;
+}
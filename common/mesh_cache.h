@@ -0,0 +1,42 @@
+#ifndef _MESH_CACHE_H
+#define _MESH_CACHE_H
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+
+#include "mapped_file.h"
+#include "mesh_buffers.h"
+
+/* A mesh ready for upload, read straight from a mapped cache file.
+ * When the cache can't be written the data lives in 'fallback'
+ * instead, so users only ever look at the pointers. */
+struct cached_mesh {
+	mapped_file file;
+	mesh_data fallback;
+	vertex_format format;
+	const unsigned char* vertices;
+	size_t nb_vertices;
+	const unsigned char* indices;
+	size_t index_bytes;
+	std::vector<submesh> parts;
+	std::vector<submesh> lods;
+	std::vector<float> lod_errors;
+	std::vector<meshlet> meshlets;
+	glm::vec3 bounds_min, bounds_max;
+	bool from_cache;  // false if the .obj had to be parsed
+};
+
+/* Options of load_mesh_cached, or-ed together. A cache built with
+ * other options, or another crease angle, is rebuilt. */
+const unsigned mesh_cache_split_16bit = 1;  // see build_mesh_data
+const unsigned mesh_cache_optimize = 2;     // see optimize_mesh
+const unsigned mesh_cache_packed = 4;       // store vertex_packed vertices
+const unsigned mesh_cache_lods = 8;         // add a LOD chain to unsplit meshes
+const unsigned mesh_cache_meshlets = 16;    // add meshlets to unsplit meshes
+
+extern bool load_mesh_cached(const char* obj_filename, unsigned options, cached_mesh* mesh,
+			     float crease_angle = 0.0f);
+extern void upload_cached_mesh(const cached_mesh* mesh, mesh_buffers* buffers);
+extern void free_cached_mesh(cached_mesh* mesh);
+
+#endif
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "frustum_cull.h"
+#include "mesh_buffers.h"
+#include "mesh_meshlets.h"
+
+/* Bounding sphere around the box of the meshlet's vertices, and the
+ * cone of its triangle normals */
+static void meshlet_bounds(const obj_mesh &mesh, const vector<unsigned> &used, meshlet &m) {
+	glm::vec3 lo = mesh.vertices[used[0]].position, hi = lo;
+	for (size_t i = 1; i < used.size(); i++) {
+		lo = glm::min(lo, mesh.vertices[used[i]].position);
+		hi = glm::max(hi, mesh.vertices[used[i]].position);
+	}
+	m.center = (lo + hi) * 0.5f;
+	m.radius = 0.0f;
+	for (size_t i = 0; i < used.size(); i++)
+		m.radius = max(m.radius, glm::length(mesh.vertices[used[i]].position - m.center));
+
+	vector<glm::vec3> normals;
+	glm::vec3 sum(0.0f);
+	for (size_t t = m.first_triangle; t < m.first_triangle + m.nb_triangles; t++) {
+		const unsigned* tri = &mesh.elements[t * 3];
+		glm::vec3 a = mesh.vertices[tri[0]].position;
+		glm::vec3 n = glm::cross(mesh.vertices[tri[1]].position - a, mesh.vertices[tri[2]].position - a);
+		float length = glm::length(n);
+		if (length > 0.0f) {
+			normals.push_back(n / length);
+			sum += normals.back();
+		}
+	}
+	float length = glm::length(sum);
+	m.cone_axis = length > 0.0f ? sum / length : glm::vec3(0.0f, 0.0f, 1.0f);
+	float min_dot = length > 0.0f ? 1.0f : -1.0f;
+	for (size_t i = 0; i < normals.size(); i++)
+		min_dot = min(min_dot, glm::dot(m.cone_axis, normals[i]));
+	// Normals more than 90 degrees apart: some triangle always faces the viewer
+	m.cone_cutoff = min_dot > 0.0f ? sqrtf(1.0f - min_dot * min_dot) : 1.0f;
+}
+
+/* Cut the triangles, in their current order, into meshlets of at
+ * most max_meshlet_vertices vertices and max_meshlet_triangles
+ * triangles. Run it after optimize_vertex_cache: neighbouring
+ * triangles then share vertices and end up in the same, compact
+ * meshlets. */
+void build_meshlets(const obj_mesh &mesh, vector<meshlet> &meshlets) {
+	meshlets.clear();
+	vector<unsigned> local(mesh.vertices.size(), ~0u);
+	vector<unsigned> used;  // vertices of the current meshlet, to reset 'local'
+	meshlet current = meshlet();
+
+	size_t nb_faces = mesh.elements.size() / 3;
+	for (size_t t = 0; t < nb_faces; t++) {
+		const unsigned* tri = &mesh.elements[t * 3];
+		unsigned a = tri[0], b = tri[1], c = tri[2];
+		size_t nb_new = (local[a] == ~0u) + (local[b] == ~0u && b != a) + (local[c] == ~0u && c != a && c != b);
+		if (used.size() + nb_new > max_meshlet_vertices || current.nb_triangles == max_meshlet_triangles) {
+			current.nb_vertices = used.size();
+			meshlet_bounds(mesh, used, current);
+			meshlets.push_back(current);
+			for (size_t i = 0; i < used.size(); i++)
+				local[used[i]] = ~0u;
+			used.clear();
+			current = meshlet();
+			current.first_triangle = t;
+		}
+		for (int k = 0; k < 3; k++) {
+			if (local[tri[k]] == ~0u) {
+				local[tri[k]] = used.size();
+				used.push_back(tri[k]);
+			}
+		}
+		current.nb_triangles++;
+	}
+	if (current.nb_triangles > 0) {
+		current.nb_vertices = used.size();
+		meshlet_bounds(mesh, used, current);
+		meshlets.push_back(current);
+	}
+}
+
+/* Keep the meshlets of 'part' that may be visible with 'mvp', given
+ * the camera position in model space, and turn them into index
+ * ranges, merging neighbours. A meshlet is dropped when its sphere
+ * is outside a frustum plane, or when it lies within the normal
+ * cone's back side as seen from the camera. */
+void cull_meshlets(const vector<meshlet> &meshlets, const submesh &part,
+		   const glm::mat4 &mvp, const glm::vec3 &camera,
+		   meshlet_draw &draw, meshlet_cull_stats* stats) {
+	// Frustum planes in model space
+	glm::vec4 planes[6];
+	frustum_planes(mvp, planes);
+
+	meshlet_cull_stats s = meshlet_cull_stats();
+	draw.counts.clear();
+	draw.offsets.clear();
+	GLsizei size = index_size(part.index_type);
+	size_t next_triangle = ~(size_t)0;  // end of the last range
+	for (size_t i = 0; i < meshlets.size(); i++) {
+		const meshlet &m = meshlets[i];
+		s.triangles += m.nb_triangles;
+
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+			outside = glm::dot(glm::vec3(planes[p]), m.center) + planes[p].w < -m.radius;
+		if (outside) {
+			s.frustum_culled += m.nb_triangles;
+			continue;
+		}
+		glm::vec3 view = m.center - camera;
+		if (glm::dot(view, m.cone_axis) >= m.cone_cutoff * glm::length(view) + m.radius) {
+			s.backface_culled += m.nb_triangles;
+			continue;
+		}
+
+		s.visible_meshlets++;
+		if (m.first_triangle == next_triangle) {
+			draw.counts.back() += m.nb_triangles * 3;
+		} else {
+			draw.counts.push_back(m.nb_triangles * 3);
+			draw.offsets.push_back((const GLvoid*) (part.index_offset + (size_t)m.first_triangle * 3 * size));
+		}
+		next_triangle = m.first_triangle + m.nb_triangles;
+	}
+	s.meshlets = meshlets.size();
+	s.draw_ranges = draw.counts.size();
+	if (stats != NULL)
+		*stats = s;
+}
+
+/* Draw what cull_meshlets kept, in one call */
+void draw_meshlets(const submesh &part, const meshlet_draw &draw) {
+	if (draw.counts.empty())
+		return;
+	glMultiDrawElements(GL_TRIANGLES, draw.counts.data(), part.index_type,
+			    (const GLvoid* const*) draw.offsets.data(), draw.counts.size());
+}
@@ -0,0 +1,51 @@
+#ifndef _MESH_MESHLETS_H
+#define _MESH_MESHLETS_H
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "obj_loader.h"
+
+struct submesh;
+
+const size_t max_meshlet_vertices = 64;
+const size_t max_meshlet_triangles = 124;
+
+/* A run of consecutive triangles of a mesh part, small enough to be
+ * culled as a whole. The cone holds every triangle normal: the
+ * meshlet faces away from any viewer inside the cone opened behind
+ * it, see cull_meshlets. Stored as is in mesh caches. */
+struct meshlet {
+	glm::vec3 center;      // bounding sphere
+	float radius;
+	glm::vec3 cone_axis;   // mean triangle normal
+	float cone_cutoff;     // sine of the normals' spread, 1 when too wide to cull
+	unsigned first_triangle;
+	unsigned nb_triangles;
+	unsigned nb_vertices;
+	unsigned padding;
+};
+
+struct meshlet_cull_stats {
+	size_t meshlets;
+	size_t visible_meshlets;
+	size_t triangles;
+	size_t frustum_culled;   // triangles of meshlets outside the frustum
+	size_t backface_culled;  // triangles of meshlets facing away
+	size_t draw_ranges;      // after merging adjacent visible meshlets
+};
+
+/* Index ranges for one glMultiDrawElements */
+struct meshlet_draw {
+	std::vector<GLsizei> counts;
+	std::vector<const GLvoid*> offsets;
+};
+
+extern void build_meshlets(const obj_mesh &mesh, std::vector<meshlet> &meshlets);
+extern void cull_meshlets(const std::vector<meshlet> &meshlets, const submesh &part,
+			  const glm::mat4 &mvp, const glm::vec3 &camera,
+			  meshlet_draw &draw, meshlet_cull_stats* stats = NULL);
+extern void draw_meshlets(const submesh &part, const meshlet_draw &draw);
+
+#endif
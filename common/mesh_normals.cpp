@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+
+#include "mesh_normals.h"
+#include "simd.h"
+
+/* Smooth normals are built in three passes over SoA data:
+ *  1. one unnormalized normal per triangle, whose length is twice
+ *     its area, plus a weight per corner when angle weighting,
+ *  2. each triangle adds its weighted normal to its three vertices,
+ *  3. every vertex normal is normalized.
+ * Passes 1 and 3 run 8 (AVX2) or 4 (SSE2) lanes at a time. Pass 2
+ * stays scalar, as neighbouring triangles write the same vertices. */
+
+/* Per-triangle output of pass 1. With angle weighting, 'cos_a' and
+ * 'cos_b' are the cosines of the angles at the first two corners
+ * and 'length' the length of the unnormalized normal. Indexed by
+ * triangle number minus 'first'. */
+struct face_arrays {
+	size_t first;
+	float *x, *y, *z;
+	float *cos_a, *cos_b, *length;
+};
+
+/* Triangles are processed in blocks small enough for their face
+ * data to stay in L1 between pass 1 and pass 2 */
+static const size_t block_size = 256;
+
+struct face_block {
+	float x[block_size], y[block_size], z[block_size];
+	float cos_a[block_size], cos_b[block_size], length[block_size];
+
+	face_arrays arrays(size_t first) {
+		face_arrays a = { first, x, y, z, cos_a, cos_b, length };
+		return a;
+	}
+};
+
+static inline void face_scalar(const float* px, const float* py, const float* pz,
+			       const unsigned* tri, bool angle_weighted, const face_arrays &faces, size_t t) {
+	unsigned a = tri[0], b = tri[1], c = tri[2];
+	float e1x = px[b] - px[a], e1y = py[b] - py[a], e1z = pz[b] - pz[a];
+	float e2x = px[c] - px[a], e2y = py[c] - py[a], e2z = pz[c] - pz[a];
+	float nx = e1y * e2z - e1z * e2y;
+	float ny = e1z * e2x - e1x * e2z;
+	float nz = e1x * e2y - e1y * e2x;
+	size_t i = t - faces.first;
+	faces.x[i] = nx;
+	faces.y[i] = ny;
+	faces.z[i] = nz;
+	if (!angle_weighted) return;
+
+	float e3x = px[c] - px[b], e3y = py[c] - py[b], e3z = pz[c] - pz[b];
+	float l1 = sqrtf(e1x * e1x + e1y * e1y + e1z * e1z);
+	float l2 = sqrtf(e2x * e2x + e2y * e2y + e2z * e2z);
+	float l3 = sqrtf(e3x * e3x + e3y * e3y + e3z * e3z);
+	faces.cos_a[i] = (e1x * e2x + e1y * e2y + e1z * e2z) / max(l1 * l2, FLT_MIN);
+	faces.cos_b[i] = -(e1x * e3x + e1y * e3y + e1z * e3z) / max(l1 * l3, FLT_MIN);
+	faces.length[i] = sqrtf(nx * nx + ny * ny + nz * nz);
+}
+
+static void faces_scalar(const float* px, const float* py, const float* pz, const unsigned* elements,
+			 size_t first, size_t last, bool angle_weighted, const face_arrays &faces) {
+	for (size_t t = first; t < last; t++)
+		face_scalar(px, py, pz, &elements[t * 3], angle_weighted, faces, t);
+}
+
+#ifdef VFLOAT_SIMD
+/* Pass 1, 'lanes' triangles at a time; returns the first triangle
+ * not done, the caller finishes the rest */
+static size_t faces_simd(const float* px, const float* py, const float* pz, const unsigned* elements,
+			 size_t first, size_t last, bool angle_weighted, const face_arrays &faces) {
+	size_t t = first;
+	for (; t + lanes <= last; t += lanes) {
+		unsigned ia[lanes], ib[lanes], ic[lanes];
+		for (int i = 0; i < lanes; i++) {
+			ia[i] = elements[(t + i) * 3];
+			ib[i] = elements[(t + i) * 3 + 1];
+			ic[i] = elements[(t + i) * 3 + 2];
+		}
+		vfloat ax = v_gather(px, ia), ay = v_gather(py, ia), az = v_gather(pz, ia);
+		vfloat bx = v_gather(px, ib), by = v_gather(py, ib), bz = v_gather(pz, ib);
+		vfloat cx = v_gather(px, ic), cy = v_gather(py, ic), cz = v_gather(pz, ic);
+		vfloat e1x = v_sub(bx, ax), e1y = v_sub(by, ay), e1z = v_sub(bz, az);
+		vfloat e2x = v_sub(cx, ax), e2y = v_sub(cy, ay), e2z = v_sub(cz, az);
+		vfloat nx = v_sub(v_mul(e1y, e2z), v_mul(e1z, e2y));
+		vfloat ny = v_sub(v_mul(e1z, e2x), v_mul(e1x, e2z));
+		vfloat nz = v_sub(v_mul(e1x, e2y), v_mul(e1y, e2x));
+		size_t i = t - faces.first;
+		v_store(&faces.x[i], nx);
+		v_store(&faces.y[i], ny);
+		v_store(&faces.z[i], nz);
+		if (!angle_weighted) continue;
+
+		vfloat e3x = v_sub(cx, bx), e3y = v_sub(cy, by), e3z = v_sub(cz, bz);
+		vfloat l1 = v_sqrt(v_add(v_add(v_mul(e1x, e1x), v_mul(e1y, e1y)), v_mul(e1z, e1z)));
+		vfloat l2 = v_sqrt(v_add(v_add(v_mul(e2x, e2x), v_mul(e2y, e2y)), v_mul(e2z, e2z)));
+		vfloat l3 = v_sqrt(v_add(v_add(v_mul(e3x, e3x), v_mul(e3y, e3y)), v_mul(e3z, e3z)));
+		vfloat dot_a = v_add(v_add(v_mul(e1x, e2x), v_mul(e1y, e2y)), v_mul(e1z, e2z));
+		vfloat dot_b = v_add(v_add(v_mul(e1x, e3x), v_mul(e1y, e3y)), v_mul(e1z, e3z));
+		vfloat tiny = v_set1(FLT_MIN);
+		v_store(&faces.cos_a[i], v_div(dot_a, v_max(v_mul(l1, l2), tiny)));
+		v_store(&faces.cos_b[i], v_div(v_sub(v_set1(0.0f), dot_b), v_max(v_mul(l1, l3), tiny)));
+		v_store(&faces.length[i], v_sqrt(v_add(v_add(v_mul(nx, nx), v_mul(ny, ny)), v_mul(nz, nz))));
+	}
+	return t;
+}
+
+/* Pass 3 over the SoA normals; returns the number of vertices done */
+static size_t normalize_simd(float* nx, float* ny, float* nz, size_t nb_vertices) {
+	size_t v = 0;
+	vfloat tiny = v_set1(FLT_MIN), one = v_set1(1.0f);
+	for (; v + lanes <= nb_vertices; v += lanes) {
+		vfloat x = v_load(&nx[v]), y = v_load(&ny[v]), z = v_load(&nz[v]);
+		vfloat len2 = v_add(v_add(v_mul(x, x), v_mul(y, y)), v_mul(z, z));
+		vfloat inv = v_div(one, v_sqrt(v_max(len2, tiny)));
+		v_store(&nx[v], v_mul(x, inv));
+		v_store(&ny[v], v_mul(y, inv));
+		v_store(&nz[v], v_mul(z, inv));
+	}
+	return v;
+}
+#endif
+
+/* Corner weights of triangle t: 1 for area weighting (the normal's
+ * length already is the area), angle / length otherwise */
+static inline void corner_weights(const face_arrays &faces, size_t t, bool angle_weighted, float w[3]) {
+	if (!angle_weighted) {
+		w[0] = w[1] = w[2] = 1.0f;
+		return;
+	}
+	size_t i = t - faces.first;
+	float length = faces.length[i];
+	if (!(length > 0.0f)) {
+		w[0] = w[1] = w[2] = 0.0f;
+		return;
+	}
+	float a = acosf(min(max(faces.cos_a[i], -1.0f), 1.0f));
+	float b = acosf(min(max(faces.cos_b[i], -1.0f), 1.0f));
+	float c = max((float)M_PI - a - b, 0.0f);
+	w[0] = a / length;
+	w[1] = b / length;
+	w[2] = c / length;
+}
+
+static void accumulate(const face_arrays &faces, const unsigned* elements, size_t first, size_t last,
+		       bool angle_weighted, float* nx, float* ny, float* nz) {
+	for (size_t t = first; t < last; t++) {
+		float w[3];
+		corner_weights(faces, t, angle_weighted, w);
+		size_t i = t - faces.first;
+		for (int c = 0; c < 3; c++) {
+			unsigned v = elements[t * 3 + c];
+			nx[v] += faces.x[i] * w[c];
+			ny[v] += faces.y[i] * w[c];
+			nz[v] += faces.z[i] * w[c];
+		}
+	}
+}
+
+static void normalize_scalar(float* nx, float* ny, float* nz, size_t first, size_t nb_vertices) {
+	for (size_t v = first; v < nb_vertices; v++) {
+		float len2 = nx[v] * nx[v] + ny[v] * ny[v] + nz[v] * nz[v];
+		float inv = 1.0f / sqrtf(max(len2, FLT_MIN));
+		nx[v] *= inv;
+		ny[v] *= inv;
+		nz[v] *= inv;
+	}
+}
+
+/* Smooth vertex normals from SoA positions and a triangle list:
+ * each vertex gets the normalized sum of the normals of the
+ * triangles around it, weighted by triangle area, or with
+ * 'angle_weighted' by the angle of the triangle at that vertex.
+ * Vertices not used by any triangle get a zero normal. */
+void smooth_normals(const float* px, const float* py, const float* pz, size_t nb_vertices,
+		    const unsigned* elements, size_t nb_elements, bool angle_weighted,
+		    float* nx, float* ny, float* nz) {
+#ifdef VFLOAT_SIMD
+	memset(nx, 0, nb_vertices * sizeof(float));
+	memset(ny, 0, nb_vertices * sizeof(float));
+	memset(nz, 0, nb_vertices * sizeof(float));
+
+	size_t nb_faces = nb_elements / 3;
+	face_block block;
+	for (size_t first = 0; first < nb_faces; first += block_size) {
+		size_t last = min(first + block_size, nb_faces);
+		face_arrays faces = block.arrays(first);
+		size_t done = faces_simd(px, py, pz, elements, first, last, angle_weighted, faces);
+		faces_scalar(px, py, pz, elements, done, last, angle_weighted, faces);
+		accumulate(faces, elements, first, last, angle_weighted, nx, ny, nz);
+	}
+
+	size_t done = normalize_simd(nx, ny, nz, nb_vertices);
+	normalize_scalar(nx, ny, nz, done, nb_vertices);
+#else
+	smooth_normals_scalar(px, py, pz, nb_vertices, elements, nb_elements, angle_weighted, nx, ny, nz);
+#endif
+}
+
+/* Same result as smooth_normals, one triangle and vertex at a time */
+void smooth_normals_scalar(const float* px, const float* py, const float* pz, size_t nb_vertices,
+			   const unsigned* elements, size_t nb_elements, bool angle_weighted,
+			   float* nx, float* ny, float* nz) {
+	memset(nx, 0, nb_vertices * sizeof(float));
+	memset(ny, 0, nb_vertices * sizeof(float));
+	memset(nz, 0, nb_vertices * sizeof(float));
+
+	size_t nb_faces = nb_elements / 3;
+	face_block block;
+	for (size_t first = 0; first < nb_faces; first += block_size) {
+		size_t last = min(first + block_size, nb_faces);
+		face_arrays faces = block.arrays(first);
+		faces_scalar(px, py, pz, elements, first, last, angle_weighted, faces);
+		accumulate(faces, elements, first, last, angle_weighted, nx, ny, nz);
+	}
+	normalize_scalar(nx, ny, nz, 0, nb_vertices);
+}
+
+/* Give every vertex of every position the same id, so seams in
+ * texture coordinates don't show up as seams in the shading */
+static void weld_positions(const obj_mesh &mesh, vector<unsigned> &position_of, size_t &nb_positions) {
+	vector<unsigned> order(mesh.vertices.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	const vector<obj_vertex> &vertices = mesh.vertices;
+	sort(order.begin(), order.end(), [&vertices](unsigned a, unsigned b) {
+		const glm::vec3 &pa = vertices[a].position, &pb = vertices[b].position;
+		if (pa.x != pb.x) return pa.x < pb.x;
+		if (pa.y != pb.y) return pa.y < pb.y;
+		return pa.z < pb.z;
+	});
+	position_of.resize(order.size());
+	nb_positions = 0;
+	for (size_t i = 0; i < order.size(); i++) {
+		if (i > 0 && !(vertices[order[i]].position == vertices[order[i - 1]].position))
+			nb_positions++;
+		position_of[order[i]] = nb_positions;
+	}
+	if (!order.empty())
+		nb_positions++;
+}
+
+/* A triangle corner around a position, with the crease cluster its
+ * triangle joined there */
+struct crease_corner {
+	unsigned cluster;
+	unsigned corner;
+};
+
+/* Recompute the normals of 'mesh', keeping hard edges. Around each
+ * position the triangles are grouped into clusters: a triangle joins
+ * the first cluster whose first triangle's face normal is within
+ * 'crease_angle' (radians) of its own, or starts a new one. Each
+ * cluster gets the weighted normal of its triangles, so vertices on
+ * a crease are split, one copy per side. This costs a compare per
+ * corner and cluster, not per pair of corners. Use a crease angle of
+ * pi or more for fully smooth normals. */
+void split_creases(obj_mesh &mesh, float crease_angle, bool angle_weighted) {
+	vector<unsigned> position_of;
+	size_t nb_positions;
+	weld_positions(mesh, position_of, nb_positions);
+
+	size_t nb_faces = mesh.elements.size() / 3;
+	vector<unsigned> elements(nb_faces * 3);
+	vector<float> px(nb_positions), py(nb_positions), pz(nb_positions);
+	for (size_t v = 0; v < mesh.vertices.size(); v++) {
+		px[position_of[v]] = mesh.vertices[v].position.x;
+		py[position_of[v]] = mesh.vertices[v].position.y;
+		pz[position_of[v]] = mesh.vertices[v].position.z;
+	}
+	for (size_t i = 0; i < elements.size(); i++)
+		elements[i] = position_of[mesh.elements[i]];
+
+	vector<float> fx(nb_faces), fy(nb_faces), fz(nb_faces);
+	vector<float> cos_a(nb_faces), cos_b(nb_faces), flength(nb_faces);
+	face_arrays faces = { 0, fx.data(), fy.data(), fz.data(), cos_a.data(), cos_b.data(), flength.data() };
+	faces_scalar(px.data(), py.data(), pz.data(), elements.data(), 0, nb_faces, angle_weighted, faces);
+	vector<glm::vec3> unit(nb_faces);
+	vector<float> weights(nb_faces * 3);
+	for (size_t t = 0; t < nb_faces; t++) {
+		glm::vec3 n(faces.x[t], faces.y[t], faces.z[t]);
+		float length = glm::length(n);
+		unit[t] = length > 0.0f ? n / length : glm::vec3(0.0, 0.0, 0.0);
+		corner_weights(faces, t, angle_weighted, &weights[t * 3]);
+	}
+
+	// Triangles around each position, as corner numbers
+	vector<unsigned> first(nb_positions + 1, 0), corners(elements.size());
+	for (size_t i = 0; i < elements.size(); i++)
+		first[elements[i] + 1]++;
+	for (size_t p = 0; p < nb_positions; p++)
+		first[p + 1] += first[p];
+	vector<unsigned> fill(first.begin(), first.end() - 1);
+	for (size_t i = 0; i < elements.size(); i++)
+		corners[fill[elements[i]]++] = i;
+
+	float min_cos = cosf(min(crease_angle, (float)M_PI));
+	const vector<obj_vertex> &in = mesh.vertices;
+	const vector<unsigned> &in_elements = mesh.elements;
+	vector<obj_vertex> vertices;
+	vector<unsigned> split_elements(elements.size());
+	vector<glm::vec3> seeds, sums;  // per cluster: first face normal, weighted normal
+	vector<crease_corner> group;
+	for (size_t p = 0; p < nb_positions; p++) {
+		seeds.clear();
+		sums.clear();
+		group.clear();
+		for (unsigned i = first[p]; i < first[p + 1]; i++) {
+			unsigned corner = corners[i];
+			size_t t = corner / 3;
+			unsigned cluster = 0;
+			while (cluster < seeds.size() && glm::dot(unit[t], seeds[cluster]) < min_cos)
+				cluster++;
+			if (cluster == seeds.size()) {
+				seeds.push_back(unit[t]);
+				sums.push_back(glm::vec3(0.0, 0.0, 0.0));
+			}
+			sums[cluster] += glm::vec3(faces.x[t], faces.y[t], faces.z[t]) * weights[corner];
+			crease_corner c = { cluster, corner };
+			group.push_back(c);
+		}
+
+		// One vertex per cluster and texture coordinate
+		sort(group.begin(), group.end(), [&](const crease_corner &a, const crease_corner &b) {
+			if (a.cluster != b.cluster) return a.cluster < b.cluster;
+			const glm::vec2 &ta = in[in_elements[a.corner]].texcoord, &tb = in[in_elements[b.corner]].texcoord;
+			if (ta.x != tb.x) return ta.x < tb.x;
+			return ta.y < tb.y;
+		});
+		for (size_t i = 0; i < group.size(); i++) {
+			const obj_vertex &vertex = in[in_elements[group[i].corner]];
+			const glm::vec2 &previous = in[in_elements[group[max(i, (size_t)1) - 1].corner]].texcoord;
+			if (i == 0 || group[i].cluster != group[i - 1].cluster
+			    || vertex.texcoord.x != previous.x || vertex.texcoord.y != previous.y) {
+				const glm::vec3 &sum = sums[group[i].cluster];
+				float length = glm::length(sum);
+				vertices.push_back(vertex);
+				vertices.back().normal = length > 0.0f ? sum / length : glm::vec3(0.0, 0.0, 0.0);
+			}
+			split_elements[group[i].corner] = vertices.size() - 1;
+		}
+	}
+	mesh.vertices.swap(vertices);
+	mesh.elements.swap(split_elements);
+}
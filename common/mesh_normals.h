@@ -0,0 +1,15 @@
+#ifndef _MESH_NORMALS_H
+#define _MESH_NORMALS_H
+#include <cstddef>
+
+#include "obj_loader.h"
+
+extern void smooth_normals(const float* px, const float* py, const float* pz, size_t nb_vertices,
+			   const unsigned* elements, size_t nb_elements, bool angle_weighted,
+			   float* nx, float* ny, float* nz);
+extern void smooth_normals_scalar(const float* px, const float* py, const float* pz, size_t nb_vertices,
+				  const unsigned* elements, size_t nb_elements, bool angle_weighted,
+				  float* nx, float* ny, float* nz);
+extern void split_creases(obj_mesh &mesh, float crease_angle, bool angle_weighted);
+
+#endif
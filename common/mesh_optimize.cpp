@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+
+#include "mesh_optimize.h"
+
+/* The caches below are simulated with timestamps: a vertex is in a
+ * FIFO cache of 'cache_size' entries while fewer than 'cache_size'
+ * misses happened since it was last loaded. Timestamps start past
+ * 'cache_size' so a zero stamp always misses. */
+
+/* Measure an index order against a FIFO post-transform cache and,
+ * for the vertices it transforms, a 16 KB direct-mapped cache of
+ * 64-byte lines in front of the vertex buffer */
+vertex_cache_stats analyze_vertex_cache(const unsigned* elements, size_t nb_elements,
+					size_t nb_vertices, size_t vertex_size, unsigned cache_size) {
+	const size_t line_size = 64, nb_lines = 256;
+	vector<unsigned> stamps(nb_vertices, 0);
+	vector<size_t> lines(nb_lines, (size_t)-1);
+	unsigned time = cache_size + 1;
+	size_t misses = 0, referenced = 0, fetched = 0;
+
+	for (size_t i = 0; i < nb_elements; i++) {
+		unsigned v = elements[i];
+		if (time - stamps[v] <= cache_size)
+			continue;
+		referenced += stamps[v] == 0;
+		stamps[v] = time++;
+		misses++;
+
+		size_t first = v * vertex_size / line_size;
+		size_t last = ((v + 1) * vertex_size - 1) / line_size;
+		for (size_t line = first; line <= last; line++) {
+			if (lines[line % nb_lines] != line) {
+				lines[line % nb_lines] = line;
+				fetched += line_size;
+			}
+		}
+	}
+
+	vertex_cache_stats stats;
+	stats.acmr = nb_elements >= 3 ? (float)misses / (nb_elements / 3) : 0;
+	stats.atvr = referenced > 0 ? (float)misses / referenced : 0;
+	stats.overfetch = referenced > 0 ? (float)fetched / (referenced * vertex_size) : 0;
+	return stats;
+}
+
+/* Pick the next vertex to fan around, following Tipsify (Sander,
+ * Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality
+ * and Reduced Overdraw", 2007): among the vertices of the last fan
+ * that still have triangles, the oldest one that will still be in
+ * the cache once its remaining triangles are emitted. When none
+ * has triangles left, fall back to the most recent vertex that does
+ * and finally to the next one in input order. */
+static unsigned next_fan(const vector<unsigned> &candidates, const vector<unsigned> &live,
+			 const vector<unsigned> &stamps, unsigned time, unsigned cache_size,
+			 vector<unsigned> &dead_end, size_t &cursor) {
+	unsigned best = ~0u;
+	long best_priority = -1;
+	for (size_t i = 0; i < candidates.size(); i++) {
+		unsigned v = candidates[i];
+		if (live[v] == 0)
+			continue;
+		long priority = 0;
+		if (time - stamps[v] + 2 * live[v] <= cache_size)
+			priority = time - stamps[v];
+		if (priority > best_priority) {
+			best = v;
+			best_priority = priority;
+		}
+	}
+	if (best != ~0u)
+		return best;
+
+	while (!dead_end.empty()) {
+		unsigned v = dead_end.back();
+		dead_end.pop_back();
+		if (live[v] > 0)
+			return v;
+	}
+	for (; cursor < live.size(); cursor++)
+		if (live[cursor] > 0)
+			return cursor;
+	return ~0u;
+}
+
+/* Reorder triangles for the post-transform cache, in time linear in
+ * the mesh size. Each step emits all the remaining triangles around
+ * one vertex, then moves to a neighbouring vertex still in cache. */
+void optimize_vertex_cache(unsigned* elements, size_t nb_elements, size_t nb_vertices,
+			   unsigned cache_size) {
+	size_t nb_faces = nb_elements / 3;
+	if (nb_faces == 0)
+		return;
+
+	// Triangles around each vertex, as offsets into 'adjacency'
+	vector<unsigned> live(nb_vertices, 0);
+	for (size_t i = 0; i < nb_faces * 3; i++)
+		live[elements[i]]++;
+	vector<size_t> offsets(nb_vertices + 1, 0);
+	for (size_t v = 0; v < nb_vertices; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	vector<unsigned> adjacency(nb_faces * 3);
+	vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < nb_faces * 3; i++)
+		adjacency[fill[elements[i]]++] = i / 3;
+
+	vector<unsigned> stamps(nb_vertices, 0);
+	vector<bool> emitted(nb_faces, false);
+	vector<unsigned> dead_end, candidates;
+	vector<unsigned> output;
+	output.reserve(nb_faces * 3);
+	unsigned time = cache_size + 1;
+	size_t cursor = 0;
+
+	unsigned fan = elements[0];
+	while (fan != ~0u) {
+		candidates.clear();
+		for (size_t k = offsets[fan]; k < offsets[fan + 1]; k++) {
+			unsigned t = adjacency[k];
+			if (emitted[t])
+				continue;
+			emitted[t] = true;
+			for (int c = 0; c < 3; c++) {
+				unsigned v = elements[t * 3 + c];
+				output.push_back(v);
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamps[v] > cache_size)
+					stamps[v] = time++;
+			}
+		}
+		fan = next_fan(candidates, live, stamps, time, cache_size, dead_end, cursor);
+	}
+	memcpy(elements, output.data(), output.size() * sizeof(unsigned));
+}
+
+struct cluster {
+	size_t begin, end;  // in triangles
+	float sort_key;
+};
+
+static bool front_first(const cluster &a, const cluster &b) {
+	return a.sort_key > b.sort_key;
+}
+
+/* Reorder clusters of a cache-optimized triangle order so surfaces
+ * likely to occlude others are drawn first, the second half of
+ * Tipsify. The order is cut where the cache restarts anyway (a
+ * triangle missing all three vertices), and further wherever a cut
+ * keeps the cluster's ACMR within 'threshold' of what it was. Each
+ * cluster then moves by how much it faces away from the mesh
+ * centre: those on the outside tend to hide those further in. */
+void optimize_overdraw(unsigned* elements, size_t nb_elements, const obj_vertex* vertices,
+		       size_t nb_vertices, float threshold, unsigned cache_size) {
+	size_t nb_faces = nb_elements / 3;
+	if (nb_faces == 0)
+		return;
+
+	// Cache misses per triangle in the current order
+	vector<unsigned> stamps(nb_vertices, 0);
+	vector<unsigned char> misses(nb_faces, 0);
+	unsigned time = cache_size + 1;
+	for (size_t i = 0; i < nb_faces * 3; i++) {
+		unsigned v = elements[i];
+		if (time - stamps[v] > cache_size) {
+			stamps[v] = time++;
+			misses[i / 3]++;
+		}
+	}
+
+	vector<cluster> clusters;
+	size_t hard_begin = 0;
+	for (size_t t = 1; t <= nb_faces; t++) {
+		if (t < nb_faces && misses[t] < 3)
+			continue;
+
+		// Split [hard_begin, t) again, replaying it with a cache
+		// flushed at each cut to get the real cost of the cut
+		size_t hard_misses = 0;
+		for (size_t i = hard_begin; i < t; i++)
+			hard_misses += misses[i];
+		float limit = threshold * hard_misses / (t - hard_begin);
+		size_t begin = hard_begin, soft_misses = 0;
+		time += cache_size + 1;
+		for (size_t i = hard_begin; i < t; i++) {
+			for (int c = 0; c < 3; c++) {
+				unsigned v = elements[i * 3 + c];
+				if (time - stamps[v] > cache_size) {
+					stamps[v] = time++;
+					soft_misses++;
+				}
+			}
+			if (i + 1 < t && soft_misses <= limit * (i + 1 - begin)) {
+				cluster c = { begin, i + 1, 0 };
+				clusters.push_back(c);
+				begin = i + 1;
+				soft_misses = 0;
+				time += cache_size + 1;
+			}
+		}
+		cluster c = { begin, t, 0 };
+		clusters.push_back(c);
+		hard_begin = t;
+	}
+
+	// Area-weighted centroids and normals, of the mesh and of each cluster
+	vector<glm::vec3> centroids(clusters.size()), normals(clusters.size());
+	glm::vec3 mesh_centroid(0);
+	float mesh_area = 0;
+	for (size_t k = 0; k < clusters.size(); k++) {
+		glm::vec3 centroid(0), normal(0);
+		float area = 0;
+		for (size_t t = clusters[k].begin; t < clusters[k].end; t++) {
+			const glm::vec3 &a = vertices[elements[t * 3]].position;
+			const glm::vec3 &b = vertices[elements[t * 3 + 1]].position;
+			const glm::vec3 &c = vertices[elements[t * 3 + 2]].position;
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float w = glm::length(n);
+			centroid += (a + b + c) * (w / 3);
+			normal += n;
+			area += w;
+		}
+		mesh_centroid += centroid;
+		mesh_area += area;
+		centroids[k] = area > 0 ? centroid / area : centroid;
+		float length = glm::length(normal);
+		normals[k] = length > 0 ? normal / length : normal;
+	}
+	if (mesh_area > 0)
+		mesh_centroid /= mesh_area;
+	for (size_t k = 0; k < clusters.size(); k++)
+		clusters[k].sort_key = glm::dot(centroids[k] - mesh_centroid, normals[k]);
+	stable_sort(clusters.begin(), clusters.end(), front_first);
+
+	vector<unsigned> output;
+	output.reserve(nb_faces * 3);
+	for (size_t k = 0; k < clusters.size(); k++)
+		output.insert(output.end(), &elements[clusters[k].begin * 3], &elements[clusters[k].end * 3]);
+	memcpy(elements, output.data(), output.size() * sizeof(unsigned));
+}
+
+/* Renumber vertices in the order the triangles first use them, so
+ * vertex fetches walk the buffer mostly forward. Vertices no
+ * triangle uses are dropped. */
+void optimize_vertex_fetch(obj_mesh &mesh) {
+	vector<unsigned> remap(mesh.vertices.size(), ~0u);
+	vector<obj_vertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.elements.size(); i++) {
+		unsigned &v = mesh.elements[i];
+		if (remap[v] == ~0u) {
+			remap[v] = vertices.size();
+			vertices.push_back(mesh.vertices[v]);
+		}
+		v = remap[v];
+	}
+	mesh.vertices.swap(vertices);
+}
+
+/* Run the three passes, in the order each expects */
+void optimize_mesh(obj_mesh &mesh, mesh_optimize_stats* stats) {
+	if (stats != NULL)
+		stats->before = analyze_vertex_cache(mesh.elements.data(), mesh.elements.size(),
+						     mesh.vertices.size(), sizeof(obj_vertex));
+	optimize_vertex_cache(mesh.elements.data(), mesh.elements.size(), mesh.vertices.size());
+	optimize_overdraw(mesh.elements.data(), mesh.elements.size(), mesh.vertices.data(), mesh.vertices.size());
+	optimize_vertex_fetch(mesh);
+	if (stats != NULL)
+		stats->after = analyze_vertex_cache(mesh.elements.data(), mesh.elements.size(),
+						    mesh.vertices.size(), sizeof(obj_vertex));
+}
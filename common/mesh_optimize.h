@@ -0,0 +1,34 @@
+#ifndef _MESH_OPTIMIZE_H
+#define _MESH_OPTIMIZE_H
+#include <cstddef>
+
+#include "obj_loader.h"
+
+/* Post-transform cache size the optimizer targets and the analysis
+ * simulates. Real GPUs differ, but orders good for a 16-entry FIFO
+ * are good for most of them. */
+const unsigned default_cache_size = 16;
+
+struct vertex_cache_stats {
+	float acmr;       // transformed vertices per triangle, 0.5 is ideal on a grid
+	float atvr;       // transformed vertices per referenced vertex, 1 is ideal
+	float overfetch;  // vertex bytes read per referenced vertex byte, 1 is ideal
+};
+
+struct mesh_optimize_stats {
+	vertex_cache_stats before;
+	vertex_cache_stats after;
+};
+
+extern vertex_cache_stats analyze_vertex_cache(const unsigned* elements, size_t nb_elements,
+					       size_t nb_vertices, size_t vertex_size,
+					       unsigned cache_size = default_cache_size);
+extern void optimize_vertex_cache(unsigned* elements, size_t nb_elements, size_t nb_vertices,
+				  unsigned cache_size = default_cache_size);
+extern void optimize_overdraw(unsigned* elements, size_t nb_elements, const obj_vertex* vertices,
+			      size_t nb_vertices, float threshold = 1.05f,
+			      unsigned cache_size = default_cache_size);
+extern void optimize_vertex_fetch(obj_mesh &mesh);
+extern void optimize_mesh(obj_mesh &mesh, mesh_optimize_stats* stats = NULL);
+
+#endif
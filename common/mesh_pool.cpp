@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+
+#include "mesh_pool.h"
+
+const char* mesh_pool_path_name(mesh_pool_path path) {
+	switch (path) {
+	case pool_multi_draw_indirect: return "multi-draw indirect";
+	case pool_base_vertex:         return "base vertex loop";
+	default:                       return "rebased attributes loop";
+	}
+}
+
+/* 'preferred', or the next one down that the context supports.
+ * Multi-draw indirect also needs GL_DRAW_INDIRECT_BUFFER, from
+ * ARB_draw_indirect or GL 4.0. */
+mesh_pool_path best_mesh_pool_path(mesh_pool_path preferred) {
+	if (preferred == pool_multi_draw_indirect
+	    && (GLEW_VERSION_4_3
+		|| (GLEW_ARB_multi_draw_indirect && (GLEW_VERSION_4_0 || GLEW_ARB_draw_indirect))))
+		return pool_multi_draw_indirect;
+	if (preferred != pool_rebase_attributes && (GLEW_VERSION_3_2 || GLEW_ARB_draw_elements_base_vertex))
+		return pool_base_vertex;
+	return pool_rebase_attributes;
+}
+
+/* Allocate the pool's buffers, for 'vertex_capacity' vertices in
+ * 'format' and 'index_capacity' indices of 'index_type'. Leaves the
+ * buffers bound. */
+void init_mesh_pool(mesh_pool* pool, vertex_format format, GLenum index_type,
+		    size_t vertex_capacity, size_t index_capacity, mesh_pool_path preferred) {
+	pool->format = format;
+	pool->index_type = index_type;
+	pool->vertex_capacity = vertex_capacity;
+	pool->index_capacity = index_capacity;
+	pool->nb_vertices = pool->nb_indices = 0;
+	pool->meshes.clear();
+	pool->layout = vertex_layout();
+	pool->path = best_mesh_pool_path(preferred);
+	// Without ARB_base_instance the indirect command's last field is
+	// reserved and must be 0; the loops have no base instance at all
+	pool->base_instance = pool->path == pool_multi_draw_indirect
+		&& (GLEW_VERSION_4_2 || GLEW_ARB_base_instance);
+	pool->commands.clear();
+	pool->indirect_buffer = 0;
+	pool->indirect_capacity = 0;
+	pool->draw_calls = 0;
+
+	glGenBuffers(1, &pool->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, pool->vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertex_capacity * vertex_size(format), NULL, GL_STATIC_DRAW);
+	glGenBuffers(1, &pool->ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_capacity * index_size(index_type), NULL, GL_STATIC_DRAW);
+}
+
+/* A part's indices in the pool's index type; false when they do not
+ * fit in it */
+static bool convert_indices(const unsigned char* indices, const submesh &part, GLenum index_type,
+			    vector<unsigned char> &out) {
+	out.resize(part.nb_indices * index_size(index_type));
+	const unsigned char* in = indices + part.index_offset;
+	if (part.index_type == index_type) {
+		memcpy(out.data(), in, out.size());
+		return true;
+	}
+	if (index_type == GL_UNSIGNED_INT) {
+		for (size_t i = 0; i < part.nb_indices; i++)
+			((GLuint*)out.data())[i] = ((const GLushort*)in)[i];
+		return true;
+	}
+	for (size_t i = 0; i < part.nb_indices; i++) {
+		GLuint index = ((const GLuint*)in)[i];
+		if (index >= max_vertices_16bit)
+			return false;
+		((GLushort*)out.data())[i] = index;
+	}
+	return true;
+}
+
+/* Copy a mesh's vertices and the indices of each of its parts into
+ * the pool. Each part becomes a pool mesh; returns the first one's
+ * number, the others following, or -1 when the pool is full or the
+ * indices do not fit its index type. */
+int add_pool_parts(mesh_pool* pool, const unsigned char* vertices, size_t nb_vertices,
+		   const unsigned char* indices, const vector<submesh> &parts) {
+	size_t nb_indices = 0;
+	for (size_t i = 0; i < parts.size(); i++)
+		nb_indices += parts[i].nb_indices;
+	if (pool->nb_vertices + nb_vertices > pool->vertex_capacity
+	    || pool->nb_indices + nb_indices > pool->index_capacity) {
+		cerr << "Mesh pool full: " << nb_vertices << " vertices and " << nb_indices
+		     << " indices do not fit" << endl;
+		return -1;
+	}
+
+	vector<vector<unsigned char> > converted(parts.size());
+	for (size_t i = 0; i < parts.size(); i++) {
+		if (!convert_indices(indices, parts[i], pool->index_type, converted[i])) {
+			cerr << "Mesh pool: a part needs 32-bit indices" << endl;
+			return -1;
+		}
+	}
+
+	GLsizei stride = vertex_size(pool->format);
+	glBindBuffer(GL_ARRAY_BUFFER, pool->vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, pool->nb_vertices * stride, nb_vertices * stride, vertices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool->ibo);
+	int first = pool->meshes.size();
+	for (size_t i = 0; i < parts.size(); i++) {
+		pool_mesh m;
+		m.first_index = pool->nb_indices;
+		m.nb_indices = parts[i].nb_indices;
+		m.base_vertex = pool->nb_vertices + parts[i].first_vertex;
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, pool->nb_indices * index_size(pool->index_type),
+				converted[i].size(), converted[i].data());
+		pool->nb_indices += parts[i].nb_indices;
+		pool->meshes.push_back(m);
+	}
+	pool->nb_vertices += nb_vertices;
+	return first;
+}
+
+int add_pool_mesh(mesh_pool* pool, const mesh_data &data) {
+	if (data.format != pool->format) {
+		cerr << "Mesh pool: vertex format mismatch" << endl;
+		return -1;
+	}
+	return add_pool_parts(pool, data.vertices.data(), data.nb_vertices, data.indices.data(), data.parts);
+}
+
+/* The one vertex layout every pool mesh is drawn with, from vertex 0 */
+void build_pool_layout(mesh_pool* pool, GLint attribute_coord, GLint attribute_normal,
+		       GLint attribute_texcoord, bool use_vao) {
+	mesh_buffers buffers;
+	buffers.vbo = pool->vbo;
+	buffers.ibo = pool->ibo;
+	buffers.format = pool->format;
+	build_mesh_layout(buffers, submesh(), attribute_coord, attribute_normal, attribute_texcoord,
+			  &pool->layout, use_vao);
+}
+
+/* Start the frame's list of draws */
+void mesh_pool_clear_draws(mesh_pool* pool) {
+	pool->commands.clear();
+}
+
+/* Queue 'instance_count' instances of a pool mesh. False, and nothing
+ * queued, for a nonzero 'base_instance' the pool can't honour. */
+bool mesh_pool_add_draw(mesh_pool* pool, int mesh, GLuint instance_count, GLuint base_instance) {
+	if (base_instance != 0 && !pool->base_instance)
+		return false;
+	const pool_mesh &m = pool->meshes[mesh];
+	draw_elements_command command = { m.nb_indices, instance_count, m.first_index, m.base_vertex, base_instance };
+	pool->commands.push_back(command);
+	return true;
+}
+
+/* The attributes of the pool's layout, moved to 'base_vertex' */
+static void rebase_attributes(const mesh_pool* pool, GLint base_vertex, gl_state* state) {
+	for (size_t i = 0; i < pool->layout.attribs.size(); i++) {
+		const vertex_attrib &a = pool->layout.attribs[i];
+		const GLvoid* pointer = (const GLvoid*) (a.offset + (size_t)base_vertex * a.stride);
+		if (state != NULL) {
+			gl_bind_buffer(state, GL_ARRAY_BUFFER, a.buffer);
+			gl_vertex_attrib_pointer(state, a.index, a.size, a.type, a.normalized, a.stride, pointer);
+		} else {
+			glBindBuffer(GL_ARRAY_BUFFER, a.buffer);
+			glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride, pointer);
+		}
+	}
+}
+
+/* Draw the frame's list: one glMultiDrawElementsIndirect from the
+ * indirect buffer, or a loop over the same commands. Leaves the
+ * pool's layout bound. */
+void draw_mesh_pool(mesh_pool* pool, gl_state* state) {
+	pool->draw_calls = 0;
+	if (pool->commands.empty())
+		return;
+	bind_vertex_layout(&pool->layout, state);
+
+	size_t nb_commands = pool->commands.size();
+	if (pool->path == pool_multi_draw_indirect) {
+		if (pool->indirect_buffer == 0)
+			glGenBuffers(1, &pool->indirect_buffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, pool->indirect_buffer);
+		pool->indirect_capacity = max(pool->indirect_capacity, nb_commands);
+		// Orphaned each frame: the GPU may still read last frame's commands
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, pool->indirect_capacity * sizeof(draw_elements_command),
+			     NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, nb_commands * sizeof(draw_elements_command),
+				pool->commands.data());
+		glMultiDrawElementsIndirect(GL_TRIANGLES, pool->index_type, (const GLvoid*) 0, nb_commands, 0);
+		pool->draw_calls = 1;
+		return;
+	}
+
+	GLsizei size = index_size(pool->index_type);
+	for (size_t i = 0; i < nb_commands; i++) {
+		const draw_elements_command &c = pool->commands[i];
+		const GLvoid* offset = (const GLvoid*) ((size_t)c.first_index * size);
+		if (pool->path == pool_base_vertex) {
+			if (c.instance_count == 1)
+				glDrawElementsBaseVertex(GL_TRIANGLES, c.count, pool->index_type, (GLvoid*) offset, c.base_vertex);
+			else
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c.count, pool->index_type, (GLvoid*) offset,
+								  c.instance_count, c.base_vertex);
+		} else {
+			rebase_attributes(pool, c.base_vertex, state);
+			if (c.instance_count == 1)
+				glDrawElements(GL_TRIANGLES, c.count, pool->index_type, offset);
+			else
+				draw_elements_instanced(GL_TRIANGLES, c.count, pool->index_type, (size_t) offset,
+							c.instance_count);
+		}
+	}
+	pool->draw_calls = nb_commands;
+}
+
+void free_mesh_pool(mesh_pool* pool) {
+	glDeleteBuffers(1, &pool->vbo);
+	glDeleteBuffers(1, &pool->ibo);
+	if (pool->indirect_buffer != 0)
+		glDeleteBuffers(1, &pool->indirect_buffer);
+	free_vertex_layout(&pool->layout);
+	pool->meshes.clear();
+	pool->commands.clear();
+	pool->nb_vertices = pool->nb_indices = 0;
+}
@@ -0,0 +1,70 @@
+#ifndef _MESH_POOL_H
+#define _MESH_POOL_H
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+
+#include "mesh_buffers.h"
+#include "vertex_layout.h"
+
+/* Layout of glMultiDrawElementsIndirect's commands */
+struct draw_elements_command {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;  // 0 unless the pool's base_instance is true
+};
+
+/* Where a mesh part was placed in the pool */
+struct pool_mesh {
+	GLuint first_index;   // in indices, into the pool's index buffer
+	GLuint nb_indices;
+	GLint base_vertex;    // in vertices, into the pool's vertex buffer
+};
+
+/* How draw_mesh_pool submits the commands, best first */
+enum mesh_pool_path {
+	pool_multi_draw_indirect,  // one glMultiDrawElementsIndirect (4.3 or ARB_multi_draw_indirect)
+	pool_base_vertex,          // glDrawElementsBaseVertex per command (3.2 or ARB_draw_elements_base_vertex)
+	pool_rebase_attributes     // attributes re-pointed at each command's base vertex, GL 2.1
+};
+
+/* Static geometry of many meshes suballocated from one vertex buffer
+ * and one index buffer of fixed capacities, all in the same vertex
+ * format and index type, so that any set of them is drawn with the
+ * same vertex layout. Packed meshes must share their bounds, as the
+ * position decode is per draw. */
+struct mesh_pool {
+	vertex_format format;
+	GLenum index_type;
+	GLuint vbo, ibo;
+	size_t vertex_capacity, index_capacity;  // in vertices and indices
+	size_t nb_vertices, nb_indices;          // used so far
+	std::vector<pool_mesh> meshes;
+	vertex_layout layout;
+	mesh_pool_path path;
+	bool base_instance;        // draws may start past instance 0: indirect path on 4.2 or ARB_base_instance
+	/* The frame's draws, filled by mesh_pool_add_draw */
+	std::vector<draw_elements_command> commands;
+	GLuint indirect_buffer;
+	size_t indirect_capacity;  // in commands
+	unsigned draw_calls;       // made by the last draw_mesh_pool
+};
+
+extern const char* mesh_pool_path_name(mesh_pool_path path);
+extern mesh_pool_path best_mesh_pool_path(mesh_pool_path preferred = pool_multi_draw_indirect);
+extern void init_mesh_pool(mesh_pool* pool, vertex_format format, GLenum index_type,
+			   size_t vertex_capacity, size_t index_capacity,
+			   mesh_pool_path preferred = pool_multi_draw_indirect);
+extern int add_pool_parts(mesh_pool* pool, const unsigned char* vertices, size_t nb_vertices,
+			  const unsigned char* indices, const std::vector<submesh> &parts);
+extern int add_pool_mesh(mesh_pool* pool, const mesh_data &data);
+extern void build_pool_layout(mesh_pool* pool, GLint attribute_coord, GLint attribute_normal,
+			      GLint attribute_texcoord, bool use_vao = true);
+extern void mesh_pool_clear_draws(mesh_pool* pool);
+extern bool mesh_pool_add_draw(mesh_pool* pool, int mesh, GLuint instance_count = 1, GLuint base_instance = 0);
+extern void draw_mesh_pool(mesh_pool* pool, gl_state* state = NULL);
+extern void free_mesh_pool(mesh_pool* pool);
+
+#endif
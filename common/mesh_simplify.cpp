@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+
+#include "mesh_simplify.h"
+
+/* Edge-collapse simplification with quadric error metrics (Garland
+ * and Heckbert, "Surface Simplification Using Quadric Error
+ * Metrics", 1997). Vertices only ever collapse onto one of their
+ * neighbours, so every LOD keeps indexing the full mesh's vertex
+ * buffer and only needs its own index range.
+ *
+ * Vertices where the .obj splits attributes (several vertices at
+ * one position: texcoord seams, hard normals) and non-manifold ones
+ * are never removed. Vertices on an open border only slide along
+ * it. */
+
+/* Sum of squared distances to a set of weighted planes, as the
+ * symmetric matrix A, vector b and constant c of
+ * p.A.p + 2 b.p + c. Kept in doubles as the terms are large and
+ * nearly cancel. */
+struct quadric {
+	double a00, a11, a22, a01, a02, a12;
+	double b0, b1, b2;
+	double c;
+	double weight;
+};
+
+static void quadric_add(quadric &q, const quadric &r) {
+	q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+	q.a01 += r.a01; q.a02 += r.a02; q.a12 += r.a12;
+	q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+	q.c += r.c;
+	q.weight += r.weight;
+}
+
+/* Plane through 'p' with unit normal 'n' */
+static quadric plane_quadric(const glm::dvec3 &p, const glm::dvec3 &n, double weight) {
+	double d = -glm::dot(n, p);
+	quadric q;
+	q.a00 = weight * n.x * n.x; q.a11 = weight * n.y * n.y; q.a22 = weight * n.z * n.z;
+	q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z; q.a12 = weight * n.y * n.z;
+	q.b0 = weight * n.x * d; q.b1 = weight * n.y * d; q.b2 = weight * n.z * d;
+	q.c = weight * d * d;
+	q.weight = weight;
+	return q;
+}
+
+/* Weighted mean squared distance from 'p' to the planes */
+static double quadric_error(const quadric &q, const glm::dvec3 &p) {
+	double e = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z
+		+ 2 * (q.a01 * p.x * p.y + q.a02 * p.x * p.z + q.a12 * p.y * p.z)
+		+ 2 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z)
+		+ q.c;
+	return q.weight > 0 ? max(e, 0.0) / q.weight : 0;
+}
+
+/* Border planes count this much more than surface ones, so open
+ * borders keep their shape */
+static const double border_weight = 10.0;
+
+enum vertex_kind { kind_manifold, kind_border, kind_locked };
+
+/* Triangles around each vertex, as offsets into 'triangles' */
+struct vertex_adjacency {
+	vector<unsigned> offsets;
+	vector<unsigned> triangles;
+};
+
+static void build_adjacency(const vector<unsigned> &elements, size_t nb_vertices, vertex_adjacency &adj) {
+	adj.offsets.assign(nb_vertices + 1, 0);
+	for (size_t i = 0; i < elements.size(); i++)
+		adj.offsets[elements[i] + 1]++;
+	for (size_t v = 0; v < nb_vertices; v++)
+		adj.offsets[v + 1] += adj.offsets[v];
+	adj.triangles.resize(elements.size());
+	vector<unsigned> fill(adj.offsets.begin(), adj.offsets.end() - 1);
+	for (size_t i = 0; i < elements.size(); i++)
+		adj.triangles[fill[elements[i]]++] = i / 3;
+}
+
+/* Number of triangles around 'a' with the half-edge a->b */
+static unsigned count_half_edges(const vector<unsigned> &elements, const vertex_adjacency &adj,
+				 unsigned a, unsigned b) {
+	unsigned count = 0;
+	for (unsigned k = adj.offsets[a]; k < adj.offsets[a + 1]; k++) {
+		const unsigned* tri = &elements[adj.triangles[k] * 3];
+		for (int c = 0; c < 3; c++)
+			count += tri[c] == a && tri[(c + 1) % 3] == b;
+	}
+	return count;
+}
+
+/* Lock vertices sharing their position with another used vertex:
+ * they sit on an attribute seam that collapses would tear open */
+static void lock_seams(const obj_mesh &mesh, const vector<unsigned> &elements, vector<unsigned char> &kinds) {
+	vector<unsigned> used;
+	vector<bool> seen(mesh.vertices.size(), false);
+	for (size_t i = 0; i < elements.size(); i++) {
+		if (!seen[elements[i]]) {
+			seen[elements[i]] = true;
+			used.push_back(elements[i]);
+		}
+	}
+	const vector<obj_vertex> &vertices = mesh.vertices;
+	sort(used.begin(), used.end(), [&vertices](unsigned a, unsigned b) {
+		const glm::vec3 &pa = vertices[a].position, &pb = vertices[b].position;
+		if (pa.x != pb.x) return pa.x < pb.x;
+		if (pa.y != pb.y) return pa.y < pb.y;
+		return pa.z < pb.z;
+	});
+	for (size_t i = 0; i + 1 < used.size(); i++) {
+		if (vertices[used[i]].position == vertices[used[i + 1]].position)
+			kinds[used[i]] = kinds[used[i + 1]] = kind_locked;
+	}
+}
+
+/* Would moving 'a' onto 'b' turn any remaining triangle around 'a'
+ * over (or make it degenerate)? */
+static bool collapse_flips(const obj_mesh &mesh, const vector<unsigned> &elements,
+			   const vertex_adjacency &adj, unsigned a, unsigned b) {
+	glm::vec3 pa = mesh.vertices[a].position, pb = mesh.vertices[b].position;
+	for (unsigned k = adj.offsets[a]; k < adj.offsets[a + 1]; k++) {
+		const unsigned* tri = &elements[adj.triangles[k] * 3];
+		if (tri[0] == b || tri[1] == b || tri[2] == b)
+			continue;  // collapses away
+		int c = tri[0] == a ? 0 : tri[1] == a ? 1 : 2;
+		glm::vec3 p1 = mesh.vertices[tri[(c + 1) % 3]].position;
+		glm::vec3 p2 = mesh.vertices[tri[(c + 2) % 3]].position;
+		glm::vec3 before = glm::cross(p1 - pa, p2 - pa);
+		glm::vec3 after = glm::cross(p1 - pb, p2 - pb);
+		if (!(glm::dot(before, after) > 0.0f))
+			return true;
+	}
+	return false;
+}
+
+struct collapse {
+	unsigned from, to;
+	double error;
+};
+
+static bool cheaper(const collapse &a, const collapse &b) {
+	return a.error < b.error;
+}
+
+/* Simplify the triangles 'elements' of 'mesh' down to about
+ * 'target_indices' indices, or as close as the locked vertices and
+ * the flip checks allow. Each pass sorts the cheapest collapse of
+ * every vertex by error and applies those that don't touch each
+ * other. Returns the error of the worst collapse, in model units. */
+float simplify_mesh(const obj_mesh &mesh, const vector<unsigned> &elements,
+		    size_t target_indices, vector<unsigned> &out) {
+	size_t nb_vertices = mesh.vertices.size();
+	out = elements;
+	if (out.size() <= target_indices)
+		return 0.0f;
+
+	vertex_adjacency adj;
+	build_adjacency(out, nb_vertices, adj);
+
+	vector<unsigned char> kinds(nb_vertices, kind_manifold);
+	lock_seams(mesh, out, kinds);
+	vector<quadric> quadrics(nb_vertices, quadric());
+	for (size_t t = 0; t < out.size() / 3; t++) {
+		const unsigned* tri = &out[t * 3];
+		glm::dvec3 p[3];
+		for (int c = 0; c < 3; c++)
+			p[c] = glm::dvec3(mesh.vertices[tri[c]].position);
+		glm::dvec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+		double length = glm::length(n);
+		if (length > 0) {
+			quadric q = plane_quadric(p[0], n / length, length * 0.5);
+			for (int c = 0; c < 3; c++)
+				quadric_add(quadrics[tri[c]], q);
+		}
+
+		for (int c = 0; c < 3; c++) {
+			unsigned a = tri[c], b = tri[(c + 1) % 3];
+			unsigned opposite = count_half_edges(out, adj, b, a);
+			if (opposite > 1 || count_half_edges(out, adj, a, b) > 1) {
+				kinds[a] = kinds[b] = kind_locked;
+			} else if (opposite == 0) {
+				if (kinds[a] != kind_locked) kinds[a] = kind_border;
+				if (kinds[b] != kind_locked) kinds[b] = kind_border;
+				// Plane through the edge, perpendicular to the triangle
+				glm::dvec3 edge = p[(c + 1) % 3] - p[c];
+				glm::dvec3 side = length > 0 ? glm::cross(edge, n / length) : glm::dvec3(0);
+				double side_length = glm::length(side);
+				if (side_length > 0) {
+					quadric q = plane_quadric(p[c], side / side_length,
+								  glm::dot(edge, edge) * border_weight);
+					quadric_add(quadrics[a], q);
+					quadric_add(quadrics[b], q);
+				}
+			}
+		}
+	}
+
+	double max_error = 0;
+	vector<collapse> best(nb_vertices), candidates;
+	vector<bool> touched(nb_vertices);
+	vector<unsigned> remap(nb_vertices);
+	while (out.size() > target_indices) {
+		// The cheapest collapse of each vertex. Each half-edge a->b
+		// offers a->b; b->a comes from the opposite half-edge, or
+		// from this one on a border.
+		for (size_t v = 0; v < nb_vertices; v++) {
+			best[v].from = best[v].to = v;
+			best[v].error = DBL_MAX;
+		}
+		for (size_t i = 0; i < out.size(); i++) {
+			unsigned a = out[i], b = out[i - i % 3 + (i + 1) % 3];
+			bool border = kinds[a] != kind_manifold && kinds[b] != kind_manifold
+				&& count_half_edges(out, adj, b, a) == 0;
+			for (int dir = 0; dir < (border ? 2 : 1); dir++, swap(a, b)) {
+				// Border vertices only move along their border
+				if (kinds[a] == kind_locked || (kinds[a] == kind_border && !border))
+					continue;
+				quadric q = quadrics[a];
+				quadric_add(q, quadrics[b]);
+				double error = quadric_error(q, glm::dvec3(mesh.vertices[b].position));
+				if (error < best[a].error) {
+					best[a].to = b;
+					best[a].error = error;
+				}
+			}
+		}
+		candidates.clear();
+		for (size_t v = 0; v < nb_vertices; v++)
+			if (best[v].to != v)
+				candidates.push_back(best[v]);
+		sort(candidates.begin(), candidates.end(), cheaper);
+
+		// An interior collapse removes two triangles, a border one one
+		size_t goal = (out.size() - target_indices) / 3, removed = 0;
+		fill(touched.begin(), touched.end(), false);
+		for (size_t v = 0; v < nb_vertices; v++)
+			remap[v] = v;
+		size_t nb_collapses = 0;
+		size_t limit = max(candidates.size() / 4, (size_t)1);
+		for (size_t i = 0; i < limit && removed < goal; i++) {
+			const collapse &c = candidates[i];
+			if (touched[c.from] || touched[c.to])
+				continue;
+			if (collapse_flips(mesh, out, adj, c.from, c.to))
+				continue;
+			remap[c.from] = c.to;
+			quadric_add(quadrics[c.to], quadrics[c.from]);
+			max_error = max(max_error, c.error);
+			removed += kinds[c.from] == kind_border ? 1 : 2;
+			nb_collapses++;
+			// The triangles around 'from' change shape, keep
+			// their other collapses for the next pass
+			for (unsigned k = adj.offsets[c.from]; k < adj.offsets[c.from + 1]; k++) {
+				const unsigned* tri = &out[adj.triangles[k] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+		}
+		if (nb_collapses == 0)
+			break;
+
+		size_t kept = 0;
+		for (size_t t = 0; t < out.size() / 3; t++) {
+			unsigned a = remap[out[t * 3]], b = remap[out[t * 3 + 1]], c = remap[out[t * 3 + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			out[kept++] = a;
+			out[kept++] = b;
+			out[kept++] = c;
+		}
+		out.resize(kept);
+		build_adjacency(out, nb_vertices, adj);
+	}
+	return sqrt(max_error);
+}
+
+/* LOD 0 is the full mesh, each next one is simplified from the
+ * previous one to 'ratios[i]' of the full triangle count, stopping
+ * early once simplification stalls. Errors add up along the chain,
+ * so they bound the distance to the full mesh. */
+void build_lod_chain(const obj_mesh &mesh, const float* ratios, size_t nb_ratios, vector<mesh_lod> &lods) {
+	lods.resize(1);
+	lods[0].elements = mesh.elements;
+	lods[0].error = 0.0f;
+	for (size_t i = 0; i < nb_ratios; i++) {
+		const mesh_lod &previous = lods.back();
+		size_t target = (size_t)(mesh.elements.size() / 3 * ratios[i]) * 3;
+		mesh_lod lod;
+		lod.error = previous.error + simplify_mesh(mesh, previous.elements, target, lod.elements);
+		if (lod.elements.size() > previous.elements.size() * 9 / 10)
+			break;
+		lods.push_back(lod);
+	}
+}
+
+/* Pick the coarsest LOD whose error, projected at the nearest point
+ * of the bounding sphere ('center', 'radius' in model units), stays
+ * under 'max_pixel_error' pixels. 'errors' must grow with the LOD
+ * index, as build_lod_chain makes them. */
+size_t select_lod(const float* errors, size_t nb_lods,
+		  const glm::mat4 &projection, const glm::mat4 &modelview,
+		  const glm::vec3 &center, float radius,
+		  float viewport_height, float max_pixel_error) {
+	// Model units to view units, the largest axis scale
+	float scale = max(glm::length(glm::vec3(modelview[0])),
+			  max(glm::length(glm::vec3(modelview[1])), glm::length(glm::vec3(modelview[2]))));
+	float pixels_per_unit = projection[1][1] * viewport_height * 0.5f * scale;
+	bool perspective = projection[2][3] != 0.0f;
+	if (perspective) {
+		glm::vec4 eye = modelview * glm::vec4(center, 1.0f);
+		float distance = -eye.z - radius * scale;
+		if (!(distance > FLT_EPSILON))
+			return 0;
+		pixels_per_unit /= distance;
+	}
+
+	for (size_t k = nb_lods; k-- > 1; )
+		if (errors[k] * pixels_per_unit <= max_pixel_error)
+			return k;
+	return 0;
+}
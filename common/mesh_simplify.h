@@ -0,0 +1,29 @@
+#ifndef _MESH_SIMPLIFY_H
+#define _MESH_SIMPLIFY_H
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "obj_loader.h"
+
+/* One level of detail: triangles over the vertices of the full mesh,
+ * and how far, in model units, its surface may stray from the full
+ * mesh's as estimated by the quadrics */
+struct mesh_lod {
+	std::vector<unsigned> elements;
+	float error;
+};
+
+/* Triangle ratios of the LODs after the full mesh */
+const float default_lod_ratios[] = { 0.5f, 0.25f, 0.125f, 0.0625f, 0.03125f };
+
+extern float simplify_mesh(const obj_mesh &mesh, const std::vector<unsigned> &elements,
+			   size_t target_indices, std::vector<unsigned> &out);
+extern void build_lod_chain(const obj_mesh &mesh, const float* ratios, size_t nb_ratios,
+			    std::vector<mesh_lod> &lods);
+extern size_t select_lod(const float* errors, size_t nb_lods,
+			 const glm::mat4 &projection, const glm::mat4 &modelview,
+			 const glm::vec3 &center, float radius,
+			 float viewport_height, float max_pixel_error = 1.0f);
+
+#endif
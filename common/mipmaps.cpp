@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "mipmaps.h"
+#include "simd.h"
+
+/* Levels are filtered as RGBA floats, 3-channel images with an opaque
+ * alpha, one row at a time: a vertical pass over the source rows under
+ * the filter, 8 (AVX2) or 4 (SSE2) floats at a time, then a horizontal
+ * pass 2 (AVX2) or 1 (SSE2) output pixels at a time. Large levels split
+ * their rows between threads. */
+
+/* Taps of a 2:1 reduction: output pixel x reads source pixels
+ * 2x + offset to 2x + offset + nb_taps - 1 */
+struct mip_kernel {
+	int nb_taps;
+	int offset;
+	float weights[8];
+};
+
+/* Source pixels beyond each end of a row, clamped to the edge pixel */
+static const int margin = 4;
+
+static double bessel_i0(double x) {
+	double sum = 1, term = 1;
+	for (int k = 1; k < 32; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+/* sinc cut off at the new Nyquist frequency under a Kaiser window
+ * reaching 4 source pixels each side of the output pixel's centre */
+static mip_kernel make_kaiser_kernel() {
+	const double alpha = 4.0, radius = 4.0;
+	mip_kernel k;
+	k.nb_taps = 8;
+	k.offset = -3;
+	double sum = 0;
+	for (int t = 0; t < 8; t++) {
+		double d = t - 3.5;  // source pixel centre to output pixel centre
+		double x = M_PI * d / 2;
+		double window = bessel_i0(alpha * sqrt(1 - (d / radius) * (d / radius))) / bessel_i0(alpha);
+		k.weights[t] = sin(x) / x * window;
+		sum += k.weights[t];
+	}
+	for (int t = 0; t < 8; t++)
+		k.weights[t] /= sum;
+	return k;
+}
+
+static const mip_kernel &kernel_of(mip_filter filter) {
+	static const mip_kernel box = { 2, 0, { 0.5f, 0.5f } };
+	static const mip_kernel kaiser = make_kaiser_kernel();
+	return filter == mip_kaiser ? kaiser : box;
+}
+
+/* Linear values are rounded to this many steps before going back to
+ * sRGB: enough that the darkest codes, 12.92 times steeper, still
+ * round right */
+static const int srgb_steps = 16384;
+
+struct srgb_tables {
+	float to_linear[256];
+	float unorm[256];
+	unsigned char to_srgb[srgb_steps];
+	srgb_tables() {
+		for (int i = 0; i < 256; i++) {
+			double c = i / 255.0;
+			to_linear[i] = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+			unorm[i] = c;
+		}
+		for (int i = 0; i < srgb_steps; i++) {
+			double l = i / (double)(srgb_steps - 1);
+			double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1 / 2.4) - 0.055;
+			to_srgb[i] = (unsigned char)(c * 255 + 0.5);
+		}
+	}
+};
+
+static const srgb_tables &tables() {
+	static const srgb_tables t;
+	return t;
+}
+
+/* 'width' source pixels to RGBA floats */
+static void decode_row(const unsigned char* in, int width, int channels, bool srgb, float* out) {
+	const srgb_tables &t = tables();
+	const float* color = srgb ? t.to_linear : t.unorm;
+	for (int x = 0; x < width; x++, in += channels, out += 4) {
+		out[0] = color[in[0]];
+		out[1] = color[in[1]];
+		out[2] = color[in[2]];
+		out[3] = channels == 4 ? t.unorm[in[3]] : 1.0f;
+	}
+}
+
+static inline void encode_pixel(const float* in, int channels, bool srgb, unsigned char* out) {
+	const srgb_tables &t = tables();
+	for (int c = 0; c < 3; c++) {
+		float v = min(max(in[c], 0.0f), 1.0f);
+		out[c] = srgb ? t.to_srgb[(int)(v * (srgb_steps - 1) + 0.5f)] : (unsigned char)(v * 255 + 0.5f);
+	}
+	if (channels == 4)
+		out[3] = (unsigned char)(min(max(in[3], 0.0f), 1.0f) * 255 + 0.5f);
+}
+
+/* Row functions, in a SIMD and a scalar flavour */
+struct row_kernels {
+	/* out[i] = sum of weights[t] * rows[t][i], for 'n' floats */
+	void (*vertical)(const float* const* rows, const float* weights, int nb_taps, int n, float* out);
+	/* 'nb_out' pixels from the row at 'in', which has 'margin' pixels before it */
+	void (*horizontal)(const float* in, const mip_kernel &k, int nb_out, float* out);
+	void (*encode)(const float* in, int width, int channels, bool srgb, unsigned char* out);
+};
+
+static void vertical_row_scalar(const float* const* rows, const float* weights, int nb_taps, int n, float* out) {
+	for (int i = 0; i < n; i++) {
+		float sum = rows[0][i] * weights[0];
+		for (int t = 1; t < nb_taps; t++)
+			sum += rows[t][i] * weights[t];
+		out[i] = sum;
+	}
+}
+
+static void horizontal_row_scalar(const float* in, const mip_kernel &k, int nb_out, float* out) {
+	for (int x = 0; x < nb_out; x++) {
+		const float* p = in + (2 * x + k.offset) * 4;
+		for (int c = 0; c < 4; c++) {
+			float sum = p[c] * k.weights[0];
+			for (int t = 1; t < k.nb_taps; t++)
+				sum += p[t * 4 + c] * k.weights[t];
+			out[x * 4 + c] = sum;
+		}
+	}
+}
+
+static void encode_row_scalar(const float* in, int width, int channels, bool srgb, unsigned char* out) {
+	for (int x = 0; x < width; x++)
+		encode_pixel(in + x * 4, channels, srgb, out + x * channels);
+}
+
+#ifdef VFLOAT_SIMD
+static const int pixel_lanes = lanes / 4;
+
+static void vertical_row_simd(const float* const* rows, const float* weights, int nb_taps, int n, float* out) {
+	int i = 0;
+	for (; i + lanes <= n; i += lanes) {
+		vfloat sum = v_mul(v_load(rows[0] + i), v_set1(weights[0]));
+		for (int t = 1; t < nb_taps; t++)
+			sum = v_add(sum, v_mul(v_load(rows[t] + i), v_set1(weights[t])));
+		v_store(out + i, sum);
+	}
+	for (; i < n; i++) {
+		float sum = rows[0][i] * weights[0];
+		for (int t = 1; t < nb_taps; t++)
+			sum += rows[t][i] * weights[t];
+		out[i] = sum;
+	}
+}
+
+static void horizontal_row_simd(const float* in, const mip_kernel &k, int nb_out, float* out) {
+	vfloat weights[8];
+	for (int t = 0; t < k.nb_taps; t++)
+		weights[t] = v_set1(k.weights[t]);
+	int x = 0;
+	for (; x + pixel_lanes <= nb_out; x += pixel_lanes) {
+		const float* p = in + (2 * x + k.offset) * 4;
+		vfloat sum = v_mul(v_load_pixels(p), weights[0]);
+		for (int t = 1; t < k.nb_taps; t++)
+			sum = v_add(sum, v_mul(v_load_pixels(p + t * 4), weights[t]));
+		v_store(out + x * 4, sum);
+	}
+	horizontal_row_scalar(in + x * 2 * 4, k, nb_out - x, out + x * 4);
+}
+
+static void encode_row_simd(const float* in, int width, int channels, bool srgb, unsigned char* out) {
+	const srgb_tables &t = tables();
+	const vfloat zero = v_set1(0.0f), one = v_set1(1.0f), half = v_set1(0.5f);
+	const vfloat scale = srgb ? v_set_pixel(srgb_steps - 1, 255) : v_set1(255);
+	int32_t index[lanes];
+	int x = 0;
+	for (; x + pixel_lanes <= width; x += pixel_lanes) {
+		vfloat v = v_min(v_max(v_load(in + x * 4), zero), one);
+		v_store_int(index, v_add(v_mul(v, scale), half));
+		for (int p = 0; p < pixel_lanes; p++) {
+			const int32_t* i = index + p * 4;
+			unsigned char* o = out + (x + p) * channels;
+			if (srgb) {
+				o[0] = t.to_srgb[i[0]];
+				o[1] = t.to_srgb[i[1]];
+				o[2] = t.to_srgb[i[2]];
+			} else {
+				o[0] = i[0];
+				o[1] = i[1];
+				o[2] = i[2];
+			}
+			if (channels == 4)
+				o[3] = i[3];
+		}
+	}
+	encode_row_scalar(in + x * 4, width - x, channels, srgb, out + x * channels);
+}
+
+static const row_kernels simd_kernels = { vertical_row_simd, horizontal_row_simd, encode_row_simd };
+#else
+static const row_kernels simd_kernels = { vertical_row_scalar, horizontal_row_scalar, encode_row_scalar };
+#endif
+
+static const row_kernels scalar_kernels = { vertical_row_scalar, horizontal_row_scalar, encode_row_scalar };
+
+/* Below this many pixels per thread, starting threads costs more
+ * than it saves */
+static const size_t min_thread_pixels = 64 * 1024;
+
+/* job(first, end) over 'nb_rows' rows of 'width' pixels, cut in
+ * slices for up to 'nb_threads' threads, this one included */
+template<class F> static void for_rows(int nb_rows, int width, int nb_threads, F job) {
+	int n = min((size_t)nb_threads, (size_t)nb_rows * width / min_thread_pixels);
+	if (n <= 1) {
+		job(0, nb_rows);
+		return;
+	}
+	vector<thread> threads;
+	for (int i = 0; i < n - 1; i++)
+		threads.push_back(thread(job, nb_rows * i / n, nb_rows * (i + 1) / n));
+	job(nb_rows * (n - 1) / n, nb_rows);
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+/* Where filter_rows reads the level above: its float rows, or for
+ * level 0 its bytes, decoded as needed into a ring of as many rows as
+ * the filter has taps, so that the largest level never exists as
+ * floats */
+struct row_source {
+	const float* level;           // NULL for level 0
+	const unsigned char* bytes;
+	int width, channels;
+	bool srgb;
+	vector<float> ring;
+	int ring_rows[8];
+};
+
+static const float* source_row(row_source &s, int y, int nb_taps) {
+	if (s.level != NULL)
+		return s.level + (size_t)y * s.width * 4;
+	// The rows under the filter are consecutive, so never share a slot
+	int slot = y % nb_taps;
+	float* row = &s.ring[(size_t)slot * s.width * 4];
+	if (s.ring_rows[slot] != y) {
+		decode_row(s.bytes + (size_t)y * s.width * s.channels, s.width, s.channels, s.srgb, row);
+		s.ring_rows[slot] = y;
+	}
+	return row;
+}
+
+/* Rows [first, end) of the level after 'src', as floats into 'dst'
+ * and as bytes into the chain */
+static void filter_rows(row_source src, int height, float* dst, int next_width, const mip_kernel &k,
+			const row_kernels &kernels, unsigned char* bytes, int first, int end) {
+	int width = src.width;
+	if (src.level == NULL) {
+		src.ring.resize((size_t)k.nb_taps * width * 4);
+		fill(src.ring_rows, src.ring_rows + 8, -1);
+	}
+	vector<float> row((width + 2 * margin) * 4);
+	float* centre = &row[margin * 4];
+	for (int y = first; y < end; y++) {
+		if (height > 1) {
+			const float* rows[8];
+			for (int t = 0; t < k.nb_taps; t++)
+				rows[t] = source_row(src, min(max(2 * y + k.offset + t, 0), height - 1), k.nb_taps);
+			kernels.vertical(rows, k.weights, k.nb_taps, width * 4, centre);
+		} else {
+			memcpy(centre, source_row(src, 0, k.nb_taps), width * 4 * sizeof(float));
+		}
+		float* out = dst + (size_t)y * next_width * 4;
+		if (width > 1) {
+			for (int m = 1; m <= margin; m++) {
+				memcpy(centre - m * 4, centre, 4 * sizeof(float));
+				memcpy(centre + (width - 1 + m) * 4, centre + (width - 1) * 4, 4 * sizeof(float));
+			}
+			kernels.horizontal(centre, k, next_width, out);
+		} else {
+			memcpy(out, centre, 4 * sizeof(float));
+		}
+		kernels.encode(out, next_width, src.channels, src.srgb, bytes + (size_t)y * next_width * src.channels);
+	}
+}
+
+static void build_chain(const unsigned char* pixels, int width, int height, int channels, bool srgb,
+			mip_filter filter, mip_chain* chain, int nb_threads, const row_kernels &kernels) {
+	chain->channels = channels;
+	chain->srgb = srgb;
+	chain->filter = filter;
+	chain->levels.clear();
+	size_t size = 0;
+	for (int w = width, h = height; ; w = max(1, w / 2), h = max(1, h / 2)) {
+		mip_level level = { w, h, size };
+		chain->levels.push_back(level);
+		size += (size_t)w * h * channels;
+		if (w == 1 && h == 1)
+			break;
+	}
+	chain->pixels.resize(size);
+	memcpy(chain->pixels.data(), pixels, (size_t)width * height * channels);
+
+	const mip_kernel &k = kernel_of(filter);
+	vector<float> level, next;
+	for (size_t i = 1; i < chain->levels.size(); i++) {
+		const mip_level &above = chain->levels[i - 1], &l = chain->levels[i];
+		row_source src;
+		src.level = i > 1 ? level.data() : NULL;
+		src.bytes = pixels;
+		src.width = above.width;
+		src.channels = channels;
+		src.srgb = srgb;
+		next.resize((size_t)l.width * l.height * 4);
+		unsigned char* bytes = &chain->pixels[l.offset];
+		for_rows(l.height, above.width, nb_threads, [&](int first, int end) {
+			filter_rows(src, above.height, next.data(), l.width, k, kernels, bytes, first, end);
+		});
+		level.swap(next);
+	}
+}
+
+const char* mip_filter_name(mip_filter filter) {
+	return filter == mip_kaiser ? "Kaiser" : "box";
+}
+
+/* Every level of a 'width' x 'height' image of 'channels' (3 or 4)
+ * bytes per pixel, on up to 'nb_threads' threads, one per core when 0 */
+void build_mip_chain(const unsigned char* pixels, int width, int height, int channels, bool srgb,
+		     mip_filter filter, mip_chain* chain, int nb_threads) {
+	if (nb_threads <= 0)
+		nb_threads = max(1, (int)thread::hardware_concurrency());
+	build_chain(pixels, width, height, channels, srgb, filter, chain, nb_threads, simd_kernels);
+}
+
+/* The same without SIMD or threads, for reference */
+void build_mip_chain_scalar(const unsigned char* pixels, int width, int height, int channels, bool srgb,
+			    mip_filter filter, mip_chain* chain) {
+	build_chain(pixels, width, height, channels, srgb, filter, chain, 1, scalar_kernels);
+}
@@ -0,0 +1,37 @@
+#ifndef _MIPMAPS_H
+#define _MIPMAPS_H
+#include <cstddef>
+#include <vector>
+
+/* Mipmap chains built on the CPU from 8-bit RGB or RGBA pixels as a
+ * decoder leaves them. sRGB color is converted to linear light for
+ * filtering and back for storage, alpha is always linear; each level
+ * is filtered from the float pixels of the one above, not from its
+ * rounded bytes. */
+enum mip_filter {
+	mip_box,     // 2x2 average, what glGenerateMipmap usually does
+	mip_kaiser   // 8x8 Kaiser-windowed sinc, sharper, no ringing to speak of
+};
+
+struct mip_level {
+	int width, height;
+	size_t offset;  // of its first byte in the chain's pixels
+};
+
+/* Every level down to 1x1, level 0 included, rows packed in the
+ * order they came in */
+struct mip_chain {
+	int channels;
+	bool srgb;
+	mip_filter filter;
+	std::vector<mip_level> levels;
+	std::vector<unsigned char> pixels;
+};
+
+extern const char* mip_filter_name(mip_filter filter);
+extern void build_mip_chain(const unsigned char* pixels, int width, int height, int channels, bool srgb,
+			    mip_filter filter, mip_chain* chain, int nb_threads = 0);
+extern void build_mip_chain_scalar(const unsigned char* pixels, int width, int height, int channels, bool srgb,
+				   mip_filter filter, mip_chain* chain);
+
+#endif
@@ -0,0 +1,502 @@
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+
+#include "mapped_file.h"
+#include "mesh_normals.h"
+#include "obj_loader.h"
+
+/* The scanner below works directly on the mapped file: every
+ * helper takes the current position and the end of the buffer,
+ * and returns the position just past what it consumed. No line is
+ * ever copied out of the file. */
+
+static inline bool is_blank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* skip_blanks(const char* p, const char* end) {
+	while (p < end && is_blank(*p)) p++;
+	return p;
+}
+
+static inline const char* skip_line(const char* p, const char* end) {
+	while (p < end && *p != '\n') p++;
+	return p < end ? p + 1 : end;
+}
+
+static inline const char* skip_token(const char* p, const char* end) {
+	while (p < end && !is_blank(*p) && *p != '\n') p++;
+	return p;
+}
+
+static const char* parse_float(const char* p, const char* end, float &value) {
+	p = skip_blanks(p, end);
+	if (p < end && *p == '+') p++;  // from_chars doesn't accept a leading '+'
+	from_chars_result res = from_chars(p, end, value);
+	return res.ptr;
+}
+
+static const char* parse_int(const char* p, const char* end, long &value, bool &ok) {
+	p = skip_blanks(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+	const char* start = p;
+	long v = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		v = v * 10 + (*p - '0');
+		p++;
+	}
+	ok = (p != start);
+	value = negative ? -v : v;
+	return p;
+}
+
+/* Value stored for an absent vt or vn in a face corner */
+static const int missing_index = INT_MIN;
+
+/* Everything parsed from one line-aligned slice of the file.
+ * Faces are fan-triangulated into 'corners', with 'stride' indices
+ * per corner: just v, or v, vt and vn. A negative index can point
+ * at an element from an earlier chunk, so it is stored relative to
+ * the chunk's first v/vt/vn and its position is remembered in
+ * 'relative' for the merge. */
+struct obj_chunk {
+	const char* begin;
+	const char* end;
+	int stride;
+	vector<glm::vec4> positions;
+	vector<glm::vec2> texcoords;
+	vector<glm::vec3> normals;
+	vector<int> corners;
+	vector<size_t> relative;
+};
+
+/* Merged contents of the whole file, all indices 0-based */
+struct obj_data {
+	int stride;
+	vector<glm::vec4> positions;
+	vector<glm::vec2> texcoords;
+	vector<glm::vec3> normals;
+	vector<int> corners;
+};
+
+/* Chunks smaller than this aren't worth a thread */
+static const size_t min_chunk_size = 1 << 20;
+
+/* A face corner with its v, vt and vn turned into chunk indices;
+ * bit i of 'relative' is set when index i is relative to the
+ * start of the chunk */
+struct obj_corner {
+	int index[3];
+	unsigned relative;
+};
+
+/* Parse one v, v/vt, v//vn or v/vt/vn face corner */
+static const char* parse_corner(const char* p, const char* end, const obj_chunk* chunk,
+				obj_corner &corner, bool &ok) {
+	long raw[3] = { 0, 0, 0 };
+	p = parse_int(p, end, raw[0], ok);
+	if (!ok || raw[0] == 0) {
+		ok = false;
+		return p;
+	}
+	// An index field left empty, as in v/ or v//, ends the face
+	if (p < end && *p == '/') {
+		p++;
+		if (p < end && *p != '/')
+			p = parse_int(p, end, raw[1], ok);
+		if (ok && p < end && *p == '/')
+			p = parse_int(p + 1, end, raw[2], ok);
+		if (!ok)
+			return p;
+	}
+
+	// 1-based or counting back from the last element read
+	corner.relative = 0;
+	for (int i = 0; i < 3; i++) {
+		if (raw[i] > 0) {
+			corner.index[i] = (int)(raw[i] - 1);
+		} else if (raw[i] < 0) {
+			size_t count = i == 0 ? chunk->positions.size()
+				: i == 1 ? chunk->texcoords.size() : chunk->normals.size();
+			corner.index[i] = (int)(count + raw[i]);
+			corner.relative |= 1 << i;
+		} else {
+			corner.index[i] = missing_index;
+		}
+	}
+	return skip_token(p, end);
+}
+
+static inline void push_corner(obj_chunk* chunk, const obj_corner &corner) {
+	size_t at = chunk->corners.size();
+	for (int i = 0; i < chunk->stride; i++)
+		chunk->corners.push_back(corner.index[i]);
+	if (corner.relative != 0) {
+		for (int i = 0; i < chunk->stride; i++)
+			if (corner.relative & (1 << i))
+				chunk->relative.push_back(at + i);
+	}
+}
+
+static void parse_chunk(obj_chunk* chunk) {
+	const char* p = chunk->begin;
+	const char* end = chunk->end;
+	while (p < end) {
+		p = skip_blanks(p, end);
+		if (end - p >= 2 && p[0] == 'v' && is_blank(p[1])) {
+			glm::vec4 v(0.0, 0.0, 0.0, 1.0);
+			p = parse_float(p + 2, end, v.x);
+			p = parse_float(p, end, v.y);
+			p = parse_float(p, end, v.z);
+			chunk->positions.push_back(v);
+		}
+		else if (end - p >= 3 && p[0] == 'v' && p[1] == 't' && is_blank(p[2])) {
+			glm::vec2 vt(0.0, 0.0);
+			p = parse_float(p + 3, end, vt.x);
+			p = parse_float(p, end, vt.y);
+			chunk->texcoords.push_back(vt);
+		}
+		else if (end - p >= 3 && p[0] == 'v' && p[1] == 'n' && is_blank(p[2])) {
+			glm::vec3 vn(0.0, 0.0, 0.0);
+			p = parse_float(p + 3, end, vn.x);
+			p = parse_float(p, end, vn.y);
+			p = parse_float(p, end, vn.z);
+			chunk->normals.push_back(vn);
+		}
+		else if (end - p >= 2 && p[0] == 'f' && is_blank(p[1])) {
+			// Triangle fan around the first corner
+			obj_corner first, previous, corner;
+			p += 2;
+			for (int n = 0; ; n++) {
+				bool ok;
+				p = parse_corner(p, end, chunk, corner, ok);
+				if (!ok) break;
+				if (n == 0) {
+					first = corner;
+				} else if (n >= 2) {
+					push_corner(chunk, first);
+					push_corner(chunk, previous);
+					push_corner(chunk, corner);
+				}
+				previous = corner;
+			}
+		}
+		p = skip_line(p, end);
+	}
+}
+
+/* Copy a parsed chunk to its place in the output, turning its
+ * relative indices into absolute ones. 'first' holds the offsets
+ * of the chunk's first position, texcoord, normal and corner. */
+static void merge_chunk(const obj_chunk* chunk, const size_t first[4], obj_data* data) {
+	copy(chunk->positions.begin(), chunk->positions.end(), data->positions.begin() + first[0]);
+	copy(chunk->texcoords.begin(), chunk->texcoords.end(), data->texcoords.begin() + first[1]);
+	copy(chunk->normals.begin(), chunk->normals.end(), data->normals.begin() + first[2]);
+	int* out = data->corners.data() + first[3];
+	size_t r = 0;
+	for (size_t i = 0; i < chunk->corners.size(); i++) {
+		int index = chunk->corners[i];
+		if (r < chunk->relative.size() && chunk->relative[r] == i) {
+			index += (int)first[i % chunk->stride];
+			r++;
+		}
+		out[i] = index;
+	}
+}
+
+/* Check that every corner refers to an existing v, vt and vn */
+static bool check_indices(const obj_data &data) {
+	const int counts[3] = {
+		(int)data.positions.size(), (int)data.texcoords.size(), (int)data.normals.size()
+	};
+	for (size_t i = 0; i < data.corners.size(); i++) {
+		int index = data.corners[i];
+		int kind = i % data.stride;
+		if (index == missing_index && kind != 0) continue;
+		if (index < 0 || index >= counts[kind]) {
+			cerr << "Face index out of range in corner " << i / data.stride << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Map and parse a whole .obj file with up to 'nthreads' threads
+ * (0 = one per core), keeping 'stride' indices per face corner.
+ * Chunks are merged in file order, so the result is identical to
+ * a single-threaded parse. */
+static bool parse_obj(const char* filename, unsigned nthreads, int stride, obj_data* data) {
+	mapped_file file;
+	if (!map_file(filename, &file))
+		return false;
+
+	if (nthreads == 0)
+		nthreads = max(thread::hardware_concurrency(), 1u);
+	nthreads = max(min((size_t)nthreads, file.size / min_chunk_size), (size_t)1);
+
+	data->stride = stride;
+	vector<obj_chunk> chunks(nthreads);
+	const char* begin = file.data;
+	const char* end = file.data + file.size;
+	for (unsigned i = 0; i < nthreads; i++) {
+		chunks[i].stride = stride;
+		chunks[i].begin = begin;
+		if (i + 1 == nthreads) {
+			chunks[i].end = end;
+		} else {
+			const char* split = file.data + file.size / nthreads * (i + 1);
+			chunks[i].end = split > begin ? skip_line(split, end) : begin;
+		}
+		begin = chunks[i].end;
+	}
+
+	vector<thread> workers;
+	for (unsigned i = 1; i < nthreads; i++)
+		workers.push_back(thread(parse_chunk, &chunks[i]));
+	parse_chunk(&chunks[0]);
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+
+	// A single chunk has nothing to rebase
+	if (nthreads == 1) {
+		data->positions.swap(chunks[0].positions);
+		data->texcoords.swap(chunks[0].texcoords);
+		data->normals.swap(chunks[0].normals);
+		data->corners.swap(chunks[0].corners);
+		unmap_file(&file);
+		return check_indices(*data);
+	}
+
+	// Lay the chunks out one after the other
+	vector<size_t> first(nthreads * 4);
+	size_t total[4] = { 0, 0, 0, 0 };
+	for (unsigned i = 0; i < nthreads; i++) {
+		size_t sizes[4] = {
+			chunks[i].positions.size(), chunks[i].texcoords.size(),
+			chunks[i].normals.size(), chunks[i].corners.size()
+		};
+		for (int j = 0; j < 4; j++) {
+			first[i * 4 + j] = total[j];
+			total[j] += sizes[j];
+		}
+	}
+	data->positions.resize(total[0]);
+	data->texcoords.resize(total[1]);
+	data->normals.resize(total[2]);
+	data->corners.resize(total[3]);
+
+	for (unsigned i = 1; i < nthreads; i++)
+		workers.push_back(thread(merge_chunk, &chunks[i], &first[i * 4], data));
+	merge_chunk(&chunks[0], &first[0], data);
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	unmap_file(&file);
+
+	return check_indices(*data);
+}
+
+/* Area-weighted smooth normals for the positions, from the v
+ * index of each corner */
+static void compute_normals(const vector<glm::vec4> &positions, const vector<int> &corners,
+			    int stride, vector<glm::vec3> &normals) {
+	size_t nb_positions = positions.size();
+	vector<float> px(nb_positions), py(nb_positions), pz(nb_positions);
+	for (size_t i = 0; i < nb_positions; i++) {
+		px[i] = positions[i].x;
+		py[i] = positions[i].y;
+		pz[i] = positions[i].z;
+	}
+	vector<unsigned> elements(corners.size() / stride);
+	for (size_t i = 0; i < elements.size(); i++)
+		elements[i] = corners[i * stride];
+
+	vector<float> nx(nb_positions), ny(nb_positions), nz(nb_positions);
+	smooth_normals(px.data(), py.data(), pz.data(), nb_positions,
+		       elements.data(), elements.size(), false, nx.data(), ny.data(), nz.data());
+	normals.resize(nb_positions);
+	for (size_t i = 0; i < nb_positions; i++)
+		normals[i] = glm::vec3(nx[i], ny[i], nz[i]);
+}
+
+/* Load positions and triangles from a Wavefront .obj file, then
+ * compute smooth per-vertex normals. Polygons are split into
+ * triangle fans; texture coordinates and normals in the file are
+ * ignored, use load_obj_mesh to get them. */
+bool load_obj(const char* filename, vector<glm::vec4> &vertices,
+	      vector<glm::vec3> &normals, vector<unsigned> &elements,
+	      unsigned nthreads) {
+	obj_data data;
+	if (!parse_obj(filename, nthreads, 1, &data))
+		return false;
+
+	elements.assign(data.corners.begin(), data.corners.end());
+	compute_normals(data.positions, data.corners, 1, normals);
+	vertices.swap(data.positions);
+	return true;
+}
+
+/* Same with 16-bit elements, for GL_UNSIGNED_SHORT draws. Fails on
+ * files with more vertices than those can address. */
+bool load_obj(const char* filename, vector<glm::vec4> &vertices,
+	      vector<glm::vec3> &normals, vector<unsigned short> &elements,
+	      unsigned nthreads) {
+	obj_data data;
+	if (!parse_obj(filename, nthreads, 1, &data))
+		return false;
+	if (data.positions.size() > 65536) {
+		cerr << filename << ": " << data.positions.size()
+		     << " vertices, too many for 16-bit indices" << endl;
+		return false;
+	}
+
+	elements.assign(data.corners.begin(), data.corners.end());
+	compute_normals(data.positions, data.corners, 1, normals);
+	vertices.swap(data.positions);
+	return true;
+}
+
+/* Open addressing (linear probing) table from (v, vt, vn) triplets
+ * to output vertices. Slots only hold a vertex number; the key is
+ * read back from the corner that first produced that vertex. Once
+ * the table is saturated new vertices are no longer indexed, so the
+ * indexed ones are always the first 'first_corner.size()'. */
+struct dedup_table {
+	vector<unsigned> slots;
+	vector<size_t> first_corner;  // per indexed vertex
+	size_t nb_vertices;           // indexed or not
+	size_t max_bytes;             // limit for 'slots' and 'first_corner'
+	bool saturated;
+};
+
+static const unsigned empty_slot = ~0u;
+
+static inline size_t hash_corner(const int* corner) {
+	unsigned long long h = (unsigned)corner[0] * 0x9E3779B97F4A7C15ull;
+	h ^= (unsigned)corner[1] * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+	h ^= (unsigned)corner[2] * 0x165667B19E3779F9ull + (h >> 32);
+	return (size_t)(h ^ (h >> 31));
+}
+
+static size_t dedup_bytes(size_t nb_slots, size_t nb_vertices) {
+	return nb_slots * sizeof(unsigned) + nb_vertices * sizeof(size_t);
+}
+
+/* Rebuild the slots with twice the capacity, if they and the
+ * 'first_corner' entries they can index fit in the memory budget */
+static bool dedup_grow(dedup_table* table, const vector<int> &corners) {
+	size_t nb_slots = max(table->slots.size() * 2, (size_t)1024);
+	size_t nb_indexed = nb_slots / 4 * 3;
+	if (dedup_bytes(nb_slots, nb_indexed) > table->max_bytes)
+		return false;
+	table->slots.assign(nb_slots, empty_slot);
+	table->first_corner.reserve(nb_indexed);
+	size_t mask = nb_slots - 1;
+	for (size_t v = 0; v < table->first_corner.size(); v++) {
+		size_t slot = hash_corner(&corners[table->first_corner[v] * 3]) & mask;
+		while (table->slots[slot] != empty_slot)
+			slot = (slot + 1) & mask;
+		table->slots[slot] = v;
+	}
+	return true;
+}
+
+/* Return the output vertex for corner 'c', creating it if needed;
+ * 'created' tells which */
+static unsigned dedup_corner(dedup_table* table, const vector<int> &corners, size_t c, bool &created) {
+	const int* key = &corners[c * 3];
+	if (!table->saturated && (table->first_corner.size() + 1) * 4 > table->slots.size() * 3)
+		table->saturated = !dedup_grow(table, corners);
+
+	created = true;
+	size_t mask = table->slots.size() - 1;
+	size_t slot = hash_corner(key) & mask;
+	for (size_t probes = 0; probes < table->slots.size(); probes++) {
+		unsigned v = table->slots[slot];
+		if (v == empty_slot) {
+			// Past the load limit new vertices are simply not indexed
+			if (!table->saturated) {
+				table->slots[slot] = table->nb_vertices;
+				table->first_corner.push_back(c);
+			}
+			return table->nb_vertices++;
+		}
+		const int* other = &corners[table->first_corner[v] * 3];
+		if (other[0] == key[0] && other[1] == key[1] && other[2] == key[2]) {
+			created = false;
+			return v;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return table->nb_vertices++;
+}
+
+/* Load a Wavefront .obj file with texture coordinates and normals
+ * into a single interleaved vertex stream. Each distinct v/vt/vn
+ * combination becomes one vertex; the deduplication table is kept
+ * under 'max_dedup_bytes', beyond which some duplicates are emitted
+ * instead. Corners without a normal get a computed one. With a
+ * 'crease_angle' (radians) above 0 all normals are computed instead,
+ * angle-weighted and split along edges sharper than that (see
+ * split_creases). 'stats' may be NULL. */
+bool load_obj_mesh(const char* filename, obj_mesh &mesh, size_t max_dedup_bytes,
+		   unsigned nthreads, obj_stats* stats, float crease_angle) {
+	obj_data data;
+	if (!parse_obj(filename, nthreads, 3, &data))
+		return false;
+
+	size_t nb_corners = data.corners.size() / 3;
+	mesh.has_texcoords = !data.texcoords.empty();
+	mesh.has_normals = !data.normals.empty();
+	bool need_normals = false;
+	for (size_t c = 0; c < nb_corners && !need_normals; c++)
+		need_normals = (data.corners[c * 3 + 2] == missing_index);
+	vector<glm::vec3> computed_normals;
+	if (need_normals)
+		compute_normals(data.positions, data.corners, 3, computed_normals);
+
+	// Vertices are made as their first corner comes, so that the
+	// table only keeps the corners of the vertices it indexes
+	dedup_table table;
+	table.nb_vertices = 0;
+	table.max_bytes = max_dedup_bytes;
+	table.saturated = !dedup_grow(&table, data.corners);
+	mesh.vertices.clear();
+	mesh.elements.resize(nb_corners);
+	for (size_t c = 0; c < nb_corners; c++) {
+		bool created;
+		mesh.elements[c] = dedup_corner(&table, data.corners, c, created);
+		if (!created)
+			continue;
+		const int* corner = &data.corners[c * 3];
+		obj_vertex out;
+		out.position = glm::vec3(data.positions[corner[0]]);
+		out.texcoord = corner[1] == missing_index ? glm::vec2(0.0, 0.0) : data.texcoords[corner[1]];
+		out.normal = corner[2] == missing_index ? computed_normals[corner[0]] : data.normals[corner[2]];
+		mesh.vertices.push_back(out);
+	}
+
+	size_t unique_vertices = mesh.vertices.size();
+	if (crease_angle > 0.0f)
+		split_creases(mesh, crease_angle, true);
+	if (stats != NULL) {
+		stats->corners = nb_corners;
+		stats->unique_vertices = unique_vertices;
+		stats->mesh_vertices = mesh.vertices.size();
+		stats->dedup_bytes = dedup_bytes(table.slots.size(), table.first_corner.capacity());
+		stats->dedup_saturated = table.saturated;
+	}
+	return true;
+}
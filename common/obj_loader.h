@@ -0,0 +1,39 @@
+#ifndef _OBJ_LOADER_H
+#define _OBJ_LOADER_H
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+/* One vertex of the interleaved stream built by load_obj_mesh */
+struct obj_vertex {
+	glm::vec3 position;
+	glm::vec2 texcoord;
+	glm::vec3 normal;
+};
+
+struct obj_mesh {
+	std::vector<obj_vertex> vertices;
+	std::vector<unsigned> elements;
+	bool has_texcoords;
+	bool has_normals;
+};
+
+struct obj_stats {
+	size_t corners;          // triangle corners read from the faces
+	size_t unique_vertices;  // vertices left after deduplication
+	size_t mesh_vertices;    // in the mesh, more once creases split some
+	size_t dedup_bytes;      // final size of the deduplication table
+	bool dedup_saturated;    // table hit its budget, some duplicates kept
+};
+
+extern bool load_obj(const char* filename, std::vector<glm::vec4> &vertices,
+		     std::vector<glm::vec3> &normals, std::vector<unsigned> &elements,
+		     unsigned nthreads = 0);
+extern bool load_obj(const char* filename, std::vector<glm::vec4> &vertices,
+		     std::vector<glm::vec3> &normals, std::vector<unsigned short> &elements,
+		     unsigned nthreads = 0);
+extern bool load_obj_mesh(const char* filename, obj_mesh &mesh,
+			  size_t max_dedup_bytes = 256 << 20, unsigned nthreads = 0,
+			  obj_stats* stats = NULL, float crease_angle = 0.0f);
+
+#endif
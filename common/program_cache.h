@@ -0,0 +1,272 @@
+#ifndef _PROGRAM_CACHE_H
+#define _PROGRAM_CACHE_H
+/* On-disk cache of linked GLSL programs, stored with
+ * glGetProgramBinary and reloaded with glProgramBinary (OpenGL 4.1 or
+ * ARB_get_program_binary). The three entry points are fetched
+ * through the windowing library, as the glad loader only goes up to
+ * OpenGL 4.0.
+ *
+ * Programs are keyed by every source string, preamble included, and
+ * the driver's vendor, renderer and version strings. A binary the
+ * driver refuses is rebuilt from source and replaced. Set
+ * PROGRAM_CACHE_DIR to move the cache, or to "" to disable it. */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+#ifdef _WIN32
+#define PROGRAM_CACHE_APIENTRY __stdcall
+#else
+#define PROGRAM_CACHE_APIENTRY
+#endif
+
+/* SDL_GL_GetProcAddress, or glfwGetProcAddress cast to it */
+typedef void* (*program_cache_loader)(const char* name);
+typedef void (PROGRAM_CACHE_APIENTRY *program_cache_get_binary)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+typedef void (PROGRAM_CACHE_APIENTRY *program_cache_binary)(GLuint, GLenum, const void*, GLsizei);
+typedef void (PROGRAM_CACHE_APIENTRY *program_cache_parameteri)(GLuint, GLenum, GLint);
+
+struct program_cache {
+	std::string dir;  // empty when binaries are not supported or disabled
+	unsigned long long driver_key;
+	program_cache_get_binary get_program_binary;
+	program_cache_binary program_binary;
+	program_cache_parameteri program_parameteri;
+	unsigned hits, misses, rejected;
+	bool last_hit;   // whether the last program came from the cache
+	double last_ms;  // time spent building it, hit or miss
+};
+
+/* Start of a cache file, followed by 'length' bytes of binary */
+struct program_cache_header {
+	char magic[8];
+	unsigned long long key;
+	GLenum format;
+	GLsizei length;
+};
+
+const char program_cache_magic[8] = "GLPROG1";
+
+/* 64-bit FNV-1a */
+inline unsigned long long program_cache_hash(unsigned long long hash, const void* data, size_t size) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+inline unsigned long long program_cache_hash_string(unsigned long long hash, const char* s) {
+	if (s == NULL)
+		s = "";
+	// Include the terminator so that "ab" + "c" differs from "a" + "bc"
+	return program_cache_hash(hash, s, strlen(s) + 1);
+}
+
+/* Call once the context is current. Leaves the cache disabled, and
+ * program_cache_link compiling every time, when the driver has no
+ * binary format. */
+inline void program_cache_init(program_cache* cache, const char* dir, program_cache_loader loader) {
+	*cache = program_cache();
+	cache->get_program_binary = (program_cache_get_binary) loader("glGetProgramBinary");
+	cache->program_binary = (program_cache_binary) loader("glProgramBinary");
+	cache->program_parameteri = (program_cache_parameteri) loader("glProgramParameteri");
+
+	// Unknown before 4.1: the query fails and leaves 0
+	GLint nb_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nb_formats);
+	while (glGetError() != GL_NO_ERROR)
+		;
+	if (nb_formats <= 0 || cache->get_program_binary == NULL
+	    || cache->program_binary == NULL || cache->program_parameteri == NULL)
+		return;
+
+	const char* env = getenv("PROGRAM_CACHE_DIR");
+	cache->dir = env != NULL ? env : dir;
+	if (cache->dir.empty())
+		return;
+#ifdef _WIN32
+	_mkdir(cache->dir.c_str());
+#else
+	mkdir(cache->dir.c_str(), 0755);
+#endif
+
+	unsigned long long hash = 14695981039346656037ULL;
+	hash = program_cache_hash_string(hash, (const char*)glGetString(GL_VENDOR));
+	hash = program_cache_hash_string(hash, (const char*)glGetString(GL_RENDERER));
+	hash = program_cache_hash_string(hash, (const char*)glGetString(GL_VERSION));
+	cache->driver_key = hash;
+}
+
+/* Compile one stage from several source strings; 0 on error */
+inline GLuint program_cache_compile(GLenum type, const char* const* sources, int nb_sources) {
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, nb_sources, sources, NULL);
+	glCompileShader(shader);
+	GLint compile_ok = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_ok);
+	if (compile_ok == GL_FALSE) {
+		GLint log_length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
+		std::vector<char> log(log_length + 1);
+		glGetShaderInfoLog(shader, log_length, NULL, log.data());
+		std::cerr << (type == GL_VERTEX_SHADER ? "vertex" : "fragment")
+			  << " shader:\n" << log.data();
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+/* Load the program stored under 'key'; 0 when missing or refused */
+inline GLuint program_cache_load(program_cache* cache, const std::string &path, unsigned long long key) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+		return 0;
+	program_cache_header header;
+	std::vector<char> binary;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1
+		&& memcmp(header.magic, program_cache_magic, sizeof(header.magic)) == 0
+		&& header.key == key && header.length > 0;
+	if (ok) {
+		binary.resize(header.length);
+		ok = fread(binary.data(), 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+	if (!ok)
+		return 0;
+
+	GLuint program = glCreateProgram();
+	cache->program_binary(program, header.format, binary.data(), header.length);
+	GLint link_ok = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+	if (link_ok == GL_FALSE) {
+		// Driver update or unsupported format
+		while (glGetError() != GL_NO_ERROR)
+			;
+		glDeleteProgram(program);
+		cache->rejected++;
+		return 0;
+	}
+	return program;
+}
+
+inline void program_cache_store(program_cache* cache, const std::string &path,
+				unsigned long long key, GLuint program) {
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+	program_cache_header header = program_cache_header();
+	memcpy(header.magic, program_cache_magic, sizeof(header.magic));
+	header.key = key;
+	std::vector<char> binary(length);
+	cache->get_program_binary(program, length, &header.length, &header.format, binary.data());
+	if (header.length <= 0)
+		return;
+
+	// Write aside then rename, so that a crash never leaves half a file
+	std::string tmp_path = path + ".tmp";
+	FILE* file = fopen(tmp_path.c_str(), "wb");
+	if (file == NULL)
+		return;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(binary.data(), 1, header.length, file) == (size_t)header.length;
+	ok = fclose(file) == 0 && ok;
+	if (ok && rename(tmp_path.c_str(), path.c_str()) != 0) {
+		remove(path.c_str());
+		ok = rename(tmp_path.c_str(), path.c_str()) == 0;
+	}
+	if (!ok)
+		remove(tmp_path.c_str());
+}
+
+/* Build a program from vertex and fragment source strings, reusing
+ * the cached binary when there is one. Returns 0 on error, after
+ * printing the compiler or linker log. */
+inline GLuint program_cache_link(program_cache* cache,
+				 const char* const* vertex_sources, int nb_vertex_sources,
+				 const char* const* fragment_sources, int nb_fragment_sources) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	cache->last_hit = false;
+
+	std::string path;
+	unsigned long long key = cache->driver_key;
+	if (!cache->dir.empty()) {
+		GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+		const char* const* sources[2] = { vertex_sources, fragment_sources };
+		int nb_sources[2] = { nb_vertex_sources, nb_fragment_sources };
+		for (int stage = 0; stage < 2; stage++) {
+			key = program_cache_hash(key, &types[stage], sizeof(types[stage]));
+			for (int i = 0; i < nb_sources[stage]; i++)
+				key = program_cache_hash_string(key, sources[stage][i]);
+		}
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.glprog", key);
+		path = cache->dir + name;
+
+		GLuint program = program_cache_load(cache, path, key);
+		if (program != 0) {
+			cache->hits++;
+			cache->last_hit = true;
+			cache->last_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			return program;
+		}
+	}
+	cache->misses++;
+
+	GLuint vs = program_cache_compile(GL_VERTEX_SHADER, vertex_sources, nb_vertex_sources);
+	GLuint fs = program_cache_compile(GL_FRAGMENT_SHADER, fragment_sources, nb_fragment_sources);
+	GLuint program = 0;
+	if (vs != 0 && fs != 0) {
+		program = glCreateProgram();
+		glAttachShader(program, vs);
+		glAttachShader(program, fs);
+		if (!path.empty())
+			cache->program_parameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(program);
+		glDetachShader(program, vs);
+		glDetachShader(program, fs);
+		GLint link_ok = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+		if (link_ok == GL_FALSE) {
+			GLint log_length = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
+			std::vector<char> log(log_length + 1);
+			glGetProgramInfoLog(program, log_length, NULL, log.data());
+			std::cerr << "glLinkProgram:" << log.data();
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+	if (vs != 0)
+		glDeleteShader(vs);
+	if (fs != 0)
+		glDeleteShader(fs);
+
+	if (program != 0 && !path.empty())
+		program_cache_store(cache, path, key, program);
+	cache->last_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return program;
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+
+#include "ring_buffer.h"
+
+/* Regions start on this boundary, enough for any uniform buffer
+ * offset alignment seen in practice */
+const size_t region_alignment = 256;
+
+const char* ring_buffer_mode_name(ring_buffer_mode mode) {
+	switch (mode) {
+	case ring_persistent:     return "persistent mapping";
+	case ring_unsynchronized: return "unsynchronized mapping";
+	default:                  return "orphaning";
+	}
+}
+
+/* 'preferred', or the next one down that the context supports */
+ring_buffer_mode best_ring_buffer_mode(ring_buffer_mode preferred) {
+	bool fences = GLEW_VERSION_3_2 || GLEW_ARB_sync;
+	bool map_range = GLEW_VERSION_3_0 || GLEW_ARB_map_buffer_range;
+	if (preferred == ring_persistent && fences && map_range && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage))
+		return ring_persistent;
+	if (preferred != ring_orphan && fences && map_range)
+		return ring_unsynchronized;
+	return ring_orphan;
+}
+
+/* Create a ring of ring_buffer_frames regions of 'frame_size' bytes.
+ * The buffer is left bound to GL_ARRAY_BUFFER. */
+bool init_ring_buffer(ring_buffer* ring, size_t frame_size, ring_buffer_mode preferred) {
+	*ring = ring_buffer();
+	ring->mode = best_ring_buffer_mode(preferred);
+	ring->frame_size = (frame_size + region_alignment - 1) / region_alignment * region_alignment;
+	ring->region = ring_buffer_frames - 1;  // the first frame moves to region 0
+	ring->uniform_alignment = 256;
+	if (GLEW_VERSION_3_1 || GLEW_ARB_uniform_buffer_object)
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ring->uniform_alignment);
+
+	glGenBuffers(1, &ring->buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, ring->buffer);
+	size_t total = ring->frame_size * ring_buffer_frames;
+	if (ring->mode == ring_persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, total, NULL, flags);
+		ring->persistent = (unsigned char*) glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags);
+		if (ring->persistent == NULL) {
+			cerr << "Could not map the ring buffer persistently" << endl;
+			glDeleteBuffers(1, &ring->buffer);
+			return false;
+		}
+	} else if (ring->mode == ring_unsynchronized) {
+		glBufferData(GL_ARRAY_BUFFER, total, NULL, GL_STREAM_DRAW);
+	} else {
+		// A single region: the driver renames the storage on each upload
+		glBufferData(GL_ARRAY_BUFFER, ring->frame_size, NULL, GL_STREAM_DRAW);
+		ring->staging.resize(ring->frame_size);
+	}
+	return true;
+}
+
+/* Wait for the GPU to be done with the region about to be reused,
+ * counting the frames where it was not */
+static void wait_region(ring_buffer* ring, int region) {
+	GLsync fence = ring->fences[region];
+	if (fence == NULL)
+		return;
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		do
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);  // 1 ms
+		while (status == GL_TIMEOUT_EXPIRED);
+		ring->stalls++;
+		ring->stall_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+	glDeleteSync(fence);
+	ring->fences[region] = NULL;
+}
+
+/* Start filling the next region. Fences the previous one first: the
+ * fence covers everything drawn since ring_buffer_end_frame. */
+void ring_buffer_begin_frame(ring_buffer* ring) {
+	if (ring->mode != ring_orphan) {
+		if (ring->frames > 0)
+			ring->fences[ring->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		ring->region = (ring->region + 1) % ring_buffer_frames;
+		wait_region(ring, ring->region);
+	}
+
+	size_t region_offset = ring->region * ring->frame_size;
+	if (ring->mode == ring_persistent) {
+		ring->mapped = ring->persistent + region_offset;
+	} else if (ring->mode == ring_unsynchronized) {
+		glBindBuffer(GL_ARRAY_BUFFER, ring->buffer);
+		ring->mapped = (unsigned char*) glMapBufferRange(GL_ARRAY_BUFFER, region_offset, ring->frame_size,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	} else {
+		ring->mapped = ring->staging.data();
+	}
+	ring->used = 0;
+	ring->in_frame = ring->mapped != NULL;
+}
+
+/* 'size' bytes from the current region, at a multiple of
+ * 'alignment' from the start of the buffer, stored in 'offset' for
+ * the draw calls. NULL when the region is full. */
+void* ring_buffer_alloc(ring_buffer* ring, size_t size, size_t alignment, size_t* offset) {
+	if (!ring->in_frame)
+		return NULL;
+	size_t start = (ring->used + alignment - 1) / alignment * alignment;
+	if (start + size > ring->frame_size) {
+		ring->failed++;
+		return NULL;
+	}
+	ring->used = start + size;
+	if (ring->used > ring->peak)
+		ring->peak = ring->used;
+	*offset = (ring->mode == ring_orphan ? 0 : ring->region * ring->frame_size) + start;
+	return ring->mapped + start;
+}
+
+/* Aligned to the stride, so that offset / stride is a base vertex */
+void* ring_buffer_alloc_vertices(ring_buffer* ring, size_t count, size_t stride, size_t* offset) {
+	return ring_buffer_alloc(ring, count * stride, stride, offset);
+}
+
+void* ring_buffer_alloc_indices(ring_buffer* ring, size_t count, GLenum index_type, size_t* offset) {
+	size_t size = index_type == GL_UNSIGNED_BYTE ? 1 : index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+	return ring_buffer_alloc(ring, count * size, size, offset);
+}
+
+/* For glBindBufferRange(GL_UNIFORM_BUFFER, ...) */
+void* ring_buffer_alloc_uniforms(ring_buffer* ring, size_t size, size_t* offset) {
+	return ring_buffer_alloc(ring, size, ring->uniform_alignment, offset);
+}
+
+/* Make the frame's data visible to GL; draw with it afterwards. May
+ * leave the buffer bound to GL_ARRAY_BUFFER. */
+void ring_buffer_end_frame(ring_buffer* ring) {
+	if (!ring->in_frame)
+		return;
+	if (ring->mode == ring_unsynchronized) {
+		glBindBuffer(GL_ARRAY_BUFFER, ring->buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	} else if (ring->mode == ring_orphan) {
+		glBindBuffer(GL_ARRAY_BUFFER, ring->buffer);
+		glBufferData(GL_ARRAY_BUFFER, ring->frame_size, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, ring->used, ring->staging.data());
+	}
+	ring->in_frame = false;
+	ring->mapped = NULL;
+	ring->frames++;
+}
+
+void free_ring_buffer(ring_buffer* ring) {
+	for (int i = 0; i < ring_buffer_frames; i++) {
+		if (ring->fences[i] != NULL)
+			glDeleteSync(ring->fences[i]);
+		ring->fences[i] = NULL;
+	}
+	// Deleting the buffer unmaps it
+	glDeleteBuffers(1, &ring->buffer);
+	ring->buffer = 0;
+	ring->persistent = NULL;
+	ring->staging.clear();
+}
@@ -0,0 +1,52 @@
+#ifndef _RING_BUFFER_H
+#define _RING_BUFFER_H
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+
+/* Regions in flight: the CPU writes one while the GPU may still read
+ * the two before */
+const int ring_buffer_frames = 3;
+
+/* How the CPU reaches the buffer, best first */
+enum ring_buffer_mode {
+	ring_persistent,     // glBufferStorage, mapped once, persistent and coherent
+	ring_unsynchronized, // glMapBufferRange(UNSYNCHRONIZED) on the frame's region
+	ring_orphan          // CPU copy, uploaded into orphaned storage each frame
+};
+
+/* A buffer cut into ring_buffer_frames regions, one per frame, each
+ * bump-allocated. Regions are fenced so that the CPU only waits when
+ * the GPU falls more than two frames behind. */
+struct ring_buffer {
+	GLuint buffer;
+	ring_buffer_mode mode;
+	size_t frame_size;    // bytes per region
+	int region;           // region of the current frame
+	size_t used;          // bytes allocated in it so far
+	unsigned char* persistent;  // whole buffer, ring_persistent
+	unsigned char* mapped;      // start of the current region
+	std::vector<unsigned char> staging;  // ring_orphan
+	GLsync fences[ring_buffer_frames];
+	GLint uniform_alignment;  // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	bool in_frame;
+	/* Statistics since creation */
+	unsigned frames;
+	unsigned stalls;      // frames that had to wait for the GPU
+	double stall_ms;      // time spent waiting
+	unsigned failed;      // allocations that did not fit
+	size_t peak;          // most bytes used in one frame
+};
+
+extern const char* ring_buffer_mode_name(ring_buffer_mode mode);
+extern ring_buffer_mode best_ring_buffer_mode(ring_buffer_mode preferred = ring_persistent);
+extern bool init_ring_buffer(ring_buffer* ring, size_t frame_size, ring_buffer_mode preferred = ring_persistent);
+extern void ring_buffer_begin_frame(ring_buffer* ring);
+extern void* ring_buffer_alloc(ring_buffer* ring, size_t size, size_t alignment, size_t* offset);
+extern void* ring_buffer_alloc_vertices(ring_buffer* ring, size_t count, size_t stride, size_t* offset);
+extern void* ring_buffer_alloc_indices(ring_buffer* ring, size_t count, GLenum index_type, size_t* offset);
+extern void* ring_buffer_alloc_uniforms(ring_buffer* ring, size_t size, size_t* offset);
+extern void ring_buffer_end_frame(ring_buffer* ring);
+extern void free_ring_buffer(ring_buffer* ring);
+
+#endif
@@ -1,9 +1,12 @@
 #include <iostream>
+#include <string>
 using namespace std;
 
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
 
+#include "shader_utils.h"
+
 /* Store a file's contents in memory, useful to pass shaders
  * source code to OpenGL. Using SDL_RWops for Android asset support. */
 char* file_read(const char* filename) {
@@ -55,6 +58,32 @@ void print_log(GLuint object) {
 }
 
 
+/* GLSL version for the current context */
+static const char* glsl_version() {
+	int profile;
+	SDL_GL_GetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, &profile);
+	if (profile == SDL_GL_CONTEXT_PROFILE_ES)
+		return "#version 100\n";  // OpenGL ES 2.0
+	else
+		return "#version 120\n";  // OpenGL 2.1
+}
+
+// GLES2 precision specifiers
+static const char* glsl_precision =
+	"#ifdef GL_ES                        \n"
+	"#  ifdef GL_FRAGMENT_PRECISION_HIGH \n"
+	"     precision highp float;         \n"
+	"#  else                             \n"
+	"     precision mediump float;       \n"
+	"#  endif                            \n"
+	"#else                               \n"
+	// Ignore unsupported precision specifiers
+	"#  define lowp                      \n"
+	"#  define mediump                   \n"
+	"#  define highp                     \n"
+	"#endif                              \n";
+
+
 /* Compile the shader from file 'filename', with error handling */
 GLuint create_shader(const char* filename, GLenum type) {
 	const GLchar* source = file_read(filename);
@@ -65,34 +94,9 @@ GLuint create_shader(const char* filename, GLenum type) {
 	}
 	GLuint res = glCreateShader(type);
 
-	// GLSL version
-	const char* version;
-	int profile;
-	SDL_GL_GetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, &profile);
-	if (profile == SDL_GL_CONTEXT_PROFILE_ES)
-		version = "#version 100\n";  // OpenGL ES 2.0
-	else
-		version = "#version 120\n";  // OpenGL 2.1
-
-	// GLES2 precision specifiers
-	const char* precision;
-	precision =
-		"#ifdef GL_ES                        \n"
-		"#  ifdef GL_FRAGMENT_PRECISION_HIGH \n"
-		"     precision highp float;         \n"
-		"#  else                             \n"
-		"     precision mediump float;       \n"
-		"#  endif                            \n"
-		"#else                               \n"
-		// Ignore unsupported precision specifiers
-		"#  define lowp                      \n"
-		"#  define mediump                   \n"
-		"#  define highp                     \n"
-		"#endif                              \n";
-
 	const GLchar* sources[] = {
-		version,
-		precision,
+		glsl_version(),
+		glsl_precision,
 		source
 	};
 	glShaderSource(res, 3, sources, NULL);
@@ -110,3 +114,52 @@ GLuint create_shader(const char* filename, GLenum type) {
 	
 	return res;
 }
+
+
+/* The program binary cache, in the user's preferences directory */
+program_cache* get_program_cache() {
+	static program_cache cache;
+	static bool initialized = false;
+	if (!initialized) {
+		string dir;
+		char* pref_path = SDL_GetPrefPath("wikibooks-opengl", "program_cache");
+		if (pref_path != NULL) {
+			dir = pref_path;
+			if (!dir.empty() && (dir.back() == '/' || dir.back() == '\\'))
+				dir.pop_back();
+			SDL_free(pref_path);
+		}
+		program_cache_init(&cache, dir.c_str(), (program_cache_loader) SDL_GL_GetProcAddress);
+		initialized = true;
+	}
+	return &cache;
+}
+
+
+/* Compile and link the program from files 'vertex_filename' and
+ * 'fragment_filename' with the same preamble as create_shader, or
+ * reload it from the binary cache */
+GLuint create_program(const char* vertex_filename, const char* fragment_filename) {
+	const char* filenames[2] = { vertex_filename, fragment_filename };
+	char* sources[2];
+	for (int i = 0; i < 2; i++) {
+		sources[i] = file_read(filenames[i]);
+		if (sources[i] == NULL) {
+			SDL_LogMessage(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_ERROR,
+				       "Error opening %s: %s", filenames[i], SDL_GetError());
+			if (i == 1)
+				free(sources[0]);
+			return 0;
+		}
+	}
+
+	const GLchar* vertex_sources[] = { glsl_version(), glsl_precision, sources[0] };
+	const GLchar* fragment_sources[] = { glsl_version(), glsl_precision, sources[1] };
+	GLuint program = program_cache_link(get_program_cache(), vertex_sources, 3, fragment_sources, 3);
+	if (program == 0)
+		SDL_LogMessage(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_ERROR,
+			       "Could not build program from %s and %s", vertex_filename, fragment_filename);
+	free(sources[0]);
+	free(sources[1]);
+	return program;
+}
@@ -2,8 +2,12 @@
 #define _SHADER_UTILS_H
 #include <GL/glew.h>
 
+#include "program_cache.h"
+
 extern char* file_read(const char* filename);
 extern void print_log(GLuint object);
 extern GLuint create_shader(const char* filename, GLenum type);
+extern program_cache* get_program_cache();
+extern GLuint create_program(const char* vertex_filename, const char* fragment_filename);
 
 #endif
@@ -0,0 +1,88 @@
+#ifndef _SIMD_H
+#define _SIMD_H
+/* The float vectors the SIMD paths of common/ are written with:
+ * 'lanes' floats at a time, 8 with AVX2 and 4 with SSE2. The wider
+ * path is opt-in, as the binary then needs an AVX2 CPU: build with
+ * make SIMD=avx2, after removing the objects of common/ built
+ * without it. Without either, VFLOAT_SIMD is left undefined and only
+ * the scalar paths are built. */
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#define VFLOAT_SIMD
+#endif
+
+#if defined(__AVX2__)
+typedef __m256 vfloat;
+static const int lanes = 8;
+static inline vfloat v_load(const float* p) { return _mm256_loadu_ps(p); }
+static inline void v_store(float* p, vfloat a) { _mm256_storeu_ps(p, a); }
+static inline vfloat v_set1(float a) { return _mm256_set1_ps(a); }
+static inline vfloat v_zero() { return _mm256_setzero_ps(); }
+static inline vfloat v_add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+static inline vfloat v_sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+static inline vfloat v_mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+static inline vfloat v_div(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+static inline vfloat v_min(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+static inline vfloat v_max(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+static inline vfloat v_sqrt(vfloat a) { return _mm256_sqrt_ps(a); }
+static inline vfloat v_or(vfloat a, vfloat b) { return _mm256_or_ps(a, b); }
+static inline vfloat v_less(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline int v_mask(vfloat a) { return _mm256_movemask_ps(a); }
+static inline void v_store_int(int32_t* p, vfloat a) { _mm256_storeu_si256((__m256i*)p, _mm256_cvttps_epi32(a)); }
+static inline vfloat v_gather(const float* base, const unsigned* index) {
+	return _mm256_i32gather_ps(base, _mm256_loadu_si256((const __m256i*)index), 4);
+}
+/* RGBA pixels at p and 2 pixels further, the inputs of 2 outputs side by side */
+static inline vfloat v_load_pixels(const float* p) {
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 8), 1);
+}
+/* 'color' in the RGB lanes, 'alpha' in the A lanes */
+static inline vfloat v_set_pixel(float color, float alpha) {
+	return _mm256_setr_ps(color, color, color, alpha, color, color, color, alpha);
+}
+/* Both halves combined with 'op' */
+static inline __m128 v_half(vfloat a, __m128 (*op)(__m128, __m128)) {
+	return op(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+}
+#elif defined(__SSE2__)
+typedef __m128 vfloat;
+static const int lanes = 4;
+static inline vfloat v_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void v_store(float* p, vfloat a) { _mm_storeu_ps(p, a); }
+static inline vfloat v_set1(float a) { return _mm_set1_ps(a); }
+static inline vfloat v_zero() { return _mm_setzero_ps(); }
+static inline vfloat v_add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+static inline vfloat v_sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+static inline vfloat v_mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+static inline vfloat v_div(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+static inline vfloat v_min(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+static inline vfloat v_max(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+static inline vfloat v_sqrt(vfloat a) { return _mm_sqrt_ps(a); }
+static inline vfloat v_or(vfloat a, vfloat b) { return _mm_or_ps(a, b); }
+static inline vfloat v_less(vfloat a, vfloat b) { return _mm_cmplt_ps(a, b); }
+static inline int v_mask(vfloat a) { return _mm_movemask_ps(a); }
+static inline void v_store_int(int32_t* p, vfloat a) { _mm_storeu_si128((__m128i*)p, _mm_cvttps_epi32(a)); }
+static inline vfloat v_gather(const float* base, const unsigned* index) {
+	return _mm_set_ps(base[index[3]], base[index[2]], base[index[1]], base[index[0]]);
+}
+static inline vfloat v_load_pixels(const float* p) { return _mm_loadu_ps(p); }
+static inline vfloat v_set_pixel(float color, float alpha) { return _mm_setr_ps(color, color, color, alpha); }
+static inline __m128 v_half(vfloat a, __m128 (*)(__m128, __m128)) { return a; }
+#endif
+
+#ifdef VFLOAT_SIMD
+/* One lane out of four with 'op' applied across them */
+static inline float v_reduce(vfloat a, __m128 (*op)(__m128, __m128)) {
+	__m128 s = v_half(a, op);
+	s = op(s, _mm_movehl_ps(s, s));
+	s = op(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+static inline __m128 add4(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+static inline __m128 min4(__m128 a, __m128 b) { return _mm_min_ps(a, b); }
+static inline __m128 max4(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+#endif
+
+#endif
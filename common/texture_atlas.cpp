@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "texture_atlas.h"
+
+/* The top of the texels used so far on a page: a run of segments
+ * from x = 0 to the page's width, each at its own height */
+struct skyline_segment {
+	int x, y, width;
+};
+
+/* Where a 'width' x 'height' rectangle would rest if it started at
+ * segment 'i': on the highest segment under it. False if it goes over
+ * the page's right or top edge. */
+static bool skyline_fit(const vector<skyline_segment> &skyline, size_t i, int width, int height, int page_size,
+			int* y) {
+	int x = skyline[i].x;
+	if (x + width > page_size)
+		return false;
+	*y = 0;
+	for (int left = width; left > 0; left -= skyline[i].width, i++) {
+		*y = max(*y, skyline[i].y);
+		if (*y + height > page_size)
+			return false;
+	}
+	return true;
+}
+
+/* Raise the skyline over a rectangle placed at segment 'i' */
+static void skyline_add(vector<skyline_segment> &skyline, size_t i, int y, int width, int height) {
+	skyline_segment top = { skyline[i].x, y + height, width };
+	skyline.insert(skyline.begin() + i, top);
+	int right = top.x + width;
+	for (size_t j = i + 1; j < skyline.size() && skyline[j].x < right; ) {
+		int covered = right - skyline[j].x;
+		if (covered < skyline[j].width) {
+			skyline[j].x += covered;
+			skyline[j].width -= covered;
+			break;
+		}
+		skyline.erase(skyline.begin() + j);
+	}
+	for (size_t j = 0; j + 1 < skyline.size(); ) {
+		if (skyline[j].y == skyline[j + 1].y) {
+			skyline[j].width += skyline[j + 1].width;
+			skyline.erase(skyline.begin() + j + 1);
+		} else {
+			j++;
+		}
+	}
+}
+
+/* The lowest spot on a page for a rectangle, leftmost among equals.
+ * False if it fits nowhere. */
+static bool skyline_best(const vector<skyline_segment> &skyline, int width, int height, int page_size,
+			 size_t* best, int* best_y) {
+	bool found = false;
+	for (size_t i = 0; i < skyline.size(); i++) {
+		int y;
+		if (skyline_fit(skyline, i, width, height, page_size, &y) && (!found || y < *best_y)) {
+			*best = i;
+			*best_y = y;
+			found = true;
+		}
+	}
+	return found;
+}
+
+/* Place 'images' on 'page_size' x 'page_size' pages, as few as the
+ * skyline finds: tallest images first, each on the first page with
+ * room for it, as low as it goes there. False if an image and its
+ * padding are larger than a page. */
+bool pack_atlas(const vector<atlas_image> &images, int page_size, int padding, texture_atlas* atlas) {
+	atlas->page_size = page_size;
+	atlas->padding = padding;
+	atlas->nb_pages = 0;
+	atlas->entries.assign(images.size(), atlas_entry());
+	atlas->image_texels = atlas->padded_texels = 0;
+
+	vector<int> order(images.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		if (images[a].height != images[b].height)
+			return images[a].height > images[b].height;
+		return images[a].width > images[b].width;
+	});
+
+	vector<vector<skyline_segment> > pages;
+	for (size_t n = 0; n < order.size(); n++) {
+		const atlas_image &image = images[order[n]];
+		int width = image.width + 2 * padding, height = image.height + 2 * padding;
+		if (image.width <= 0 || image.height <= 0 || width > page_size || height > page_size) {
+			cerr << "Image " << order[n] << " of " << image.width << " x " << image.height
+			     << " does not fit on an atlas page of " << page_size << endl;
+			return false;
+		}
+		size_t page = 0, segment = 0;
+		int y = 0;
+		while (page < pages.size() && !skyline_best(pages[page], width, height, page_size, &segment, &y))
+			page++;
+		if (page == pages.size()) {
+			skyline_segment floor = { 0, 0, page_size };
+			pages.push_back(vector<skyline_segment>(1, floor));
+			segment = 0;
+			y = 0;
+		}
+		atlas_entry &entry = atlas->entries[order[n]];
+		entry.page = page;
+		entry.x = pages[page][segment].x + padding;
+		entry.y = y + padding;
+		entry.width = image.width;
+		entry.height = image.height;
+		skyline_add(pages[page], segment, y, width, height);
+		atlas->image_texels += (size_t)image.width * image.height;
+		atlas->padded_texels += (size_t)width * height;
+	}
+	atlas->nb_pages = pages.size();
+	return true;
+}
+
+/* Share of the pages' texels taken by the images themselves */
+float atlas_efficiency(const texture_atlas* atlas) {
+	if (atlas->nb_pages == 0)
+		return 0;
+	return (float)atlas->image_texels / ((float)atlas->nb_pages * atlas->page_size * atlas->page_size);
+}
+
+/* The texels of 'page', from each image's 'pixels' of 'channels'
+ * bytes, rows in the order they came in. The padding repeats the
+ * nearest edge texel, the rest is zero. */
+void atlas_page_pixels(const texture_atlas* atlas, int page, const vector<const unsigned char*> &pixels,
+		       int channels, vector<unsigned char> &out) {
+	int size = atlas->page_size, padding = atlas->padding;
+	out.assign((size_t)size * size * channels, 0);
+	for (size_t i = 0; i < atlas->entries.size(); i++) {
+		const atlas_entry &entry = atlas->entries[i];
+		if (entry.page != page)
+			continue;
+		size_t row_size = (size_t)entry.width * channels;
+		for (int y = -padding; y < entry.height + padding; y++) {
+			const unsigned char* src = pixels[i] + (size_t)min(max(y, 0), entry.height - 1) * row_size;
+			unsigned char* dst = &out[((size_t)(entry.y + y) * size + entry.x) * channels];
+			memcpy(dst, src, row_size);
+			for (int x = 1; x <= padding; x++) {
+				memcpy(dst - x * channels, src, channels);
+				memcpy(dst + row_size + (x - 1) * channels, src + row_size - channels, channels);
+			}
+		}
+	}
+}
+
+/* u' = offset[0] + u * scale[0], the same for v with [1], maps an
+ * image's texture coordinates to its page's */
+void atlas_uv_transform(const texture_atlas* atlas, int image, float* scale, float* offset) {
+	const atlas_entry &entry = atlas->entries[image];
+	float size = atlas->page_size;
+	scale[0] = entry.width / size;
+	scale[1] = entry.height / size;
+	offset[0] = entry.x / size;
+	offset[1] = entry.y / size;
+}
+
+/* Rewrite in place 'count' texture coordinates of 'image', the u of
+ * each 'stride' floats after the previous one's */
+void atlas_remap_uvs(const texture_atlas* atlas, int image, float* uvs, size_t count, size_t stride) {
+	float scale[2], offset[2];
+	atlas_uv_transform(atlas, image, scale, offset);
+	for (size_t i = 0; i < count; i++, uvs += stride) {
+		uvs[0] = offset[0] + uvs[0] * scale[0];
+		uvs[1] = offset[1] + uvs[1] * scale[1];
+	}
+}
+
+/* Images of the same size into the same array, in the order they
+ * come, a new array once one has 'max_layers' (see
+ * GL_MAX_ARRAY_TEXTURE_LAYERS) */
+void group_texture_arrays(const vector<atlas_image> &images, int max_layers, texture_array_layout* layout) {
+	layout->groups.clear();
+	layout->group.assign(images.size(), 0);
+	layout->layer.assign(images.size(), 0);
+	map<pair<int, int>, int> filling;  // the group taking more images of a size
+	for (size_t i = 0; i < images.size(); i++) {
+		pair<int, int> size(images[i].width, images[i].height);
+		map<pair<int, int>, int>::iterator it = filling.find(size);
+		if (it == filling.end() || (int)layout->groups[it->second].images.size() >= max_layers) {
+			texture_array_group group;
+			group.width = images[i].width;
+			group.height = images[i].height;
+			layout->groups.push_back(group);
+			filling[size] = layout->groups.size() - 1;
+			it = filling.find(size);
+		}
+		texture_array_group &group = layout->groups[it->second];
+		layout->group[i] = it->second;
+		layout->layer[i] = group.images.size();
+		group.images.push_back(i);
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef _TEXTURE_ATLAS_H
+#define _TEXTURE_ATLAS_H
+#include <cstddef>
+#include <vector>
+
+/* Many small images gathered into a few textures, so that the objects
+ * using them draw in one batch per texture instead of one bind and
+ * one draw each.
+ * pack_atlas places them on square pages with a skyline packer,
+ * tallest first, each surrounded by 'padding' texels repeating its
+ * edge so that bilinear filtering and the first mipmaps don't bleed
+ * its neighbours in. Texture coordinates are rewritten to the page's,
+ * which rules out GL_REPEAT: tiled images belong in a texture array.
+ * group_texture_arrays sorts images of the same size into the layers
+ * of GL_TEXTURE_2D_ARRAY textures, where coordinates stay as they are
+ * and the layer goes along with them. */
+struct atlas_image {
+	int width, height;
+};
+
+/* Where an image went, in texels of its page */
+struct atlas_entry {
+	int page;
+	int x, y;
+	int width, height;
+};
+
+struct texture_atlas {
+	int page_size;
+	int padding;
+	int nb_pages;
+	std::vector<atlas_entry> entries;  // one per image, in the order given
+	size_t image_texels;               // of the images alone
+	size_t padded_texels;              // with their padding
+};
+
+/* One GL_TEXTURE_2D_ARRAY: images of the same size, image 'images[i]'
+ * in layer i */
+struct texture_array_group {
+	int width, height;
+	std::vector<int> images;
+};
+
+struct texture_array_layout {
+	std::vector<texture_array_group> groups;
+	std::vector<int> group, layer;  // per image
+};
+
+extern bool pack_atlas(const std::vector<atlas_image> &images, int page_size, int padding, texture_atlas* atlas);
+extern float atlas_efficiency(const texture_atlas* atlas);
+extern void atlas_page_pixels(const texture_atlas* atlas, int page, const std::vector<const unsigned char*> &pixels,
+			      int channels, std::vector<unsigned char> &out);
+extern void atlas_uv_transform(const texture_atlas* atlas, int image, float* scale, float* offset);
+extern void atlas_remap_uvs(const texture_atlas* atlas, int image, float* uvs, size_t count, size_t stride = 2);
+extern void group_texture_arrays(const std::vector<atlas_image> &images, int max_layers,
+				 texture_array_layout* layout);
+
+#endif
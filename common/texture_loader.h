@@ -0,0 +1,751 @@
+#ifndef _TEXTURE_LOADER_H
+#define _TEXTURE_LOADER_H
+/* Textures loaded in the background: image files are decoded by a
+ * pool of worker threads into a staging area, and the GL thread
+ * uploads them a few rows at a time, through a pixel buffer object
+ * when the context has them (OpenGL 2.1), under a byte budget per
+ * frame. Until its pixels are all up, a texture's handle gives the
+ * placeholder texture. Mipmaps are made by the GPU after the upload,
+ * or built by the workers with mipmaps.h, filtering sRGB images in
+ * linear light. With compression enabled the workers also encode
+ * every level to BC1, BC3 or BC7 with block_compress.h. Textures built
+ * on the CPU are kept next to the image in a KTX2 file so that later
+ * runs only read them back.
+ * Given a GPU memory budget, textures left unused for a while lose
+ * their top mipmap levels, then their storage, and load again when
+ * next drawn (see texture_loader_update).
+ * Include stb_image.h or SDL_image.h before it to get the matching
+ * decoder. */
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "block_compress.h"
+#include "ktx2.h"
+#include "mipmaps.h"
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER_BINDING
+#define GL_PIXEL_UNPACK_BUFFER_BINDING 0x88EF
+#endif
+#ifndef GL_NUM_EXTENSIONS
+#define GL_NUM_EXTENSIONS 0x821D
+#endif
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+/* Pixels as a decoder leaves them: rows packed, top row first unless
+ * the decoder flips them, 3 (RGB) or 4 (RGBA) bytes each */
+struct decoded_image {
+	int width, height, channels;
+	std::vector<unsigned char> pixels;
+};
+
+/* Called on the worker threads; false when the file can't be read */
+typedef bool (*texture_decoder)(const char* path, decoded_image* out);
+
+/* How the pixels reach the texture, best first */
+enum texture_upload_path {
+	texture_upload_pbo,     // copied into an orphaned pixel buffer object, then glTexSubImage2D from it
+	texture_upload_direct   // glTexSubImage2D from the staging area
+};
+
+/* Where the levels below 0 come from */
+enum texture_mipmaps {
+	texture_mipmaps_none,    // level 0 only
+	texture_mipmaps_gpu,     // glGenerateMipmap once level 0 is up
+	texture_mipmaps_box,     // build_mip_chain on a worker, mip_box
+	texture_mipmaps_kaiser   // build_mip_chain on a worker, mip_kaiser
+};
+
+enum texture_status {
+	texture_pending,  // queued, decoding, or partly uploaded
+	texture_ready,
+	texture_failed,
+	texture_evicted   // storage released over the budget, loaded again when drawn
+};
+
+/* GPU memory of a texture's levels, and what they would take as GL_RGB(A) */
+struct texture_footprint {
+	size_t bytes, uncompressed;
+};
+
+/* Residency over a frame, see texture_loader_update */
+struct texture_residency_counters {
+	unsigned hits;     // textures drawn with all their levels
+	unsigned misses;   // drawn reduced, or as the placeholder
+	unsigned dropped;  // top levels released to fit the budget
+	unsigned evicted;  // textures released altogether
+};
+
+struct texture_request {
+	std::string path;
+	texture_mipmaps mipmaps;
+	bool srgb;            // filter CPU mipmaps in linear light; the texture stays GL_RGB(A)
+	bool compress, bc7;   // as the loader was when requested
+	GLuint texture;
+	texture_status status;
+	ktx2_texture image;   // staged levels, a single one without CPU mipmaps; once
+			      // uploaded, the levels on the GPU without their data
+	int uploaded_level;
+	int uploaded_rows;    // of pixels, or of blocks for a compressed texture
+	/* Residency, GL thread only */
+	texture_footprint footprint;  // of 'texture'
+	int dropped_levels;   // top levels of 'image' released from 'texture', its base level
+	unsigned last_used;   // frame of the last texture_loader_texture
+	GLuint spare;         // what was left of 'texture' while it loads again
+	int spare_levels;     // levels the spare spans from 0, released or not; 0 when it's empty
+	texture_footprint spare_footprint;
+};
+
+struct texture_loader {
+	texture_decoder decode;
+	texture_upload_path path;
+	std::vector<std::thread> workers;
+	/* Shared with the workers, under 'lock' */
+	std::mutex lock;
+	std::condition_variable wake;  // a request came, room was made, or stopping
+	std::deque<texture_request> requests;  // by handle
+	std::deque<int> to_decode, to_upload;
+	int decoding;
+	size_t staged_bytes;
+	size_t staging_limit;  // workers wait while the staging area holds more
+	bool stopping;
+	int mip_threads;       // each worker's threads for build_mip_chain and compress_mip_chain
+	bool cache_textures;   // read and write .ktx2 files, true by default
+	/* GL thread only */
+	GLuint placeholder;
+	GLuint pbo;
+	size_t frame_budget;   // bytes uploaded per texture_loader_update at most
+	bool compress, bc7;    // see enable_texture_compression
+	/* Residency, GL thread only */
+	size_t vram_budget;    // bytes of textures on the GPU, 0 (the default) for no limit
+	unsigned evict_after;  // frames unused before a texture counts against the budget, 60 by default
+	int min_resident_size; // levels are dropped while the next one is this large, 32 by default
+	unsigned frame;
+	texture_footprint resident;  // every texture on the GPU, spares included
+	texture_residency_counters this_frame, last_frame;
+	/* Statistics since creation */
+	unsigned ready, failed;
+	size_t uploaded_bytes;
+	double upload_ms;      // spent in texture_loader_update uploading
+	unsigned upload_frames;
+};
+
+inline const char* texture_upload_path_name(texture_upload_path path) {
+	return path == texture_upload_pbo ? "pixel buffer object" : "direct";
+}
+
+/* 'preferred', or direct uploads when the context is older than 2.1 */
+inline texture_upload_path best_texture_upload_path(texture_upload_path preferred = texture_upload_pbo) {
+	const char* version = (const char*)glGetString(GL_VERSION);
+	int major = 0, minor = 0;
+	if (preferred == texture_upload_pbo && version != NULL && sscanf(version, "%d.%d", &major, &minor) == 2
+	    && (major > 2 || (major == 2 && minor >= 1)))
+		return texture_upload_pbo;
+	return texture_upload_direct;
+}
+
+/* Whether the context has extension 'name' */
+inline bool texture_loader_has_extension(const char* name) {
+	const char* version = (const char*)glGetString(GL_VERSION);
+	int major = 0;
+	if (version != NULL && sscanf(version, "%d", &major) == 1 && major >= 3) {
+		// GL_EXTENSIONS as a string is gone from core profiles
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+			if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+				return true;
+		return false;
+	}
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	size_t length = strlen(name);
+	for (const char* p = extensions; p != NULL && (p = strstr(p, name)) != NULL; p += length)
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+			return true;
+	return false;
+}
+
+/* GL's internal format for a staged texture, and the format of its
+ * pixels when it isn't compressed */
+inline GLenum texture_gl_format(ktx2_format format, GLenum* pixel_format) {
+	*pixel_format = ktx2_format_channels(format) == 3 ? GL_RGB : GL_RGBA;
+	switch (format) {
+	case ktx2_bc1_rgb_unorm: case ktx2_bc1_rgb_srgb:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case ktx2_bc3_unorm: case ktx2_bc3_srgb:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case ktx2_bc7_unorm: case ktx2_bc7_srgb:
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default:
+		return *pixel_format;
+	}
+}
+
+#ifdef STBI_VERSION
+/* Decoder for stb_image, flipped for OpenGL's bottom-up rows */
+inline bool stb_decode_image(const char* path, decoded_image* out) {
+	stbi_set_flip_vertically_on_load_thread(1);
+	int channels = 0;
+	if (!stbi_info(path, &out->width, &out->height, &channels))
+		return false;
+	out->channels = channels == 3 ? 3 : 4;
+	unsigned char* pixels = stbi_load(path, &out->width, &out->height, &channels, out->channels);
+	if (pixels == NULL)
+		return false;
+	out->pixels.assign(pixels, pixels + (size_t)out->width * out->height * out->channels);
+	stbi_image_free(pixels);
+	return true;
+}
+#endif
+
+#ifdef SDL_IMAGE_MAJOR_VERSION
+/* Decoder for SDL_image, rows kept top first as IMG_Load gives them */
+inline bool sdl_decode_image(const char* path, decoded_image* out) {
+	SDL_Surface* loaded = IMG_Load(path);
+	if (loaded == NULL)
+		return false;
+	SDL_Surface* rgba = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+	if (rgba != loaded)
+		SDL_FreeSurface(loaded);
+	if (rgba == NULL)
+		return false;
+	out->width = rgba->w;
+	out->height = rgba->h;
+	out->channels = 4;
+	out->pixels.resize((size_t)rgba->w * rgba->h * 4);
+	for (int y = 0; y < rgba->h; y++)
+		memcpy(&out->pixels[(size_t)y * rgba->w * 4], (const unsigned char*)rgba->pixels + y * rgba->pitch, rgba->w * 4);
+	SDL_FreeSurface(rgba);
+	return true;
+}
+#endif
+
+/* Whether a texture read back from its .ktx2 file is what a request
+ * asks for now */
+inline bool texture_loader_cache_fits(const ktx2_texture* texture, const char* mipmaps, bool srgb, bool compress,
+				      bool bc7) {
+	const char* built_with = ktx2_metadata(texture, "mipmaps");
+	if (built_with == NULL || strcmp(built_with, mipmaps) != 0 || ktx2_format_srgb(texture->format) != srgb)
+		return false;
+	if (!ktx2_format_compressed(texture->format))
+		return !compress;
+	bool is_bc7 = texture->format == ktx2_bc7_unorm || texture->format == ktx2_bc7_srgb;
+	bool is_bc3 = texture->format == ktx2_bc3_unorm || texture->format == ktx2_bc3_srgb;
+	return compress && (is_bc7 ? bc7 : !is_bc3 || !bc7);
+}
+
+/* On a worker: the levels to upload for 'path', read back from its
+ * .ktx2 file when they're built on the CPU and the file is still
+ * valid. The file holds the rows as this loader's decoder gave them. */
+inline bool texture_loader_prepare(texture_loader* loader, const std::string &path, texture_mipmaps mipmaps,
+				   bool srgb, bool compress, bool bc7, ktx2_texture* texture) {
+	if (compress && mipmaps == texture_mipmaps_gpu)
+		mipmaps = texture_mipmaps_box;  // glGenerateMipmap can't work on compressed textures
+	bool cpu_mipmaps = mipmaps == texture_mipmaps_box || mipmaps == texture_mipmaps_kaiser;
+	mip_filter filter = mipmaps == texture_mipmaps_kaiser ? mip_kaiser : mip_box;
+	const char* mipmaps_name = cpu_mipmaps ? mip_filter_name(filter) : "none";
+	bool cached = (cpu_mipmaps || compress) && loader->cache_textures;
+	std::string cache_path = path + ".ktx2";
+	if (cached && read_ktx2(cache_path.c_str(), texture) && ktx2_matches_source(texture, path.c_str())
+	    && texture_loader_cache_fits(texture, mipmaps_name, srgb, compress, bc7))
+		return true;
+
+	decoded_image image = decoded_image();
+	if (!loader->decode(path.c_str(), &image) || (image.channels != 3 && image.channels != 4)
+	    || image.width <= 0 || image.height <= 0
+	    || image.pixels.size() != (size_t)image.width * image.height * image.channels)
+		return false;
+	mip_chain chain = mip_chain();
+	if (cpu_mipmaps) {
+		build_mip_chain(image.pixels.data(), image.width, image.height, image.channels, srgb, filter, &chain,
+				loader->mip_threads);
+	} else {
+		chain.channels = image.channels;
+		chain.srgb = srgb;
+		chain.filter = filter;
+		mip_level level = { image.width, image.height, 0 };
+		chain.levels.assign(1, level);
+		chain.pixels.swap(image.pixels);
+	}
+	texture->metadata.clear();
+	if (compress)
+		compress_mip_chain(&chain, image.channels == 3 ? block_bc1 : bc7 ? block_bc7 : block_bc3, texture,
+				   loader->mip_threads);
+	else
+		ktx2_from_mip_chain(&chain, texture);
+	if (cached) {
+		ktx2_set_metadata(texture, "mipmaps", mipmaps_name);
+		if (!ktx2_set_source(texture, path.c_str()) || !write_ktx2(cache_path.c_str(), texture))
+			std::cerr << "Could not write " << cache_path << std::endl;
+	}
+	return true;
+}
+
+inline void texture_loader_worker(texture_loader* loader) {
+	std::unique_lock<std::mutex> guard(loader->lock);
+	while (true) {
+		loader->wake.wait(guard, [loader] {
+			return loader->stopping
+				|| (!loader->to_decode.empty() && loader->staged_bytes < loader->staging_limit);
+		});
+		if (loader->stopping)
+			return;
+		int handle = loader->to_decode.front();
+		loader->to_decode.pop_front();
+		std::string path = loader->requests[handle].path;
+		texture_mipmaps mipmaps = loader->requests[handle].mipmaps;
+		bool srgb = loader->requests[handle].srgb;
+		bool compress = loader->requests[handle].compress, bc7 = loader->requests[handle].bc7;
+		loader->decoding++;
+		guard.unlock();
+
+		ktx2_texture image = ktx2_texture();
+		if (!texture_loader_prepare(loader, path, mipmaps, srgb, compress, bc7, &image))
+			image.data.clear();  // reported by texture_loader_update
+
+		guard.lock();
+		loader->decoding--;
+		texture_request &r = loader->requests[handle];
+		std::swap(r.image, image);
+		loader->staged_bytes += r.image.data.size();
+		loader->to_upload.push_back(handle);
+	}
+}
+
+/* Start 'nb_workers' decoding threads, or one per core but one for
+ * the GL thread when 0 */
+inline bool init_texture_loader(texture_loader* loader, texture_decoder decode, int nb_workers = 0,
+				size_t frame_budget = 4 << 20, texture_upload_path preferred = texture_upload_pbo) {
+	loader->decode = decode;
+	loader->path = best_texture_upload_path(preferred);
+	loader->decoding = 0;
+	loader->staged_bytes = 0;
+	loader->staging_limit = 256 << 20;
+	loader->stopping = false;
+	loader->cache_textures = true;
+	loader->frame_budget = frame_budget;
+	loader->compress = loader->bc7 = false;
+	loader->vram_budget = 0;
+	loader->evict_after = 60;
+	loader->min_resident_size = 32;
+	loader->frame = 0;
+	loader->resident = texture_footprint();
+	loader->this_frame = loader->last_frame = texture_residency_counters();
+	loader->ready = loader->failed = 0;
+	loader->uploaded_bytes = 0;
+	loader->upload_ms = 0;
+	loader->upload_frames = 0;
+
+	// Grey and magenta checks, for textures still on their way
+	static const unsigned char checks[16] = { 160, 160, 160, 255,  255, 0, 255, 255,
+						  255, 0, 255, 255,  160, 160, 160, 255 };
+	glGenTextures(1, &loader->placeholder);
+	glBindTexture(GL_TEXTURE_2D, loader->placeholder);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, checks);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	loader->pbo = 0;
+	if (loader->path == texture_upload_pbo)
+		glGenBuffers(1, &loader->pbo);
+
+	if (nb_workers <= 0)
+		nb_workers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+	loader->mip_threads = std::max(1, (int)std::thread::hardware_concurrency() / nb_workers);
+	for (int i = 0; i < nb_workers; i++)
+		loader->workers.push_back(std::thread(texture_loader_worker, loader));
+	return loader->placeholder != 0;
+}
+
+/* Compress the textures requested from now on: BC1 for RGB images,
+ * BC7 for RGBA ones where the context has BPTC and 'bc7' allows, BC3
+ * otherwise. Their mipmaps are built on the CPU, even those asked of
+ * the GPU. False, and uncompressed textures as before, when the
+ * context has no S3TC. */
+inline bool enable_texture_compression(texture_loader* loader, bool bc7 = true) {
+	loader->compress = texture_loader_has_extension("GL_EXT_texture_compression_s3tc");
+	loader->bc7 = loader->compress && bc7 && texture_loader_has_extension("GL_ARB_texture_compression_bptc");
+	return loader->compress;
+}
+
+/* Queue an image file; returns the handle to draw it with. 'srgb'
+ * says its colors are sRGB-encoded, as most images are, for CPU
+ * mipmaps to be filtered in linear light. */
+inline int request_texture(texture_loader* loader, const char* path, texture_mipmaps mipmaps = texture_mipmaps_gpu,
+			   bool srgb = true) {
+	texture_request r;
+	r.path = path;
+	r.mipmaps = mipmaps;
+	r.srgb = srgb;
+	r.compress = loader->compress;
+	r.bc7 = loader->bc7;
+	r.status = texture_pending;
+	r.image = ktx2_texture();
+	r.uploaded_level = r.uploaded_rows = 0;
+	r.footprint = r.spare_footprint = texture_footprint();
+	r.dropped_levels = r.spare_levels = 0;
+	r.last_used = loader->frame;
+	r.spare = 0;
+	glGenTextures(1, &r.texture);
+	std::lock_guard<std::mutex> guard(loader->lock);
+	int handle = loader->requests.size();
+	loader->requests.push_back(r);
+	loader->to_decode.push_back(handle);
+	loader->wake.notify_one();
+	return handle;
+}
+
+/* Queue a reduced or evicted texture to load again. What's left of a
+ * reduced one moves to the request's spare texture, drawn until the
+ * full one is up. */
+inline void texture_loader_reload(texture_loader* loader, int handle) {
+	texture_request &r = loader->requests[handle];
+	if (r.status == texture_ready) {
+		if (r.spare == 0)
+			glGenTextures(1, &r.spare);
+		std::swap(r.texture, r.spare);
+		r.spare_levels = r.image.levels.size();
+		r.spare_footprint = r.footprint;
+		r.footprint = texture_footprint();
+	}
+	r.status = texture_pending;
+	r.dropped_levels = 0;
+	r.uploaded_level = r.uploaded_rows = 0;
+	std::lock_guard<std::mutex> guard(loader->lock);
+	loader->to_decode.push_back(handle);
+	loader->wake.notify_one();
+}
+
+/* The texture to bind for 'handle' this frame: the placeholder until
+ * it's ready. A texture reduced or evicted over the budget is drawn as
+ * it is, and loads again. */
+inline GLuint texture_loader_texture(texture_loader* loader, int handle) {
+	texture_request &r = loader->requests[handle];
+	if (r.last_used != loader->frame) {
+		r.last_used = loader->frame;
+		if (r.status == texture_ready && r.dropped_levels == 0)
+			loader->this_frame.hits++;
+		else
+			loader->this_frame.misses++;
+		if (r.status == texture_evicted || (r.status == texture_ready && r.dropped_levels > 0))
+			texture_loader_reload(loader, handle);
+	}
+	if (r.status == texture_ready)
+		return r.texture;
+	return r.spare_levels > 0 ? r.spare : loader->placeholder;
+}
+
+/* Textures queued, decoding or waiting to be uploaded */
+inline size_t texture_loader_queue_depth(texture_loader* loader) {
+	std::lock_guard<std::mutex> guard(loader->lock);
+	return loader->to_decode.size() + loader->decoding + loader->to_upload.size();
+}
+
+/* Megabytes per second while uploading */
+inline double texture_loader_upload_rate(const texture_loader* loader) {
+	return loader->upload_ms > 0 ? loader->uploaded_bytes / (loader->upload_ms * 1000.0) : 0.0;
+}
+
+/* 'rows' rows, of pixels or of blocks, of 'r' from the first rows of
+ * its current level not yet uploaded, into its bound texture */
+inline void texture_loader_upload_rows(texture_loader* loader, texture_request &r, int rows) {
+	GLenum pixel_format;
+	GLenum internal_format = texture_gl_format(r.image.format, &pixel_format);
+	const mip_level &level = r.image.levels[r.uploaded_level];
+	size_t row_size = ktx2_level_size(r.image.format, level.width, 1);
+	const unsigned char* pixels = &r.image.data[level.offset + r.uploaded_rows * row_size];
+	size_t size = rows * row_size;
+	if (loader->pbo != 0) {
+		// Orphaned first: the previous upload may still be reading it
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, loader->pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		void* mapped = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if (mapped != NULL) {
+			memcpy(mapped, pixels, size);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			pixels = NULL;  // offset 0 in the buffer
+		} else {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+	}
+	if (ktx2_format_compressed(r.image.format)) {
+		int y = r.uploaded_rows * 4;
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, r.uploaded_level, 0, y, level.width, std::min(rows * 4, level.height - y),
+					  internal_format, size, pixels);
+	} else {
+		glTexSubImage2D(GL_TEXTURE_2D, r.uploaded_level, 0, r.uploaded_rows, level.width, rows, pixel_format,
+				GL_UNSIGNED_BYTE, pixels);
+	}
+	if (loader->pbo != 0)
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	r.uploaded_rows += rows;
+}
+
+/* The GPU memory of levels [first, end) of 'image' */
+inline texture_footprint texture_levels_footprint(const ktx2_texture &image, int first) {
+	texture_footprint footprint = texture_footprint();
+	for (size_t i = first; i < image.levels.size(); i++) {
+		const mip_level &level = image.levels[i];
+		footprint.bytes += ktx2_level_size(image.format, level.width, level.height);
+		footprint.uncompressed += (size_t)level.width * level.height * ktx2_format_channels(image.format);
+	}
+	return footprint;
+}
+
+inline void add_footprint(texture_footprint* total, const texture_footprint &footprint) {
+	total->bytes += footprint.bytes;
+	total->uncompressed += footprint.uncompressed;
+}
+
+inline void remove_footprint(texture_footprint* total, const texture_footprint &footprint) {
+	total->bytes -= footprint.bytes;
+	total->uncompressed -= footprint.uncompressed;
+}
+
+/* Free the storage of levels [first, end) of the bound texture,
+ * keeping its name */
+inline void texture_loader_release_levels(int first, int end) {
+	for (int i = first; i < end; i++)
+		glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+}
+
+inline void texture_loader_release_spare(texture_loader* loader, texture_request &r) {
+	if (r.spare_levels == 0)
+		return;
+	glBindTexture(GL_TEXTURE_2D, r.spare);
+	texture_loader_release_levels(0, r.spare_levels);
+	remove_footprint(&loader->resident, r.spare_footprint);
+	r.spare_levels = 0;
+	r.spare_footprint = texture_footprint();
+}
+
+/* Release the top 'count' levels of ready texture 'r': its base level
+ * moves past them before their storage goes, so the texture stays
+ * complete and keeps its name, and nothing is read back from the GPU.
+ * The driver moves the levels left to smaller storage when the
+ * texture is next used. */
+inline void texture_loader_drop_levels(texture_loader* loader, texture_request &r, int count) {
+	glBindTexture(GL_TEXTURE_2D, r.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, r.dropped_levels + count);
+	texture_loader_release_levels(r.dropped_levels, r.dropped_levels + count);
+	remove_footprint(&loader->resident, r.footprint);
+	r.dropped_levels += count;
+	r.footprint = texture_levels_footprint(r.image, r.dropped_levels);
+	add_footprint(&loader->resident, r.footprint);
+	loader->this_frame.dropped += count;
+}
+
+/* Get back under the budget: textures unused for 'evict_after' frames,
+ * least recently used first, lose their top levels while the next one
+ * is at least 'min_resident_size' on a side, then, if that is not
+ * enough, their storage. Textures in use stay, over the budget or not. */
+inline void texture_loader_enforce_budget(texture_loader* loader) {
+	std::vector<int> unused;
+	for (size_t i = 0; i < loader->requests.size(); i++) {
+		const texture_request &r = loader->requests[i];
+		if (r.status == texture_ready && loader->frame - r.last_used > loader->evict_after)
+			unused.push_back(i);
+	}
+	std::stable_sort(unused.begin(), unused.end(), [loader](int a, int b) {
+		return loader->requests[a].last_used < loader->requests[b].last_used;
+	});
+
+	for (size_t i = 0; i < unused.size() && loader->resident.bytes > loader->vram_budget; i++) {
+		texture_request &r = loader->requests[unused[i]];
+		int count = 0;
+		size_t freed = 0;
+		for (int top = r.dropped_levels + 1; loader->resident.bytes - freed > loader->vram_budget
+			     && top < (int)r.image.levels.size()
+			     && std::max(r.image.levels[top].width, r.image.levels[top].height) >= loader->min_resident_size;
+		     top++) {
+			const mip_level &level = r.image.levels[top - 1];
+			freed += ktx2_level_size(r.image.format, level.width, level.height);
+			count++;
+		}
+		if (count > 0)
+			texture_loader_drop_levels(loader, r, count);
+	}
+	for (size_t i = 0; i < unused.size() && loader->resident.bytes > loader->vram_budget; i++) {
+		texture_request &r = loader->requests[unused[i]];
+		glBindTexture(GL_TEXTURE_2D, r.texture);
+		texture_loader_release_levels(r.dropped_levels, r.image.levels.size());
+		remove_footprint(&loader->resident, r.footprint);
+		r.footprint = texture_footprint();
+		r.status = texture_evicted;
+		loader->this_frame.evicted++;
+	}
+}
+
+/* Once per frame on the GL thread, before drawing: moves the residency
+ * counters to last_frame, uploads decoded textures, oldest first,
+ * until the frame's upload budget is spent, a texture possibly over
+ * several frames, then gets back under the memory budget if there is
+ * one. The texture unit, bindings and pixel store alignments are
+ * left as they were. Returns how many textures became ready. */
+inline unsigned texture_loader_update(texture_loader* loader) {
+	loader->last_frame = loader->this_frame;
+	loader->this_frame = texture_residency_counters();
+	loader->frame++;
+	bool over_budget = loader->vram_budget > 0 && loader->resident.bytes > loader->vram_budget;
+	bool uploading;
+	{
+		std::lock_guard<std::mutex> guard(loader->lock);
+		uploading = !loader->to_upload.empty();
+	}
+	if (!uploading && !over_budget)
+		return 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	GLint active_texture, bound_texture, unpack_buffer = 0, alignment;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound_texture);
+	if (loader->pbo != 0)
+		glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack_buffer);
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (unpack_buffer != 0)
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	unsigned completed = 0;
+	size_t sent = 0, staged_freed = 0;
+	while (sent < loader->frame_budget) {
+		int handle;
+		{
+			std::lock_guard<std::mutex> guard(loader->lock);
+			if (loader->to_upload.empty())
+				break;
+			handle = loader->to_upload.front();
+		}
+		texture_request &r = loader->requests[handle];
+		if (r.image.data.empty()) {
+			std::cerr << "Could not load texture " << r.path << std::endl;
+			r.status = texture_failed;
+			loader->failed++;
+			texture_loader_release_spare(loader, r);
+		} else {
+			GLenum pixel_format;
+			GLenum internal_format = texture_gl_format(r.image.format, &pixel_format);
+			bool compressed = ktx2_format_compressed(r.image.format);
+			int nb_levels = r.image.levels.size();
+			glBindTexture(GL_TEXTURE_2D, r.texture);
+			if (r.uploaded_level == 0 && r.uploaded_rows == 0) {
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+						r.mipmaps != texture_mipmaps_none ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				// GL's defaults, unless CPU mipmaps stop short of the max
+				// level; reset for a name that held a reduced texture
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+						r.mipmaps == texture_mipmaps_gpu && !compressed ? 1000 : nb_levels - 1);
+				for (int i = 0; i < nb_levels; i++) {
+					const mip_level &level = r.image.levels[i];
+					if (compressed)
+						glCompressedTexImage2D(GL_TEXTURE_2D, i, internal_format, level.width, level.height, 0,
+								       ktx2_level_size(r.image.format, level.width, level.height), NULL);
+					else
+						glTexImage2D(GL_TEXTURE_2D, i, internal_format, level.width, level.height, 0,
+							     pixel_format, GL_UNSIGNED_BYTE, NULL);
+				}
+			}
+			// Whole rows, at least one so that a wide image gets through
+			while (r.uploaded_level < nb_levels && sent < loader->frame_budget) {
+				const mip_level &level = r.image.levels[r.uploaded_level];
+				size_t row_size = ktx2_level_size(r.image.format, level.width, 1);
+				int nb_rows = compressed ? (level.height + 3) / 4 : level.height;
+				int rows = std::min((size_t)(nb_rows - r.uploaded_rows),
+						    std::max((size_t)1, (loader->frame_budget - sent) / row_size));
+				texture_loader_upload_rows(loader, r, rows);
+				sent += rows * row_size;
+				if (r.uploaded_rows == nb_rows) {
+					r.uploaded_level++;
+					r.uploaded_rows = 0;
+				}
+			}
+			if (r.uploaded_level < nb_levels)
+				break;  // budget spent
+			if (r.mipmaps == texture_mipmaps_gpu && !compressed) {
+				glGenerateMipmap(GL_TEXTURE_2D);
+				for (mip_level level = r.image.levels.back(); level.width > 1 || level.height > 1; ) {
+					level.width = std::max(1, level.width / 2);
+					level.height = std::max(1, level.height / 2);
+					r.image.levels.push_back(level);
+				}
+			}
+			r.footprint = texture_levels_footprint(r.image, 0);
+			add_footprint(&loader->resident, r.footprint);
+			texture_loader_release_spare(loader, r);
+			r.status = texture_ready;
+			loader->ready++;
+			completed++;
+		}
+		staged_freed += r.image.data.size();
+		std::vector<unsigned char>().swap(r.image.data);
+		std::lock_guard<std::mutex> guard(loader->lock);
+		loader->to_upload.pop_front();
+		loader->staged_bytes -= staged_freed;
+		staged_freed = 0;
+		loader->wake.notify_all();
+	}
+
+	if (loader->vram_budget > 0 && loader->resident.bytes > loader->vram_budget)
+		texture_loader_enforce_budget(loader);
+
+	glBindTexture(GL_TEXTURE_2D, bound_texture);
+	glActiveTexture(active_texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+	if (unpack_buffer != 0)
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer);
+	if (uploading) {
+		loader->uploaded_bytes += sent;
+		loader->upload_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		loader->upload_frames++;
+	}
+	return completed;
+}
+
+/* Stop the workers, then delete every texture and the placeholder */
+inline void free_texture_loader(texture_loader* loader) {
+	{
+		std::lock_guard<std::mutex> guard(loader->lock);
+		loader->stopping = true;
+		loader->wake.notify_all();
+	}
+	for (size_t i = 0; i < loader->workers.size(); i++)
+		loader->workers[i].join();
+	loader->workers.clear();
+	for (size_t i = 0; i < loader->requests.size(); i++) {
+		glDeleteTextures(1, &loader->requests[i].texture);
+		if (loader->requests[i].spare != 0)
+			glDeleteTextures(1, &loader->requests[i].spare);
+	}
+	loader->requests.clear();
+	loader->to_decode.clear();
+	loader->to_upload.clear();
+	glDeleteTextures(1, &loader->placeholder);
+	if (loader->pbo != 0)
+		glDeleteBuffers(1, &loader->pbo);
+}
+
+#endif
@@ -0,0 +1,251 @@
+#include <cstddef>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "transform_hierarchy.h"
+#include "simd.h"
+
+/* Local matrices are built 8 (AVX2) or 4 (SSE2) nodes at a time from
+ * the component arrays; world and MVP matrices, which chain through
+ * the parents, one node at a time with a column per SSE register. */
+
+void init_transform_hierarchy(transform_hierarchy* h, size_t capacity) {
+	vector<float>* components[] = { &h->tx, &h->ty, &h->tz, &h->qx, &h->qy, &h->qz, &h->qw,
+					&h->sx, &h->sy, &h->sz };
+	for (int c = 0; c < 10; c++) {
+		components[c]->clear();
+		components[c]->reserve(capacity);
+	}
+	for (int e = 0; e < 12; e++) {
+		h->local[e].clear();
+		h->local[e].reserve(capacity);
+	}
+	h->parent.clear();
+	h->parent.reserve(capacity);
+	h->dirty.clear();
+	h->dirty.reserve(capacity);
+	h->moved.clear();
+	h->moved.reserve(capacity);
+	h->world.clear();
+	h->world.reserve(capacity);
+	h->mvp.clear();
+	h->mvp.reserve(capacity);
+	h->view_projection = glm::mat4(1.0f);
+	h->nb_locals = h->nb_worlds = h->nb_mvps = 0;
+}
+
+/* A node under 'parent' (-1 for a root), which must already exist;
+ * returns its index. Its matrices are built by the next update. */
+int add_transform_node(transform_hierarchy* h, int parent, const glm::vec3 &translation,
+		       const glm::vec4 &rotation, const glm::vec3 &scale) {
+	int node = h->parent.size();
+	if (parent >= node)
+		parent = -1;
+	h->tx.push_back(translation.x);
+	h->ty.push_back(translation.y);
+	h->tz.push_back(translation.z);
+	h->qx.push_back(rotation.x);
+	h->qy.push_back(rotation.y);
+	h->qz.push_back(rotation.z);
+	h->qw.push_back(rotation.w);
+	h->sx.push_back(scale.x);
+	h->sy.push_back(scale.y);
+	h->sz.push_back(scale.z);
+	for (int e = 0; e < 12; e++)
+		h->local[e].push_back(0.0f);
+	h->parent.push_back(parent);
+	h->dirty.push_back(1);
+	h->moved.push_back(0);
+	h->world.push_back(glm::mat4(1.0f));
+	h->mvp.push_back(glm::mat4(1.0f));
+	return node;
+}
+
+void set_node_translation(transform_hierarchy* h, int node, const glm::vec3 &translation) {
+	h->tx[node] = translation.x;
+	h->ty[node] = translation.y;
+	h->tz[node] = translation.z;
+	h->dirty[node] = 1;
+}
+
+void set_node_rotation(transform_hierarchy* h, int node, const glm::vec4 &rotation) {
+	h->qx[node] = rotation.x;
+	h->qy[node] = rotation.y;
+	h->qz[node] = rotation.z;
+	h->qw[node] = rotation.w;
+	h->dirty[node] = 1;
+}
+
+void set_node_scale(transform_hierarchy* h, int node, const glm::vec3 &scale) {
+	h->sx[node] = scale.x;
+	h->sy[node] = scale.y;
+	h->sz[node] = scale.z;
+	h->dirty[node] = 1;
+}
+
+/* Translation * rotation * scale, the rotation from the quaternion as
+ * 05_cubes' instanced vertex shader does */
+static size_t build_locals_scalar(transform_hierarchy* h, size_t first, size_t count) {
+	size_t nb_built = 0;
+	for (size_t i = first; i < count; i++) {
+		if (!h->dirty[i])
+			continue;
+		float x = h->qx[i], y = h->qy[i], z = h->qz[i], w = h->qw[i];
+		float columns[12] = {
+			(1 - 2*(y*y + z*z)) * h->sx[i], 2*(x*y + w*z) * h->sx[i], 2*(x*z - w*y) * h->sx[i],
+			2*(x*y - w*z) * h->sy[i], (1 - 2*(x*x + z*z)) * h->sy[i], 2*(y*z + w*x) * h->sy[i],
+			2*(x*z + w*y) * h->sz[i], 2*(y*z - w*x) * h->sz[i], (1 - 2*(x*x + y*y)) * h->sz[i],
+			h->tx[i], h->ty[i], h->tz[i]
+		};
+		for (int e = 0; e < 12; e++)
+			h->local[e][i] = columns[e];
+		nb_built++;
+	}
+	return nb_built;
+}
+
+static glm::mat4 local_matrix(const transform_hierarchy* h, size_t i) {
+	glm::mat4 m(1.0f);
+	for (int c = 0; c < 4; c++)
+		m[c] = glm::vec4(h->local[c * 3][i], h->local[c * 3 + 1][i], h->local[c * 3 + 2][i], c == 3 ? 1.0f : 0.0f);
+	return m;
+}
+
+/* Whether the node's own transform or any ancestor's changed, its
+ * parent's flag being already set as it comes first; clears its
+ * dirty flag */
+static inline bool node_moved(transform_hierarchy* h, size_t i) {
+	int p = h->parent[i];
+	unsigned char moved = h->dirty[i] | (p >= 0 ? h->moved[p] : 0);
+	h->moved[i] = moved;
+	h->dirty[i] = 0;
+	return moved;
+}
+
+/* Whether the MVPs of every node need rebuilding, or only those of
+ * the moved ones */
+static bool camera_moved(transform_hierarchy* h, const glm::mat4 &view_projection) {
+	bool changed = memcmp(glm::value_ptr(view_projection), glm::value_ptr(h->view_projection),
+			      sizeof(float) * 16) != 0;
+	h->view_projection = view_projection;
+	return changed;
+}
+
+/* The same steps as update_transforms with glm's matrix products,
+ * to check it against */
+void update_transforms_scalar(transform_hierarchy* h, const glm::mat4 &view_projection) {
+	size_t count = h->parent.size();
+	bool all = camera_moved(h, view_projection);
+	h->nb_locals = build_locals_scalar(h, 0, count);
+	h->nb_worlds = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (!node_moved(h, i))
+			continue;
+		int p = h->parent[i];
+		h->world[i] = p >= 0 ? h->world[p] * local_matrix(h, i) : local_matrix(h, i);
+		if (!all)
+			h->mvp[i] = view_projection * h->world[i];
+		h->nb_worlds++;
+	}
+	h->nb_mvps = h->nb_worlds;
+	if (all) {
+		for (size_t i = 0; i < count; i++)
+			h->mvp[i] = view_projection * h->world[i];
+		h->nb_mvps = count;
+	}
+}
+
+#ifdef VFLOAT_SIMD
+/* Whether any of the 'lanes' nodes from 'first' is dirty */
+static inline bool any_dirty(const unsigned char* dirty) {
+	for (int l = 0; l < lanes; l++)
+		if (dirty[l])
+			return true;
+	return false;
+}
+
+/* build_locals_scalar 'lanes' nodes at a time: a block is rebuilt
+ * whole when any of its nodes is dirty */
+static size_t build_locals(transform_hierarchy* h) {
+	size_t count = h->parent.size(), nb_built = 0, i = 0;
+	vfloat one = v_set1(1.0f), two = v_set1(2.0f);
+	for (; i + lanes <= count; i += lanes) {
+		if (!any_dirty(&h->dirty[i]))
+			continue;
+		vfloat x = v_load(&h->qx[i]), y = v_load(&h->qy[i]), z = v_load(&h->qz[i]), w = v_load(&h->qw[i]);
+		vfloat sx = v_load(&h->sx[i]), sy = v_load(&h->sy[i]), sz = v_load(&h->sz[i]);
+		vfloat xx = v_mul(x, x), yy = v_mul(y, y), zz = v_mul(z, z);
+		vfloat xy = v_mul(x, y), xz = v_mul(x, z), yz = v_mul(y, z);
+		vfloat wx = v_mul(w, x), wy = v_mul(w, y), wz = v_mul(w, z);
+		vfloat columns[9] = {
+			v_mul(v_sub(one, v_mul(two, v_add(yy, zz))), sx),
+			v_mul(v_mul(two, v_add(xy, wz)), sx),
+			v_mul(v_mul(two, v_sub(xz, wy)), sx),
+			v_mul(v_mul(two, v_sub(xy, wz)), sy),
+			v_mul(v_sub(one, v_mul(two, v_add(xx, zz))), sy),
+			v_mul(v_mul(two, v_add(yz, wx)), sy),
+			v_mul(v_mul(two, v_add(xz, wy)), sz),
+			v_mul(v_mul(two, v_sub(yz, wx)), sz),
+			v_mul(v_sub(one, v_mul(two, v_add(xx, yy))), sz)
+		};
+		for (int e = 0; e < 9; e++)
+			v_store(&h->local[e][i], columns[e]);
+		v_store(&h->local[9][i], v_load(&h->tx[i]));
+		v_store(&h->local[10][i], v_load(&h->ty[i]));
+		v_store(&h->local[11][i], v_load(&h->tz[i]));
+		for (int l = 0; l < lanes; l++)
+			nb_built += h->dirty[i + l];
+	}
+	return nb_built + build_locals_scalar(h, i, count);
+}
+
+/* 'out' = 'm' * the affine matrix of columns 'a' (3 floats each,
+ * 'stride' apart), all column-major */
+static inline void mul_affine(const float* m, const float* a, int stride, float* out) {
+	__m128 m0 = _mm_loadu_ps(m), m1 = _mm_loadu_ps(m + 4), m2 = _mm_loadu_ps(m + 8), m3 = _mm_loadu_ps(m + 12);
+	for (int c = 0; c < 4; c++) {
+		const float* col = a + c * stride;
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, _mm_set1_ps(col[0])), _mm_mul_ps(m1, _mm_set1_ps(col[1]))),
+				      _mm_mul_ps(m2, _mm_set1_ps(col[2])));
+		_mm_storeu_ps(out + c * 4, c == 3 ? _mm_add_ps(r, m3) : r);
+	}
+}
+
+/* Local matrices of the dirty nodes, then the world and MVP matrices
+ * of the nodes under them, parents first, in the same pass */
+void update_transforms(transform_hierarchy* h, const glm::mat4 &view_projection) {
+	static const float identity[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+	size_t count = h->parent.size();
+	bool all = camera_moved(h, view_projection);
+	const float* vp = glm::value_ptr(view_projection);
+	h->nb_locals = build_locals(h);
+	h->nb_worlds = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (!node_moved(h, i))
+			continue;
+		int p = h->parent[i];
+		float local[12];
+		for (int e = 0; e < 12; e++)
+			local[e] = h->local[e][i];
+		float* world = glm::value_ptr(h->world[i]);
+		mul_affine(p >= 0 ? glm::value_ptr(h->world[p]) : identity, local, 3, world);
+		if (!all)
+			mul_affine(vp, world, 4, glm::value_ptr(h->mvp[i]));
+		h->nb_worlds++;
+	}
+	h->nb_mvps = h->nb_worlds;
+	if (all) {
+		for (size_t i = 0; i < count; i++)
+			mul_affine(vp, glm::value_ptr(h->world[i]), 4, glm::value_ptr(h->mvp[i]));
+		h->nb_mvps = count;
+	}
+}
+#else
+void update_transforms(transform_hierarchy* h, const glm::mat4 &view_projection) {
+	update_transforms_scalar(h, view_projection);
+}
+#endif
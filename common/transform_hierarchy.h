@@ -0,0 +1,40 @@
+#ifndef _TRANSFORM_HIERARCHY_H
+#define _TRANSFORM_HIERARCHY_H
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+/* A scene graph flattened into arrays: each node's local translation,
+ * rotation (unit quaternion, xyz and w) and scale stored one array
+ * per component, and its parent's index, always lower than its own so
+ * that one pass in order visits parents first. Changing a node marks
+ * it dirty; update_transforms then rebuilds the local matrices of the
+ * dirty nodes, and the world and MVP matrices of their subtrees only,
+ * several nodes at a time where the CPU has SIMD. */
+struct transform_hierarchy {
+	std::vector<float> tx, ty, tz;
+	std::vector<float> qx, qy, qz, qw;
+	std::vector<float> sx, sy, sz;
+	std::vector<int> parent;            // -1 for a root
+	std::vector<unsigned char> dirty;   // local transform changed since the last update
+	std::vector<unsigned char> moved;   // world matrix rebuilt by the last update
+	/* Local matrices, the upper 3x4 of each, one array per element
+	 * in column-major order */
+	std::vector<float> local[12];
+	std::vector<glm::mat4> world, mvp;
+	glm::mat4 view_projection;
+	/* Statistics of the last update */
+	size_t nb_locals, nb_worlds, nb_mvps;
+};
+
+extern void init_transform_hierarchy(transform_hierarchy* h, size_t capacity = 0);
+extern int add_transform_node(transform_hierarchy* h, int parent, const glm::vec3 &translation,
+			      const glm::vec4 &rotation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
+			      const glm::vec3 &scale = glm::vec3(1.0f));
+extern void set_node_translation(transform_hierarchy* h, int node, const glm::vec3 &translation);
+extern void set_node_rotation(transform_hierarchy* h, int node, const glm::vec4 &rotation);
+extern void set_node_scale(transform_hierarchy* h, int node, const glm::vec3 &scale);
+extern void update_transforms(transform_hierarchy* h, const glm::mat4 &view_projection);
+extern void update_transforms_scalar(transform_hierarchy* h, const glm::mat4 &view_projection);
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef _UNIFORM_BLOCKS_H
+#define _UNIFORM_BLOCKS_H
+/* std140 uniform blocks shared between programs (OpenGL 3.1 or
+ * ARB_uniform_buffer_object). A program that declares
+ *
+ *   layout(std140) uniform Frame { mat4 view; mat4 projection; float time; };
+ *
+ * reads the camera from one buffer at frame_block_binding, filled
+ * once per frame whatever the number of programs. Per-object blocks,
+ * named Object, are suballocated from one uniform_buffer and bound
+ * with glBindBufferRange at object_block_binding before each draw. */
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+const GLuint frame_block_binding = 0;
+const GLuint object_block_binding = 1;
+const char frame_block_name[] = "Frame";
+const char object_block_name[] = "Object";
+
+/* The Frame block, as std140 lays it out */
+struct frame_block {
+	float view[16];        // column-major, like glm::value_ptr
+	float projection[16];
+	float time;
+	float padding[3];
+};
+
+/* Per-object blocks written on the CPU during the frame, then uploaded
+ * in one call */
+struct uniform_buffer {
+	GLuint buffer;
+	GLint alignment;       // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	GLint max_block_size;  // GL_MAX_UNIFORM_BLOCK_SIZE
+	std::vector<unsigned char> staging;
+	size_t used;
+	unsigned failed;       // allocations that did not fit
+};
+
+/* Point the program's Frame and Object blocks, when it has them, at
+ * their binding points. Done once after linking. */
+inline void bind_uniform_blocks(GLuint program) {
+	GLuint index = glGetUniformBlockIndex(program, frame_block_name);
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, index, frame_block_binding);
+	index = glGetUniformBlockIndex(program, object_block_name);
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, index, object_block_binding);
+}
+
+/* The Frame block's buffer, bound to frame_block_binding for good */
+inline GLuint init_frame_block() {
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_block), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, frame_block_binding, buffer);
+	return buffer;
+}
+
+inline void update_frame_block(GLuint buffer, const frame_block &block) {
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+}
+
+inline bool init_uniform_buffer(uniform_buffer* ub, size_t capacity) {
+	*ub = uniform_buffer();
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ub->alignment);
+	glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &ub->max_block_size);
+	if (ub->alignment <= 0)
+		ub->alignment = 256;
+	ub->staging.resize(capacity);
+	glGenBuffers(1, &ub->buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, ub->buffer);
+	glBufferData(GL_UNIFORM_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	return ub->buffer != 0;
+}
+
+/* Start a new frame's worth of blocks */
+inline void uniform_buffer_reset(uniform_buffer* ub) {
+	ub->used = 0;
+}
+
+/* 'size' bytes for one block, to fill before uniform_buffer_upload;
+ * its offset for uniform_buffer_bind goes to 'offset'. NULL when the
+ * buffer is full or the block too large for GL. */
+inline void* uniform_buffer_alloc(uniform_buffer* ub, size_t size, size_t* offset) {
+	size_t start = (ub->used + ub->alignment - 1) / ub->alignment * ub->alignment;
+	if (start + size > ub->staging.size() || size > (size_t)ub->max_block_size) {
+		ub->failed++;
+		return NULL;
+	}
+	ub->used = start + size;
+	*offset = start;
+	return ub->staging.data() + start;
+}
+
+/* Send every block allocated since the reset, into fresh storage so
+ * that draws still reading the previous frame's blocks do not stall */
+inline void uniform_buffer_upload(uniform_buffer* ub) {
+	glBindBuffer(GL_UNIFORM_BUFFER, ub->buffer);
+	glBufferData(GL_UNIFORM_BUFFER, ub->staging.size(), NULL, GL_STREAM_DRAW);
+	if (ub->used > 0)
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, ub->used, ub->staging.data());
+}
+
+/* Make the block at 'offset' the one programs read at 'binding' */
+inline void uniform_buffer_bind(const uniform_buffer* ub, GLuint binding, size_t offset, size_t size) {
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, ub->buffer, offset, size);
+}
+
+inline void free_uniform_buffer(uniform_buffer* ub) {
+	glDeleteBuffers(1, &ub->buffer);
+	ub->buffer = 0;
+	ub->staging.clear();
+	ub->used = 0;
+}
+
+#endif
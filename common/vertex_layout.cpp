@@ -0,0 +1,161 @@
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+
+#include "vertex_layout.h"
+
+/* Desktop GL has core or ARB vertex arrays, GLES2 the OES ones */
+#ifdef GL_OES_vertex_array_object
+static bool use_oes_vertex_arrays() {
+	return !GLEW_VERSION_3_0 && !GLEW_ARB_vertex_array_object && GLEW_OES_vertex_array_object;
+}
+#else
+static bool use_oes_vertex_arrays() {
+	return false;
+}
+#endif
+
+static void gen_vertex_array(GLuint* vao) {
+#ifdef GL_OES_vertex_array_object
+	if (use_oes_vertex_arrays()) {
+		glGenVertexArraysOES(1, vao);
+		return;
+	}
+#endif
+	glGenVertexArrays(1, vao);
+}
+
+static void bind_vertex_array(GLuint vao) {
+#ifdef GL_OES_vertex_array_object
+	if (use_oes_vertex_arrays()) {
+		glBindVertexArrayOES(vao);
+		return;
+	}
+#endif
+	glBindVertexArray(vao);
+}
+
+static void delete_vertex_array(GLuint* vao) {
+#ifdef GL_OES_vertex_array_object
+	if (use_oes_vertex_arrays()) {
+		glDeleteVertexArraysOES(1, vao);
+		return;
+	}
+#endif
+	glDeleteVertexArrays(1, vao);
+}
+
+bool vertex_arrays_available() {
+	return GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object || use_oes_vertex_arrays();
+}
+
+/* Per-instance attributes and instanced draws: core in 3.3 and 3.1,
+ * or ARB_instanced_arrays and ARB_draw_instanced on GL 2.1 */
+bool instancing_available() {
+	return (GLEW_VERSION_3_3 || GLEW_ARB_instanced_arrays)
+		&& (GLEW_VERSION_3_1 || GLEW_ARB_draw_instanced);
+}
+
+static void vertex_attrib_divisor(GLuint index, GLuint divisor) {
+	if (GLEW_VERSION_3_3)
+		glVertexAttribDivisor(index, divisor);
+	else
+		glVertexAttribDivisorARB(index, divisor);
+}
+
+void draw_elements_instanced(GLenum mode, GLsizei count, GLenum type, size_t offset, GLsizei instances) {
+	if (GLEW_VERSION_3_1)
+		glDrawElementsInstanced(mode, count, type, (const GLvoid*) offset, instances);
+	else
+		glDrawElementsInstancedARB(mode, count, type, (const GLvoid*) offset, instances);
+}
+
+void add_vertex_attrib(vertex_layout* layout, GLuint index, GLuint buffer, GLint size, GLenum type,
+		       GLboolean normalized, GLsizei stride, size_t offset, GLuint divisor) {
+	vertex_attrib attrib = { index, buffer, size, type, normalized, stride, offset, divisor };
+	layout->attribs.push_back(attrib);
+}
+
+/* Set every attribute up, through the state cache when there is one */
+static void point_layout(const vertex_layout* layout, gl_state* state) {
+	for (size_t i = 0; i < layout->attribs.size(); i++) {
+		const vertex_attrib &a = layout->attribs[i];
+		if (state != NULL) {
+			gl_enable_vertex_attrib_array(state, a.index, true);
+			gl_bind_buffer(state, GL_ARRAY_BUFFER, a.buffer);
+			gl_vertex_attrib_pointer(state, a.index, a.size, a.type, a.normalized, a.stride,
+						 (const GLvoid*) a.offset);
+		} else {
+			glEnableVertexAttribArray(a.index);
+			glBindBuffer(GL_ARRAY_BUFFER, a.buffer);
+			glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride,
+					      (const GLvoid*) a.offset);
+		}
+		if (a.divisor != 0)
+			vertex_attrib_divisor(a.index, a.divisor);
+	}
+	if (state != NULL)
+		gl_bind_buffer(state, GL_ELEMENT_ARRAY_BUFFER, layout->element_buffer);
+	else
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, layout->element_buffer);
+}
+
+/* Record the attributes into a vertex array object, if available and
+ * 'use_vao'. Leaves vertex array 0 bound. */
+void build_vertex_layout(vertex_layout* layout, bool use_vao) {
+	layout->vao = 0;
+	if (!use_vao || !vertex_arrays_available())
+		return;
+	gen_vertex_array(&layout->vao);
+	bind_vertex_array(layout->vao);
+	point_layout(layout, NULL);
+	bind_vertex_array(0);
+}
+
+/* Ready the layout for drawing. Pass the state cache if the caller
+ * uses one, so that it knows what is bound. */
+void bind_vertex_layout(const vertex_layout* layout, gl_state* state) {
+	if (layout->vao == 0) {
+		point_layout(layout, state);
+	} else if (state == NULL) {
+		bind_vertex_array(layout->vao);
+	} else if (gl_state_changed(state, state->vertex_array != layout->vao)) {
+		bind_vertex_array(layout->vao);
+		state->vertex_array = layout->vao;
+		gl_state_invalidate_attribs(state);
+	}
+}
+
+/* Restore the default: no vertex array object, or no attribute
+ * arrays enabled on the fallback path */
+void unbind_vertex_layout(const vertex_layout* layout, gl_state* state) {
+	if (layout->vao != 0) {
+		if (state == NULL) {
+			bind_vertex_array(0);
+		} else if (gl_state_changed(state, state->vertex_array != 0)) {
+			bind_vertex_array(0);
+			state->vertex_array = 0;
+			gl_state_invalidate_attribs(state);
+		}
+		return;
+	}
+	for (size_t i = 0; i < layout->attribs.size(); i++) {
+		const vertex_attrib &a = layout->attribs[i];
+		if (state != NULL)
+			gl_enable_vertex_attrib_array(state, a.index, false);
+		else
+			glDisableVertexAttribArray(a.index);
+		// Divisors outlive the draw on vertex array 0
+		if (a.divisor != 0)
+			vertex_attrib_divisor(a.index, 0);
+	}
+}
+
+void free_vertex_layout(vertex_layout* layout) {
+	if (layout->vao != 0)
+		delete_vertex_array(&layout->vao);
+	layout->vao = 0;
+	layout->attribs.clear();
+}
@@ -0,0 +1,41 @@
+#ifndef _VERTEX_LAYOUT_H
+#define _VERTEX_LAYOUT_H
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+
+#include "gl_state.h"
+
+/* One glVertexAttribPointer, sourced from 'buffer' */
+struct vertex_attrib {
+	GLuint index;
+	GLuint buffer;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
+	size_t offset;
+	GLuint divisor;  // 0 per vertex, n to advance every n instances
+};
+
+/* Vertex attributes and index buffer of a draw. Recorded once into a
+ * vertex array object when the context has them (OpenGL 3.0,
+ * ARB_vertex_array_object or OES_vertex_array_object); otherwise
+ * every bind sets the attributes up again, as GL 2.1 requires. */
+struct vertex_layout {
+	std::vector<vertex_attrib> attribs;
+	GLuint element_buffer;
+	GLuint vao;  // 0 on the fallback path
+};
+
+extern bool vertex_arrays_available();
+extern bool instancing_available();
+extern void add_vertex_attrib(vertex_layout* layout, GLuint index, GLuint buffer, GLint size, GLenum type,
+			      GLboolean normalized, GLsizei stride, size_t offset, GLuint divisor = 0);
+extern void build_vertex_layout(vertex_layout* layout, bool use_vao = true);
+extern void bind_vertex_layout(const vertex_layout* layout, gl_state* state = NULL);
+extern void unbind_vertex_layout(const vertex_layout* layout, gl_state* state = NULL);
+extern void draw_elements_instanced(GLenum mode, GLsizei count, GLenum type, size_t offset, GLsizei instances);
+extern void free_vertex_layout(vertex_layout* layout);
+
+#endif